@@ -3,26 +3,19 @@ core.async_jobs = {}
 
 local function handle_job(jobid, serialized_retval)
 	local retval = core.deserialize(serialized_retval)
-	assert(type(core.async_jobs[jobid]) == "function")
-	core.async_jobs[jobid](retval)
+	local job = core.async_jobs[jobid]
+	assert(job and type(job.callback) == "function")
 	core.async_jobs[jobid] = nil
+	if job.mod_origin then
+		core.set_last_run_mod(job.mod_origin)
+	end
+	job.callback(retval)
 end
 
-if core.register_globalstep then
-	core.register_globalstep(function(dtime)
-		for i, job in ipairs(core.get_finished_jobs()) do
-			handle_job(job.jobid, job.retval)
-		end
-	end)
-else
-	core.async_event_handler = handle_job
-end
+core.async_event_handler = handle_job
 
 function core.handle_async(func, parameter, callback)
-	-- Serialize function
-	local serialized_func = string.dump(func)
-
-	assert(serialized_func ~= nil)
+	assert(type(func) == "function")
 
 	-- Serialize parameters
 	local serialized_param = core.serialize(parameter)
@@ -31,9 +24,14 @@ function core.handle_async(func, parameter, callback)
 		return false
 	end
 
-	local jobid = core.do_async_callback(serialized_func, serialized_param)
+	-- The function is serialized by the engine
+	local jobid = core.do_async_callback(func, serialized_param)
 
-	core.async_jobs[jobid] = callback
+	core.async_jobs[jobid] = {
+		callback = callback,
+		-- The main menu has no mods
+		mod_origin = core.get_last_run_mod and core.get_last_run_mod(),
+	}
 
 	return true
 end
@@ -17,7 +17,7 @@
 --   2. Recursively dump the value into a string.
 -- @param x Value to serialize (nil is allowed).
 -- @return load()able string containing the value.
-function core.serialize(x)
+local function lua_serialize(x)
 	local local_index  = 1  -- Top index of the "_" local table in the dump
 	-- table->nil/1/2 set of tables seen.
 	-- nil = not seen, 1 = seen once, 2 = seen multiple times.
@@ -185,7 +185,7 @@ local safe_env = {
 	loadstring = function() end,
 }
 
-function core.deserialize(str, safe)
+local function lua_deserialize(str, safe)
 	if str:byte(1) == 0x1B then
 		return nil, "Bytecode prohibited"
 	end
@@ -202,6 +202,34 @@ function core.deserialize(str, safe)
 end
 
 
+-- Plain values and tables are handled by the engine, which is a lot faster.
+-- Everything else falls back to the Lua implementation above.
+local native_serialize = core.native_serialize
+local native_deserialize = core.native_deserialize
+
+function core.serialize(x, format)
+	if not native_serialize then
+		return lua_serialize(x)
+	end
+	if format == "binary" then
+		return native_serialize(x, true)
+	end
+	return native_serialize(x) or lua_serialize(x)
+end
+
+function core.deserialize(str, safe)
+	if native_deserialize then
+		local handled, data = native_deserialize(str)
+		if handled then
+			return data
+		elseif data then
+			return nil, data
+		end
+	end
+	return lua_deserialize(str, safe)
+end
+
+
 -- Unit tests
 local test_in = {cat={sound="nyan", speed=400}, dog={sound="woof"}}
 local test_out = core.deserialize(core.serialize(test_in))
@@ -215,3 +243,11 @@ test_out = core.deserialize(core.serialize(test_in))
 assert(test_in.escape_chars == test_out.escape_chars)
 assert(test_in.non_european == test_out.non_european)
 
+if native_serialize then
+	test_in = {1, 2.5, "three", {four = true}, [-1] = false, [0.5] = "\0\n"}
+	test_in[5] = test_in[4]
+	test_out = core.deserialize(core.serialize(test_in, "binary"))
+	assert(test_out[2] == 2.5 and test_out[3] == "three")
+	assert(test_out[4].four == true and test_out[5] == test_out[4])
+	assert(test_out[-1] == false and test_out[0.5] == "\0\n")
+end
@@ -19,6 +19,8 @@ if not time_to_live then
 	time_to_live = 900
 end
 
+local settled_step_interval = 0.5
+
 core.register_entity(":__builtin:item", {
 	initial_properties = {
 		hp_max = 1,
@@ -190,6 +192,8 @@ core.register_entity(":__builtin:item", {
 				self.object:setacceleration({x = 0, y = 0, z = 0})
 				self.physical_state = false
 				self.object:set_properties({physical = false})
+				-- Resting items only need to notice the ground disappearing
+				self.object:set_step_interval(settled_step_interval)
 			end
 		else
 			if not self.physical_state then
@@ -197,6 +201,7 @@ core.register_entity(":__builtin:item", {
 				self.object:setacceleration({x = 0, y = -10, z = 0})
 				self.physical_state = true
 				self.object:set_properties({physical = true})
+				self.object:set_step_interval(0)
 			end
 		end
 	end,
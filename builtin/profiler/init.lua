@@ -22,6 +22,36 @@ local instrumentation  = assert(loadfile(profiler_path .. "instrumentation.lua")
 local reporter = dofile(profiler_path .. "reporter.lua")
 profiler.instrument = instrumentation.instrument
 
+local sampling_interval = tonumber(core.setting_get("profiler.sampling_interval")) or 0
+
+---
+-- Handles `/profiler sampling <command>`, which controls the engine's
+-- sampling profiler.
+--
+local function sampling_command(command, arg)
+	if command == "start" then
+		local interval = tonumber(arg) or sampling_interval
+		if interval <= 0 then
+			interval = 10
+		end
+		core.sampling_profiler_start(interval)
+		return true, string.format("Sampling started, every %d ms", interval)
+	elseif command == "stop" then
+		core.sampling_profiler_stop()
+		return true, "Sampling stopped"
+	elseif command == "save" then
+		local samples, count = core.sampling_profiler_get()
+		if count == 0 then
+			return false, "No samples were taken"
+		end
+		return reporter.save_folded(samples)
+	elseif command == "reset" then
+		core.sampling_profiler_get(true)
+		return true, "Samples were reset"
+	end
+	return false, "Usage: sampling start [interval_ms] | stop | save | reset"
+end
+
 ---
 -- Delayed registration of the /profiler chat command
 -- Is called later, after `core.register_chatcommand` was set up.
@@ -33,6 +63,7 @@ function profiler.init_chatcommand()
 	end
 
 	local param_usage = "print [filter] | dump [filter] | save [format [filter]] | reset"
+		.. " | sampling start [interval_ms]|stop|save|reset | callbacks [filter|reset]"
 	core.register_chatcommand("profiler", {
 		description = "handle the profiler and profiling data",
 		params = param_usage,
@@ -51,6 +82,12 @@ function profiler.init_chatcommand()
 			elseif command == "reset" then
 				sampler.reset()
 				return true, "Statistics were reset"
+			elseif command == "sampling" then
+				return sampling_command(args[1], args[2])
+			elseif command == "callbacks" then
+				local reset = args[1] == "reset"
+				return true, reporter.print_callback_times(
+					core.get_callback_times(reset), not reset and args[1] or nil)
 			end
 
 			return false, string.format(
@@ -69,4 +106,14 @@ end
 sampler.init()
 instrumentation.init()
 
+if sampling_interval > 0 then
+	core.sampling_profiler_start(sampling_interval)
+	core.register_on_shutdown(function()
+		local samples, count = core.sampling_profiler_get()
+		if count > 0 then
+			reporter.save_folded(samples)
+		end
+	end)
+end
+
 return profiler
@@ -274,4 +274,55 @@ function reporter.save(profile, format, filter)
 	return true, logmessage
 end
 
+---
+-- Save samples of the sampling profiler to the world path, as folded stacks
+-- which can be turned into flame graphs by flamegraph.pl.
+-- @return success, log message
+--
+function reporter.save_folded(samples)
+	local path = get_save_path("folded")
+
+	local output, io_err = io.open(path, "w")
+	if not output then
+		return false, "Saving of samples failed with: " .. io_err
+	end
+	output:write(samples)
+	output:close()
+
+	local logmessage = "Samples saved to " .. path
+	core.log("action", logmessage)
+	return true, logmessage
+end
+
+---
+-- Format the time the engine spent in the callbacks of each mod, as returned
+-- by `core.get_callback_times()`, longest first.
+-- @return string to be printed to the console
+--
+function reporter.print_callback_times(times, filter)
+	if filter == "" then filter = nil end
+	local rows = {}
+	for _, time in pairs(times) do
+		if filter_matches(filter, time.mod) then
+			rows[#rows + 1] = time
+		end
+	end
+	table.sort(rows, function(a, b) return a.time_us > b.time_us end)
+
+	local row_format = " %-24s | %-20s | %10s | %8s | %8s | %8s"
+	local lines = {
+		sprintf(row_format, "mod", "callback", "total ms", "calls", "avg us", "max us"),
+	}
+	for _, time in ipairs(rows) do
+		lines[#lines + 1] = sprintf(row_format,
+			shorten(time.mod, 24),
+			shorten(time.entry, 20),
+			format_number(time.time_us / 1000, "%.1f"),
+			format_number(time.calls),
+			format_number(time.time_us / time.calls),
+			format_number(time.max_us))
+	end
+	return table.concat(lines, LINE_DELIM)
+end
+
 return reporter
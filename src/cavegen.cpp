@@ -65,13 +65,13 @@ CavesNoiseIntersection::~CavesNoiseIntersection()
 
 
 void CavesNoiseIntersection::generateCaves(MMVManip *vm,
-	v3s16 nmin, v3s16 nmax, u8 *biomemap)
+	v3s16 nmin, v3s16 nmax, u8 *biomemap, MapgenSlabWorkers *workers)
 {
 	assert(vm);
 	assert(biomemap);
 
-	noise_cave1->perlinMap3D(nmin.X, nmin.Y - 1, nmin.Z);
-	noise_cave2->perlinMap3D(nmin.X, nmin.Y - 1, nmin.Z);
+	calc_noise_3d(workers, noise_cave1, nmin.X, nmin.Y - 1, nmin.Z);
+	calc_noise_3d(workers, noise_cave2, nmin.X, nmin.Y - 1, nmin.Z);
 
 	v3s16 em = vm->m_area.getExtent();
 	u32 index2d = 0;
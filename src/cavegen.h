@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define DEFAULT_LAVA_DEPTH (-256)
 
 class GenerateNotifier;
+class MapgenSlabWorkers;
 
 /*
 	CavesNoiseIntersection is a cave digging algorithm that carves smooth,
@@ -44,7 +45,9 @@ class CavesNoiseIntersection {
 		s32 seed, float cave_width);
 	~CavesNoiseIntersection();
 
-	void generateCaves(MMVManip *vm, v3s16 nmin, v3s16 nmax, u8 *biomemap);
+	// If workers is not NULL, the cave noises are computed with its help
+	void generateCaves(MMVManip *vm, v3s16 nmin, v3s16 nmax, u8 *biomemap,
+		MapgenSlabWorkers *workers=NULL);
 
 private:
 	INodeDefManager *m_ndef;
@@ -37,10 +37,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 struct NearbyCollisionInfo {
 	NearbyCollisionInfo(bool is_ul, bool is_obj, int bouncy,
-			const v3s16 &pos, const aabb3f &box) :
+			const v3s16 &pos, const aabb3f &box,
+			ActiveObject *object = NULL) :
 		is_unloaded(is_ul),
 		is_step_up(false),
 		is_object(is_obj),
+		object(object),
 		bouncy(bouncy),
 		position(pos),
 		box(box)
@@ -49,6 +51,7 @@ struct NearbyCollisionInfo {
 	bool is_unloaded;
 	bool is_step_up;
 	bool is_object;
+	ActiveObject *object;
 	int bouncy;
 	v3s16 position;
 	aabb3f box;
@@ -388,7 +391,8 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 				aabb3f object_collisionbox;
 				if (object->getCollisionBox(&object_collisionbox) &&
 						object->collideWithObjects()) {
-					cinfo.push_back(NearbyCollisionInfo(false, true, 0, v3s16(), object_collisionbox));
+					cinfo.push_back(NearbyCollisionInfo(false, true, 0,
+						v3s16(), object_collisionbox, object));
 				}
 			}
 		}
@@ -499,6 +503,7 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 				info.type = COLLISION_NODE;
 
 			info.node_p = nearest_info.position;
+			info.object = nearest_info.object;
 			info.bouncy = bouncy;
 			info.old_speed = *speed_f;
 
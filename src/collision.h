@@ -38,6 +38,7 @@ struct CollisionInfo
 {
 	enum CollisionType type;
 	v3s16 node_p; // COLLISION_NODE
+	ActiveObject *object; // COLLISION_OBJECT
 	bool bouncy;
 	v3f old_speed;
 	v3f new_speed;
@@ -45,6 +46,7 @@ struct CollisionInfo
 	CollisionInfo():
 		type(COLLISION_NODE),
 		node_p(-32768,-32768,-32768),
+		object(NULL),
 		bouncy(false),
 		old_speed(0,0,0),
 		new_speed(0,0,0)
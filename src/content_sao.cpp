@@ -241,6 +241,11 @@ LuaEntitySAO::LuaEntitySAO(ServerEnvironment *env, v3f pos,
 	m_init_name(name),
 	m_init_state(state),
 	m_registered(false),
+	m_step_interval(0),
+	m_step_dtime(0),
+	m_sleeping(false),
+	m_sleep_timer(0),
+	m_wake_distance(0),
 	m_velocity(0,0,0),
 	m_acceleration(0,0,0),
 	m_last_sent_yaw(0),
@@ -378,6 +383,17 @@ void LuaEntitySAO::step(float dtime, bool send_recommended)
 			m_base_position = p_pos;
 			m_velocity = p_velocity;
 			m_acceleration = p_acceleration;
+
+			// Bumping into other entities wakes both of them
+			for (size_t i = 0; i < moveresult.collisions.size(); i++) {
+				const CollisionInfo &info = moveresult.collisions[i];
+				if (info.type != COLLISION_OBJECT || info.object == NULL)
+					continue;
+				wake();
+				ServerActiveObject *obj = (ServerActiveObject *)info.object;
+				if (obj->getType() == ACTIVEOBJECT_TYPE_LUAENTITY)
+					((LuaEntitySAO *)obj)->wake();
+			}
 		} else {
 			m_base_position += dtime * m_velocity + 0.5 * dtime
 					* dtime * m_acceleration;
@@ -402,8 +418,19 @@ void LuaEntitySAO::step(float dtime, bool send_recommended)
 		}
 	}
 
-	if(m_registered){
-		m_env->getScriptIface()->luaentity_Step(m_id, dtime);
+	if (m_registered) {
+		m_step_dtime += dtime;
+		if (m_sleeping && m_sleep_timer >= 0) {
+			m_sleep_timer -= dtime;
+			if (m_sleep_timer <= 0)
+				m_sleeping = false;
+		}
+
+		if (!m_sleeping && m_step_dtime >= m_step_interval) {
+			float step_dtime = m_step_dtime;
+			m_step_dtime = 0;
+			m_env->getScriptIface()->luaentity_Step(m_id, step_dtime);
+		}
 	}
 
 	if(send_recommended == false)
@@ -578,6 +605,8 @@ int LuaEntitySAO::punch(v3f dir,
 			punchitem,
 			time_from_last_punch);
 
+	wake();
+
 	bool damage_handled = m_env->getScriptIface()->luaentity_Punch(m_id, puncher,
 			time_from_last_punch, toolcap, dir, result.did_punch ? result.damage : 0);
 
@@ -615,9 +644,17 @@ void LuaEntitySAO::rightClick(ServerActiveObject *clicker)
 	// It's best that attachments cannot be clicked
 	if (isAttached())
 		return;
+	wake();
 	m_env->getScriptIface()->luaentity_Rightclick(m_id, clicker);
 }
 
+void LuaEntitySAO::sleep(float time, float wake_distance)
+{
+	m_sleeping = true;
+	m_sleep_timer = time;
+	m_wake_distance = MYMAX(wake_distance, 0);
+}
+
 void LuaEntitySAO::setPos(const v3f &pos)
 {
 	if(isAttached())
@@ -127,6 +127,25 @@ class LuaEntitySAO : public UnitSAO
 	std::string getName();
 	bool getCollisionBox(aabb3f *toset) const;
 	bool collideWithObjects() const;
+
+	/*
+		Step scheduling. on_step is called at most every step interval
+		seconds, and not at all while sleeping. It always gets the time
+		since it was last called.
+	*/
+	void setStepInterval(float interval)
+	{ m_step_interval = MYMAX(interval, 0); }
+	float getStepInterval() const
+	{ return m_step_interval; }
+	// time < 0 sleeps until woken, players closer than wake_distance
+	// wake the entity if it is > 0
+	void sleep(float time, float wake_distance);
+	void wake()
+	{ m_sleeping = false; }
+	bool isSleeping() const
+	{ return m_sleeping; }
+	float getWakeDistance() const
+	{ return m_wake_distance; }
 private:
 	std::string getPropertyPacket();
 	void sendPosition(bool do_interpolate, bool is_movement_end);
@@ -135,6 +154,13 @@ class LuaEntitySAO : public UnitSAO
 	std::string m_init_state;
 	bool m_registered;
 
+	float m_step_interval;
+	// Time since on_step was last called
+	float m_step_dtime;
+	bool m_sleeping;
+	float m_sleep_timer;
+	float m_wake_distance;
+
 	v3f m_velocity;
 	v3f m_acceleration;
 
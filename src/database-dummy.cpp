@@ -57,3 +57,31 @@ void Database_Dummy::listAllLoadableBlocks(std::vector<v3s16> &dst)
 	}
 }
 
+void Database_Dummy::getModEntries(const std::string &modname, StringMap *storage)
+{
+	std::map<std::string, StringMap>::const_iterator mod_pair =
+		m_mod_storage_database.find(modname);
+	if (mod_pair == m_mod_storage_database.end())
+		return;
+
+	for (StringMap::const_iterator it = mod_pair->second.begin();
+			it != mod_pair->second.end(); ++it)
+		(*storage)[it->first] = it->second;
+}
+
+bool Database_Dummy::setModEntry(const std::string &modname,
+	const std::string &key, const std::string &value)
+{
+	m_mod_storage_database[modname][key] = value;
+	return true;
+}
+
+bool Database_Dummy::removeModEntry(const std::string &modname,
+	const std::string &key)
+{
+	std::map<std::string, StringMap>::iterator mod_pair =
+		m_mod_storage_database.find(modname);
+	if (mod_pair != m_mod_storage_database.end())
+		mod_pair->second.erase(key);
+	return true;
+}
@@ -25,7 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "database.h"
 #include "irrlichttypes.h"
 
-class Database_Dummy : public Database
+class Database_Dummy : public Database, public ModStorageDatabase
 {
 public:
 	bool saveBlock(const v3s16 &pos, const std::string &data);
@@ -33,8 +33,14 @@ class Database_Dummy : public Database
 	bool deleteBlock(const v3s16 &pos);
 	void listAllLoadableBlocks(std::vector<v3s16> &dst);
 
+	void getModEntries(const std::string &modname, StringMap *storage);
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	bool removeModEntry(const std::string &modname, const std::string &key);
+
 private:
 	std::map<s64, std::string> m_database;
+	std::map<std::string, StringMap> m_mod_storage_database;
 };
 
 #endif
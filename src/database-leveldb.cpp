@@ -29,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/string.h"
 
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 
 
 #define ENSURE_STATUS_OK(s) \
@@ -97,5 +98,105 @@ void Database_LevelDB::listAllLoadableBlocks(std::vector<v3s16> &dst)
 	delete it;
 }
 
+
+static inline std::string mod_entry_key(const std::string &modname,
+	const std::string &key)
+{
+	std::string db_key = modname;
+	db_key.push_back('\0');
+	return db_key + key;
+}
+
+ModStorageDatabase_LevelDB::ModStorageDatabase_LevelDB(const std::string &savedir) :
+	m_in_batch(false)
+{
+	leveldb::Options options;
+	options.create_if_missing = true;
+	leveldb::Status status = leveldb::DB::Open(options,
+		savedir + DIR_DELIM + "mod_storage.db", &m_database);
+	ENSURE_STATUS_OK(status);
+}
+
+ModStorageDatabase_LevelDB::~ModStorageDatabase_LevelDB()
+{
+	delete m_database;
+}
+
+void ModStorageDatabase_LevelDB::beginSave()
+{
+	m_batch.Clear();
+	m_in_batch = true;
+}
+
+void ModStorageDatabase_LevelDB::endSave()
+{
+	m_in_batch = false;
+	leveldb::Status status = m_database->Write(leveldb::WriteOptions(), &m_batch);
+	m_batch.Clear();
+	ENSURE_STATUS_OK(status);
+}
+
+void ModStorageDatabase_LevelDB::rollbackSave()
+{
+	m_in_batch = false;
+	m_batch.Clear();
+}
+
+void ModStorageDatabase_LevelDB::getModEntries(const std::string &modname,
+	StringMap *storage)
+{
+	std::string prefix = mod_entry_key(modname, "");
+
+	leveldb::Iterator* it = m_database->NewIterator(leveldb::ReadOptions());
+	for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix);
+			it->Next()) {
+		leveldb::Slice key = it->key();
+		key.remove_prefix(prefix.size());
+		(*storage)[key.ToString()] = it->value().ToString();
+	}
+	ENSURE_STATUS_OK(it->status());
+	delete it;
+}
+
+bool ModStorageDatabase_LevelDB::setModEntry(const std::string &modname,
+	const std::string &key, const std::string &value)
+{
+	if (m_in_batch) {
+		m_batch.Put(mod_entry_key(modname, key), value);
+		return true;
+	}
+
+	leveldb::Status status = m_database->Put(leveldb::WriteOptions(),
+			mod_entry_key(modname, key), value);
+	if (!status.ok()) {
+		warningstream << "setModEntry: LevelDB error saving \"" << key
+			<< "\" of mod \"" << modname << "\": " << status.ToString()
+			<< std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool ModStorageDatabase_LevelDB::removeModEntry(const std::string &modname,
+	const std::string &key)
+{
+	if (m_in_batch) {
+		m_batch.Delete(mod_entry_key(modname, key));
+		return true;
+	}
+
+	leveldb::Status status = m_database->Delete(leveldb::WriteOptions(),
+			mod_entry_key(modname, key));
+	if (!status.ok()) {
+		warningstream << "removeModEntry: LevelDB error removing \"" << key
+			<< "\" of mod \"" << modname << "\": " << status.ToString()
+			<< std::endl;
+		return false;
+	}
+
+	return true;
+}
+
 #endif // USE_LEVELDB
 
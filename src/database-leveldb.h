@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "database.h"
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 #include <string>
 
 class Database_LevelDB : public Database
@@ -43,6 +44,32 @@ class Database_LevelDB : public Database
 	leveldb::DB *m_database;
 };
 
+/*
+	Mod storage in its own database (mod_storage.db), the key of an entry
+	is the name of the mod and the entry key separated by a NUL byte.
+	Changes between beginSave() and endSave() are written as one batch.
+*/
+class ModStorageDatabase_LevelDB : public ModStorageDatabase
+{
+public:
+	ModStorageDatabase_LevelDB(const std::string &savedir);
+	~ModStorageDatabase_LevelDB();
+
+	void beginSave();
+	void endSave();
+	void rollbackSave();
+
+	void getModEntries(const std::string &modname, StringMap *storage);
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	bool removeModEntry(const std::string &modname, const std::string &key);
+
+private:
+	leveldb::DB *m_database;
+	leveldb::WriteBatch m_batch;
+	bool m_in_batch;
+};
+
 #endif // USE_LEVELDB
 
 #endif
@@ -150,6 +150,30 @@ void Database_PostgreSQL::initStatements()
 
 	prepareStatement("list_all_loadable_blocks",
 			"SELECT posX, posY, posZ FROM blocks");
+
+	prepareStatement("get_mod_entries",
+			"SELECT key, value FROM mod_storage WHERE modname = $1");
+
+	if (m_pgversion < 90500) {
+		prepareStatement("set_mod_entry_insert",
+			"INSERT INTO mod_storage (modname, key, value) SELECT "
+			"$1, $2::bytea, $3::bytea "
+			"WHERE NOT EXISTS (SELECT true FROM mod_storage "
+			"WHERE modname = $1 AND key = $2::bytea)");
+
+		prepareStatement("set_mod_entry_update",
+			"UPDATE mod_storage SET value = $3::bytea "
+			"WHERE modname = $1 AND key = $2::bytea");
+	} else {
+		prepareStatement("set_mod_entry",
+			"INSERT INTO mod_storage (modname, key, value) VALUES "
+			"($1, $2::bytea, $3::bytea) "
+			"ON CONFLICT ON CONSTRAINT mod_storage_pkey DO "
+			"UPDATE SET value = $3::bytea");
+	}
+
+	prepareStatement("remove_mod_entry",
+			"DELETE FROM mod_storage WHERE modname = $1 AND key = $2::bytea");
 }
 
 PGresult *Database_PostgreSQL::checkResults(PGresult *result, bool clear)
@@ -193,6 +217,22 @@ void Database_PostgreSQL::createDatabase()
 
 	PQclear(result);
 
+	result = checkResults(PQexec(m_conn,
+		"SELECT relname FROM pg_class WHERE relname='mod_storage';"),
+		false);
+
+	if (!PQntuples(result)) {
+		static const char* dbcreate_sql = "CREATE TABLE mod_storage ("
+			"modname TEXT NOT NULL,"
+			"key BYTEA NOT NULL,"
+			"value BYTEA NOT NULL,"
+			"PRIMARY KEY (modname, key)"
+		");";
+		checkResults(PQexec(m_conn, dbcreate_sql));
+	}
+
+	PQclear(result);
+
 	infostream << "PostgreSQL: Game Database was inited." << std::endl;
 }
 
@@ -208,6 +248,11 @@ void Database_PostgreSQL::endSave()
 	checkResults(PQexec(m_conn, "COMMIT;"));
 }
 
+void Database_PostgreSQL::rollbackSave()
+{
+	checkResults(PQexec(m_conn, "ROLLBACK;"));
+}
+
 bool Database_PostgreSQL::saveBlock(const v3s16 &pos,
 		const std::string &data)
 {
@@ -302,4 +347,62 @@ void Database_PostgreSQL::listAllLoadableBlocks(std::vector<v3s16> &dst)
 	PQclear(results);
 }
 
+void Database_PostgreSQL::getModEntries(const std::string &modname,
+		StringMap *storage)
+{
+	verifyDatabase();
+
+	const void *args[] = { modname.c_str() };
+	const int argLen[] = { (int)modname.size() };
+	const int argFmt[] = { 0 };
+
+	PGresult *results = execPrepared("get_mod_entries", ARRLEN(args), args,
+			argLen, argFmt, false);
+
+	int numrows = PQntuples(results);
+
+	for (int row = 0; row < numrows; ++row) {
+		(*storage)[std::string(PQgetvalue(results, row, 0),
+				PQgetlength(results, row, 0))] =
+			std::string(PQgetvalue(results, row, 1),
+				PQgetlength(results, row, 1));
+	}
+
+	PQclear(results);
+}
+
+bool Database_PostgreSQL::setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value)
+{
+	verifyDatabase();
+
+	const void *args[] = { modname.c_str(), key.c_str(), value.c_str() };
+	const int argLen[] = {
+		(int)modname.size(), (int)key.size(), (int)value.size()
+	};
+	const int argFmt[] = { 0, 1, 1 };
+
+	if (m_pgversion < 90500) {
+		execPrepared("set_mod_entry_update", ARRLEN(args), args, argLen, argFmt);
+		execPrepared("set_mod_entry_insert", ARRLEN(args), args, argLen, argFmt);
+	} else {
+		execPrepared("set_mod_entry", ARRLEN(args), args, argLen, argFmt);
+	}
+	return true;
+}
+
+bool Database_PostgreSQL::removeModEntry(const std::string &modname,
+		const std::string &key)
+{
+	verifyDatabase();
+
+	const void *args[] = { modname.c_str(), key.c_str() };
+	const int argLen[] = { (int)modname.size(), (int)key.size() };
+	const int argFmt[] = { 0, 1 };
+
+	execPrepared("remove_mod_entry", ARRLEN(args), args, argLen, argFmt);
+
+	return true;
+}
+
 #endif // USE_POSTGRESQL
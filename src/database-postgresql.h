@@ -27,7 +27,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 class Settings;
 
-class Database_PostgreSQL : public Database
+/*
+	Also stores the mod storage, in the table mod_storage. The server uses
+	a separate instance for it, so that it has a connection of its own.
+*/
+class Database_PostgreSQL : public Database, public ModStorageDatabase
 {
 public:
 	Database_PostgreSQL(const Settings &conf);
@@ -35,6 +39,7 @@ class Database_PostgreSQL : public Database
 
 	void beginSave();
 	void endSave();
+	void rollbackSave();
 
 	bool saveBlock(const v3s16 &pos, const std::string &data);
 	void loadBlock(const v3s16 &pos, std::string *block);
@@ -42,6 +47,11 @@ class Database_PostgreSQL : public Database
 	void listAllLoadableBlocks(std::vector<v3s16> &dst);
 	bool initialized() const;
 
+	void getModEntries(const std::string &modname, StringMap *storage);
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	bool removeModEntry(const std::string &modname, const std::string &key);
+
 private:
 	// Database initialization
 	void connectToDatabase();
@@ -32,19 +32,19 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <cassert>
 
 
-Database_Redis::Database_Redis(Settings &conf)
+static redisContext *connect_redis(Settings &conf, std::string *hash)
 {
 	std::string tmp;
 	try {
 		tmp = conf.get("redis_address");
-		hash = conf.get("redis_hash");
+		*hash = conf.get("redis_hash");
 	} catch (SettingNotFoundException) {
 		throw SettingNotFoundException("Set redis_address and "
 			"redis_hash in world.mt to use the redis backend");
 	}
 	const char *addr = tmp.c_str();
 	int port = conf.exists("redis_port") ? conf.getU16("redis_port") : 6379;
-	ctx = redisConnect(addr, port);
+	redisContext *ctx = redisConnect(addr, port);
 	if (!ctx) {
 		throw DatabaseException("Cannot allocate redis context");
 	} else if (ctx->err) {
@@ -52,6 +52,23 @@ Database_Redis::Database_Redis(Settings &conf)
 		redisFree(ctx);
 		throw DatabaseException(err);
 	}
+	return ctx;
+}
+
+static void run_redis_command(redisContext *ctx, const char *command)
+{
+	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx, command));
+	if (!reply) {
+		throw DatabaseException(std::string("Redis command '") + command +
+			"' failed: " + ctx->errstr);
+	}
+	freeReplyObject(reply);
+}
+
+
+Database_Redis::Database_Redis(Settings &conf)
+{
+	ctx = connect_redis(conf, &hash);
 }
 
 Database_Redis::~Database_Redis()
@@ -60,21 +77,11 @@ Database_Redis::~Database_Redis()
 }
 
 void Database_Redis::beginSave() {
-	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx, "MULTI"));
-	if (!reply) {
-		throw DatabaseException(std::string(
-			"Redis command 'MULTI' failed: ") + ctx->errstr);
-	}
-	freeReplyObject(reply);
+	run_redis_command(ctx, "MULTI");
 }
 
 void Database_Redis::endSave() {
-	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx, "EXEC"));
-	if (!reply) {
-		throw DatabaseException(std::string(
-			"Redis command 'EXEC' failed: ") + ctx->errstr);
-	}
-	freeReplyObject(reply);
+	run_redis_command(ctx, "EXEC");
 }
 
 bool Database_Redis::saveBlock(const v3s16 &pos, const std::string &data)
@@ -186,5 +193,136 @@ void Database_Redis::listAllLoadableBlocks(std::vector<v3s16> &dst)
 	freeReplyObject(reply);
 }
 
+
+
+ModStorageDatabase_Redis::ModStorageDatabase_Redis(Settings &conf)
+{
+	ctx = connect_redis(conf, &hash);
+}
+
+ModStorageDatabase_Redis::~ModStorageDatabase_Redis()
+{
+	redisFree(ctx);
+}
+
+void ModStorageDatabase_Redis::beginSave()
+{
+	run_redis_command(ctx, "MULTI");
+}
+
+void ModStorageDatabase_Redis::endSave()
+{
+	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx, "EXEC"));
+	if (!reply) {
+		throw DatabaseException(std::string(
+			"Redis command 'EXEC' failed: ") + ctx->errstr);
+	}
+
+	// The commands of the transaction fail only now, each with its reply
+	std::string errstr;
+	if (reply->type == REDIS_REPLY_ERROR) {
+		errstr.assign(reply->str, reply->len);
+	} else if (reply->type != REDIS_REPLY_ARRAY) {
+		errstr = "transaction aborted";
+	} else {
+		for (size_t i = 0; i < reply->elements; i++) {
+			redisReply *result = reply->element[i];
+			if (result->type == REDIS_REPLY_ERROR) {
+				errstr.assign(result->str, result->len);
+				break;
+			}
+		}
+	}
+	freeReplyObject(reply);
+
+	if (!errstr.empty()) {
+		throw DatabaseException(std::string(
+			"Failed to save mod storage to database: ") + errstr);
+	}
+}
+
+void ModStorageDatabase_Redis::rollbackSave()
+{
+	run_redis_command(ctx, "DISCARD");
+}
+
+void ModStorageDatabase_Redis::getModEntries(const std::string &modname,
+	StringMap *storage)
+{
+	std::string mod_hash = getModHash(modname);
+	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx,
+			"HGETALL %b", mod_hash.c_str(), mod_hash.size()));
+	if (!reply) {
+		throw DatabaseException(std::string(
+			"Redis command 'HGETALL %s' failed: ") + ctx->errstr);
+	}
+	switch (reply->type) {
+	case REDIS_REPLY_ARRAY:
+		// Field names and values alternate
+		for (size_t i = 0; i + 1 < reply->elements; i += 2) {
+			redisReply *key = reply->element[i];
+			redisReply *value = reply->element[i + 1];
+			assert(key->type == REDIS_REPLY_STRING &&
+				value->type == REDIS_REPLY_STRING);
+			(*storage)[std::string(key->str, key->len)] =
+				std::string(value->str, value->len);
+		}
+		break;
+	case REDIS_REPLY_ERROR: {
+		std::string errstr(reply->str, reply->len);
+		freeReplyObject(reply);
+		throw DatabaseException(std::string(
+			"Failed to get mod storage from database: ") + errstr);
+	}
+	}
+	freeReplyObject(reply);
+}
+
+bool ModStorageDatabase_Redis::setModEntry(const std::string &modname,
+	const std::string &key, const std::string &value)
+{
+	std::string mod_hash = getModHash(modname);
+	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx,
+			"HSET %b %b %b", mod_hash.c_str(), mod_hash.size(),
+			key.c_str(), key.size(), value.c_str(), value.size()));
+	if (!reply) {
+		warningstream << "setModEntry: redis command 'HSET' failed on \""
+			<< key << "\" of mod \"" << modname << "\": " << ctx->errstr
+			<< std::endl;
+		return false;
+	}
+
+	bool good = reply->type != REDIS_REPLY_ERROR;
+	if (!good) {
+		warningstream << "setModEntry: saving \"" << key << "\" of mod \""
+			<< modname << "\" failed: " << std::string(reply->str, reply->len)
+			<< std::endl;
+	}
+	freeReplyObject(reply);
+	return good;
+}
+
+bool ModStorageDatabase_Redis::removeModEntry(const std::string &modname,
+	const std::string &key)
+{
+	std::string mod_hash = getModHash(modname);
+	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx,
+			"HDEL %b %b", mod_hash.c_str(), mod_hash.size(),
+			key.c_str(), key.size()));
+	if (!reply) {
+		throw DatabaseException(std::string(
+			"Redis command 'HDEL %s %s' failed: ") + ctx->errstr);
+	}
+
+	bool good = reply->type != REDIS_REPLY_ERROR;
+	if (!good) {
+		warningstream << "removeModEntry: removing \"" << key << "\" of mod \""
+			<< modname << "\" failed: " << std::string(reply->str, reply->len)
+			<< std::endl;
+	}
+	freeReplyObject(reply);
+	return good;
+}
+
 #endif // USE_REDIS
 
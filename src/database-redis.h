@@ -49,6 +49,35 @@ class Database_Redis : public Database
 	std::string hash;
 };
 
+/*
+	Mod storage in the hashes "<redis_hash>:mod_storage:<modname>",
+	using a connection of its own.
+*/
+class ModStorageDatabase_Redis : public ModStorageDatabase
+{
+public:
+	ModStorageDatabase_Redis(Settings &conf);
+	~ModStorageDatabase_Redis();
+
+	void beginSave();
+	void endSave();
+	void rollbackSave();
+
+	void getModEntries(const std::string &modname, StringMap *storage);
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	bool removeModEntry(const std::string &modname, const std::string &key);
+
+private:
+	std::string getModHash(const std::string &modname) const
+	{
+		return hash + ":mod_storage:" + modname;
+	}
+
+	redisContext *ctx;
+	std::string hash;
+};
+
 #endif // USE_REDIS
 
 #endif
@@ -22,6 +22,12 @@ SQLite format specification:
 	blocks:
 		(PK) INT id
 		BLOB data
+
+mod_storage.sqlite:
+	mod_storage:
+		(PK) TEXT modname
+		(PK) BLOB key
+		BLOB value
 */
 
 
@@ -298,3 +304,167 @@ Database_SQLite3::~Database_SQLite3()
 	SQLOK_ERRSTREAM(sqlite3_close(m_database), "Failed to close database");
 }
 
+
+ModStorageDatabase_SQLite3::ModStorageDatabase_SQLite3(const std::string &savedir) :
+	m_initialized(false),
+	m_savedir(savedir),
+	m_database(NULL),
+	m_stmt_get(NULL),
+	m_stmt_set(NULL),
+	m_stmt_remove(NULL),
+	m_stmt_begin(NULL),
+	m_stmt_end(NULL)
+{
+}
+
+ModStorageDatabase_SQLite3::~ModStorageDatabase_SQLite3()
+{
+	FINALIZE_STATEMENT(m_stmt_get)
+	FINALIZE_STATEMENT(m_stmt_set)
+	FINALIZE_STATEMENT(m_stmt_remove)
+	FINALIZE_STATEMENT(m_stmt_begin)
+	FINALIZE_STATEMENT(m_stmt_end)
+
+	SQLOK_ERRSTREAM(sqlite3_close(m_database), "Failed to close database");
+}
+
+void ModStorageDatabase_SQLite3::verifyDatabase()
+{
+	if (m_initialized) return;
+
+	std::string dbp = m_savedir + DIR_DELIM + "mod_storage.sqlite";
+
+	if (!fs::CreateAllDirs(m_savedir)) {
+		infostream << "ModStorageDatabase_SQLite3: Failed to create directory \""
+			<< m_savedir << "\"" << std::endl;
+		throw FileNotGoodException("Failed to create database "
+				"save directory");
+	}
+
+	SQLOK(sqlite3_open_v2(dbp.c_str(), &m_database,
+			SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL),
+		std::string("Failed to open SQLite3 database file ") + dbp);
+
+	SQLOK(sqlite3_busy_handler(m_database, Database_SQLite3::busyHandler,
+		m_busy_handler_data), "Failed to set SQLite3 busy handler");
+
+	SQLOK(sqlite3_exec(m_database,
+		"CREATE TABLE IF NOT EXISTS `mod_storage` (\n"
+		"	`modname` TEXT NOT NULL,\n"
+		"	`key` BLOB NOT NULL,\n"
+		"	`value` BLOB NOT NULL,\n"
+		"	PRIMARY KEY (`modname`, `key`)\n"
+		");\n",
+		NULL, NULL, NULL),
+		"Failed to create database table");
+
+	std::string query_str = std::string("PRAGMA synchronous = ")
+			 + itos(g_settings->getU16("sqlite_synchronous"));
+	SQLOK(sqlite3_exec(m_database, query_str.c_str(), NULL, NULL, NULL),
+		"Failed to modify sqlite3 synchronous mode");
+
+	PREPARE_STATEMENT(begin, "BEGIN");
+	PREPARE_STATEMENT(end, "COMMIT");
+	PREPARE_STATEMENT(get, "SELECT `key`, `value` FROM `mod_storage` "
+		"WHERE `modname` = ?");
+	PREPARE_STATEMENT(set, "REPLACE INTO `mod_storage` (`modname`, `key`, `value`) "
+		"VALUES (?, ?, ?)");
+	PREPARE_STATEMENT(remove, "DELETE FROM `mod_storage` "
+		"WHERE `modname` = ? AND `key` = ?");
+
+	m_initialized = true;
+
+	verbosestream << "ModStorage: SQLite3 database opened." << std::endl;
+}
+
+void ModStorageDatabase_SQLite3::beginSave()
+{
+	verifyDatabase();
+	SQLRES(sqlite3_step(m_stmt_begin), SQLITE_DONE,
+		"Failed to start SQLite3 transaction");
+	sqlite3_reset(m_stmt_begin);
+}
+
+void ModStorageDatabase_SQLite3::endSave()
+{
+	verifyDatabase();
+	SQLRES(sqlite3_step(m_stmt_end), SQLITE_DONE,
+		"Failed to commit SQLite3 transaction");
+	sqlite3_reset(m_stmt_end);
+}
+
+void ModStorageDatabase_SQLite3::rollbackSave()
+{
+	verifyDatabase();
+
+	// The statement that failed was not reset
+	sqlite3_reset(m_stmt_set);
+	sqlite3_reset(m_stmt_remove);
+	sqlite3_reset(m_stmt_begin);
+	sqlite3_reset(m_stmt_end);
+
+	// Nothing to roll back if BEGIN failed or COMMIT went through
+	if (sqlite3_get_autocommit(m_database))
+		return;
+	SQLOK(sqlite3_exec(m_database, "ROLLBACK", NULL, NULL, NULL),
+		"Failed to roll back SQLite3 transaction");
+}
+
+void ModStorageDatabase_SQLite3::getModEntries(const std::string &modname,
+	StringMap *storage)
+{
+	verifyDatabase();
+
+	SQLOK(sqlite3_bind_text(m_stmt_get, 1, modname.c_str(), modname.size(), NULL),
+		"Internal error: failed to bind query at " __FILE__ ":" TOSTRING(__LINE__));
+
+	while (sqlite3_step(m_stmt_get) == SQLITE_ROW) {
+		const char *key = (const char *) sqlite3_column_blob(m_stmt_get, 0);
+		size_t key_len = sqlite3_column_bytes(m_stmt_get, 0);
+		const char *value = (const char *) sqlite3_column_blob(m_stmt_get, 1);
+		size_t value_len = sqlite3_column_bytes(m_stmt_get, 1);
+		// Empty blobs are returned as NULL
+		(*storage)[key ? std::string(key, key_len) : ""] =
+			value ? std::string(value, value_len) : "";
+	}
+	sqlite3_reset(m_stmt_get);
+}
+
+bool ModStorageDatabase_SQLite3::setModEntry(const std::string &modname,
+	const std::string &key, const std::string &value)
+{
+	verifyDatabase();
+
+	SQLOK(sqlite3_bind_text(m_stmt_set, 1, modname.c_str(), modname.size(), NULL),
+		"Internal error: failed to bind query at " __FILE__ ":" TOSTRING(__LINE__));
+	SQLOK(sqlite3_bind_blob(m_stmt_set, 2, key.data(), key.size(), NULL),
+		"Internal error: failed to bind query at " __FILE__ ":" TOSTRING(__LINE__));
+	SQLOK(sqlite3_bind_blob(m_stmt_set, 3, value.data(), value.size(), NULL),
+		"Internal error: failed to bind query at " __FILE__ ":" TOSTRING(__LINE__));
+
+	SQLRES(sqlite3_step(m_stmt_set), SQLITE_DONE, "Failed to set mod entry")
+	sqlite3_reset(m_stmt_set);
+
+	return true;
+}
+
+bool ModStorageDatabase_SQLite3::removeModEntry(const std::string &modname,
+	const std::string &key)
+{
+	verifyDatabase();
+
+	SQLOK(sqlite3_bind_text(m_stmt_remove, 1, modname.c_str(), modname.size(), NULL),
+		"Internal error: failed to bind query at " __FILE__ ":" TOSTRING(__LINE__));
+	SQLOK(sqlite3_bind_blob(m_stmt_remove, 2, key.data(), key.size(), NULL),
+		"Internal error: failed to bind query at " __FILE__ ":" TOSTRING(__LINE__));
+
+	bool good = sqlite3_step(m_stmt_remove) == SQLITE_DONE;
+	sqlite3_reset(m_stmt_remove);
+
+	if (!good) {
+		warningstream << "removeModEntry: Failed to remove \"" << key
+			<< "\" of mod \"" << modname << "\": "
+			<< sqlite3_errmsg(m_database) << std::endl;
+	}
+	return good;
+}
@@ -42,6 +42,9 @@ class Database_SQLite3 : public Database
 	void listAllLoadableBlocks(std::vector<v3s16> &dst);
 	bool initialized() const { return m_initialized; }
 
+	// Waits for the database lock, warning about long delays
+	static int busyHandler(void *data, int count);
+
 private:
 	// Open the database
 	void openDatabase();
@@ -65,8 +68,43 @@ class Database_SQLite3 : public Database
 	sqlite3_stmt *m_stmt_end;
 
 	s64 m_busy_handler_data[2];
+};
 
-	static int busyHandler(void *data, int count);
+/*
+	Mod storage in its own file (mod_storage.sqlite), so that writing it
+	from another thread does not contend with map saving for the lock.
+*/
+class ModStorageDatabase_SQLite3 : public ModStorageDatabase
+{
+public:
+	ModStorageDatabase_SQLite3(const std::string &savedir);
+	~ModStorageDatabase_SQLite3();
+
+	void beginSave();
+	void endSave();
+	void rollbackSave();
+
+	void getModEntries(const std::string &modname, StringMap *storage);
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	bool removeModEntry(const std::string &modname, const std::string &key);
+
+private:
+	// Open and initialize the database if needed
+	void verifyDatabase();
+
+	bool m_initialized;
+
+	std::string m_savedir;
+
+	sqlite3 *m_database;
+	sqlite3_stmt *m_stmt_get;
+	sqlite3_stmt *m_stmt_set;
+	sqlite3_stmt *m_stmt_remove;
+	sqlite3_stmt *m_stmt_begin;
+	sqlite3_stmt *m_stmt_end;
+
+	s64 m_busy_handler_data[2];
 };
 
 #endif
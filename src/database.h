@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irr_v3d.h"
 #include "irrlichttypes.h"
 #include "util/basic_macros.h"
+#include "util/string.h"
 
 class Database
 {
@@ -46,5 +47,28 @@ class Database
 	virtual bool initialized() const { return true; }
 };
 
+/*
+	Storage of the key-value pairs set by mods through the mod storage API.
+	Changes are made between beginSave() and endSave(), or dropped by
+	rollbackSave() if one of them failed.
+*/
+class ModStorageDatabase
+{
+public:
+	virtual ~ModStorageDatabase() {}
+
+	virtual void beginSave() {}
+	virtual void endSave() {}
+	virtual void rollbackSave() {}
+
+	// Adds all stored entries of the mod to storage
+	virtual void getModEntries(const std::string &modname, StringMap *storage) = 0;
+	// Return false on failure; removing an entry that isn't stored isn't one
+	virtual bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value) = 0;
+	virtual bool removeModEntry(const std::string &modname,
+		const std::string &key) = 0;
+};
+
 #endif
 
@@ -105,6 +105,10 @@ EmergeManager::EmergeManager(Server *server)
 
 	enable_mapgen_debug_info = g_settings->getBool("enable_mapgen_debug_info");
 
+	num_mapchunk_threads = g_settings->getU16("num_mapchunk_threads");
+	if (num_mapchunk_threads < 1)
+		num_mapchunk_threads = 1;
+
 	// If unspecified, leave a proc for the main thread and one for
 	// some other misc thread
 	s16 nthreads = 0;
@@ -616,6 +620,7 @@ void *EmergeThread::run()
 					"EmergeThread: Mapgen::makeChunk", SPT_AVG);
 				TimeTaker t("mapgen::make_block()");
 
+				bmdata.vmanip->copySnapshots();
 				m_mapgen->makeChunk(&bmdata);
 
 				if (enable_mapgen_debug_info == false)
@@ -94,6 +94,10 @@ class EmergeManager {
 	INodeDefManager *ndef;
 	bool enable_mapgen_debug_info;
 
+	// Number of threads generating a single mapchunk, including the
+	// emerge thread itself
+	u16 num_mapchunk_threads;
+
 	// Generation Notify
 	u32 gen_notify_on;
 	std::set<u32> gen_notify_on_deco_ids;
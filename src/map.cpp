@@ -44,8 +44,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "database.h"
 #include "database-dummy.h"
 #include "database-sqlite3.h"
+#include "threading/atomic.h"
+#include "threading/semaphore.h"
+#include "threading/thread.h"
+#include <cstring>
 #include <deque>
-#include <queue>
 #if USE_LEVELDB
 #include "database-leveldb.h"
 #endif
@@ -65,6 +68,9 @@ Map::Map(std::ostream &dout, IGameDef *gamedef):
 	m_dout(dout),
 	m_gamedef(gamedef),
 	m_sector_cache(NULL),
+	m_block_cache(NULL),
+	m_usage_clock(0),
+	m_sector_sweep_p(0, 0),
 	m_nodedef(gamedef->ndef()),
 	m_transforming_liquid_loop_count_multiplier(1.0f),
 	m_unprocessed_count(0),
@@ -75,6 +81,8 @@ Map::Map(std::ostream &dout, IGameDef *gamedef):
 
 Map::~Map()
 {
+	stopLiquidThreads();
+
 	/*
 		Free all MapSectors
 	*/
@@ -142,11 +150,14 @@ MapSector * Map::getSectorNoGenerate(v2s16 p)
 
 MapBlock * Map::getBlockNoCreateNoEx(v3s16 p3d)
 {
-	v2s16 p2d(p3d.X, p3d.Z);
-	MapSector * sector = getSectorNoGenerateNoEx(p2d);
-	if(sector == NULL)
-		return NULL;
-	MapBlock *block = sector->getBlockNoCreateNoEx(p3d.Y);
+	if (m_block_cache != NULL && p3d == m_block_cache_p)
+		return m_block_cache;
+
+	MapBlock *block = m_block_index.get(p3d);
+	if (block != NULL) {
+		m_block_cache_p = p3d;
+		m_block_cache = block;
+	}
 	return block;
 }
 
@@ -158,6 +169,33 @@ MapBlock * Map::getBlockNoCreate(v3s16 p3d)
 	return block;
 }
 
+void Map::indexBlock(MapBlock *block)
+{
+	m_block_index.insert(block->getPos(), block);
+	block->resetUsageTimer();
+	bucketBlock(block);
+}
+
+// The second of m_usage_clock the block was last used in
+static inline u32 usage_bucket(MapBlock *block)
+{
+	return (u32)block->getLastUsed();
+}
+
+void Map::bucketBlock(MapBlock *block)
+{
+	u32 bucket = usage_bucket(block);
+	block->setUsageBucket(bucket);
+	m_usage_buckets[bucket].push_back(block->getPos());
+}
+
+void Map::unindexBlock(MapBlock *block)
+{
+	if (m_block_cache == block)
+		m_block_cache = NULL;
+	m_block_index.remove(block->getPos());
+}
+
 bool Map::isNodeUnderground(v3s16 p)
 {
 	v3s16 blockpos = getNodeBlockPos(p);
@@ -931,6 +969,111 @@ bool Map::removeNodeWithEvent(v3s16 p)
 	return succeeded;
 }
 
+u32 Map::addNodesWithEvent(const std::vector<v3s16> &positions, MapNode n,
+		bool remove_metadata)
+{
+	// Never allow placing CONTENT_IGNORE, see setNode()
+	if (n.getContent() == CONTENT_IGNORE) {
+		errorstream << "Map::addNodesWithEvent(): Not allowing to place "
+			"CONTENT_IGNORE" << std::endl;
+		return 0;
+	}
+
+	// Group the positions by block, keeping the order within a block
+	std::map<v3s16, std::vector<v3s16> > positions_by_block;
+	for (std::vector<v3s16>::const_iterator it = positions.begin();
+			it != positions.end(); ++it)
+		positions_by_block[getNodeBlockPos(*it)].push_back(*it);
+
+	IRollbackManager *rollback = m_gamedef->rollback();
+	std::vector<std::pair<v3s16, MapNode> > oldnodes;
+	oldnodes.reserve(positions.size());
+	std::map<v3s16, MapBlock*> modified_blocks;
+
+	for (std::map<v3s16, std::vector<v3s16> >::const_iterator
+			bit = positions_by_block.begin();
+			bit != positions_by_block.end(); ++bit) {
+		v3s16 blockpos = bit->first;
+		MapBlock *block = getBlockNoCreateNoEx(blockpos);
+		if (block == NULL || block->isDummy())
+			continue;
+
+		for (std::vector<v3s16>::const_iterator it = bit->second.begin();
+				it != bit->second.end(); ++it) {
+			v3s16 p = *it;
+			v3s16 relpos = p - blockpos * MAP_BLOCKSIZE;
+
+			// Collect old node for rollback
+			RollbackNode rollback_oldnode;
+			if (rollback)
+				rollback_oldnode = RollbackNode(this, p, m_gamedef);
+
+			bool is_valid_position;
+			MapNode oldnode = block->getNodeNoCheck(relpos, &is_valid_position);
+
+			if (remove_metadata)
+				removeNodeMetadata(p);
+
+			// The light is reset by updateChangedLighting()
+			block->setNodeNoCheck(relpos, n);
+			oldnodes.push_back(std::pair<v3s16, MapNode>(p, oldnode));
+
+			// Report for rollback
+			if (rollback) {
+				RollbackNode rollback_newnode(this, p, m_gamedef);
+				RollbackAction action;
+				action.setSetNode(p, rollback_oldnode, rollback_newnode);
+				rollback->reportAction(action);
+			}
+		}
+		modified_blocks[blockpos] = block;
+	}
+
+	if (oldnodes.empty())
+		return 0;
+
+	updateChangedLighting(oldnodes, modified_blocks);
+
+	for (std::map<v3s16, MapBlock*>::iterator i = modified_blocks.begin();
+			i != modified_blocks.end(); ++i)
+		i->second->expireDayNightDiff();
+
+	// Add neighboring liquid nodes and the nodes to transform queue,
+	// see addNodeAndUpdate()
+	static const v3s16 dirs[7] = {
+		v3s16(0,0,1), // back
+		v3s16(0,1,0), // top
+		v3s16(1,0,0), // right
+		v3s16(0,0,-1), // front
+		v3s16(0,-1,0), // bottom
+		v3s16(-1,0,0), // left
+		v3s16(0,0,0), // self
+	};
+	for (std::vector<std::pair<v3s16, MapNode> >::const_iterator
+			it = oldnodes.begin(); it != oldnodes.end(); ++it) {
+		for (u16 i = 0; i < 7; i++) {
+			v3s16 p2 = it->first + dirs[i];
+
+			bool is_valid_position;
+			MapNode n2 = getNodeNoEx(p2, &is_valid_position);
+			if (is_valid_position &&
+					(m_nodedef->get(n2).isLiquid() ||
+					n2.getContent() == CONTENT_AIR))
+				m_transforming_liquid.push_back(p2);
+		}
+	}
+
+	// Clients get the modified blocks again instead of every single node
+	MapEditEvent event;
+	event.type = MEET_OTHER;
+	for (std::map<v3s16, MapBlock*>::iterator i = modified_blocks.begin();
+			i != modified_blocks.end(); ++i)
+		event.modified_blocks.insert(i->first);
+	dispatchEvent(&event);
+
+	return oldnodes.size();
+}
+
 bool Map::getDayNightDiff(v3s16 blockpos)
 {
 	try{
@@ -988,21 +1131,6 @@ bool Map::getDayNightDiff(v3s16 blockpos)
 	return false;
 }
 
-struct TimeOrderedMapBlock {
-	MapSector *sect;
-	MapBlock *block;
-
-	TimeOrderedMapBlock(MapSector *sect, MapBlock *block) :
-		sect(sect),
-		block(block)
-	{}
-
-	bool operator<(const TimeOrderedMapBlock &b) const
-	{
-		return block->getUsageTimer() < b.block->getUsageTimer();
-	};
-};
-
 /*
 	Updates usage timers
 */
@@ -1017,118 +1145,133 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 	std::vector<v2s16> sector_deletion_queue;
 	u32 deleted_blocks_count = 0;
 	u32 saved_blocks_count = 0;
-	u32 block_count_all = 0;
+	// Node data statistics of the blocks looked at
+	u32 node_data_blocks = 0;
+	u32 packed_blocks_count = 0;
+	u64 node_data_size = 0;
+
+	m_usage_clock += dtime;
 
 	beginSave();
 
-	// If there is no practical limit, we spare creation of mapblock_queue
-	if (max_loaded_blocks == U32_MAX) {
+	if (unload_timeout < 0) {
+		// Unload everything that is not referenced
 		for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
 				si != m_sectors.end(); ++si) {
-			MapSector *sector = si->second;
-
-			bool all_blocks_deleted = true;
-
 			MapBlockVect blocks;
-			sector->getBlocks(blocks);
+			si->second->getBlocks(blocks);
 
 			for (MapBlockVect::iterator i = blocks.begin();
 					i != blocks.end(); ++i) {
 				MapBlock *block = (*i);
-
-				block->incrementUsageTimer(dtime);
-
-				if (block->refGet() == 0
-						&& block->getUsageTimer() > unload_timeout) {
-					v3s16 p = block->getPos();
-
-					// Save if modified
-					if (block->getModified() != MOD_STATE_CLEAN
-							&& save_before_unloading) {
-						modprofiler.add(block->getModifiedReasonString(), 1);
-						if (!saveBlock(block))
-							continue;
-						saved_blocks_count++;
-					}
-
-					// Delete from memory
-					sector->deleteBlock(block);
-
-					if (unloaded_blocks)
-						unloaded_blocks->push_back(p);
-
-					deleted_blocks_count++;
-				} else {
-					all_blocks_deleted = false;
-					block_count_all++;
-				}
+				v3s16 p = block->getPos();
+				if (block->refGet() != 0 || !unloadBlock(block,
+						save_before_unloading, &modprofiler, &saved_blocks_count))
+					continue;
+				if (unloaded_blocks)
+					unloaded_blocks->push_back(p);
+				deleted_blocks_count++;
 			}
 
-			if (all_blocks_deleted) {
+			if (si->second->empty())
 				sector_deletion_queue.push_back(si->first);
-			}
 		}
 	} else {
-		std::priority_queue<TimeOrderedMapBlock> mapblock_queue;
-		for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
-				si != m_sectors.end(); ++si) {
-			MapSector *sector = si->second;
-
-			MapBlockVect blocks;
-			sector->getBlocks(blocks);
-
-			for(MapBlockVect::iterator i = blocks.begin();
-					i != blocks.end(); ++i) {
-				MapBlock *block = (*i);
-
-				block->incrementUsageTimer(dtime);
-				mapblock_queue.push(TimeOrderedMapBlock(sector, block));
+		/*
+			Go through the oldest buckets while they are older than the
+			timeout or there are too many blocks. Blocks used this second
+			are never unloaded.
+		*/
+		u32 now_bucket = (u32)m_usage_clock;
+		while (!m_usage_buckets.empty()) {
+			std::map<u32, std::vector<v3s16> >::iterator it =
+				m_usage_buckets.begin();
+			u32 bucket = it->first;
+			if (bucket >= now_bucket)
+				break;
+			bool expired = bucket + 1 <= m_usage_clock - unload_timeout;
+			if (!expired && m_block_index.size() <= max_loaded_blocks)
+				break;
+			if (it->second.empty()) {
+				m_usage_buckets.erase(it);
+				continue;
 			}
-		}
-		block_count_all = mapblock_queue.size();
-		// Delete old blocks, and blocks over the limit from the memory
-		while (!mapblock_queue.empty() && (mapblock_queue.size() > max_loaded_blocks
-				|| mapblock_queue.top().block->getUsageTimer() > unload_timeout)) {
-			TimeOrderedMapBlock b = mapblock_queue.top();
-			mapblock_queue.pop();
 
-			MapBlock *block = b.block;
+			v3s16 p = it->second.back();
+			it->second.pop_back();
 
-			if (block->refGet() != 0)
+			// Skip blocks that were unloaded or moved to another bucket
+			MapBlock *block = getBlockNoCreateNoEx(p);
+			if (block == NULL || block->getUsageBucket() != bucket)
 				continue;
 
-			v3s16 p = block->getPos();
+			// Pack blocks that were not written to since they were put in
+			if (!block->checkNodeDataWritten())
+				block->compressNodeData();
+			node_data_blocks++;
+			packed_blocks_count += block->isNodeDataCompressed();
+			node_data_size += block->getNodeDataSize();
 
-			// Save if modified
-			if (block->getModified() != MOD_STATE_CLEAN && save_before_unloading) {
-				modprofiler.add(block->getModifiedReasonString(), 1);
-				if (!saveBlock(block))
-					continue;
-				saved_blocks_count++;
+			// Used since then, or in use now
+			if (block->refGet() != 0)
+				block->resetUsageTimer();
+			if (usage_bucket(block) != bucket) {
+				bucketBlock(block);
+				continue;
 			}
 
-			// Delete from memory
-			b.sect->deleteBlock(block);
-
+			v2s16 p2d(p.X, p.Z);
+			if (!unloadBlock(block, save_before_unloading, &modprofiler,
+					&saved_blocks_count)) {
+				// Try again later
+				block->resetUsageTimer();
+				bucketBlock(block);
+				continue;
+			}
 			if (unloaded_blocks)
 				unloaded_blocks->push_back(p);
-
 			deleted_blocks_count++;
-			block_count_all--;
-		}
-		// Delete empty sectors
-		for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
-			si != m_sectors.end(); ++si) {
-			if (si->second->empty()) {
-				sector_deletion_queue.push_back(si->first);
-			}
+
+			MapSector *sector = getSectorNoGenerateNoEx(p2d);
+			if (sector && sector->empty())
+				sector_deletion_queue.push_back(p2d);
 		}
 	}
 	endSave();
 
+	/*
+		Look for sectors left empty otherwise, a few each time
+	*/
+	std::map<v2s16, MapSector*>::iterator si =
+		m_sectors.lower_bound(m_sector_sweep_p);
+	for (u32 i = 0; i < 64 && !m_sectors.empty(); i++) {
+		if (si == m_sectors.end())
+			si = m_sectors.begin();
+		if (si->second->empty() &&
+				std::find(sector_deletion_queue.begin(),
+					sector_deletion_queue.end(), si->first) ==
+					sector_deletion_queue.end())
+			sector_deletion_queue.push_back(si->first);
+		++si;
+	}
+	if (si != m_sectors.end())
+		m_sector_sweep_p = si->first;
+
 	// Finally delete the empty sectors
 	deleteSectors(sector_deletion_queue);
 
+	if (node_data_blocks != 0) {
+		const char *prefix = mapType() == MAPTYPE_SERVER ? "SMap: " : "CM: ";
+		g_profiler->avg(std::string(prefix) + "node data bytes per block",
+			node_data_size / node_data_blocks);
+		// Estimated from the blocks looked at
+		g_profiler->avg(std::string(prefix) + "node data MiB",
+			(float)node_data_size / node_data_blocks *
+			m_block_index.size() / (1024.0f * 1024.0f));
+		g_profiler->avg(std::string(prefix) + "packed blocks (frac)",
+			(float)packed_blocks_count / node_data_blocks);
+	}
+
 	if(deleted_blocks_count != 0)
 	{
 		PrintInfo(infostream); // ServerMap/ClientMap:
@@ -1136,7 +1279,7 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 				<<" blocks from memory";
 		if(save_before_unloading)
 			infostream<<", of which "<<saved_blocks_count<<" were written";
-		infostream<<", "<<block_count_all<<" blocks in memory";
+		infostream<<", "<<m_block_index.size()<<" blocks in memory";
 		infostream<<"."<<std::endl;
 		if(saved_blocks_count != 0){
 			PrintInfo(infostream); // ServerMap/ClientMap:
@@ -1146,6 +1289,27 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 	}
 }
 
+bool Map::unloadBlock(MapBlock *block, bool save_before_unloading,
+	Profiler *modprofiler, u32 *saved_blocks_count)
+{
+	// Queued lighting would be lost with the block
+	finishQueuedLighting(block);
+
+	// Save if modified
+	if (block->getModified() != MOD_STATE_CLEAN && save_before_unloading) {
+		modprofiler->add(block->getModifiedReasonString(), 1);
+		if (!saveBlock(block))
+			return false;
+		(*saved_blocks_count)++;
+	}
+
+	// Delete from memory
+	v3s16 p = block->getPos();
+	MapSector *sector = getSectorNoGenerate(v2s16(p.X, p.Z));
+	sector->deleteBlock(block);
+	return true;
+}
+
 void Map::unloadUnreferencedBlocks(std::vector<v3s16> *unloaded_blocks)
 {
 	timerUpdate(0.0, -1.0, 0, unloaded_blocks);
@@ -1202,20 +1366,422 @@ s32 Map::transforming_liquid_size() {
         return m_transforming_liquid.size();
 }
 
+/*
+	Liquid transformation
+
+	A step takes a batch from the front of the queue and handles it in two
+	phases. First the new state of the nodes is computed from the map as it
+	was at the beginning of the step; the batch is split by mapblock into
+	units that liquid_threads threads compute. Then the changes are applied
+	and the neighbours queued, in the order of the queue. As no computation
+	sees the changes of another, the result does not depend on the number
+	of threads; they only become visible to the next step.
+*/
+
+// Reads the nodes of a mapblock and its six neighbours
+class LiquidNodeReader
+{
+public:
+	LiquidNodeReader(Map *map, v3s16 blockpos):
+		m_blockpos(blockpos)
+	{
+		memset(m_blocks, 0, sizeof(m_blocks));
+		m_blocks[index(v3s16(0, 0, 0))] = map->getBlockNoCreateNoEx(blockpos);
+		for (u16 i = 0; i < 6; i++)
+			m_blocks[index(g_6dirs[i])] =
+				map->getBlockNoCreateNoEx(blockpos + g_6dirs[i]);
+	}
+
+	// p has to be in the block or next to it
+	MapNode get(v3s16 p) const
+	{
+		v3s16 blockpos = getNodeBlockPos(p);
+		MapBlock *block = m_blocks[index(blockpos - m_blockpos)];
+		if (block == NULL)
+			return MapNode(CONTENT_IGNORE);
+		bool is_valid;
+		return block->getNodeNoCheck(p - blockpos * MAP_BLOCKSIZE, &is_valid);
+	}
+
+private:
+	static inline u16 index(v3s16 d)
+	{
+		return (d.X + 1) + (d.Y + 1) * 3 + (d.Z + 1) * 9;
+	}
+
+	v3s16 m_blockpos;
+	MapBlock *m_blocks[27];
+};
+
+struct LiquidTransform
+{
+	LiquidTransform():
+		changed(false),
+		reflow(false),
+		num_neighbors(0)
+	{ }
+
+	bool changed;
+	MapNode n;
+	MapNode oldnode;
+	// Not at its max level yet because of viscosity
+	bool reflow;
+	// To be queued, in order
+	u8 num_neighbors;
+	v3s16 neighbors[12];
+};
+
+// The nodes of a batch that lie in one mapblock
+struct LiquidUnit
+{
+	LiquidUnit(Map *map, v3s16 blockpos):
+		reader(map, blockpos)
+	{ }
+
+	LiquidNodeReader reader;
+	std::vector<u32> indices;
+};
+
+struct LiquidBatch
+{
+	std::vector<v3s16> positions;
+	std::vector<LiquidTransform> transforms;
+	std::vector<LiquidUnit> units;
+	// Next unit to be computed
+	Atomic<u32> next_unit;
+};
+
+static void compute_liquid_transform(INodeDefManager *ndef,
+	const LiquidNodeReader &reader, v3s16 p0, LiquidTransform *t)
+{
+	MapNode n0 = reader.get(p0);
+
+	/*
+		Collect information about current node
+	 */
+	s8 liquid_level = -1;
+	// The liquid node which will be placed there if
+	// the liquid flows into this node.
+	content_t liquid_kind = CONTENT_IGNORE;
+	// The node which will be placed there if liquid
+	// can't flow into this node.
+	content_t floodable_node = CONTENT_AIR;
+	const ContentFeatures &cf = ndef->get(n0);
+	LiquidType liquid_type = cf.liquid_type;
+	switch (liquid_type) {
+		case LIQUID_SOURCE:
+			liquid_level = LIQUID_LEVEL_SOURCE;
+			liquid_kind = ndef->getId(cf.liquid_alternative_flowing);
+			break;
+		case LIQUID_FLOWING:
+			liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
+			liquid_kind = n0.getContent();
+			break;
+		case LIQUID_NONE:
+			// if this node is 'floodable', it *could* be transformed
+			// into a liquid, otherwise it stays as it is.
+			if (!cf.floodable)
+				return;
+			floodable_node = n0.getContent();
+			liquid_kind = CONTENT_AIR;
+			break;
+	}
+
+	/*
+		Collect information about the environment
+	 */
+	const v3s16 *dirs = g_6dirs;
+	NodeNeighbor sources[6]; // surrounding sources
+	int num_sources = 0;
+	NodeNeighbor flows[6]; // surrounding flowing liquid nodes
+	int num_flows = 0;
+	NodeNeighbor airs[6]; // surrounding air
+	int num_airs = 0;
+	NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
+	int num_neutrals = 0;
+	bool flowing_down = false;
+	bool ignored_sources = false;
+	for (u16 i = 0; i < 6; i++) {
+		NeighborType nt = NEIGHBOR_SAME_LEVEL;
+		switch (i) {
+			case 1:
+				nt = NEIGHBOR_UPPER;
+				break;
+			case 4:
+				nt = NEIGHBOR_LOWER;
+				break;
+		}
+		v3s16 npos = p0 + dirs[i];
+		NodeNeighbor nb(reader.get(npos), nt, npos);
+		const ContentFeatures &cfnb = ndef->get(nb.n);
+		switch (ndef->get(nb.n.getContent()).liquid_type) {
+			case LIQUID_NONE:
+				if (cfnb.floodable) {
+					airs[num_airs++] = nb;
+					// if the current node is a water source the neighbor
+					// should be enqueded for transformation regardless of whether the
+					// current node changes or not.
+					if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
+						t->neighbors[t->num_neighbors++] = npos;
+					// if the current node happens to be a flowing node, it will start to flow down here.
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				} else {
+					neutrals[num_neutrals++] = nb;
+					if (nb.n.getContent() == CONTENT_IGNORE) {
+						// If node below is ignore prevent water from
+						// spreading outwards and otherwise prevent from
+						// flowing away as ignore node might be the source
+						if (nb.t == NEIGHBOR_LOWER)
+							flowing_down = true;
+						else
+							ignored_sources = true;
+					}
+				}
+				break;
+			case LIQUID_SOURCE:
+				// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+				if (liquid_kind == CONTENT_AIR)
+					liquid_kind = ndef->getId(cfnb.liquid_alternative_flowing);
+				if (ndef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					// Do not count bottom source, it will screw things up
+					if(dirs[i].Y != -1)
+						sources[num_sources++] = nb;
+				}
+				break;
+			case LIQUID_FLOWING:
+				// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+				if (liquid_kind == CONTENT_AIR)
+					liquid_kind = ndef->getId(cfnb.liquid_alternative_flowing);
+				if (ndef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					flows[num_flows++] = nb;
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				}
+				break;
+		}
+	}
+
+	/*
+		decide on the type (and possibly level) of the current node
+	 */
+	content_t new_node_content;
+	s8 new_node_level = -1;
+	s8 max_node_level = -1;
+
+	u8 range = ndef->get(liquid_kind).liquid_range;
+	if (range > LIQUID_LEVEL_MAX + 1)
+		range = LIQUID_LEVEL_MAX + 1;
+
+	if ((num_sources >= 2 && ndef->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
+		// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
+		// or the flowing alternative of the first of the surrounding sources (if it's air), so
+		// it's perfectly safe to use liquid_kind here to determine the new node content.
+		new_node_content = ndef->getId(ndef->get(liquid_kind).liquid_alternative_source);
+	} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
+		// liquid_kind is set properly, see above
+		max_node_level = new_node_level = LIQUID_LEVEL_MAX;
+		if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+	} else if (ignored_sources && liquid_level >= 0) {
+		// Maybe there are neighbouring sources that aren't loaded yet
+		// so prevent flowing away.
+		new_node_level = liquid_level;
+		new_node_content = liquid_kind;
+	} else {
+		// no surrounding sources, so get the maximum level that can flow into this node
+		for (u16 i = 0; i < num_flows; i++) {
+			u8 nb_liquid_level = (flows[i].n.param2 & LIQUID_LEVEL_MASK);
+			switch (flows[i].t) {
+				case NEIGHBOR_UPPER:
+					if (nb_liquid_level + WATER_DROP_BOOST > max_node_level) {
+						max_node_level = LIQUID_LEVEL_MAX;
+						if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
+							max_node_level = nb_liquid_level + WATER_DROP_BOOST;
+					} else if (nb_liquid_level > max_node_level) {
+						max_node_level = nb_liquid_level;
+					}
+					break;
+				case NEIGHBOR_LOWER:
+					break;
+				case NEIGHBOR_SAME_LEVEL:
+					if ((flows[i].n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
+							nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
+						max_node_level = nb_liquid_level - 1;
+					break;
+			}
+		}
+
+		u8 viscosity = ndef->get(liquid_kind).liquid_viscosity;
+		if (viscosity > 1 && max_node_level != liquid_level) {
+			// amount to gain, limited by viscosity
+			// must be at least 1 in absolute value
+			s8 level_inc = max_node_level - liquid_level;
+			if (level_inc < -viscosity || level_inc > viscosity)
+				new_node_level = liquid_level + level_inc/viscosity;
+			else if (level_inc < 0)
+				new_node_level = liquid_level - 1;
+			else if (level_inc > 0)
+				new_node_level = liquid_level + 1;
+			if (new_node_level != max_node_level)
+				t->reflow = true;
+		} else {
+			new_node_level = max_node_level;
+		}
+
+		if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+
+	}
+
+	/*
+		check if anything has changed. if not, there is nothing to do.
+	 */
+	if (new_node_content == n0.getContent() &&
+			(ndef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
+			((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
+			((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
+			== flowing_down)))
+		return;
+
+
+	/*
+		update the current node
+	 */
+	MapNode n00 = n0;
+	//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
+	if (ndef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
+		// set level to last 3 bits, flowing down bit to 4th bit
+		n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
+	} else {
+		// set the liquid level and flow bit to 0
+		n0.param2 = ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
+	}
+	n0.setContent(new_node_content);
+
+	// Ignore light (because calling voxalgo::update_lighting_nodes)
+	n0.setLight(LIGHTBANK_DAY, 0, ndef);
+	n0.setLight(LIGHTBANK_NIGHT, 0, ndef);
+
+	t->changed = true;
+	t->n = n0;
+	t->oldnode = n00;
+
+	/*
+		enqueue neighbors for update if neccessary
+	 */
+	switch (ndef->get(n0.getContent()).liquid_type) {
+		case LIQUID_SOURCE:
+		case LIQUID_FLOWING:
+			// make sure source flows into all neighboring nodes
+			for (u16 i = 0; i < num_flows; i++)
+				if (flows[i].t != NEIGHBOR_UPPER)
+					t->neighbors[t->num_neighbors++] = flows[i].p;
+			for (u16 i = 0; i < num_airs; i++)
+				if (airs[i].t != NEIGHBOR_UPPER)
+					t->neighbors[t->num_neighbors++] = airs[i].p;
+			break;
+		case LIQUID_NONE:
+			// this flow has turned to air; neighboring flows might need to do the same
+			for (u16 i = 0; i < num_flows; i++)
+				t->neighbors[t->num_neighbors++] = flows[i].p;
+			break;
+	}
+}
+
+static void compute_liquid_batch(INodeDefManager *ndef, LiquidBatch *batch)
+{
+	u32 i;
+	while ((i = batch->next_unit++) < batch->units.size()) {
+		const LiquidUnit &unit = batch->units[i];
+		for (size_t j = 0; j < unit.indices.size(); j++) {
+			u32 k = unit.indices[j];
+			compute_liquid_transform(ndef, unit.reader, batch->positions[k],
+				&batch->transforms[k]);
+		}
+	}
+}
+
+class LiquidTransformThread : public Thread
+{
+public:
+	LiquidTransformThread(INodeDefManager *ndef):
+		Thread("LiquidTransform"),
+		m_ndef(ndef),
+		m_batch(NULL)
+	{ }
+
+	// Helps computing the batch, done() has to be called before the next
+	void compute(LiquidBatch *batch)
+	{
+		m_batch = batch;
+		m_start.post();
+	}
+
+	void done()
+	{
+		m_done.wait();
+	}
+
+	void stop()
+	{
+		Thread::stop();
+		m_start.post();
+	}
+
+	void *run()
+	{
+		DSTACK(FUNCTION_NAME);
+		BEGIN_DEBUG_EXCEPTION_HANDLER
+
+		while (!stopRequested()) {
+			m_start.wait();
+			if (stopRequested())
+				break;
+			compute_liquid_batch(m_ndef, m_batch);
+			m_done.post();
+		}
+
+		END_DEBUG_EXCEPTION_HANDLER
+
+		return NULL;
+	}
+
+private:
+	INodeDefManager *m_ndef;
+	LiquidBatch *m_batch;
+	Semaphore m_start;
+	Semaphore m_done;
+};
+
+void Map::stopLiquidThreads()
+{
+	for (size_t i = 0; i < m_liquid_threads.size(); i++) {
+		m_liquid_threads[i]->stop();
+		m_liquid_threads[i]->wait();
+		delete m_liquid_threads[i];
+	}
+	m_liquid_threads.clear();
+}
+
 void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks)
 {
 	DSTACK(FUNCTION_NAME);
 	//TimeTaker timer("transformLiquids()");
 
-	u32 loopcount = 0;
 	u32 initial_size = m_transforming_liquid.size();
 
 	/*if(initial_size != 0)
 		infostream<<"transformLiquids(): initial_size="<<initial_size<<std::endl;*/
 
-	// list of nodes that due to viscosity have not reached their max level height
-	std::deque<v3s16> must_reflow;
-
 	std::vector<std::pair<v3s16, MapNode> > changed_nodes;
 
 	u32 liquid_loop_max = g_settings->getS32("liquid_loop_max");
@@ -1238,287 +1804,97 @@ void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks)
 	loop_max *= m_transforming_liquid_loop_count_multiplier;
 #endif
 
-	while (m_transforming_liquid.size() != 0)
-	{
-		// This should be done here so that it is done when continue is used
-		if (loopcount >= initial_size || loopcount >= loop_max)
-			break;
-		loopcount++;
-
-		/*
-			Get a queued transforming liquid node
-		*/
+	/*
+		Take the batch and split it by mapblock
+	*/
+	LiquidBatch batch;
+	u32 batch_size = MYMIN(initial_size, loop_max);
+	batch.positions.reserve(batch_size);
+	std::map<v3s16, u32> unit_of_block;
+	for (u32 i = 0; i < batch_size; i++) {
 		v3s16 p0 = m_transforming_liquid.front();
 		m_transforming_liquid.pop_front();
+		batch.positions.push_back(p0);
 
-		MapNode n0 = getNodeNoEx(p0);
-
-		/*
-			Collect information about current node
-		 */
-		s8 liquid_level = -1;
-		// The liquid node which will be placed there if
-		// the liquid flows into this node.
-		content_t liquid_kind = CONTENT_IGNORE;
-		// The node which will be placed there if liquid
-		// can't flow into this node.
-		content_t floodable_node = CONTENT_AIR;
-		const ContentFeatures &cf = m_nodedef->get(n0);
-		LiquidType liquid_type = cf.liquid_type;
-		switch (liquid_type) {
-			case LIQUID_SOURCE:
-				liquid_level = LIQUID_LEVEL_SOURCE;
-				liquid_kind = m_nodedef->getId(cf.liquid_alternative_flowing);
-				break;
-			case LIQUID_FLOWING:
-				liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
-				liquid_kind = n0.getContent();
-				break;
-			case LIQUID_NONE:
-				// if this node is 'floodable', it *could* be transformed
-				// into a liquid, otherwise, continue with the next node.
-				if (!cf.floodable)
-					continue;
-				floodable_node = n0.getContent();
-				liquid_kind = CONTENT_AIR;
-				break;
+		v3s16 blockpos = getNodeBlockPos(p0);
+		std::map<v3s16, u32>::iterator it = unit_of_block.find(blockpos);
+		if (it == unit_of_block.end()) {
+			it = unit_of_block.insert(std::make_pair(blockpos,
+				(u32)batch.units.size())).first;
+			batch.units.push_back(LiquidUnit(this, blockpos));
 		}
+		batch.units[it->second].indices.push_back(i);
+	}
+	batch.transforms.resize(batch_size);
+	batch.next_unit = 0;
 
-		/*
-			Collect information about the environment
-		 */
-		const v3s16 *dirs = g_6dirs;
-		NodeNeighbor sources[6]; // surrounding sources
-		int num_sources = 0;
-		NodeNeighbor flows[6]; // surrounding flowing liquid nodes
-		int num_flows = 0;
-		NodeNeighbor airs[6]; // surrounding air
-		int num_airs = 0;
-		NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
-		int num_neutrals = 0;
-		bool flowing_down = false;
-		bool ignored_sources = false;
-		for (u16 i = 0; i < 6; i++) {
-			NeighborType nt = NEIGHBOR_SAME_LEVEL;
-			switch (i) {
-				case 1:
-					nt = NEIGHBOR_UPPER;
-					break;
-				case 4:
-					nt = NEIGHBOR_LOWER;
-					break;
-			}
-			v3s16 npos = p0 + dirs[i];
-			NodeNeighbor nb(getNodeNoEx(npos), nt, npos);
-			const ContentFeatures &cfnb = m_nodedef->get(nb.n);
-			switch (m_nodedef->get(nb.n.getContent()).liquid_type) {
-				case LIQUID_NONE:
-					if (cfnb.floodable) {
-						airs[num_airs++] = nb;
-						// if the current node is a water source the neighbor
-						// should be enqueded for transformation regardless of whether the
-						// current node changes or not.
-						if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
-							m_transforming_liquid.push_back(npos);
-						// if the current node happens to be a flowing node, it will start to flow down here.
-						if (nb.t == NEIGHBOR_LOWER)
-							flowing_down = true;
-					} else {
-						neutrals[num_neutrals++] = nb;
-						if (nb.n.getContent() == CONTENT_IGNORE) {
-							// If node below is ignore prevent water from
-							// spreading outwards and otherwise prevent from
-							// flowing away as ignore node might be the source
-							if (nb.t == NEIGHBOR_LOWER)
-								flowing_down = true;
-							else
-								ignored_sources = true;
-						}
-					}
-					break;
-				case LIQUID_SOURCE:
-					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
-					if (liquid_kind == CONTENT_AIR)
-						liquid_kind = m_nodedef->getId(cfnb.liquid_alternative_flowing);
-					if (m_nodedef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						// Do not count bottom source, it will screw things up
-						if(dirs[i].Y != -1)
-							sources[num_sources++] = nb;
-					}
-					break;
-				case LIQUID_FLOWING:
-					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
-					if (liquid_kind == CONTENT_AIR)
-						liquid_kind = m_nodedef->getId(cfnb.liquid_alternative_flowing);
-					if (m_nodedef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						flows[num_flows++] = nb;
-						if (nb.t == NEIGHBOR_LOWER)
-							flowing_down = true;
-					}
-					break;
-			}
-		}
+	/*
+		Compute the new nodes, with the help of the threads
+	*/
+	u32 num_threads = g_settings->getU16("liquid_threads");
+	if (num_threads == 0)
+		num_threads = Thread::getNumberOfProcessors();
+	num_threads = MYMIN(num_threads, batch.units.size());
+	while (m_liquid_threads.size() + 1 < num_threads) {
+		LiquidTransformThread *thread = new LiquidTransformThread(m_nodedef);
+		thread->start();
+		m_liquid_threads.push_back(thread);
+	}
+	for (u32 i = 0; i + 1 < num_threads; i++)
+		m_liquid_threads[i]->compute(&batch);
+	compute_liquid_batch(m_nodedef, &batch);
+	for (u32 i = 0; i + 1 < num_threads; i++)
+		m_liquid_threads[i]->done();
 
-		/*
-			decide on the type (and possibly level) of the current node
-		 */
-		content_t new_node_content;
-		s8 new_node_level = -1;
-		s8 max_node_level = -1;
-
-		u8 range = m_nodedef->get(liquid_kind).liquid_range;
-		if (range > LIQUID_LEVEL_MAX + 1)
-			range = LIQUID_LEVEL_MAX + 1;
-
-		if ((num_sources >= 2 && m_nodedef->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
-			// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
-			// or the flowing alternative of the first of the surrounding sources (if it's air), so
-			// it's perfectly safe to use liquid_kind here to determine the new node content.
-			new_node_content = m_nodedef->getId(m_nodedef->get(liquid_kind).liquid_alternative_source);
-		} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
-			// liquid_kind is set properly, see above
-			max_node_level = new_node_level = LIQUID_LEVEL_MAX;
-			if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
-		} else if (ignored_sources && liquid_level >= 0) {
-			// Maybe there are neighbouring sources that aren't loaded yet
-			// so prevent flowing away.
-			new_node_level = liquid_level;
-			new_node_content = liquid_kind;
-		} else {
-			// no surrounding sources, so get the maximum level that can flow into this node
-			for (u16 i = 0; i < num_flows; i++) {
-				u8 nb_liquid_level = (flows[i].n.param2 & LIQUID_LEVEL_MASK);
-				switch (flows[i].t) {
-					case NEIGHBOR_UPPER:
-						if (nb_liquid_level + WATER_DROP_BOOST > max_node_level) {
-							max_node_level = LIQUID_LEVEL_MAX;
-							if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
-								max_node_level = nb_liquid_level + WATER_DROP_BOOST;
-						} else if (nb_liquid_level > max_node_level) {
-							max_node_level = nb_liquid_level;
-						}
-						break;
-					case NEIGHBOR_LOWER:
-						break;
-					case NEIGHBOR_SAME_LEVEL:
-						if ((flows[i].n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
-								nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
-							max_node_level = nb_liquid_level - 1;
-						break;
-				}
-			}
+	/*
+		Apply the changes in the order of the queue
+	*/
+	// list of nodes that due to viscosity have not reached their max level height
+	std::deque<v3s16> must_reflow;
 
-			u8 viscosity = m_nodedef->get(liquid_kind).liquid_viscosity;
-			if (viscosity > 1 && max_node_level != liquid_level) {
-				// amount to gain, limited by viscosity
-				// must be at least 1 in absolute value
-				s8 level_inc = max_node_level - liquid_level;
-				if (level_inc < -viscosity || level_inc > viscosity)
-					new_node_level = liquid_level + level_inc/viscosity;
-				else if (level_inc < 0)
-					new_node_level = liquid_level - 1;
-				else if (level_inc > 0)
-					new_node_level = liquid_level + 1;
-				if (new_node_level != max_node_level)
-					must_reflow.push_back(p0);
+	for (u32 i = 0; i < batch_size; i++) {
+		v3s16 p0 = batch.positions[i];
+		const LiquidTransform &t = batch.transforms[i];
+		if (t.reflow)
+			must_reflow.push_back(p0);
+
+		if (t.changed) {
+			MapNode n0 = t.n;
+
+			// Find out whether there is a suspect for this action
+			std::string suspect;
+			if (m_gamedef->rollback())
+				suspect = m_gamedef->rollback()->getSuspect(p0, 83, 1);
+
+			if (m_gamedef->rollback() && !suspect.empty()) {
+				// Blame suspect
+				RollbackScopeActor rollback_scope(m_gamedef->rollback(), suspect, true);
+				// Get old node for rollback
+				RollbackNode rollback_oldnode(this, p0, m_gamedef);
+				// Set node
+				setNode(p0, n0);
+				// Report
+				RollbackNode rollback_newnode(this, p0, m_gamedef);
+				RollbackAction action;
+				action.setSetNode(p0, rollback_oldnode, rollback_newnode);
+				m_gamedef->rollback()->reportAction(action);
 			} else {
-				new_node_level = max_node_level;
+				// Set node
+				setNode(p0, n0);
 			}
 
-			if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
-
-		}
-
-		/*
-			check if anything has changed. if not, just continue with the next node.
-		 */
-		if (new_node_content == n0.getContent() &&
-				(m_nodedef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
-				((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
-				((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
-				== flowing_down)))
-			continue;
-
-
-		/*
-			update the current node
-		 */
-		MapNode n00 = n0;
-		//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
-		if (m_nodedef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
-			// set level to last 3 bits, flowing down bit to 4th bit
-			n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
-		} else {
-			// set the liquid level and flow bit to 0
-			n0.param2 = ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
-		}
-		n0.setContent(new_node_content);
-
-		// Ignore light (because calling voxalgo::update_lighting_nodes)
-		n0.setLight(LIGHTBANK_DAY, 0, m_nodedef);
-		n0.setLight(LIGHTBANK_NIGHT, 0, m_nodedef);
-
-		// Find out whether there is a suspect for this action
-		std::string suspect;
-		if (m_gamedef->rollback())
-			suspect = m_gamedef->rollback()->getSuspect(p0, 83, 1);
-
-		if (m_gamedef->rollback() && !suspect.empty()) {
-			// Blame suspect
-			RollbackScopeActor rollback_scope(m_gamedef->rollback(), suspect, true);
-			// Get old node for rollback
-			RollbackNode rollback_oldnode(this, p0, m_gamedef);
-			// Set node
-			setNode(p0, n0);
-			// Report
-			RollbackNode rollback_newnode(this, p0, m_gamedef);
-			RollbackAction action;
-			action.setSetNode(p0, rollback_oldnode, rollback_newnode);
-			m_gamedef->rollback()->reportAction(action);
-		} else {
-			// Set node
-			setNode(p0, n0);
-		}
-
-		v3s16 blockpos = getNodeBlockPos(p0);
-		MapBlock *block = getBlockNoCreateNoEx(blockpos);
-		if (block != NULL) {
-			modified_blocks[blockpos] =  block;
-			changed_nodes.push_back(std::pair<v3s16, MapNode>(p0, n00));
+			v3s16 blockpos = getNodeBlockPos(p0);
+			MapBlock *block = getBlockNoCreateNoEx(blockpos);
+			if (block != NULL) {
+				modified_blocks[blockpos] =  block;
+				changed_nodes.push_back(std::pair<v3s16, MapNode>(p0, t.oldnode));
+			}
 		}
 
-		/*
-			enqueue neighbors for update if neccessary
-		 */
-		switch (m_nodedef->get(n0.getContent()).liquid_type) {
-			case LIQUID_SOURCE:
-			case LIQUID_FLOWING:
-				// make sure source flows into all neighboring nodes
-				for (u16 i = 0; i < num_flows; i++)
-					if (flows[i].t != NEIGHBOR_UPPER)
-						m_transforming_liquid.push_back(flows[i].p);
-				for (u16 i = 0; i < num_airs; i++)
-					if (airs[i].t != NEIGHBOR_UPPER)
-						m_transforming_liquid.push_back(airs[i].p);
-				break;
-			case LIQUID_NONE:
-				// this flow has turned to air; neighboring flows might need to do the same
-				for (u16 i = 0; i < num_flows; i++)
-					m_transforming_liquid.push_back(flows[i].p);
-				break;
-		}
+		for (u8 j = 0; j < t.num_neighbors; j++)
+			m_transforming_liquid.push_back(t.neighbors[j]);
 	}
-	//infostream<<"Map::transformLiquids(): loopcount="<<loopcount<<std::endl;
+	//infostream<<"Map::transformLiquids(): loopcount="<<batch_size<<std::endl;
 
 	for (std::deque<v3s16>::iterator iter = must_reflow.begin(); iter != must_reflow.end(); ++iter)
 		m_transforming_liquid.push_back(*iter);
@@ -1575,6 +1951,131 @@ void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks)
 	}
 }
 
+void Map::updateChangedLighting(std::vector<std::pair<v3s16, MapNode> > &oldnodes,
+	std::map<v3s16, MapBlock*> &modified_blocks, bool lazy)
+{
+	if (oldnodes.empty())
+		return;
+
+	// voxalgo::update_lighting_nodes() needs the new nodes to be unlit
+	MapBlock *block = NULL;
+	v3s16 last_blockpos;
+	for (std::vector<std::pair<v3s16, MapNode> >::iterator
+			it = oldnodes.begin(); it != oldnodes.end(); ++it) {
+		v3s16 blockpos, relpos;
+		getNodeBlockPosWithOffset(it->first, blockpos, relpos);
+		if (block == NULL || blockpos != last_blockpos) {
+			block = getBlockNoCreateNoEx(blockpos);
+			last_blockpos = blockpos;
+		}
+		if (block == NULL || block->isDummy())
+			continue;
+
+		bool is_valid_position;
+		MapNode n = block->getNodeNoCheck(relpos, &is_valid_position);
+		n.setLight(LIGHTBANK_DAY, 0, m_nodedef);
+		n.setLight(LIGHTBANK_NIGHT, 0, m_nodedef);
+		block->setNodeNoCheck(relpos, n);
+	}
+
+	if (lazy) {
+		for (std::vector<std::pair<v3s16, MapNode> >::iterator
+				it = oldnodes.begin(); it != oldnodes.end(); ++it) {
+			std::map<v3s16, MapNode>::iterator q =
+				m_lighting_queue_nodes.find(it->first);
+			if (q == m_lighting_queue_nodes.end()) {
+				m_lighting_queue_nodes[it->first] = it->second;
+				m_lighting_queue.push_back(it->first);
+				m_lighting_queue_blocks[getNodeBlockPos(it->first)]++;
+				continue;
+			}
+
+			/*
+				Changed again before the queue got to it.  The light around
+				the node may still come from either old node, so unlight
+				from the brighter one; update_lighting_nodes() only looks at
+				the light of the old node.
+			*/
+			MapNode merged(CONTENT_AIR);
+			for (u32 i = 0; i < 2; i++) {
+				LightBank bank = i == 0 ? LIGHTBANK_DAY : LIGHTBANK_NIGHT;
+				merged.setLight(bank, MYMAX(
+					q->second.getLight(bank, m_nodedef),
+					it->second.getLight(bank, m_nodedef)), m_nodedef);
+			}
+			q->second = merged;
+		}
+		return;
+	}
+
+	voxalgo::update_lighting_nodes(this, m_nodedef, oldnodes, modified_blocks);
+}
+
+void Map::updateQueuedLighting(std::map<v3s16, MapBlock*> &modified_blocks,
+	u32 max_nodes)
+{
+	// The blocks may be unloaded again, only their positions are used
+	for (std::set<v3s16>::iterator it = m_lighting_unloaded_blocks.begin();
+			it != m_lighting_unloaded_blocks.end(); ++it)
+		modified_blocks[*it] = getBlockNoCreateNoEx(*it);
+	m_lighting_unloaded_blocks.clear();
+
+	if (m_lighting_queue.empty())
+		return;
+
+	// 0 means no limit
+	u32 count = m_lighting_queue.size();
+	if (max_nodes != 0)
+		count = MYMIN(count, max_nodes);
+
+	std::vector<std::pair<v3s16, MapNode> > oldnodes;
+	oldnodes.reserve(count);
+	for (u32 i = 0; i < count; i++) {
+		v3s16 p = m_lighting_queue.front();
+		m_lighting_queue.pop_front();
+
+		std::map<v3s16, MapNode>::iterator q = m_lighting_queue_nodes.find(p);
+		oldnodes.push_back(*q);
+		m_lighting_queue_nodes.erase(q);
+
+		std::map<v3s16, u32>::iterator qb =
+			m_lighting_queue_blocks.find(getNodeBlockPos(p));
+		if (--qb->second == 0)
+			m_lighting_queue_blocks.erase(qb);
+	}
+
+	voxalgo::update_lighting_nodes(this, m_nodedef, oldnodes, modified_blocks);
+}
+
+void Map::finishQueuedLighting(MapBlock *block)
+{
+	v3s16 blockpos = block->getPos();
+	std::map<v3s16, u32>::iterator qb = m_lighting_queue_blocks.find(blockpos);
+	if (qb == m_lighting_queue_blocks.end())
+		return;
+	m_lighting_queue_blocks.erase(qb);
+
+	std::vector<std::pair<v3s16, MapNode> > oldnodes;
+	std::deque<v3s16>::iterator kept = m_lighting_queue.begin();
+	for (std::deque<v3s16>::iterator it = m_lighting_queue.begin();
+			it != m_lighting_queue.end(); ++it) {
+		if (getNodeBlockPos(*it) != blockpos) {
+			*kept++ = *it;
+			continue;
+		}
+		std::map<v3s16, MapNode>::iterator q = m_lighting_queue_nodes.find(*it);
+		oldnodes.push_back(*q);
+		m_lighting_queue_nodes.erase(q);
+	}
+	m_lighting_queue.erase(kept, m_lighting_queue.end());
+
+	std::map<v3s16, MapBlock*> modified_blocks;
+	voxalgo::update_lighting_nodes(this, m_nodedef, oldnodes, modified_blocks);
+	for (std::map<v3s16, MapBlock*>::iterator it = modified_blocks.begin();
+			it != modified_blocks.end(); ++it)
+		m_lighting_unloaded_blocks.insert(it->first);
+}
+
 std::vector<v3s16> Map::findNodesWithMetadata(v3s16 p1, v3s16 p2)
 {
 	std::vector<v3s16> positions_with_meta;
@@ -1603,7 +2104,7 @@ std::vector<v3s16> Map::findNodesWithMetadata(v3s16 p1, v3s16 p2)
 		}
 
 		v3s16 p_base = blockpos * MAP_BLOCKSIZE;
-		std::vector<v3s16> keys = block->m_node_metadata.getAllKeys();
+		std::vector<v3s16> keys = block->getNodeMetadataList().getAllKeys();
 		for (size_t i = 0; i != keys.size(); i++) {
 			v3s16 p(keys[i] + p_base);
 			if (!area.contains(p))
@@ -1631,7 +2132,7 @@ NodeMetadata *Map::getNodeMetadata(v3s16 p)
 				<<std::endl;
 		return NULL;
 	}
-	NodeMetadata *meta = block->m_node_metadata.get(p_rel);
+	NodeMetadata *meta = block->getNodeMetadataList().get(p_rel);
 	return meta;
 }
 
@@ -1650,7 +2151,7 @@ bool Map::setNodeMetadata(v3s16 p, NodeMetadata *meta)
 				<<std::endl;
 		return false;
 	}
-	block->m_node_metadata.set(p_rel, meta);
+	block->getNodeMetadataList().set(p_rel, meta);
 	return true;
 }
 
@@ -1665,7 +2166,7 @@ void Map::removeNodeMetadata(v3s16 p)
 				<<std::endl;
 		return;
 	}
-	block->m_node_metadata.remove(p_rel);
+	block->getNodeMetadataList().remove(p_rel);
 }
 
 NodeTimer Map::getNodeTimer(v3s16 p)
@@ -1683,7 +2184,7 @@ NodeTimer Map::getNodeTimer(v3s16 p)
 				<<std::endl;
 		return NodeTimer();
 	}
-	NodeTimer t = block->m_node_timers.get(p_rel);
+	NodeTimer t = block->getNodeTimerList().get(p_rel);
 	NodeTimer nt(t.timeout, t.elapsed, p);
 	return nt;
 }
@@ -1705,7 +2206,7 @@ void Map::setNodeTimer(const NodeTimer &t)
 		return;
 	}
 	NodeTimer nt(t.timeout, t.elapsed, p_rel);
-	block->m_node_timers.set(nt);
+	block->getNodeTimerList().set(nt);
 }
 
 void Map::removeNodeTimer(v3s16 p)
@@ -1719,7 +2220,7 @@ void Map::removeNodeTimer(v3s16 p)
 				<<std::endl;
 		return;
 	}
-	block->m_node_timers.remove(p_rel);
+	block->getNodeTimerList().remove(p_rel);
 }
 
 /*
@@ -1922,8 +2423,9 @@ bool ServerMap::initBlockMake(v3s16 blockpos, BlockMakeData *data)
 		neighboring blocks
 	*/
 
+	// The nodes are copied in by the emerge thread without the env lock
 	data->vmanip = new MMVManip(this);
-	data->vmanip->initialEmerge(full_bpmin, full_bpmax);
+	data->vmanip->snapshotEmerge(full_bpmin, full_bpmax);
 
 	// Note: we may need this again at some point.
 #if 0
@@ -3114,6 +3616,7 @@ MMVManip::MMVManip(Map *map):
 
 MMVManip::~MMVManip()
 {
+	dropSnapshots();
 }
 
 void MMVManip::initialEmerge(v3s16 blockpos_min, v3s16 blockpos_max,
@@ -3204,6 +3707,56 @@ void MMVManip::initialEmerge(v3s16 blockpos_min, v3s16 blockpos_max,
 	m_is_dirty = false;
 }
 
+void MMVManip::snapshotEmerge(v3s16 blockpos_min, v3s16 blockpos_max)
+{
+	TimeTaker timer1("snapshotEmerge", &emerge_time);
+
+	ServerMap *svrmap = (ServerMap *)m_map;
+	for(s32 z=blockpos_min.Z; z<=blockpos_max.Z; z++)
+	for(s32 y=blockpos_min.Y; y<=blockpos_max.Y; y++)
+	for(s32 x=blockpos_min.X; x<=blockpos_max.X; x++)
+	{
+		v3s16 p(x,y,z);
+		if (m_loaded_blocks.find(p) != m_loaded_blocks.end())
+			continue;
+
+		MapBlock *block = m_map->getBlockNoCreateNoEx(p);
+		if (block == NULL || block->isDummy()) {
+			block = svrmap->emergeBlock(p, false);
+			if (block == NULL)
+				block = svrmap->createBlock(p);
+		}
+
+		MapBlockSnapshot *snapshot = block->getSnapshot();
+		if (snapshot != NULL)
+			m_snapshots.push_back(snapshot);
+		m_loaded_blocks[p] = 0;
+	}
+
+	m_is_dirty = false;
+}
+
+void MMVManip::copySnapshots()
+{
+	VoxelArea area;
+	for (size_t i = 0; i < m_snapshots.size(); i++) {
+		v3s16 p = m_snapshots[i]->getPosRelative();
+		area.addArea(VoxelArea(p, p + v3s16(1,1,1) * (MAP_BLOCKSIZE - 1)));
+	}
+	addArea(area);
+
+	for (size_t i = 0; i < m_snapshots.size(); i++)
+		m_snapshots[i]->copyTo(*this);
+	dropSnapshots();
+}
+
+void MMVManip::dropSnapshots()
+{
+	for (size_t i = 0; i < m_snapshots.size(); i++)
+		m_snapshots[i]->drop();
+	m_snapshots.clear();
+}
+
 void MMVManip::blitBackAll(std::map<v3s16, MapBlock*> *modified_blocks,
 	bool overwrite_generated)
 {
@@ -3231,4 +3784,72 @@ void MMVManip::blitBackAll(std::map<v3s16, MapBlock*> *modified_blocks,
 	}
 }
 
+void MMVManip::blitBackChanged(std::map<v3s16, MapBlock*> *modified_blocks,
+	std::vector<std::pair<v3s16, MapNode> > *oldnodes,
+	std::map<v3s16, MapBlock*> *written_blocks)
+{
+	if (m_area.getExtent() == v3s16(0,0,0))
+		return;
+
+	INodeDefManager *ndef = m_map->getNodeDefManager();
+
+	for (std::map<v3s16, u8>::iterator
+			i = m_loaded_blocks.begin();
+			i != m_loaded_blocks.end(); ++i) {
+		v3s16 p = i->first;
+		MapBlock *block = m_map->getBlockNoCreateNoEx(p);
+		if ((i->second & VMANIP_BLOCK_DATA_INEXIST) || block == NULL ||
+				block->isDummy())
+			continue;
+		if (written_blocks)
+			(*written_blocks)[p] = block;
+
+		/*
+			Compare the block with the voxel data.  Like copyTo(), ignore
+			is never written back.
+		*/
+		v3s16 p0 = block->getPosRelative();
+		bool changed = false;
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 y = 0; y < MAP_BLOCKSIZE; y++) {
+			u32 vi = m_area.index(p0.X, p0.Y + y, p0.Z + z);
+			for (s16 x = 0; x < MAP_BLOCKSIZE; x++, vi++) {
+				MapNode &n = m_data[vi];
+				if (n.getContent() == CONTENT_IGNORE)
+					continue;
+
+				const MapNode &n_old = block->getNodeUnsafe(x, y, z);
+				if (n.getContent() == n_old.getContent()) {
+					if (n.param1 != n_old.param1 || n.param2 != n_old.param2)
+						changed = true;
+					continue;
+				}
+				changed = true;
+
+				if (oldnodes == NULL)
+					continue;
+
+				// Nodes with the same lighting properties keep their light
+				const ContentFeatures &f = ndef->get(n);
+				const ContentFeatures &f_old = ndef->get(n_old);
+				if (f.light_propagates != f_old.light_propagates ||
+						f.sunlight_propagates != f_old.sunlight_propagates ||
+						f.light_source != f_old.light_source)
+					oldnodes->push_back(std::make_pair(
+						p0 + v3s16(x, y, z), n_old));
+				else
+					n.param1 = n_old.param1;
+			}
+		}
+
+		if (!changed)
+			continue;
+
+		block->copyFrom(*this);
+
+		if (modified_blocks)
+			(*modified_blocks)[p] = block;
+	}
+}
+
 //END
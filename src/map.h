@@ -25,6 +25,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <set>
 #include <map>
 #include <list>
+#include <deque>
+#include <vector>
 
 #include "irrlichttypes_bloated.h"
 #include "mapnode.h"
@@ -35,6 +37,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/cpp11_container.h"
 #include "nodetimer.h"
 #include "map_settings_manager.h"
+#include "mapblock_index.h"
 
 class Settings;
 class Database;
@@ -42,10 +45,13 @@ class ClientMap;
 class MapSector;
 class ServerMapSector;
 class MapBlock;
+class MapBlockSnapshot;
 class NodeMetadata;
 class IGameDef;
 class IRollbackManager;
 class EmergeManager;
+class LiquidTransformThread;
+class Profiler;
 class ServerEnvironment;
 struct BlockMakeData;
 
@@ -241,6 +247,15 @@ class Map /*: public NodeContainer*/
 	bool addNodeWithEvent(v3s16 p, MapNode n, bool remove_metadata = true);
 	bool removeNodeWithEvent(v3s16 p);
 
+	/*
+		Places n at all positions with a single lighting update, and emits
+		one MEET_OTHER event for all modified blocks instead of an event per
+		node. Positions in blocks that are not loaded are skipped.
+		Returns the number of nodes placed.
+	*/
+	u32 addNodesWithEvent(const std::vector<v3s16> &positions, MapNode n,
+			bool remove_metadata = true);
+
 	/*
 		Takes the blocks at the edges into account
 	*/
@@ -274,6 +289,10 @@ class Map /*: public NodeContainer*/
 	*/
 	void unloadUnreferencedBlocks(std::vector<v3s16> *unloaded_blocks=NULL);
 
+	// Seconds that timerUpdate() has advanced, for the usage timers of
+	// the blocks
+	double getUsageClock() const { return m_usage_clock; }
+
 	// Deletes sectors and their blocks from memory
 	// Takes cache into account
 	// If deleted sector is in sector cache, clears cache
@@ -284,6 +303,22 @@ class Map /*: public NodeContainer*/
 
 	void transformLiquids(std::map<v3s16, MapBlock*> & modified_blocks);
 
+	/*
+		Updates lighting around nodes that were changed without it, eg. by
+		MMVManip::blitBackChanged().  The light of the new nodes is reset
+		first.  If lazy is true, the update is only queued and finished over
+		the following server steps by updateQueuedLighting().
+	*/
+	void updateChangedLighting(std::vector<std::pair<v3s16, MapNode> > &oldnodes,
+		std::map<v3s16, MapBlock*> &modified_blocks, bool lazy = false);
+	// Processes at most max_nodes nodes of the lighting queue
+	void updateQueuedLighting(std::map<v3s16, MapBlock*> &modified_blocks,
+		u32 max_nodes);
+	bool hasQueuedLighting()
+	{
+		return !m_lighting_queue.empty() || !m_lighting_unloaded_blocks.empty();
+	}
+
 	/*
 		Node metadata
 		These are basically coordinate wrappers to MapBlock
@@ -332,6 +367,11 @@ class Map /*: public NodeContainer*/
 
 protected:
 	friend class LuaVoxelManip;
+	friend class MapSector;
+
+	// Called by MapSector when it gains or loses a block
+	void indexBlock(MapBlock *block);
+	void unindexBlock(MapBlock *block);
 
 	std::ostream &m_dout; // A bit deprecated, could be removed
 
@@ -345,17 +385,57 @@ class Map /*: public NodeContainer*/
 	MapSector *m_sector_cache;
 	v2s16 m_sector_cache_p;
 
+	// All blocks of m_sectors, for block lookups without the sector
+	MapBlockIndex m_block_index;
+	// Last block found, set to NULL when it is removed
+	MapBlock *m_block_cache;
+	v3s16 m_block_cache_p;
+
+	double m_usage_clock;
+	/*
+		The loaded blocks by the second of the usage clock at which they
+		were last used, as of when they were put in. A block is also used
+		later when it is in a bucket other than its getUsageBucket(),
+		timerUpdate() then moves it. Looking at the oldest buckets finds
+		the blocks to unload without going through all of them.
+	*/
+	std::map<u32, std::vector<v3s16> > m_usage_buckets;
+	// Where timerUpdate() continues looking for empty sectors
+	v2s16 m_sector_sweep_p;
+
 	// Queued transforming water nodes
 	UniqueQueue<v3s16> m_transforming_liquid;
 
+	// Changed nodes waiting for a lighting update
+	std::deque<v3s16> m_lighting_queue;
+	// The node each queued node replaced; a node changed again while
+	// queued keeps one entry with the light of both
+	std::map<v3s16, MapNode> m_lighting_queue_nodes;
+	// Number of queued nodes per block
+	std::map<v3s16, u32> m_lighting_queue_blocks;
+	// Blocks whose light changed when lighting was finished for unloading,
+	// reported by the next updateQueuedLighting()
+	std::set<v3s16> m_lighting_unloaded_blocks;
+
 	// This stores the properties of the nodes on the map.
 	INodeDefManager *m_nodedef;
 
 private:
+	void stopLiquidThreads();
+	// Puts a block into the bucket of its last use
+	void bucketBlock(MapBlock *block);
+	// Updates the queued lighting of the nodes of a block to be unloaded
+	void finishQueuedLighting(MapBlock *block);
+	// Saves and deletes a block, returns false if it has to stay
+	bool unloadBlock(MapBlock *block, bool save_before_unloading,
+		Profiler *modprofiler, u32 *saved_blocks_count);
+
 	f32 m_transforming_liquid_loop_count_multiplier;
 	u32 m_unprocessed_count;
 	u32 m_inc_trending_up_start_time; // milliseconds
 	bool m_queue_size_timer_started;
+	// Helpers of transformLiquids(), started as liquid_threads asks for
+	std::vector<LiquidTransformThread *> m_liquid_threads;
 
 	DISABLE_CLASS_COPY(Map);
 };
@@ -390,6 +470,8 @@ class ServerMap : public Map
 
 	/*
 		Blocks are generated by using these and makeBlock().
+		The nodes of data->vmanip have to be copied in with
+		MMVManip::copySnapshots() before makeBlock().
 	*/
 	bool initBlockMake(v3s16 blockpos, BlockMakeData *data);
 	void finishBlockMake(BlockMakeData *data,
@@ -535,6 +617,7 @@ class MMVManip : public VoxelManipulator
 	{
 		VoxelManipulator::clear();
 		m_loaded_blocks.clear();
+		dropSnapshots();
 	}
 
 	void setMap(Map *map)
@@ -543,10 +626,30 @@ class MMVManip : public VoxelManipulator
 	void initialEmerge(v3s16 blockpos_min, v3s16 blockpos_max,
 		bool load_if_inexistent = true);
 
+	/*
+		Like initialEmerge(), but only takes snapshots of the blocks.
+		Their nodes are copied in by copySnapshots(), which can be called
+		after the environment lock is released.
+	*/
+	void snapshotEmerge(v3s16 blockpos_min, v3s16 blockpos_max);
+	void copySnapshots();
+
 	// This is much faster with big chunks of generated data
 	void blitBackAll(std::map<v3s16, MapBlock*> * modified_blocks,
 		bool overwrite_generated = true);
 
+	/*
+		Like blitBackAll(), but only copies the blocks in which a node has
+		actually been changed.  If oldnodes is not NULL, the replaced node of
+		every change that can affect lighting is added to it, to be passed
+		to Map::updateChangedLighting(); other replaced nodes pass their
+		light on to the new node.  written_blocks, if not NULL, gets all
+		blocks of the area that exist in the map, changed or not.
+	*/
+	void blitBackChanged(std::map<v3s16, MapBlock*> *modified_blocks,
+		std::vector<std::pair<v3s16, MapNode> > *oldnodes,
+		std::map<v3s16, MapBlock*> *written_blocks = NULL);
+
 	bool m_is_dirty;
 
 protected:
@@ -557,6 +660,12 @@ class MMVManip : public VoxelManipulator
 		value = flags describing the block
 	*/
 	std::map<v3s16, u8> m_loaded_blocks;
+
+private:
+	void dropSnapshots();
+
+	// Taken by snapshotEmerge(), not copied in yet
+	std::vector<MapBlockSnapshot *> m_snapshots;
 };
 
 #endif
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapblock.h"
 
+#include <cstring>
 #include <sstream>
 #include "map.h"
 #include "light.h"
@@ -70,6 +71,12 @@ MapBlock::MapBlock(Map *parent, v3s16 pos, IGameDef *gamedef, bool dummy):
 		m_pos(pos),
 		m_pos_relative(pos * MAP_BLOCKSIZE),
 		m_gamedef(gamedef),
+		data(NULL),
+		m_palette_index_bits(0),
+		m_node_data_written(false),
+		m_pack_failed(false),
+		m_network_nodes_version(0),
+		m_snapshot(NULL),
 		m_modified(MOD_STATE_WRITE_NEEDED),
 		m_modified_reason(MOD_REASON_INITIAL),
 		is_underground(false),
@@ -79,10 +86,10 @@ MapBlock::MapBlock(Map *parent, v3s16 pos, IGameDef *gamedef, bool dummy):
 		m_generated(false),
 		m_timestamp(BLOCK_TIMESTAMP_UNDEFINED),
 		m_disk_timestamp(BLOCK_TIMESTAMP_UNDEFINED),
-		m_usage_timer(0),
+		m_last_used(0),
+		m_usage_bucket(0),
 		m_refcount(0)
 {
-	data = NULL;
 	if(dummy == false)
 		reallocate();
 
@@ -107,6 +114,17 @@ MapBlock::~MapBlock()
 
 	if(data)
 		delete[] data;
+	dropSnapshot();
+}
+
+void MapBlock::resetUsageTimer()
+{
+	m_last_used = m_parent ? m_parent->getUsageClock() : 0;
+}
+
+float MapBlock::getUsageTimer()
+{
+	return m_parent ? m_parent->getUsageClock() - m_last_used : 0;
 }
 
 bool MapBlock::isValidPositionParent(v3s16 p)
@@ -125,14 +143,14 @@ MapNode MapBlock::getNodeParent(v3s16 p, bool *is_valid_position)
 	if (isValidPosition(p) == false)
 		return m_parent->getNodeNoEx(getPosRelative() + p, is_valid_position);
 
-	if (data == NULL) {
+	if (isDummy()) {
 		if (is_valid_position)
 			*is_valid_position = false;
 		return MapNode(CONTENT_IGNORE);
 	}
 	if (is_valid_position)
 		*is_valid_position = true;
-	return data[p.Z * zstride + p.Y * ystride + p.X];
+	return getNodeAt(p.Z * zstride + p.Y * ystride + p.X);
 }
 
 std::string MapBlock::getModifiedReasonString()
@@ -357,8 +375,17 @@ void MapBlock::copyTo(VoxelManipulator &dst)
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
 	// Copy from data to VoxelManipulator
-	dst.copyFrom(data, data_area, v3s16(0,0,0),
+	if (data != NULL) {
+		dst.copyFrom(data, data_area, v3s16(0,0,0),
+				getPosRelative(), data_size);
+		return;
+	}
+
+	MapNode *nodes = new MapNode[nodecount];
+	copyNodes(nodes);
+	dst.copyFrom(nodes, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
+	delete[] nodes;
 }
 
 void MapBlock::copyFrom(VoxelManipulator &dst)
@@ -367,7 +394,7 @@ void MapBlock::copyFrom(VoxelManipulator &dst)
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
 	// Copy from VoxelManipulator to data
-	dst.copyTo(data, data_area, v3s16(0,0,0),
+	dst.copyTo(getWritableData(), data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
 }
 
@@ -378,18 +405,26 @@ void MapBlock::actuallyUpdateDayNightDiff()
 	// Running this function un-expires m_day_night_differs
 	m_day_night_differs_expired = false;
 
-	if (data == NULL) {
+	if (isDummy()) {
 		m_day_night_differs = false;
 		return;
 	}
 
-	bool differs;
+	// A palette holds every distinct node once
+	const MapNode *nodes = data;
+	u32 count = nodecount;
+	if (data == NULL) {
+		nodes = &m_palette[0];
+		count = m_palette.size();
+	}
+
+	bool differs = false;
 
 	/*
 		Check if any lighting value differs
 	*/
-	for (u32 i = 0; i < nodecount; i++) {
-		MapNode &n = data[i];
+	for (u32 i = 0; i < count; i++) {
+		const MapNode &n = nodes[i];
 
 		differs = !n.isLightDayNightEq(nodemgr);
 		if (differs)
@@ -402,8 +437,8 @@ void MapBlock::actuallyUpdateDayNightDiff()
 	*/
 	if (differs) {
 		bool only_air = true;
-		for (u32 i = 0; i < nodecount; i++) {
-			MapNode &n = data[i];
+		for (u32 i = 0; i < count; i++) {
+			const MapNode &n = nodes[i];
 			if (n.getContent() != CONTENT_AIR) {
 				only_air = false;
 				break;
@@ -421,7 +456,7 @@ void MapBlock::expireDayNightDiff()
 {
 	//INodeDefManager *nodemgr = m_gamedef->ndef();
 
-	if(data == NULL){
+	if(isDummy()){
 		m_day_night_differs = false;
 		m_day_night_differs_expired = false;
 		return;
@@ -430,16 +465,188 @@ void MapBlock::expireDayNightDiff()
 	m_day_night_differs_expired = true;
 }
 
+/*
+	Packs nodecount nodes into a palette of the distinct nodes and their
+	indices into it. Fails if there are more than 256 distinct nodes.
+*/
+static bool pack_nodes(const MapNode *nodes, std::vector<MapNode> &palette,
+	std::vector<u8> &packed_indices, u8 &bits)
+{
+	const u32 nodecount = MapBlock::nodecount;
+
+	// Small hash table from the packed nodes to their palette index
+	const u32 slot_count = 512;
+	u32 slot_keys[slot_count];
+	s16 slot_indices[slot_count];
+	for (u32 i = 0; i < slot_count; i++)
+		slot_indices[i] = -1;
+
+	palette.clear();
+	u8 *indices = new u8[nodecount];
+	u32 last_key = 0;
+	u8 last_index = 0;
+	for (u32 i = 0; i < nodecount; i++) {
+		const MapNode &n = nodes[i];
+		u32 key = ((u32)n.param0 << 16) | ((u32)n.param1 << 8) | n.param2;
+		// Nodes mostly come in runs
+		if (i > 0 && key == last_key) {
+			indices[i] = last_index;
+			continue;
+		}
+
+		u32 slot = (key * 2654435761U) >> 23;
+		while (slot_indices[slot] != -1 && slot_keys[slot] != key)
+			slot = (slot + 1) & (slot_count - 1);
+		if (slot_indices[slot] == -1) {
+			// Too many distinct nodes, the indices would not fit into a byte
+			if (palette.size() == 256) {
+				delete[] indices;
+				return false;
+			}
+			slot_keys[slot] = key;
+			slot_indices[slot] = palette.size();
+			palette.push_back(n);
+		}
+
+		last_key = key;
+		last_index = slot_indices[slot];
+		indices[i] = last_index;
+	}
+	// Give back what push_back reserved
+	std::vector<MapNode>(palette).swap(palette);
+
+	bits = 8;
+	if (palette.size() == 1)
+		bits = 0;
+	else if (palette.size() <= 2)
+		bits = 1;
+	else if (palette.size() <= 4)
+		bits = 2;
+	else if (palette.size() <= 16)
+		bits = 4;
+
+	packed_indices.assign(nodecount * bits / 8, 0);
+	if (bits > 0) {
+		for (u32 i = 0; i < nodecount; i++) {
+			u32 bit = i * bits;
+			packed_indices[bit >> 3] |= indices[i] << (bit & 7);
+		}
+	}
+	delete[] indices;
+	return true;
+}
+
+void MapBlock::compressNodeData()
+{
+	if (data == NULL || m_pack_failed)
+		return;
+
+	std::vector<MapNode> palette;
+	std::vector<u8> indices;
+	u8 bits;
+	if (!pack_nodes(data, palette, indices, bits)) {
+		m_pack_failed = true;
+		return;
+	}
+
+	m_palette.swap(palette);
+	m_palette_indices.swap(indices);
+	m_palette_index_bits = bits;
+
+	delete[] data;
+	data = NULL;
+}
+
+void MapBlock::decompressNodeData()
+{
+	MapNode *nodes = new MapNode[nodecount];
+	if (m_palette.empty()) {
+		// Dummy block
+		for (u32 i = 0; i < nodecount; i++)
+			nodes[i] = MapNode(CONTENT_IGNORE);
+	} else {
+		copyNodes(nodes);
+	}
+
+	data = nodes;
+	std::vector<MapNode>().swap(m_palette);
+	std::vector<u8>().swap(m_palette_indices);
+	m_palette_index_bits = 0;
+}
+
+void MapBlock::copyNodes(MapNode *dst)
+{
+	if (data != NULL) {
+		memcpy(dst, data, nodecount * sizeof(MapNode));
+	} else if (m_palette_index_bits == 0) {
+		for (u32 i = 0; i < nodecount; i++)
+			dst[i] = m_palette[0];
+	} else {
+		for (u32 i = 0; i < nodecount; i++)
+			dst[i] = getNodeAt(i);
+	}
+}
+
+u32 MapBlock::getNodeDataSize()
+{
+	if (data != NULL)
+		return nodecount * sizeof(MapNode);
+	return m_palette.capacity() * sizeof(MapNode) +
+		m_palette_indices.capacity();
+}
+
+bool MapBlock::mayContainContent(const std::vector<bool> &contents)
+{
+	if (data != NULL)
+		return true;
+	for (std::vector<MapNode>::const_iterator it = m_palette.begin();
+			it != m_palette.end(); ++it) {
+		content_t c = it->getContent();
+		if (c < contents.size() && contents[c])
+			return true;
+	}
+	return false;
+}
+
+MapBlockSnapshot *MapBlock::getSnapshot()
+{
+	if (isDummy())
+		return NULL;
+
+	if (m_snapshot == NULL) {
+		MapBlockSnapshot *snapshot = new MapBlockSnapshot(m_pos);
+		if (data == NULL) {
+			// Packed nodes only have to be copied
+			snapshot->m_palette = m_palette;
+			snapshot->m_palette_indices = m_palette_indices;
+			snapshot->m_palette_index_bits = m_palette_index_bits;
+		} else if (m_pack_failed || !pack_nodes(data, snapshot->m_palette,
+				snapshot->m_palette_indices,
+				snapshot->m_palette_index_bits)) {
+			snapshot->m_palette.assign(data, data + nodecount);
+			snapshot->m_palette_indices.clear();
+			snapshot->m_palette_index_bits = 0;
+		}
+		m_snapshot = snapshot;
+	}
+
+	m_snapshot->grab();
+	return m_snapshot;
+}
+
 s16 MapBlock::getGroundLevel(v2s16 p2d)
 {
 	if(isDummy())
 		return -3;
 	try
 	{
+		bool is_valid_position;
 		s16 y = MAP_BLOCKSIZE-1;
 		for(; y>=0; y--)
 		{
-			MapNode n = getNodeRef(p2d.X, y, p2d.Y);
+			MapNode n = getNode(p2d.X, y, p2d.Y, &is_valid_position);
+			if(!is_valid_position)
+				return -3;
 			if(m_gamedef->ndef()->get(n).walkable)
 			{
 				if(y == MAP_BLOCKSIZE-1)
@@ -456,6 +663,47 @@ s16 MapBlock::getGroundLevel(v2s16 p2d)
 	}
 }
 
+/*
+	MapBlockSnapshot
+*/
+
+void MapBlockSnapshot::copyNodes(MapNode *dst) const
+{
+	if (m_palette.size() == nodecount) {
+		memcpy(dst, &m_palette[0], nodecount * sizeof(MapNode));
+	} else if (m_palette_index_bits == 0) {
+		for (u32 i = 0; i < nodecount; i++)
+			dst[i] = m_palette[0];
+	} else {
+		for (u32 i = 0; i < nodecount; i++)
+			dst[i] = getNodeAt(i);
+	}
+}
+
+void MapBlockSnapshot::copyTo(VoxelManipulator &dst) const
+{
+	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
+	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
+
+	if (m_palette.size() == nodecount) {
+		dst.copyFrom(&m_palette[0], data_area, v3s16(0,0,0),
+				getPosRelative(), data_size);
+		return;
+	}
+
+	MapNode *nodes = new MapNode[nodecount];
+	copyNodes(nodes);
+	dst.copyFrom(nodes, data_area, v3s16(0,0,0),
+			getPosRelative(), data_size);
+	delete[] nodes;
+}
+
+u32 MapBlockSnapshot::getDataSize() const
+{
+	return m_palette.capacity() * sizeof(MapNode) +
+		m_palette_indices.capacity();
+}
+
 /*
 	Serialization
 */
@@ -558,7 +806,7 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
 
-	if(data == NULL)
+	if(isDummy())
 	{
 		throw SerializationError("ERROR: Not writing dummy block.");
 	}
@@ -584,8 +832,7 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 	if(disk)
 	{
 		MapNode *tmp_nodes = new MapNode[nodecount];
-		for(u32 i=0; i<nodecount; i++)
-			tmp_nodes[i] = data[i];
+		copyNodes(tmp_nodes);
 		getBlockNodeIdMapping(&nimap, tmp_nodes, m_gamedef->ndef());
 
 		u8 content_width = 2;
@@ -602,16 +849,37 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 		u8 params_width = 2;
 		writeU8(os, content_width);
 		writeU8(os, params_width);
-		MapNode::serializeBulk(os, version, data, nodecount,
-				content_width, params_width, true);
+
+		// The nodes are compressed again only after they were written to
+		if (m_network_nodes.empty() || m_network_nodes_version != version) {
+			MapNode *nodes = data;
+			if (nodes == NULL) {
+				nodes = new MapNode[nodecount];
+				copyNodes(nodes);
+			}
+
+			std::ostringstream oss(std::ios_base::binary);
+			MapNode::serializeBulk(oss, version, nodes, nodecount,
+					content_width, params_width, true);
+			m_network_nodes = oss.str();
+			m_network_nodes_version = version;
+
+			if (nodes != data)
+				delete[] nodes;
+		}
+		os << m_network_nodes;
 	}
 
 	/*
 		Node metadata
 	*/
-	std::ostringstream oss(std::ios_base::binary);
-	m_node_metadata.serialize(oss);
-	compressZlib(oss.str(), os);
+	if (!m_node_metadata_data.empty()) {
+		os << m_node_metadata_data;
+	} else {
+		std::ostringstream oss(std::ios_base::binary);
+		m_node_metadata.serialize(oss);
+		compressZlib(oss.str(), os);
+	}
 
 	/*
 		Data that goes to disk, but not the network
@@ -620,11 +888,14 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 	{
 		if(version <= 24){
 			// Node timers
-			m_node_timers.serialize(os, version);
+			getNodeTimerList().serialize(os, version);
 		}
 
 		// Static objects
-		m_static_objects.serialize(os);
+		if (!m_static_objects_data.empty())
+			os << m_static_objects_data;
+		else
+			m_static_objects.serialize(os);
 
 		// Timestamp
 		writeU32(os, getTimestamp());
@@ -634,14 +905,17 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 
 		if(version >= 25){
 			// Node timers
-			m_node_timers.serialize(os, version);
+			if (!m_node_timers_data.empty())
+				os << m_node_timers_data;
+			else
+				m_node_timers.serialize(os, version);
 		}
 	}
 }
 
 void MapBlock::serializeNetworkSpecific(std::ostream &os, u16 net_proto_version)
 {
-	if(data == NULL)
+	if(isDummy())
 	{
 		throw SerializationError("ERROR: Not writing dummy block.");
 	}
@@ -663,9 +937,18 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 
 	m_day_night_differs_expired = false;
 
+	// The nodes are read into data
+	getWritableData();
+
+	// Drop what is left of earlier data
+	m_node_metadata_data.clear();
+	m_node_timers_data.clear();
+	m_static_objects_data.clear();
+
 	if(version <= 21)
 	{
 		deSerialize_pre22(is, version, disk);
+		compressNodeData();
 		return;
 	}
 
@@ -696,16 +979,29 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 			<<": Node metadata"<<std::endl);
 	// Ignore errors
 	try {
-		std::ostringstream oss(std::ios_base::binary);
-		decompressZlib(is, oss);
-		std::istringstream iss(oss.str(), std::ios_base::binary);
-		if (version >= 23)
-			m_node_metadata.deSerialize(iss, m_gamedef->idef());
-		else
-			content_nodemeta_deserialize_legacy(iss,
-				&m_node_metadata, &m_node_timers,
-				m_gamedef->idef());
+		std::streampos start = is.tellg();
+		if (version >= 23 && start != std::streampos(-1)) {
+			// Keep the compressed metadata, it is parsed when used
+			std::ostream discard(NULL);
+			decompressZlib(is, discard);
+			std::streampos end = is.tellg();
+			is.seekg(start);
+			m_node_metadata.clear();
+			m_node_metadata_data.resize(end - start);
+			is.read(&m_node_metadata_data[0], end - start);
+		} else {
+			std::ostringstream oss(std::ios_base::binary);
+			decompressZlib(is, oss);
+			std::istringstream iss(oss.str(), std::ios_base::binary);
+			if (version >= 23)
+				m_node_metadata.deSerialize(iss, m_gamedef->idef());
+			else
+				content_nodemeta_deserialize_legacy(iss,
+					&m_node_metadata, &m_node_timers,
+					m_gamedef->idef());
+		}
 	} catch(SerializationError &e) {
+		m_node_metadata_data.clear();
 		warningstream<<"MapBlock::deSerialize(): Ignoring an error"
 				<<" while deserializing node metadata at ("
 				<<PP(getPos())<<": "<<e.what()<<std::endl;
@@ -730,7 +1026,7 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 		// Static objects
 		TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())
 				<<": Static objects"<<std::endl);
-		m_static_objects.deSerialize(is);
+		m_static_objects_data = StaticObjectList::readSerialized(is);
 
 		// Timestamp
 		TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())
@@ -748,14 +1044,55 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 		if(version >= 25){
 			TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())
 					<<": Node timers (ver>=25)"<<std::endl);
-			m_node_timers.deSerialize(is, version);
+			m_node_timers.clear();
+			m_node_timers_data = NodeTimerList::readSerialized(is, version);
 		}
 	}
 
+	compressNodeData();
+
 	TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())
 			<<": Done."<<std::endl);
 }
 
+void MapBlock::loadNodeMetadata()
+{
+	std::string data;
+	data.swap(m_node_metadata_data);
+
+	// Ignore errors, as when loading the block
+	try {
+		std::istringstream is(data, std::ios_base::binary);
+		std::ostringstream oss(std::ios_base::binary);
+		decompressZlib(is, oss);
+		std::istringstream iss(oss.str(), std::ios_base::binary);
+		m_node_metadata.deSerialize(iss, m_gamedef->idef());
+	} catch(SerializationError &e) {
+		warningstream<<"MapBlock::loadNodeMetadata(): Ignoring an error"
+				<<" while deserializing node metadata at ("
+				<<PP(getPos())<<": "<<e.what()<<std::endl;
+	}
+}
+
+void MapBlock::loadNodeTimers()
+{
+	std::string data;
+	data.swap(m_node_timers_data);
+
+	std::istringstream is(data, std::ios_base::binary);
+	// The data is in the format of version 25 and later
+	m_node_timers.deSerialize(is, SER_FMT_VER_HIGHEST_READ);
+}
+
+void MapBlock::loadStaticObjects()
+{
+	std::string data;
+	data.swap(m_static_objects_data);
+
+	std::istringstream is(data, std::ios_base::binary);
+	m_static_objects.deSerialize(is);
+}
+
 void MapBlock::deSerializeNetworkSpecific(std::istream &is)
 {
 	try {
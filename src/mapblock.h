@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define MAPBLOCK_HEADER
 
 #include <set>
+#include <vector>
 #include "debug.h"
 #include "irr_v3d.h"
 #include "mapnode.h"
@@ -32,6 +33,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "modifiedstate.h"
 #include "util/numeric.h" // getContainerPos
 #include "settings.h"
+#include "threading/atomic.h"
 
 class Map;
 class NodeMetadataList;
@@ -123,6 +125,101 @@ class NodeContainer
 #define MOD_REASON_EXPIRE_DAYNIGHTDIFF       (1 << 18)
 #define MOD_REASON_UNKNOWN                   (1 << 19)
 
+////
+//// MapBlockSnapshot
+////
+
+// Index i of the palette indices, packed into bits bits each
+inline u32 unpackPaletteIndex(const std::vector<u8> &indices, u8 bits, u32 i)
+{
+	u32 bit = i * bits;
+	return (indices[bit >> 3] >> (bit & 7)) & ((1 << bits) - 1);
+}
+
+/*
+	The nodes of a block as they were at one point in time, for reading
+	them without the environment lock, e.g. in the emerge threads.
+
+	A snapshot is never changed once made. The block keeps the snapshot
+	it made last and hands it out again until its nodes are written to;
+	every user grabs it and the last one to drop it deletes it.
+*/
+class MapBlockSnapshot
+{
+public:
+	inline v3s16 getPos() const
+	{
+		return m_pos;
+	}
+
+	inline v3s16 getPosRelative() const
+	{
+		return m_pos * MAP_BLOCKSIZE;
+	}
+
+	// p is relative to the block; outside of it CONTENT_IGNORE is returned
+	inline MapNode getNode(v3s16 p) const
+	{
+		if (p.X < 0 || p.X >= MAP_BLOCKSIZE || p.Y < 0 ||
+				p.Y >= MAP_BLOCKSIZE || p.Z < 0 || p.Z >= MAP_BLOCKSIZE)
+			return MapNode(CONTENT_IGNORE);
+		return getNodeAt((p.Z * MAP_BLOCKSIZE + p.Y) * MAP_BLOCKSIZE + p.X);
+	}
+
+	// Copies all nodes to dst, which has room for nodecount nodes
+	void copyNodes(MapNode *dst) const;
+	// Copies the nodes to VoxelManipulator to getPosRelative()
+	void copyTo(VoxelManipulator &dst) const;
+
+	// Memory used by the nodes, in bytes
+	u32 getDataSize() const;
+
+	void grab()
+	{
+		++m_refcount;
+	}
+
+	void drop()
+	{
+		if (--m_refcount == 0)
+			delete this;
+	}
+
+	static const u32 nodecount = MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
+
+private:
+	friend class MapBlock;
+
+	// Made by MapBlock::getSnapshot(), which fills in the nodes
+	MapBlockSnapshot(v3s16 pos):
+		m_pos(pos),
+		m_palette_index_bits(0),
+		m_refcount(1)
+	{}
+
+	~MapBlockSnapshot() {}
+
+	inline const MapNode &getNodeAt(u32 i) const
+	{
+		if (m_palette_index_bits == 0)
+			return m_palette.size() == nodecount ? m_palette[i] : m_palette[0];
+		return m_palette[unpackPaletteIndex(m_palette_indices,
+			m_palette_index_bits, i)];
+	}
+
+	v3s16 m_pos;
+
+	/*
+		The nodes as a palette, like in MapBlock. Nodes that do not fit
+		into one are kept as they are, in a "palette" of nodecount nodes.
+	*/
+	std::vector<MapNode> m_palette;
+	std::vector<u8> m_palette_indices;
+	u8 m_palette_index_bits;
+
+	Atomic<u32> m_refcount;
+};
+
 ////
 //// MapBlock itself
 ////
@@ -143,16 +240,57 @@ class MapBlock /*: public NodeContainer*/
 		return m_parent;
 	}
 
+	// Fills the block with CONTENT_IGNORE, as a uniform block
 	void reallocate()
 	{
 		delete[] data;
-		data = new MapNode[nodecount];
-		for (u32 i = 0; i < nodecount; i++)
-			data[i] = MapNode(CONTENT_IGNORE);
+		data = NULL;
+		m_palette.assign(1, MapNode(CONTENT_IGNORE));
+		m_palette_indices.clear();
+		m_palette_index_bits = 0;
+		std::string().swap(m_network_nodes);
+		dropSnapshot();
 
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_REALLOCATE);
 	}
 
+	////
+	//// Node data compression (see data)
+	////
+
+	// Packs the node data into a palette if that takes less memory
+	void compressNodeData();
+
+	inline bool isNodeDataCompressed()
+	{
+		return !m_palette.empty();
+	}
+
+	// Memory used by the node data, in bytes
+	u32 getNodeDataSize();
+
+	/*
+		Whether the block may have a node of a content c for which
+		contents[c] is set. Only blocks with packed node data can tell
+		from their palette that they don't; dummy blocks have no nodes.
+	*/
+	bool mayContainContent(const std::vector<bool> &contents);
+
+	// Whether nodes were written since the last call
+	inline bool checkNodeDataWritten()
+	{
+		bool written = m_node_data_written;
+		m_node_data_written = false;
+		return written;
+	}
+
+	/*
+		Returns the nodes as they are now, for reading them later without
+		the environment lock, or NULL for dummy blocks. The caller has to
+		drop() the snapshot.
+	*/
+	MapBlockSnapshot *getSnapshot();
+
 	////
 	//// Modification tracking methods
 	////
@@ -192,7 +330,7 @@ class MapBlock /*: public NodeContainer*/
 
 	inline bool isDummy()
 	{
-		return (data == NULL);
+		return (data == NULL && m_palette.empty());
 	}
 
 	inline void unDummify()
@@ -243,7 +381,7 @@ class MapBlock /*: public NodeContainer*/
 	{
 		if (m_lighting_expired)
 			return false;
-		if (data == NULL)
+		if (isDummy())
 			return false;
 		return true;
 	}
@@ -276,7 +414,7 @@ class MapBlock /*: public NodeContainer*/
 
 	inline bool isValidPosition(s16 x, s16 y, s16 z)
 	{
-		return data != NULL
+		return !isDummy()
 			&& x >= 0 && x < MAP_BLOCKSIZE
 			&& y >= 0 && y < MAP_BLOCKSIZE
 			&& z >= 0 && z < MAP_BLOCKSIZE;
@@ -294,7 +432,7 @@ class MapBlock /*: public NodeContainer*/
 		if (!*valid_position)
 			return MapNode(CONTENT_IGNORE);
 
-		return data[z * zstride + y * ystride + x];
+		return getNodeAt(z * zstride + y * ystride + x);
 	}
 
 	inline MapNode getNode(v3s16 p, bool *valid_position)
@@ -313,7 +451,7 @@ class MapBlock /*: public NodeContainer*/
 		if (!isValidPosition(x, y, z))
 			throw InvalidPositionException();
 
-		data[z * zstride + y * ystride + x] = n;
+		getWritableData()[z * zstride + y * ystride + x] = n;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
 	}
 
@@ -328,11 +466,11 @@ class MapBlock /*: public NodeContainer*/
 
 	inline MapNode getNodeNoCheck(s16 x, s16 y, s16 z, bool *valid_position)
 	{
-		*valid_position = data != NULL;
-		if (!valid_position)
+		*valid_position = !isDummy();
+		if (!*valid_position)
 			return MapNode(CONTENT_IGNORE);
 
-		return data[z * zstride + y * ystride + x];
+		return getNodeAt(z * zstride + y * ystride + x);
 	}
 
 	inline MapNode getNodeNoCheck(v3s16 p, bool *valid_position)
@@ -346,22 +484,23 @@ class MapBlock /*: public NodeContainer*/
 	//// Caller must ensure that this is not a dummy block (by calling isDummy())
 	////
 
-	inline const MapNode &getNodeUnsafe(s16 x, s16 y, s16 z)
+	// Returns a copy, as writes can unpack the node data
+	inline MapNode getNodeUnsafe(s16 x, s16 y, s16 z)
 	{
-		return data[z * zstride + y * ystride + x];
+		return getNodeAt(z * zstride + y * ystride + x);
 	}
 
-	inline const MapNode &getNodeUnsafe(v3s16 &p)
+	inline MapNode getNodeUnsafe(v3s16 &p)
 	{
 		return getNodeUnsafe(p.X, p.Y, p.Z);
 	}
 
 	inline void setNodeNoCheck(s16 x, s16 y, s16 z, MapNode & n)
 	{
-		if (data == NULL)
+		if (isDummy())
 			throw InvalidPositionException();
 
-		data[z * zstride + y * ystride + x] = n;
+		getWritableData()[z * zstride + y * ystride + x] = n;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE_NO_CHECK);
 	}
 
@@ -452,22 +591,27 @@ class MapBlock /*: public NodeContainer*/
 	}
 
 	////
-	//// Usage timer (see m_usage_timer)
+	//// Usage timer (see m_last_used)
 	////
 
-	inline void resetUsageTimer()
+	void resetUsageTimer();
+	// Seconds since the block was last used
+	float getUsageTimer();
+	// The usage clock of the parent Map when the block was last used
+	inline double getLastUsed()
 	{
-		m_usage_timer = 0;
+		return m_last_used;
 	}
 
-	inline void incrementUsageTimer(float dtime)
+	// The bucket of Map::m_usage_buckets the block is in
+	inline u32 getUsageBucket()
 	{
-		m_usage_timer += dtime;
+		return m_usage_bucket;
 	}
 
-	inline float getUsageTimer()
+	inline void setUsageBucket(u32 bucket)
 	{
-		return m_usage_timer;
+		m_usage_bucket = bucket;
 	}
 
 	////
@@ -495,22 +639,49 @@ class MapBlock /*: public NodeContainer*/
 
 	inline NodeTimer getNodeTimer(v3s16 p)
 	{
-		return m_node_timers.get(p);
+		return getNodeTimerList().get(p);
 	}
 
 	inline void removeNodeTimer(v3s16 p)
 	{
-		m_node_timers.remove(p);
+		getNodeTimerList().remove(p);
 	}
 
 	inline void setNodeTimer(const NodeTimer &t)
 	{
-		m_node_timers.set(t);
+		getNodeTimerList().set(t);
 	}
 
 	inline void clearNodeTimers()
 	{
-		m_node_timers.clear();
+		getNodeTimerList().clear();
+	}
+
+	////
+	//// Node metadata, node timers and static objects
+	////
+
+	// Loaded blocks keep these serialized until they are used
+
+	inline NodeMetadataList &getNodeMetadataList()
+	{
+		if (!m_node_metadata_data.empty())
+			loadNodeMetadata();
+		return m_node_metadata;
+	}
+
+	inline NodeTimerList &getNodeTimerList()
+	{
+		if (!m_node_timers_data.empty())
+			loadNodeTimers();
+		return m_node_timers;
+	}
+
+	inline StaticObjectList &getStaticObjectList()
+	{
+		if (!m_static_objects_data.empty())
+			loadStaticObjects();
+		return m_static_objects;
 	}
 
 	////
@@ -534,6 +705,46 @@ class MapBlock /*: public NodeContainer*/
 
 	void deSerialize_pre22(std::istream &is, u8 version, bool disk);
 
+	void loadNodeMetadata();
+	void loadNodeTimers();
+	void loadStaticObjects();
+
+	// Node i, in z-y-x order, of a block that is not a dummy
+	inline const MapNode &getNodeAt(u32 i)
+	{
+		if (data != NULL)
+			return data[i];
+		if (m_palette_index_bits == 0)
+			return m_palette[0];
+		return m_palette[unpackPaletteIndex(m_palette_indices,
+			m_palette_index_bits, i)];
+	}
+
+	// Returns data for writing, unpacking the palette if needed
+	inline MapNode *getWritableData()
+	{
+		if (data == NULL)
+			decompressNodeData();
+		m_node_data_written = true;
+		m_pack_failed = false;
+		if (!m_network_nodes.empty())
+			std::string().swap(m_network_nodes);
+		dropSnapshot();
+		return data;
+	}
+
+	// Forgets the last snapshot, its users keep it until they drop it
+	inline void dropSnapshot()
+	{
+		if (m_snapshot != NULL)
+			m_snapshot->drop();
+		m_snapshot = NULL;
+	}
+
+	void decompressNodeData();
+	// Copies all nodes to dst, which has room for nodecount nodes
+	void copyNodes(MapNode *dst);
+
 	/*
 		Used only internally, because changes can't be tracked
 	*/
@@ -543,7 +754,7 @@ class MapBlock /*: public NodeContainer*/
 		if (!isValidPosition(x, y, z))
 			throw InvalidPositionException();
 
-		return data[z * zstride + y * ystride + x];
+		return getWritableData()[z * zstride + y * ystride + x];
 	}
 
 	inline MapNode &getNodeRef(v3s16 &p)
@@ -560,10 +771,6 @@ class MapBlock /*: public NodeContainer*/
 	MapBlockMesh *mesh;
 #endif
 
-	NodeMetadataList m_node_metadata;
-	NodeTimerList m_node_timers;
-	StaticObjectList m_static_objects;
-
 	static const u32 ystride = MAP_BLOCKSIZE;
 	static const u32 zstride = MAP_BLOCKSIZE * MAP_BLOCKSIZE;
 
@@ -590,10 +797,48 @@ class MapBlock /*: public NodeContainer*/
 	IGameDef *m_gamedef;
 
 	/*
-		If NULL, block is a dummy block.
+		The nodes are stored either unpacked in data, or as a palette of
+		the distinct nodes, with each node given by its index in the
+		palette. The indices take m_palette_index_bits (0, 1, 2, 4 or 8)
+		bits each; blocks made of a single node have no indices at all.
+
+		Blocks are packed when they are loaded and while nodes are not
+		written to them, writing unpacks them.
+
+		If both are empty, block is a dummy block.
 		Dummy blocks are used for caching not-found-on-disk blocks.
 	*/
 	MapNode *data;
+	std::vector<MapNode> m_palette;
+	std::vector<u8> m_palette_indices;
+	u8 m_palette_index_bits;
+	bool m_node_data_written;
+	// The unpacked nodes have too many distinct nodes for a palette, so
+	// they aren't packed again until they are written to
+	bool m_pack_failed;
+
+	/*
+		The compressed nodes as last sent to clients, in the serialization
+		version m_network_nodes_version. Dropped when nodes are written.
+	*/
+	std::string m_network_nodes;
+	u8 m_network_nodes_version;
+
+	// The snapshot of the nodes handed out last, NULL once they changed
+	MapBlockSnapshot *m_snapshot;
+
+	NodeMetadataList m_node_metadata;
+	NodeTimerList m_node_timers;
+	StaticObjectList m_static_objects;
+
+	/*
+		The parts of a block loaded from disk that were not used since,
+		as they were read: the compressed node metadata, the node timers
+		and the static objects. Empty once parsed.
+	*/
+	std::string m_node_metadata_data;
+	std::string m_node_timers_data;
+	std::string m_static_objects_data;
 
 	/*
 		- On the server, this is used for telling whether the
@@ -637,10 +882,12 @@ class MapBlock /*: public NodeContainer*/
 	u32 m_disk_timestamp;
 
 	/*
-		When the block is accessed, this is set to 0.
-		Map will unload the block when this reaches a timeout.
+		When the block is accessed, this is set to the usage clock of the
+		parent Map. Map unloads the block when it has not been used for a
+		timeout.
 	*/
-	float m_usage_timer;
+	double m_last_used;
+	u32 m_usage_bucket;
 
 	/*
 		Reference count; currently used for determining if this block is in
@@ -0,0 +1,103 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "mapblock_index.h"
+
+#define MAPBLOCK_INDEX_MIN_CAPACITY 64
+
+MapBlockIndex::MapBlockIndex() :
+	m_entries(MAPBLOCK_INDEX_MIN_CAPACITY),
+	m_mask(MAPBLOCK_INDEX_MIN_CAPACITY - 1),
+	m_size(0)
+{
+}
+
+void MapBlockIndex::insert(v3s16 p, MapBlock *block)
+{
+	if ((m_size + 1) * 2 > m_entries.size())
+		resize(m_entries.size() * 2);
+
+	u64 key = packKey(p);
+	u32 i = hashKey(key) & m_mask;
+	for (; m_entries[i].block != NULL; i = (i + 1) & m_mask) {
+		if (m_entries[i].key == key) {
+			m_entries[i].block = block;
+			return;
+		}
+	}
+
+	m_entries[i].key = key;
+	m_entries[i].block = block;
+	m_size++;
+}
+
+bool MapBlockIndex::remove(v3s16 p)
+{
+	u64 key = packKey(p);
+	u32 i = hashKey(key) & m_mask;
+	for (;; i = (i + 1) & m_mask) {
+		if (m_entries[i].block == NULL)
+			return false;
+		if (m_entries[i].key == key)
+			break;
+	}
+
+	// Move back the following entries that could not be put into slot i
+	u32 j = i;
+	for (;;) {
+		j = (j + 1) & m_mask;
+		if (m_entries[j].block == NULL)
+			break;
+		// An entry may stay if its home slot lies cyclically in (i, j]
+		u32 home = hashKey(m_entries[j].key) & m_mask;
+		bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+		if (stays)
+			continue;
+		m_entries[i] = m_entries[j];
+		i = j;
+	}
+
+	m_entries[i] = Entry();
+	m_size--;
+	return true;
+}
+
+void MapBlockIndex::clear()
+{
+	std::vector<Entry>(MAPBLOCK_INDEX_MIN_CAPACITY).swap(m_entries);
+	m_mask = MAPBLOCK_INDEX_MIN_CAPACITY - 1;
+	m_size = 0;
+}
+
+void MapBlockIndex::resize(u32 capacity)
+{
+	std::vector<Entry> entries(capacity);
+	entries.swap(m_entries);
+	m_mask = capacity - 1;
+
+	for (std::vector<Entry>::const_iterator it = entries.begin();
+			it != entries.end(); ++it) {
+		if (it->block == NULL)
+			continue;
+		u32 i = hashKey(it->key) & m_mask;
+		while (m_entries[i].block != NULL)
+			i = (i + 1) & m_mask;
+		m_entries[i] = *it;
+	}
+}
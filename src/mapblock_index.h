@@ -0,0 +1,94 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MAPBLOCK_INDEX_HEADER
+#define MAPBLOCK_INDEX_HEADER
+
+#include <vector>
+#include "irrlichttypes.h"
+#include "irr_v3d.h"
+
+class MapBlock;
+
+/*
+	Hash table of the loaded MapBlocks of a Map, by block position.
+
+	Open addressing with linear probing in a single array, so that a lookup
+	is a hash and usually one or two cache lines. The table is kept at most
+	half full, so that there always is an empty slot ending a probe.
+	Removal shifts the following entries back instead of leaving tombstones.
+
+	Does not own the blocks; they are owned by their MapSector.
+*/
+class MapBlockIndex
+{
+public:
+	MapBlockIndex();
+
+	// Returns NULL if there is no block at p
+	inline MapBlock *get(v3s16 p) const
+	{
+		u64 key = packKey(p);
+		for (u32 i = hashKey(key) & m_mask; ; i = (i + 1) & m_mask) {
+			const Entry &entry = m_entries[i];
+			if (entry.block == NULL)
+				return NULL;
+			if (entry.key == key)
+				return entry.block;
+		}
+	}
+
+	// Replaces a block at the same position
+	void insert(v3s16 p, MapBlock *block);
+	// Returns false if there was no block at p
+	bool remove(v3s16 p);
+	void clear();
+
+	u32 size() const { return m_size; }
+	u32 capacity() const { return m_entries.size(); }
+
+private:
+	struct Entry {
+		Entry() : key(0), block(NULL) {}
+
+		u64 key;
+		// NULL if the slot is empty
+		MapBlock *block;
+	};
+
+	static inline u64 packKey(v3s16 p)
+	{
+		return (u64)(u16)p.X | ((u64)(u16)p.Y << 16) | ((u64)(u16)p.Z << 32);
+	}
+
+	// Fibonacci hashing, neighbouring blocks end up in different slots
+	static inline u32 hashKey(u64 key)
+	{
+		return (u32)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+	}
+
+	void resize(u32 capacity);
+
+	std::vector<Entry> m_entries;
+	// m_entries.size() - 1, the size is a power of two
+	u32 m_mask;
+	u32 m_size;
+};
+
+#endif
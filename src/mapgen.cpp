@@ -39,6 +39,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/numeric.h"
 #include "filesys.h"
 #include "log.h"
+#include "threading/thread.h"
 #include "mapgen_flat.h"
 #include "mapgen_fractal.h"
 #include "mapgen_v5.h"
@@ -49,6 +50,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "cavegen.h"
 #include "dungeongen.h"
 
+// Flags in Mapgen::m_light_props; the high nibble holds the light source
+#define LIGHTPROP_PROPAGATES          0x01
+#define LIGHTPROP_SUNLIGHT_PROPAGATES 0x02
+
 FlagDesc flagdesc_mapgen[] = {
 	{"caves",       MG_CAVES},
 	{"dungeons",    MG_DUNGEONS},
@@ -108,6 +113,8 @@ Mapgen::Mapgen()
 	biomegen  = NULL;
 	biomemap  = NULL;
 	heightmap = NULL;
+
+	m_light_props_ndef = NULL;
 }
 
 
@@ -140,6 +147,8 @@ Mapgen::Mapgen(int mapgenid, MapgenParams *params, EmergeManager *emerge) :
 	biomegen  = NULL;
 	biomemap  = NULL;
 	heightmap = NULL;
+
+	m_light_props_ndef = NULL;
 }
 
 
@@ -417,12 +426,33 @@ void Mapgen::setLighting(u8 light, v3s16 nmin, v3s16 nmax)
 }
 
 
-void Mapgen::lightSpread(VoxelArea &a, v3s16 p, u8 light)
+void Mapgen::updateLightProps()
+{
+	if (m_light_props_ndef == ndef)
+		return;
+
+	// Index directly by content_t, the table covers every possible value
+	m_light_props.resize(0x10000);
+	for (u32 c = 0; c < 0x10000; c++) {
+		const ContentFeatures &cf = ndef->get((content_t)c);
+		u8 props = 0;
+		if (cf.light_propagates)
+			props |= LIGHTPROP_PROPAGATES;
+		if (cf.sunlight_propagates)
+			props |= LIGHTPROP_SUNLIGHT_PROPAGATES;
+		props |= (cf.light_source & 0x0F) << 4;
+		m_light_props[c] = props;
+	}
+
+	m_light_props_ndef = ndef;
+}
+
+
+void Mapgen::lightSpread(const VoxelArea &a, u32 vi, v3s16 p, u8 light)
 {
-	if (light <= 1 || !a.contains(p))
+	if (!a.contains(p))
 		return;
 
-	u32 vi = vm->m_area.index(p);
 	MapNode &n = vm->m_data[vi];
 
 	// Decay light in each of the banks separately
@@ -438,23 +468,47 @@ void Mapgen::lightSpread(VoxelArea &a, v3s16 p, u8 light)
 	// we hit a solid block that light cannot pass through.
 	if ((light_day  <= (n.param1 & 0x0F) &&
 		light_night <= (n.param1 & 0xF0)) ||
-		!ndef->get(n).light_propagates)
+		!(m_light_props[n.getContent()] & LIGHTPROP_PROPAGATES))
 		return;
 
-	// Since this recursive function only terminates when there is no light from
-	// either bank left, we need to take the max of both banks into account for
-	// the case where spreading has stopped for one light bank but not the other.
+	// Spreading only stops when there is no light left in either bank, so the
+	// max of both banks has to be taken for the case where spreading has
+	// stopped for one light bank but not the other.
 	light = MYMAX(light_day, n.param1 & 0x0F) |
 			MYMAX(light_night, n.param1 & 0xF0);
 
 	n.param1 = light;
 
-	lightSpread(a, p + v3s16(0, 0, 1), light);
-	lightSpread(a, p + v3s16(0, 1, 0), light);
-	lightSpread(a, p + v3s16(1, 0, 0), light);
-	lightSpread(a, p - v3s16(0, 0, 1), light);
-	lightSpread(a, p - v3s16(0, 1, 0), light);
-	lightSpread(a, p - v3s16(1, 0, 0), light);
+	if (light > 1) {
+		LightQueueEntry e = {vi, p, light};
+		m_light_queue.push_back(e);
+	}
+}
+
+
+void Mapgen::spreadLightFromQueue(const VoxelArea &a)
+{
+	v3s16 em = vm->m_area.getExtent();
+	u32 ystride = em.X;
+	u32 zstride = (u32)em.X * em.Y;
+
+	// The queue is processed first-in first-out; entries appended while
+	// processing are picked up by the same loop.  Since light only ever
+	// increases while spreading, the order in which nodes are visited does
+	// not influence the result.
+	for (size_t head = 0; head < m_light_queue.size(); head++) {
+		LightQueueEntry e = m_light_queue[head];
+		v3s16 p = e.p;
+
+		lightSpread(a, e.vi + zstride, v3s16(p.X,     p.Y,     p.Z + 1), e.light);
+		lightSpread(a, e.vi + ystride, v3s16(p.X,     p.Y + 1, p.Z    ), e.light);
+		lightSpread(a, e.vi + 1,       v3s16(p.X + 1, p.Y,     p.Z    ), e.light);
+		lightSpread(a, e.vi - zstride, v3s16(p.X,     p.Y,     p.Z - 1), e.light);
+		lightSpread(a, e.vi - ystride, v3s16(p.X,     p.Y - 1, p.Z    ), e.light);
+		lightSpread(a, e.vi - 1,       v3s16(p.X - 1, p.Y,     p.Z    ), e.light);
+	}
+
+	m_light_queue.clear();
 }
 
 
@@ -476,15 +530,24 @@ void Mapgen::propagateSunlight(v3s16 nmin, v3s16 nmax, bool propagate_shadow)
 	//TimeTaker t("propagateSunlight");
 	VoxelArea a(nmin, nmax);
 	bool block_is_underground = (water_level >= nmax.Y);
-	v3s16 em = vm->m_area.getExtent();
+	v3s16 ea = a.getExtent();
+
+	updateLightProps();
 
 	// NOTE: Direct access to the low 4 bits of param1 is okay here because,
 	// by definition, sunlight will never be in the night lightbank.
 
+	// Sunlight is propagated downwards one whole XZ layer at a time instead
+	// of column by column, so that the inner loop walks along contiguous
+	// memory.  sunlit[] tracks which columns still receive sunlight.
+	std::vector<u8> sunlit((u32)ea.X * ea.Z);
+	bool any_sunlit = false;
+
+	u32 j = 0;
 	for (int z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++) {
-		for (int x = a.MinEdge.X; x <= a.MaxEdge.X; x++) {
+		u32 i = vm->m_area.index(a.MinEdge.X, a.MaxEdge.Y + 1, z);
+		for (int x = a.MinEdge.X; x <= a.MaxEdge.X; x++, i++, j++) {
 			// see if we can get a light value from the overtop
-			u32 i = vm->m_area.index(x, a.MaxEdge.Y + 1, z);
 			if (vm->m_data[i].getContent() == CONTENT_IGNORE) {
 				if (block_is_underground)
 					continue;
@@ -492,14 +555,23 @@ void Mapgen::propagateSunlight(v3s16 nmin, v3s16 nmax, bool propagate_shadow)
 					propagate_shadow) {
 				continue;
 			}
-			vm->m_area.add_y(em, i, -1);
+			sunlit[j] = LIGHTPROP_SUNLIGHT_PROPAGATES;
+			any_sunlit = true;
+		}
+	}
 
-			for (int y = a.MaxEdge.Y; y >= a.MinEdge.Y; y--) {
+	for (int y = a.MaxEdge.Y; y >= a.MinEdge.Y && any_sunlit; y--) {
+		any_sunlit = false;
+		j = 0;
+		for (int z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++) {
+			u32 i = vm->m_area.index(a.MinEdge.X, y, z);
+			for (int x = 0; x < ea.X; x++, i++, j++) {
 				MapNode &n = vm->m_data[i];
-				if (!ndef->get(n).sunlight_propagates)
-					break;
-				n.param1 = LIGHT_SUN;
-				vm->m_area.add_y(em, i, -1);
+				u8 s = sunlit[j] & m_light_props[n.getContent()];
+				sunlit[j] = s;
+				if (s)
+					n.param1 = LIGHT_SUN;
+				any_sunlit |= (s != 0);
 			}
 		}
 	}
@@ -507,38 +579,76 @@ void Mapgen::propagateSunlight(v3s16 nmin, v3s16 nmax, bool propagate_shadow)
 }
 
 
+bool Mapgen::isLightUniform(const VoxelArea &a)
+{
+	bool found = false;
+	u8 light = 0;
+
+	for (int z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++) {
+		for (int y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++) {
+			u32 i = vm->m_area.index(a.MinEdge.X, y, z);
+			for (int x = a.MinEdge.X; x <= a.MaxEdge.X; x++, i++) {
+				MapNode &n = vm->m_data[i];
+				u8 props = m_light_props[n.getContent()];
+				if (!(props & LIGHTPROP_PROPAGATES))
+					continue;
+
+				// Light sources
+				if (props >> 4)
+					return false;
+
+				if (!found) {
+					light = n.param1;
+					found = true;
+				} else if (n.param1 != light) {
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+
 void Mapgen::spreadLight(v3s16 nmin, v3s16 nmax)
 {
 	//TimeTaker t("spreadLight");
 	VoxelArea a(nmin, nmax);
 
+	updateLightProps();
+
+	// Light spreading can't change anything if all nodes it passes through
+	// carry the same light and none of them emits light.  This is the common
+	// case for chunks of solid stone deep underground or of air high in the
+	// sky, so avoid the spreading for those.
+	if (isLightUniform(a))
+		return;
+
 	for (int z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++) {
 		for (int y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++) {
 			u32 i = vm->m_area.index(a.MinEdge.X, y, z);
 			for (int x = a.MinEdge.X; x <= a.MaxEdge.X; x++, i++) {
 				MapNode &n = vm->m_data[i];
-				if (n.getContent() == CONTENT_IGNORE)
-					continue;
-
-				const ContentFeatures &cf = ndef->get(n);
-				if (!cf.light_propagates)
+				u8 props = m_light_props[n.getContent()];
+				if (!(props & LIGHTPROP_PROPAGATES))
 					continue;
 
 				// TODO(hmmmmm): Abstract away direct param1 accesses with a
 				// wrapper, but something lighter than MapNode::get/setLight
 
-				u8 light_produced = cf.light_source;
+				u8 light_produced = props >> 4;
 				if (light_produced)
 					n.param1 = light_produced | (light_produced << 4);
 
+				// Finish spreading before moving on to the next node, as a
+				// light source resets its own light above.  Results would
+				// otherwise differ from spreading node by node.
 				u8 light = n.param1;
-				if (light) {
-					lightSpread(a, v3s16(x,     y,     z + 1), light);
-					lightSpread(a, v3s16(x,     y + 1, z    ), light);
-					lightSpread(a, v3s16(x + 1, y,     z    ), light);
-					lightSpread(a, v3s16(x,     y,     z - 1), light);
-					lightSpread(a, v3s16(x,     y - 1, z    ), light);
-					lightSpread(a, v3s16(x - 1, y,     z    ), light);
+				if (light > 1) {
+					LightQueueEntry e = {i, v3s16(x, y, z), light};
+					m_light_queue.push_back(e);
+					spreadLightFromQueue(a);
 				}
 			}
 		}
@@ -548,6 +658,137 @@ void Mapgen::spreadLight(v3s16 nmin, v3s16 nmax)
 }
 
 
+////
+//// MapgenSlabWorkers
+////
+
+class MapgenSlabThread : public Thread {
+public:
+	MapgenSlabThread(MapgenSlabWorkers *workers) :
+		Thread("MapgenSlab"),
+		m_workers(workers)
+	{}
+
+	void *run()
+	{
+		DSTACK(FUNCTION_NAME);
+		BEGIN_DEBUG_EXCEPTION_HANDLER
+
+		while (!stopRequested()) {
+			m_start.wait();
+			if (stopRequested())
+				break;
+
+			m_workers->runSlabs();
+			m_workers->m_done.post();
+		}
+
+		END_DEBUG_EXCEPTION_HANDLER
+		return NULL;
+	}
+
+	Semaphore m_start;
+
+private:
+	MapgenSlabWorkers *m_workers;
+};
+
+
+MapgenSlabWorkers::MapgenSlabWorkers(u16 num_threads) :
+	m_job(NULL),
+	m_next_y(0),
+	m_y_max(-1)
+{
+	for (u16 i = 1; i < num_threads; i++) {
+		MapgenSlabThread *thread = new MapgenSlabThread(this);
+		thread->start();
+		m_threads.push_back(thread);
+	}
+}
+
+
+MapgenSlabWorkers::~MapgenSlabWorkers()
+{
+	for (size_t i = 0; i != m_threads.size(); i++) {
+		m_threads[i]->stop();
+		m_threads[i]->m_start.post();
+		m_threads[i]->wait();
+		delete m_threads[i];
+	}
+}
+
+
+void MapgenSlabWorkers::run(MapgenSlabJob *job, s16 y_min, s16 y_max)
+{
+	if (m_threads.empty() || y_max - y_min < MAP_BLOCKSIZE) {
+		job->run(y_min, y_max);
+		return;
+	}
+
+	m_job    = job;
+	m_next_y = y_min;
+	m_y_max  = y_max;
+
+	for (size_t i = 0; i != m_threads.size(); i++)
+		m_threads[i]->m_start.post();
+
+	runSlabs();
+
+	for (size_t i = 0; i != m_threads.size(); i++)
+		m_done.wait();
+
+	m_job = NULL;
+}
+
+
+void MapgenSlabWorkers::runSlabs()
+{
+	for (;;) {
+		s16 y_min, y_max;
+		{
+			MutexAutoLock lock(m_mutex);
+			if (m_next_y > m_y_max)
+				return;
+			y_min = m_next_y;
+			y_max = MYMIN(y_min + MAP_BLOCKSIZE - 1, m_y_max);
+			m_next_y = y_max + 1;
+		}
+
+		m_job->run(y_min, y_max);
+	}
+}
+
+
+class NoiseSlabJob : public MapgenSlabJob {
+public:
+	NoiseSlabJob(Noise *noise, float x, float y, float z) :
+		m_noise(noise), m_x(x), m_y(y), m_z(z)
+	{}
+
+	void run(s16 y_min, s16 y_max)
+	{
+		m_noise->perlinMap3DSlab(m_x, m_y, m_z, y_min, y_max + 1);
+	}
+
+private:
+	Noise *m_noise;
+	float m_x, m_y, m_z;
+};
+
+
+void calc_noise_3d(MapgenSlabWorkers *workers, Noise *noise,
+	float x, float y, float z)
+{
+	if (!workers) {
+		noise->perlinMap3D(x, y, z);
+		return;
+	}
+
+	NoiseSlabJob job(noise, x, y, z);
+	workers->run(&job, 0, noise->sy - 1);
+}
+
+
 ////
 //// MapgenBasic
 ////
@@ -558,6 +799,11 @@ MapgenBasic::MapgenBasic(int mapgenid, MapgenParams *params, EmergeManager *emer
 	this->m_emerge = emerge;
 	this->m_bmgr   = emerge->biomemgr;
 
+	//// Threads helping to generate large mapchunks, if enabled
+	this->m_slab_workers = NULL;
+	if (emerge->num_mapchunk_threads > 1)
+		this->m_slab_workers = new MapgenSlabWorkers(emerge->num_mapchunk_threads);
+
 	//// Here, 'stride' refers to the number of elements needed to skip to index
 	//// an adjacent element for that coordinate in noise/height/biome maps
 	//// (*not* vmanip content map!)
@@ -624,11 +870,21 @@ MapgenBasic::MapgenBasic(int mapgenid, MapgenParams *params, EmergeManager *emer
 
 MapgenBasic::~MapgenBasic()
 {
+	delete m_slab_workers;
 	delete biomegen;
 	delete []heightmap;
 }
 
 
+void MapgenBasic::runSlabJob(MapgenSlabJob *job, s16 y_min, s16 y_max)
+{
+	if (m_slab_workers)
+		m_slab_workers->run(job, y_min, y_max);
+	else
+		job->run(y_min, y_max);
+}
+
+
 MgStoneType MapgenBasic::generateBiomes()
 {
 	// can't generate biomes without a biome generator!
@@ -822,7 +1078,7 @@ void MapgenBasic::generateCaves(s16 max_stone_y, s16 large_cave_depth)
 	CavesNoiseIntersection caves_noise(ndef, m_bmgr, csize,
 		&np_cave1, &np_cave2, seed, cave_width);
 
-	caves_noise.generateCaves(vm, node_min, node_max, biomemap);
+	caves_noise.generateCaves(vm, node_min, node_max, biomemap, m_slab_workers);
 
 	if (node_max.Y > large_cave_depth)
 		return;
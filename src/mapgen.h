@@ -25,6 +25,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapnode.h"
 #include "util/string.h"
 #include "util/container.h"
+#include "threading/mutex.h"
+#include "threading/mutex_auto_lock.h"
+#include "threading/semaphore.h"
 
 #define MAPGEN_DEFAULT MAPGEN_V7
 #define MAPGEN_DEFAULT_NAME "v7"
@@ -56,6 +59,7 @@ class VoxelManipulator;
 struct BlockMakeData;
 class VoxelArea;
 class Map;
+class MapgenSlabThread;
 
 enum MapgenObject {
 	MGOBJ_VMANIP,
@@ -84,6 +88,13 @@ enum MgStoneType {
 	MGSTONE_SANDSTONE,
 };
 
+// A node the light of which still has to be spread to its neighbors
+struct LightQueueEntry {
+	u32 vi;
+	v3s16 p;
+	u8 light;
+};
+
 struct GenNotifyEvent {
 	GenNotifyType type;
 	v3s16 pos;
@@ -188,10 +199,13 @@ class Mapgen {
 	void updateLiquid(UniqueQueue<v3s16> *trans_liquid, v3s16 nmin, v3s16 nmax);
 
 	void setLighting(u8 light, v3s16 nmin, v3s16 nmax);
-	void lightSpread(VoxelArea &a, v3s16 p, u8 light);
+	void updateLightProps();
+	void lightSpread(const VoxelArea &a, u32 vi, v3s16 p, u8 light);
+	void spreadLightFromQueue(const VoxelArea &a);
 	void calcLighting(v3s16 nmin, v3s16 nmax, v3s16 full_nmin, v3s16 full_nmax,
 		bool propagate_shadow = true);
 	void propagateSunlight(v3s16 nmin, v3s16 nmax, bool propagate_shadow);
+	bool isLightUniform(const VoxelArea &a);
 	void spreadLight(v3s16 nmin, v3s16 nmax);
 
 	virtual void makeChunk(BlockMakeData *data) {}
@@ -217,9 +231,97 @@ class Mapgen {
 	// that checks whether there are floodable nodes without liquid beneath
 	// the node at index vi.
 	inline bool isLiquidHorizontallyFlowable(u32 vi, v3s16 em);
+
+	// Lighting properties of every content_t, see updateLightProps()
+	std::vector<u8> m_light_props;
+	INodeDefManager *m_light_props_ndef;
+	// Nodes to spread light from, kept to avoid reallocating it every chunk
+	std::vector<LightQueueEntry> m_light_queue;
+
 	DISABLE_CLASS_COPY(Mapgen);
 };
 
+/*
+	Work on a mapchunk that is split into slabs of rows along Y, so that it
+	can be spread over the threads of MapgenSlabWorkers.  run() is called
+	for each slab, possibly concurrently, so it may only write data
+	belonging to its own rows and must not depend on the order of slabs.
+*/
+class MapgenSlabJob {
+public:
+	virtual ~MapgenSlabJob() {}
+
+	virtual void run(s16 y_min, s16 y_max) = 0;
+};
+
+/*
+	Slab job calling a method of a mapgen for each slab.  The method returns
+	a height, of which the maximum over all slabs is kept (eg. the highest
+	stone node), which does not depend on how the rows were split.
+*/
+template <typename T>
+class MapgenSlabMethod : public MapgenSlabJob {
+public:
+	typedef s16 (T::*Method)(s16 y_min, s16 y_max);
+
+	MapgenSlabMethod(T *mapgen, Method method) :
+		max_y(-MAX_MAP_GENERATION_LIMIT),
+		m_mapgen(mapgen),
+		m_method(method)
+	{}
+
+	void run(s16 y_min, s16 y_max)
+	{
+		s16 y = (m_mapgen->*m_method)(y_min, y_max);
+
+		MutexAutoLock lock(m_mutex);
+		if (y > max_y)
+			max_y = y;
+	}
+
+	s16 max_y;
+
+private:
+	T *m_mapgen;
+	Method m_method;
+	Mutex m_mutex;
+};
+
+/*
+	Threads helping the emerge thread that owns a mapgen with generating a
+	single mapchunk.  Slabs are always MAP_BLOCKSIZE rows high, whatever the
+	number of threads, so the generated terrain does not depend on it.
+*/
+class MapgenSlabWorkers {
+public:
+	// num_threads includes the thread calling run()
+	MapgenSlabWorkers(u16 num_threads);
+	~MapgenSlabWorkers();
+
+	// Runs job on all slabs of the rows y_min..y_max and waits until done
+	void run(MapgenSlabJob *job, s16 y_min, s16 y_max);
+
+private:
+	friend class MapgenSlabThread;
+
+	// Runs the job on slabs until none are left
+	void runSlabs();
+
+	std::vector<MapgenSlabThread *> m_threads;
+
+	Mutex m_mutex;
+	Semaphore m_done;
+	MapgenSlabJob *m_job;
+	s16 m_next_y;
+	s16 m_y_max;
+
+	DISABLE_CLASS_COPY(MapgenSlabWorkers);
+};
+
+// noise->perlinMap3D(x, y, z), split into slabs if workers is not NULL
+void calc_noise_3d(MapgenSlabWorkers *workers, Noise *noise,
+	float x, float y, float z);
+
 /*
 	MapgenBasic is a Mapgen implementation that handles basic functionality
 	the majority of conventional mapgens will probably want to use, but isn't
@@ -240,6 +342,8 @@ class MapgenBasic : public Mapgen {
 	virtual ~MapgenBasic();
 
 	virtual void generateCaves(s16 max_stone_y, s16 large_cave_depth);
+	// Runs job on the rows y_min..y_max, using the slab workers if any
+	void runSlabJob(MapgenSlabJob *job, s16 y_min, s16 y_max);
 	virtual void generateDungeons(s16 max_stone_y, MgStoneType stone_type);
 	virtual MgStoneType generateBiomes();
 	virtual void dustTopNodes();
@@ -247,6 +351,7 @@ class MapgenBasic : public Mapgen {
 protected:
 	EmergeManager *m_emerge;
 	BiomeManager *m_bmgr;
+	MapgenSlabWorkers *m_slab_workers;
 
 	Noise *noise_filler_depth;
 
@@ -239,6 +239,21 @@ void MapgenFractal::makeChunk(BlockMakeData *data)
 }
 
 
+bool MapgenFractal::getFractalPossibleInRow(s16 y, s16 z)
+{
+	// In the Mandelbrot set the first iteration always yields n = c, so a
+	// row where cy * cy + cz * cz alone exceeds the escape radius escapes
+	// immediately for every x.  Nothing similar holds for Julia sets.
+	if (julia || iterations == 0 || formula < 1 || formula > 9)
+		return true;
+
+	float cy = (float)y / scale.Y - offset.Y;
+	float cz = (float)z / scale.Z - offset.Z;
+
+	return cy * cy + cz * cz <= 4.0f;
+}
+
+
 bool MapgenFractal::getFractalAtPoint(s16 x, s16 y, s16 z)
 {
 	float cx, cy, cz, cw, ox, oy, oz, ow;
@@ -360,24 +375,37 @@ bool MapgenFractal::getFractalAtPoint(s16 x, s16 y, s16 z)
 
 
 s16 MapgenFractal::generateTerrain()
+{
+	noise_seabed->perlinMap2D(node_min.X, node_min.Z);
+
+	// The fractal is evaluated per node, so the rows are split among the
+	// slab workers
+	MapgenSlabMethod<MapgenFractal> job(this, &MapgenFractal::generateTerrainSlab);
+	runSlabJob(&job, node_min.Y - 1, node_max.Y + 1);
+
+	return job.max_y;
+}
+
+
+s16 MapgenFractal::generateTerrainSlab(s16 y_min, s16 y_max)
 {
 	MapNode n_air(CONTENT_AIR);
 	MapNode n_stone(c_stone);
 	MapNode n_water(c_water_source);
 
 	s16 stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
-	u32 index2d = 0;
-
-	noise_seabed->perlinMap2D(node_min.X, node_min.Z);
 
 	for (s16 z = node_min.Z; z <= node_max.Z; z++) {
-		for (s16 y = node_min.Y - 1; y <= node_max.Y + 1; y++) {
+		for (s16 y = y_min; y <= y_max; y++) {
+			bool fractal_row = getFractalPossibleInRow(y, z);
 			u32 vi = vm->m_area.index(node_min.X, y, z);
+			u32 index2d = (z - node_min.Z) * ystride;
 			for (s16 x = node_min.X; x <= node_max.X; x++, vi++, index2d++) {
 				if (vm->m_data[vi].getContent() == CONTENT_IGNORE) {
 					s16 seabed_height = noise_seabed->result[index2d];
 
-					if (y <= seabed_height || getFractalAtPoint(x, y, z)) {
+					if (y <= seabed_height ||
+							(fractal_row && getFractalAtPoint(x, y, z))) {
 						vm->m_data[vi] = n_stone;
 						if (y > stone_surface_max_y)
 							stone_surface_max_y = y;
@@ -388,9 +416,7 @@ s16 MapgenFractal::generateTerrain()
 					}
 				}
 			}
-			index2d -= ystride;
 		}
-		index2d += ystride;
 	}
 
 	return stone_surface_max_y;
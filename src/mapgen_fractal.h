@@ -66,8 +66,10 @@ class MapgenFractal : public MapgenBasic {
 
 	virtual void makeChunk(BlockMakeData *data);
 	int getSpawnLevelAtPoint(v2s16 p);
+	bool getFractalPossibleInRow(s16 y, s16 z);
 	bool getFractalAtPoint(s16 x, s16 y, s16 z);
 	s16 generateTerrain();
+	s16 generateTerrainSlab(s16 y_min, s16 y_max);
 
 private:
 	u16 formula;
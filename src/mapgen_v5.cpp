@@ -240,31 +240,70 @@ void MapgenV5::makeChunk(BlockMakeData *data)
 //}
 
 
-int MapgenV5::generateBaseTerrain()
+float MapgenV5::groundFactorFromMap(u32 index2d)
 {
-	u32 index = 0;
-	u32 index2d = 0;
-	int stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
+	float f = 0.55 + noise_factor->result[index2d];
+	if (f < 0.01)
+		f = 0.01;
+	else if (f >= 1.0)
+		f *= 1.6;
+	return f;
+}
+
 
+int MapgenV5::generateBaseTerrain()
+{
 	noise_factor->perlinMap2D(node_min.X, node_min.Z);
 	noise_height->perlinMap2D(node_min.X, node_min.Z);
-	noise_ground->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+
+	float ground_min;
+	NoiseBounds(&noise_ground->np, &ground_min, &ground_max);
+
+	// The 3D ground noise is only needed if, for some column, the noise bounds
+	// cannot decide between stone and air somewhere within this chunk
+	use_ground_noise = false;
+	for (u32 i = 0; i < (u32)csize.X * csize.Z; i++) {
+		float f = groundFactorFromMap(i);
+		float h = noise_height->result[i];
+		if (node_max.Y + 1 - h > ground_min * f &&
+				node_min.Y - 1 - h <= ground_max * f) {
+			use_ground_noise = true;
+			break;
+		}
+	}
+
+	if (use_ground_noise) {
+		calc_noise_3d(m_slab_workers, noise_ground,
+			node_min.X, node_min.Y - 1, node_min.Z);
+	}
+
+	MapgenSlabMethod<MapgenV5> job(this, &MapgenV5::generateBaseTerrainSlab);
+	runSlabJob(&job, node_min.Y - 1, node_max.Y + 1);
+
+	return job.max_y;
+}
+
+
+s16 MapgenV5::generateBaseTerrainSlab(s16 y_min, s16 y_max)
+{
+	s16 stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
 
 	for (s16 z=node_min.Z; z<=node_max.Z; z++) {
-		for (s16 y=node_min.Y - 1; y<=node_max.Y + 1; y++) {
+		u32 index = (z - node_min.Z) * zstride_1u1d +
+			(y_min - (node_min.Y - 1)) * ystride;
+		for (s16 y=y_min; y<=y_max; y++) {
 			u32 vi = vm->m_area.index(node_min.X, y, z);
+			u32 index2d = (z - node_min.Z) * ystride;
 			for (s16 x=node_min.X; x<=node_max.X; x++, vi++, index++, index2d++) {
 				if (vm->m_data[vi].getContent() != CONTENT_IGNORE)
 					continue;
 
-				float f = 0.55 + noise_factor->result[index2d];
-				if (f < 0.01)
-					f = 0.01;
-				else if (f >= 1.0)
-					f *= 1.6;
+				float f = groundFactorFromMap(index2d);
 				float h = noise_height->result[index2d];
+				float ground = use_ground_noise ?
+					noise_ground->result[index] : ground_max;
 
-				if (noise_ground->result[index] * f < y - h) {
+				if (ground * f < y - h) {
 					if (y <= water_level)
 						vm->m_data[vi] = MapNode(c_water_source);
 					else
@@ -275,9 +314,7 @@ int MapgenV5::generateBaseTerrain()
 						stone_surface_max_y = y;
 				}
 			}
-			index2d -= ystride;
 		}
-		index2d += ystride;
 	}
 
 	return stone_surface_max_y;
@@ -57,9 +57,16 @@ class MapgenV5 : public MapgenBasic {
 
 	virtual void makeChunk(BlockMakeData *data);
 	int getSpawnLevelAtPoint(v2s16 p);
+	float groundFactorFromMap(u32 index2d);
 	int generateBaseTerrain();
+	s16 generateBaseTerrainSlab(s16 y_min, s16 y_max);
 
 private:
+	// Whether the 3D ground noise is used for the current chunk, and the
+	// value used in its place if not
+	bool use_ground_noise;
+	float ground_max;
+
 	Noise *noise_factor;
 	Noise *noise_height;
 	Noise *noise_ground;
@@ -387,12 +387,55 @@ void MapgenV7::floatBaseExtentFromMap(s16 *float_base_min, s16 *float_base_max,
 }
 
 
-int MapgenV7::generateTerrain()
+bool MapgenV7::mountainsInChunk()
 {
-	MapNode n_air(CONTENT_AIR);
-	MapNode n_stone(c_stone);
-	MapNode n_water(c_water_source);
+	float mount_min, mount_max;
+	NoiseBounds(&noise_mountain->np, &mount_min, &mount_max);
+
+	u32 index2d = 0;
+	for (s16 z = node_min.Z; z <= node_max.Z; z++)
+	for (s16 x = node_min.X; x <= node_max.X; x++, index2d++) {
+		// Mountain terrain is only checked above the base terrain
+		s16 surface_y = baseTerrainLevelFromMap(index2d);
+		s16 y_min = MYMAX(surface_y + 1, node_min.Y - 1);
+		if (y_min > node_max.Y + 1)
+			continue;
+
+		// The density gradient -y / mounthn is below -mount_max for any
+		// y > mount_max * mounthn, so no mountain can exist there
+		float mounthn = noise_mount_height->result[index2d];
+		if (mounthn <= 0.0f || y_min <= mount_max * mounthn)
+			return true;
+	}
+
+	return false;
+}
+
+
+bool MapgenV7::floatMountainsInChunk()
+{
+	if (float_mount_height <= 0.0f)
+		return true;
+
+	float mount_min, mount_max;
+	NoiseBounds(&noise_mountain->np, &mount_min, &mount_max);
+
+	// The density gradient is -pow(dist / float_mount_height, 0.75), where
+	// dist is the distance from floatland_level, so floatland mountains can
+	// only exist within 'reach' nodes of it
+	float floatn_max = mount_max + float_mount_density;
+	if (floatn_max < 0.0f)
+		return false;
+
+	float reach = float_mount_height * pow(floatn_max, 1.0f / 0.75f) + 1.0f;
 
+	return node_max.Y + 1 >= floatland_level - 1 - reach &&
+		node_min.Y - 1 <= floatland_level + reach;
+}
+
+
+int MapgenV7::generateTerrain()
+{
 	//// Calculate noise for terrain generation
 	noise_terrain_persist->perlinMap2D(node_min.X, node_min.Z);
 	float *persistmap = noise_terrain_persist->result;
@@ -401,10 +444,6 @@ int MapgenV7::generateTerrain()
 	noise_terrain_alt->perlinMap2D(node_min.X, node_min.Z, persistmap);
 	noise_height_select->perlinMap2D(node_min.X, node_min.Z);
 
-	if ((spflags & MGV7_MOUNTAINS) || (spflags & MGV7_FLOATLANDS)) {
-		noise_mountain->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
-	}
-
 	if (spflags & MGV7_MOUNTAINS) {
 		noise_mount_height->perlinMap2D(node_min.X, node_min.Z);
 	}
@@ -414,7 +453,31 @@ int MapgenV7::generateTerrain()
 		noise_float_base_height->perlinMap2D(node_min.X, node_min.Z);
 	}
 
+	// The 3D mountain noise is by far the most expensive part of terrain
+	// generation, so skip it for chunks where the noise bounds show that it
+	// cannot affect any node (deep underground or high in the sky)
+	gen_mountains = (spflags & MGV7_MOUNTAINS) && mountainsInChunk();
+	gen_float_mountains = (spflags & MGV7_FLOATLANDS) && floatMountainsInChunk();
+
+	if (gen_mountains || gen_float_mountains) {
+		calc_noise_3d(m_slab_workers, noise_mountain,
+			node_min.X, node_min.Y - 1, node_min.Z);
+	}
+
 	//// Place nodes
+	MapgenSlabMethod<MapgenV7> job(this, &MapgenV7::generateTerrainSlab);
+	runSlabJob(&job, node_min.Y - 1, node_max.Y + 1);
+
+	return job.max_y;
+}
+
+
+s16 MapgenV7::generateTerrainSlab(s16 y_min, s16 y_max)
+{
+	MapNode n_air(CONTENT_AIR);
+	MapNode n_stone(c_stone);
+	MapNode n_water(c_water_source);
+
 	v3s16 em = vm->m_area.getExtent();
 	s16 stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
 	u32 index2d = 0;
@@ -432,23 +495,26 @@ int MapgenV7::generateTerrain()
 		if (spflags & MGV7_FLOATLANDS)
 			floatBaseExtentFromMap(&float_base_min, &float_base_max, index2d);
 
-		u32 vi = vm->m_area.index(x, node_min.Y - 1, z);
-		u32 index3d = (z - node_min.Z) * zstride_1u1d + (x - node_min.X);
+		u32 vi = vm->m_area.index(x, y_min, z);
+		u32 index3d = (z - node_min.Z) * zstride_1u1d +
+			(y_min - (node_min.Y - 1)) * ystride + (x - node_min.X);
 
-		for (s16 y = node_min.Y - 1; y <= node_max.Y + 1; y++) {
+		for (s16 y = y_min; y <= y_max; y++) {
 			if (vm->m_data[vi].getContent() == CONTENT_IGNORE) {
 				if (y <= surface_y) {
 					vm->m_data[vi] = n_stone;  // Base terrain
-				} else if ((spflags & MGV7_MOUNTAINS) &&
+				} else if (gen_mountains &&
 						getMountainTerrainFromMap(index3d, index2d, y)) {
 					vm->m_data[vi] = n_stone;  // Mountain terrain
 					if (y > stone_surface_max_y)
 						stone_surface_max_y = y;
 				} else if ((spflags & MGV7_FLOATLANDS) &&
 						((y >= float_base_min && y <= float_base_max) ||
-						getFloatlandMountainFromMap(index3d, index2d, y))) {
+						(gen_float_mountains &&
+						getFloatlandMountainFromMap(index3d, index2d, y)))) {
 					vm->m_data[vi] = n_stone;  // Floatland terrain
-					stone_surface_max_y = node_max.Y;
+					if (node_max.Y > stone_surface_max_y)
+						stone_surface_max_y = node_max.Y;
 				} else if (y <= water_level) {
 					vm->m_data[vi] = n_water;  // Ground level water
 				} else if ((spflags & MGV7_FLOATLANDS) &&
@@ -472,7 +538,8 @@ void MapgenV7::generateRidgeTerrain()
 	if ((node_max.Y < water_level - 16) || (node_max.Y > shadow_limit))
 		return;
 
-	noise_ridge->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+	calc_noise_3d(m_slab_workers, noise_ridge,
+		node_min.X, node_min.Y - 1, node_min.Z);
 	noise_ridge_uwater->perlinMap2D(node_min.X, node_min.Z);
 
 	MapNode n_water(c_water_source);
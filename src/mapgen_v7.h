@@ -79,10 +79,18 @@ class MapgenV7 : public MapgenBasic {
 	bool getFloatlandMountainFromMap(int idx_xyz, int idx_xz, s16 y);
 	void floatBaseExtentFromMap(s16 *float_base_min, s16 *float_base_max, int idx_xz);
 
+	bool mountainsInChunk();
+	bool floatMountainsInChunk();
+
 	int generateTerrain();
+	s16 generateTerrainSlab(s16 y_min, s16 y_max);
 	void generateRidgeTerrain();
 
 private:
+	// Whether the 3D mountain noise affects the current chunk
+	bool gen_mountains;
+	bool gen_float_mountains;
+
 	float float_mount_density;
 	float float_mount_height;
 	s16 floatland_level;
@@ -310,7 +310,7 @@ void MapgenValleys::calculateNoise()
 	noise_valley_depth->perlinMap2D(x, z);
 	noise_valley_profile->perlinMap2D(x, z);
 
-	noise_inter_valley_fill->perlinMap3D(x, y, z);
+	calc_noise_3d(m_slab_workers, noise_inter_valley_fill, x, y, z);
 
 	//mapgen_profiler->avg("noisemaps", tcn.stop() / 1000.f);
 
@@ -604,8 +604,10 @@ void MapgenValleys::generateCaves(s16 max_stone_y, s16 large_cave_depth)
 	if (max_stone_y < node_min.Y)
 		return;
 
-	noise_cave1->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
-	noise_cave2->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+	calc_noise_3d(m_slab_workers, noise_cave1,
+		node_min.X, node_min.Y - 1, node_min.Z);
+	calc_noise_3d(m_slab_workers, noise_cave2,
+		node_min.X, node_min.Y - 1, node_min.Z);
 
 	PseudoRandom ps(blockseed + 72202);
 
@@ -627,7 +629,8 @@ void MapgenValleys::generateCaves(s16 max_stone_y, s16 large_cave_depth)
 
 	// Cache the tcave values as they only vary by altitude.
 	if (node_max.Y <= massive_cave_depth) {
-		noise_massive_caves->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
+		calc_noise_3d(m_slab_workers, noise_massive_caves,
+			node_min.X, node_min.Y - 1, node_min.Z);
 
 		for (s16 y = node_min.Y - 1; y <= node_max.Y; y++) {
 			float tcave = massive_cave_threshold;
@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <algorithm>
 #include <fstream>
 #include <typeinfo>
 #include "mg_schematic.h"
@@ -71,6 +72,7 @@ Schematic::Schematic()
 	slice_probs = NULL;
 	flags       = 0;
 	size        = v3s16(0, 0, 0);
+	m_prepared  = false;
 }
 
 
@@ -91,45 +93,102 @@ void Schematic::resolveNodeNames()
 		content_t c_new = c_nodes[c_original];
 		schemdata[i].setContent(c_new);
 	}
+
+	prepare();
 }
 
 
-void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_place)
+void Schematic::prepare()
 {
 	sanity_check(m_ndef != NULL);
 
 	int xstride = 1;
 	int ystride = size.X;
 	int zstride = size.X * size.Y;
+	u32 nodecount = size.X * size.Y * size.Z;
+
+	for (int rot = ROTATE_0; rot <= ROTATE_270; rot++) {
+		s16 sx = size.X;
+		s16 sy = size.Y;
+		s16 sz = size.Z;
+
+		int i_start, i_step_x, i_step_z;
+		switch (rot) {
+			case ROTATE_90:
+				i_start  = sx - 1;
+				i_step_x = zstride;
+				i_step_z = -xstride;
+				SWAP(s16, sx, sz);
+				break;
+			case ROTATE_180:
+				i_start  = zstride * (sz - 1) + sx - 1;
+				i_step_x = -xstride;
+				i_step_z = -zstride;
+				break;
+			case ROTATE_270:
+				i_start  = zstride * (sz - 1);
+				i_step_x = -zstride;
+				i_step_z = xstride;
+				SWAP(s16, sx, sz);
+				break;
+			default:
+				i_start  = 0;
+				i_step_x = xstride;
+				i_step_z = zstride;
+		}
+
+		std::vector<MapNode> &nodes = m_rotated_nodes[rot];
+		std::vector<u8> &probs = m_rotated_probs[rot];
+		nodes.resize(nodecount);
+		probs.resize(nodecount);
+
+		u32 j = 0;
+		for (s16 z = 0; z != sz; z++)
+		for (s16 y = 0; y != sy; y++) {
+			u32 i = z * i_step_z + y * ystride + i_start;
+			for (s16 x = 0; x != sx; x++, i += i_step_x, j++) {
+				MapNode n = schemdata[i];
+
+				probs[j] = (n.getContent() == CONTENT_IGNORE) ?
+					MTSCHEM_PROB_NEVER : n.param1;
+
+				n.param1 = 0;
+				if (rot != ROTATE_0)
+					n.rotateAlongYAxis(m_ndef, (Rotation)rot);
+				nodes[j] = n;
+			}
+		}
+	}
+
+	m_prepared = true;
+}
+
+
+void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_place)
+{
+	sanity_check(m_ndef != NULL);
+
+	if (!m_prepared)
+		prepare();
+
+	if (m_rotated_nodes[rot].empty())
+		return;
+
+	const MapNode *nodes = &m_rotated_nodes[rot][0];
+	const u8 *probs = &m_rotated_probs[rot][0];
 
 	s16 sx = size.X;
 	s16 sy = size.Y;
 	s16 sz = size.Z;
+	if (rot == ROTATE_90 || rot == ROTATE_270)
+		SWAP(s16, sx, sz);
 
-	int i_start, i_step_x, i_step_z;
-	switch (rot) {
-		case ROTATE_90:
-			i_start  = sx - 1;
-			i_step_x = zstride;
-			i_step_z = -xstride;
-			SWAP(s16, sx, sz);
-			break;
-		case ROTATE_180:
-			i_start  = zstride * (sz - 1) + sx - 1;
-			i_step_x = -xstride;
-			i_step_z = -zstride;
-			break;
-		case ROTATE_270:
-			i_start  = zstride * (sz - 1);
-			i_step_x = -zstride;
-			i_step_z = xstride;
-			SWAP(s16, sx, sz);
-			break;
-		default:
-			i_start  = 0;
-			i_step_x = xstride;
-			i_step_z = zstride;
-	}
+	//// Clip the rows to the VoxelManip area
+	const VoxelArea &area = vm->m_area;
+	int x_start = MYMAX(0, area.MinEdge.X - p.X);
+	int x_end   = MYMIN(sx, area.MaxEdge.X - p.X + 1);
+	int z_start = MYMAX(0, area.MinEdge.Z - p.Z);
+	int z_end   = MYMIN(sz, area.MaxEdge.Z - p.Z + 1);
 
 	s16 y_map = p.Y;
 	for (s16 y = 0; y != sy; y++) {
@@ -137,24 +196,24 @@ void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_pla
 			(slice_probs[y] <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
 			continue;
 
-		for (s16 z = 0; z != sz; z++) {
-			u32 i = z * i_step_z + y * ystride + i_start;
-			for (s16 x = 0; x != sx; x++, i += i_step_x) {
-				u32 vi = vm->m_area.index(p.X + x, y_map, p.Z + z);
-				if (!vm->m_area.contains(vi))
-					continue;
-
-				if (schemdata[i].getContent() == CONTENT_IGNORE)
-					continue;
+		if (y_map < area.MinEdge.Y || y_map > area.MaxEdge.Y) {
+			y_map++;
+			continue;
+		}
 
-				u8 placement_prob     = schemdata[i].param1 & MTSCHEM_PROB_MASK;
-				bool force_place_node = schemdata[i].param1 & MTSCHEM_FORCE_PLACE;
+		for (int z = z_start; z < z_end; z++) {
+			u32 i = (z * sy + y) * sx + x_start;
+			u32 vi = area.index(p.X + x_start, y_map, p.Z + z);
+			for (int x = x_start; x < x_end; x++, i++, vi++) {
+				u8 placement_prob     = probs[i] & MTSCHEM_PROB_MASK;
+				bool force_place_node = probs[i] & MTSCHEM_FORCE_PLACE;
 
 				if (placement_prob == MTSCHEM_PROB_NEVER)
 					continue;
 
+				MapNode &n = vm->m_data[vi];
 				if (!force_place && !force_place_node) {
-					content_t c = vm->m_data[vi].getContent();
+					content_t c = n.getContent();
 					if (c != CONTENT_AIR && c != CONTENT_IGNORE)
 						continue;
 				}
@@ -163,11 +222,11 @@ void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_pla
 					(placement_prob <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
 					continue;
 
-				vm->m_data[vi] = schemdata[i];
-				vm->m_data[vi].param1 = 0;
-
-				if (rot)
-					vm->m_data[vi].rotateAlongYAxis(m_ndef, rot);
+				// A node that stays the same keeps its light
+				if (n.getContent() == nodes[i].getContent())
+					n.param2 = nodes[i].param2;
+				else
+					n = nodes[i];
 			}
 		}
 		y_map++;
@@ -175,27 +234,35 @@ void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_pla
 }
 
 
-bool Schematic::placeOnVManip(MMVManip *vm, v3s16 p, u32 flags,
-	Rotation rot, bool force_place)
+v3s16 Schematic::getPlacement(v3s16 *p, u32 flags, Rotation *rot)
 {
-	assert(vm != NULL);
-	assert(schemdata != NULL);
-	sanity_check(m_ndef != NULL);
-
 	//// Determine effective rotation and effective schematic dimensions
-	if (rot == ROTATE_RAND)
-		rot = (Rotation)myrand_range(ROTATE_0, ROTATE_270);
+	if (*rot == ROTATE_RAND)
+		*rot = (Rotation)myrand_range(ROTATE_0, ROTATE_270);
 
-	v3s16 s = (rot == ROTATE_90 || rot == ROTATE_270) ?
+	v3s16 s = (*rot == ROTATE_90 || *rot == ROTATE_270) ?
 		v3s16(size.Z, size.Y, size.X) : size;
 
 	//// Adjust placement position if necessary
 	if (flags & DECO_PLACE_CENTER_X)
-		p.X -= (s.X + 1) / 2;
+		p->X -= (s.X + 1) / 2;
 	if (flags & DECO_PLACE_CENTER_Y)
-		p.Y -= (s.Y + 1) / 2;
+		p->Y -= (s.Y + 1) / 2;
 	if (flags & DECO_PLACE_CENTER_Z)
-		p.Z -= (s.Z + 1) / 2;
+		p->Z -= (s.Z + 1) / 2;
+
+	return s;
+}
+
+
+bool Schematic::placeOnVManip(MMVManip *vm, v3s16 p, u32 flags,
+	Rotation rot, bool force_place)
+{
+	assert(vm != NULL);
+	assert(schemdata != NULL);
+	sanity_check(m_ndef != NULL);
+
+	v3s16 s = getPlacement(&p, flags, &rot);
 
 	blitToVManip(vm, p, rot, force_place);
 
@@ -205,47 +272,128 @@ bool Schematic::placeOnVManip(MMVManip *vm, v3s16 p, u32 flags,
 void Schematic::placeOnMap(Map *map, v3s16 p, u32 flags,
 	Rotation rot, bool force_place)
 {
-	std::map<v3s16, MapBlock *> lighting_modified_blocks;
-	std::map<v3s16, MapBlock *> modified_blocks;
-	std::map<v3s16, MapBlock *>::iterator it;
+	std::vector<SchematicPlacement> placements(1);
+	placements[0].schematic   = this;
+	placements[0].p           = p;
+	placements[0].flags       = flags;
+	placements[0].rot         = rot;
+	placements[0].force_place = force_place;
+
+	place_schematics_on_map(map, placements);
+}
 
-	assert(map != NULL);
-	assert(schemdata != NULL);
-	sanity_check(m_ndef != NULL);
 
-	//// Determine effective rotation and effective schematic dimensions
-	if (rot == ROTATE_RAND)
-		rot = (Rotation)myrand_range(ROTATE_0, ROTATE_270);
+// Largest VoxelManip area, in MapBlocks, that placements are grouped into
+#define SCHEMATIC_CLUSTER_MAX_BLOCKS 512
 
-	v3s16 s = (rot == ROTATE_90 || rot == ROTATE_270) ?
-			v3s16(size.Z, size.Y, size.X) : size;
+// Placements put into the same VoxelManip
+struct SchematicCluster {
+	// In MapBlocks
+	VoxelArea area;
+	// The number of MapBlocks the placements cover, counting overlaps
+	s32 used_blocks;
+	std::vector<size_t> placements;
+};
 
-	//// Adjust placement position if necessary
-	if (flags & DECO_PLACE_CENTER_X)
-		p.X -= (s.X + 1) / 2;
-	if (flags & DECO_PLACE_CENTER_Y)
-		p.Y -= (s.Y + 1) / 2;
-	if (flags & DECO_PLACE_CENTER_Z)
-		p.Z -= (s.Z + 1) / 2;
+static bool areas_overlap(const VoxelArea &a, const VoxelArea &b)
+{
+	return a.MinEdge.X <= b.MaxEdge.X && b.MinEdge.X <= a.MaxEdge.X &&
+		a.MinEdge.Y <= b.MaxEdge.Y && b.MinEdge.Y <= a.MaxEdge.Y &&
+		a.MinEdge.Z <= b.MaxEdge.Z && b.MinEdge.Z <= a.MaxEdge.Z;
+}
+
+/*
+	Groups placements so that each VoxelManip mostly covers blocks that
+	are written to, instead of everything between far apart placements.
+	Placements in overlapping areas always end up in the same group, so
+	that they are placed in their order.
+*/
+static void cluster_placements(std::vector<SchematicPlacement> &placements,
+	std::vector<SchematicCluster> *clusters)
+{
+	for (size_t i = 0; i != placements.size(); i++) {
+		SchematicPlacement &sp = placements[i];
+		v3s16 s = sp.schematic->getPlacement(&sp.p, sp.flags, &sp.rot);
+		sp.flags = 0;
+		if (s.X <= 0 || s.Y <= 0 || s.Z <= 0)
+			continue;
+
+		SchematicCluster cluster;
+		cluster.area = VoxelArea(getNodeBlockPos(sp.p),
+			getNodeBlockPos(sp.p + s - v3s16(1,1,1)));
+		cluster.used_blocks = cluster.area.getVolume();
+		cluster.placements.push_back(i);
+
+		// Merging grows the area, which can reach further clusters
+		bool merged = true;
+		while (merged) {
+			merged = false;
+			for (size_t c = 0; c != clusters->size(); c++) {
+				SchematicCluster &other = (*clusters)[c];
+				VoxelArea area = cluster.area;
+				area.addArea(other.area);
+				s32 used = cluster.used_blocks + other.used_blocks;
+				if (!areas_overlap(cluster.area, other.area) &&
+						(area.getVolume() > 2 * used ||
+						area.getVolume() > SCHEMATIC_CLUSTER_MAX_BLOCKS))
+					continue;
+
+				cluster.area = area;
+				cluster.used_blocks = used;
+				cluster.placements.insert(cluster.placements.end(),
+					other.placements.begin(), other.placements.end());
+				(*clusters)[c] = clusters->back();
+				clusters->pop_back();
+				merged = true;
+				break;
+			}
+		}
+
+		std::sort(cluster.placements.begin(), cluster.placements.end());
+		clusters->push_back(cluster);
+	}
+}
+
+void place_schematics_on_map(Map *map,
+	std::vector<SchematicPlacement> &placements)
+{
+	std::map<v3s16, MapBlock *> modified_blocks;
+	std::map<v3s16, MapBlock *>::iterator it;
+	std::vector<std::pair<v3s16, MapNode> > oldnodes;
 
-	//// Create VManip for effected area, emerge our area, modify area
-	//// inside VManip, then blit back.
-	v3s16 bp1 = getNodeBlockPos(p);
-	v3s16 bp2 = getNodeBlockPos(p + s - v3s16(1,1,1));
+	assert(map != NULL);
 
-	MMVManip vm(map);
-	vm.initialEmerge(bp1, bp2);
+	for (size_t i = 0; i != placements.size(); i++) {
+		assert(placements[i].schematic != NULL);
+		assert(placements[i].schematic->schemdata != NULL);
+	}
 
-	blitToVManip(&vm, p, rot, force_place);
+	//// Fix rotations and positions, and group the placements
+	std::vector<SchematicCluster> clusters;
+	cluster_placements(placements, &clusters);
+	if (clusters.empty())
+		return;
+
+	//// For each group create a VManip for its area, place its schematics
+	//// inside it, then blit back the changed blocks. Groups do not share
+	//// the blocks they change, so their order does not matter.
+	for (size_t c = 0; c != clusters.size(); c++) {
+		const SchematicCluster &cluster = clusters[c];
+		MMVManip vm(map);
+		vm.initialEmerge(cluster.area.MinEdge, cluster.area.MaxEdge);
+
+		for (size_t i = 0; i != cluster.placements.size(); i++) {
+			SchematicPlacement &sp = placements[cluster.placements[i]];
+			sp.schematic->blitToVManip(&vm, sp.p, sp.rot, sp.force_place);
+		}
 
-	vm.blitBackAll(&modified_blocks);
+		vm.blitBackChanged(&modified_blocks, &oldnodes);
+	}
 
 	//// Carry out post-map-modification actions
 
-	//// Update lighting
-	// TODO: Optimize this by using Mapgen::calcLighting() instead
-	lighting_modified_blocks.insert(modified_blocks.begin(), modified_blocks.end());
-	map->updateLighting(lighting_modified_blocks, modified_blocks);
+	//// Update lighting around the changed nodes
+	map->updateChangedLighting(oldnodes, modified_blocks);
 
 	//// Create & dispatch map modification events to observers
 	MapEditEvent event;
@@ -558,6 +706,8 @@ void Schematic::applyProbabilities(v3s16 p0,
 		s16 y = (*splist)[i].first - p0.Y;
 		slice_probs[y] = (*splist)[i].second;
 	}
+
+	m_prepared = false;
 }
 
 
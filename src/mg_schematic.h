@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define MG_SCHEMATIC_HEADER
 
 #include <map>
+#include <vector>
 #include "mg_decoration.h"
 #include "util/string.h"
 
@@ -106,10 +107,17 @@ class Schematic : public ObjDef, public NodeResolver {
 	bool serializeToLua(std::ostream *os, const std::vector<std::string> &names,
 		bool use_comments, u32 indent_spaces);
 
+	// Builds the node data used for placement, from schemdata and m_ndef
+	void prepare();
+
 	void blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_place);
 	bool placeOnVManip(MMVManip *vm, v3s16 p, u32 flags, Rotation rot, bool force_place);
 	void placeOnMap(Map *map, v3s16 p, u32 flags, Rotation rot, bool force_place);
 
+	// Picks a random rotation if requested and adjusts p by the
+	// DECO_PLACE_CENTER_* flags; returns the size in that rotation
+	v3s16 getPlacement(v3s16 *p, u32 flags, Rotation *rot);
+
 	void applyProbabilities(v3s16 p0,
 		std::vector<std::pair<v3s16, u8> > *plist,
 		std::vector<std::pair<s16, u8> > *splist);
@@ -119,6 +127,25 @@ class Schematic : public ObjDef, public NodeResolver {
 	v3s16 size;
 	MapNode *schemdata;
 	u8 *slice_probs;
+
+private:
+	/*
+		Placement data for each rotation, in the order of the rotated
+		schematic: the nodes with param2 already rotated and param1 cleared,
+		and for each node its placement probability plus the
+		MTSCHEM_FORCE_PLACE bit.  Ignore nodes never get placed.
+	*/
+	bool m_prepared;
+	std::vector<MapNode> m_rotated_nodes[4];
+	std::vector<u8> m_rotated_probs[4];
+};
+
+struct SchematicPlacement {
+	Schematic *schematic;
+	v3s16 p;
+	u32 flags;
+	Rotation rot;
+	bool force_place;
 };
 
 class SchematicManager : public ObjDefManager {
@@ -142,6 +169,13 @@ class SchematicManager : public ObjDefManager {
 	Server *m_server;
 };
 
+/*
+	Places all schematics, with one VoxelManip for each group of placements
+	that are close to each other or overlap
+*/
+void place_schematics_on_map(Map *map,
+	std::vector<SchematicPlacement> &placements);
+
 void generate_nodelist_and_update_ids(MapNode *nodes, size_t nodecount,
 	std::vector<std::string> *usednodes, INodeDefManager *ndef);
 
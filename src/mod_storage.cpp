@@ -0,0 +1,283 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "mod_storage.h"
+#include "config.h"
+#include "database.h"
+#include "database-dummy.h"
+#include "database-sqlite3.h"
+#if USE_LEVELDB
+#include "database-leveldb.h"
+#endif
+#if USE_REDIS
+#include "database-redis.h"
+#endif
+#if USE_POSTGRESQL
+#include "database-postgresql.h"
+#endif
+#include "exceptions.h"
+#include "log.h"
+#include "threading/mutex_auto_lock.h"
+
+// Times a batch is tried before its changes are given up
+#define MOD_STORAGE_WRITE_ATTEMPTS 3
+
+/*
+	ModStorage
+*/
+
+ModStorage::ModStorage(ModStorageManager *manager, const std::string &modname) :
+	m_manager(manager),
+	m_modname(modname),
+	m_loaded(false)
+{
+}
+
+void ModStorage::load()
+{
+	if (m_loaded)
+		return;
+
+	m_manager->loadEntries(m_modname, &m_values);
+	m_loaded = true;
+}
+
+bool ModStorage::contains(const std::string &key)
+{
+	load();
+	return m_values.find(key) != m_values.end();
+}
+
+std::string ModStorage::getString(const std::string &key)
+{
+	load();
+	StringMap::const_iterator it = m_values.find(key);
+	if (it == m_values.end())
+		return "";
+	return it->second;
+}
+
+void ModStorage::setString(const std::string &key, const std::string &value)
+{
+	load();
+	if (value.empty()) {
+		if (m_values.erase(key) == 0)
+			return;
+	} else {
+		StringMap::iterator it = m_values.find(key);
+		if (it != m_values.end() && it->second == value)
+			return;
+		m_values[key] = value;
+	}
+	m_dirty_keys.insert(key);
+}
+
+void ModStorage::getKeys(std::vector<std::string> *keys)
+{
+	load();
+	keys->reserve(keys->size() + m_values.size());
+	for (StringMap::const_iterator it = m_values.begin();
+			it != m_values.end(); ++it)
+		keys->push_back(it->first);
+}
+
+const StringMap &ModStorage::getValues()
+{
+	load();
+	return m_values;
+}
+
+/*
+	ModStorageManager
+*/
+
+ModStorageManager::ModStorageManager(ModStorageDatabase *database) :
+	Thread("ModStorage"),
+	m_database(database),
+	m_write_failures(0)
+{
+}
+
+ModStorageManager::~ModStorageManager()
+{
+	save();
+
+	stop();
+	m_queue_sem.post();
+	wait();
+
+	// Anything the thread did not get to
+	while (!writeQueued())
+		;
+
+	for (std::map<std::string, ModStorage *>::iterator it = m_storages.begin();
+			it != m_storages.end(); ++it)
+		delete it->second;
+
+	delete m_database;
+}
+
+ModStorage *ModStorageManager::getStorage(const std::string &modname)
+{
+	std::map<std::string, ModStorage *>::iterator it = m_storages.find(modname);
+	if (it != m_storages.end())
+		return it->second;
+
+	ModStorage *storage = new ModStorage(this, modname);
+	m_storages[modname] = storage;
+	return storage;
+}
+
+void ModStorageManager::loadEntries(const std::string &modname, StringMap *values)
+{
+	MutexAutoLock lock(m_database_mutex);
+	try {
+		m_database->getModEntries(modname, values);
+	} catch (DatabaseException &e) {
+		errorstream << "ModStorage: Failed to load storage of mod \""
+			<< modname << "\": " << e.what() << std::endl;
+	}
+}
+
+void ModStorageManager::save()
+{
+	std::vector<ModStorageChange> batch;
+
+	for (std::map<std::string, ModStorage *>::iterator it = m_storages.begin();
+			it != m_storages.end(); ++it) {
+		ModStorage *storage = it->second;
+		if (!storage->isModified())
+			continue;
+
+		for (std::set<std::string>::const_iterator key =
+				storage->m_dirty_keys.begin();
+				key != storage->m_dirty_keys.end(); ++key) {
+			ModStorageChange change;
+			change.modname = storage->m_modname;
+			change.key = *key;
+			change.value = storage->getString(*key);
+			batch.push_back(change);
+		}
+		storage->m_dirty_keys.clear();
+	}
+
+	if (batch.empty())
+		return;
+
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		m_queue.push_back(std::vector<ModStorageChange>());
+		m_queue.back().swap(batch);
+	}
+	m_queue_sem.post();
+}
+
+void ModStorageManager::flush()
+{
+	save();
+	while (!writeQueued())
+		;
+}
+
+bool ModStorageManager::writeQueued()
+{
+	// Holding the database lock while taking batches keeps them in order
+	MutexAutoLock lock(m_database_mutex);
+
+	for (;;) {
+		std::vector<ModStorageChange> batch;
+		{
+			MutexAutoLock queue_lock(m_queue_mutex);
+			if (m_queue.empty())
+				return true;
+			batch.swap(m_queue.front());
+			m_queue.pop_front();
+		}
+
+		try {
+			m_database->beginSave();
+			for (std::vector<ModStorageChange>::const_iterator it = batch.begin();
+					it != batch.end(); ++it) {
+				// Some databases report failures only by the result
+				if (it->value.empty() ?
+						!m_database->removeModEntry(it->modname, it->key) :
+						!m_database->setModEntry(it->modname, it->key, it->value))
+					throw DatabaseException("Failed to write \"" + it->key +
+						"\" of mod \"" + it->modname + "\"");
+			}
+			m_database->endSave();
+			m_write_failures = 0;
+		} catch (DatabaseException &e) {
+			errorstream << "ModStorage: Failed to save " << batch.size()
+				<< " entries: " << e.what() << std::endl;
+			try {
+				m_database->rollbackSave();
+			} catch (DatabaseException &rollback_error) {
+				errorstream << "ModStorage: Failed to roll back: "
+					<< rollback_error.what() << std::endl;
+			}
+
+			// Later batches must not overtake this one
+			if (++m_write_failures < MOD_STORAGE_WRITE_ATTEMPTS) {
+				MutexAutoLock queue_lock(m_queue_mutex);
+				m_queue.push_front(std::vector<ModStorageChange>());
+				m_queue.front().swap(batch);
+				return false;
+			}
+			errorstream << "ModStorage: Dropped " << batch.size()
+				<< " entries after " << m_write_failures
+				<< " failed attempts" << std::endl;
+			m_write_failures = 0;
+		}
+	}
+}
+
+void *ModStorageManager::run()
+{
+	while (!stopRequested()) {
+		m_queue_sem.wait();
+		writeQueued();
+	}
+
+	return NULL;
+}
+
+ModStorageDatabase *ModStorageManager::createDatabase(const std::string &name,
+	const std::string &savedir, Settings &conf)
+{
+	if (name == "sqlite3")
+		return new ModStorageDatabase_SQLite3(savedir);
+	if (name == "dummy")
+		return new Database_Dummy();
+	#if USE_LEVELDB
+	if (name == "leveldb")
+		return new ModStorageDatabase_LevelDB(savedir);
+	#endif
+	#if USE_REDIS
+	if (name == "redis")
+		return new ModStorageDatabase_Redis(conf);
+	#endif
+	#if USE_POSTGRESQL
+	if (name == "postgresql")
+		return new Database_PostgreSQL(conf);
+	#endif
+
+	throw BaseException(std::string("Mod storage backend ") + name +
+		" not supported.");
+}
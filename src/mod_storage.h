@@ -0,0 +1,135 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MOD_STORAGE_HEADER
+#define MOD_STORAGE_HEADER
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "threading/mutex.h"
+#include "threading/semaphore.h"
+#include "threading/thread.h"
+#include "util/string.h"
+
+class ModStorageDatabase;
+class ModStorageManager;
+class Settings;
+
+/*
+	The key-value storage of one mod.
+
+	The entries are read from the database on first access, after that
+	all reads are served from memory. Changed keys are remembered until
+	the manager hands them to its writer thread.
+
+	Only used from the server thread.
+*/
+class ModStorage {
+public:
+	ModStorage(ModStorageManager *manager, const std::string &modname);
+
+	const std::string &getModName() const { return m_modname; }
+
+	bool contains(const std::string &key);
+	// Returns "" if the key is not set
+	std::string getString(const std::string &key);
+	// Setting a key to "" removes it
+	void setString(const std::string &key, const std::string &value);
+
+	void getKeys(std::vector<std::string> *keys);
+	const StringMap &getValues();
+
+	bool isModified() const { return !m_dirty_keys.empty(); }
+
+private:
+	friend class ModStorageManager;
+
+	void load();
+
+	ModStorageManager *m_manager;
+	std::string m_modname;
+	bool m_loaded;
+	StringMap m_values;
+	std::set<std::string> m_dirty_keys;
+};
+
+struct ModStorageChange {
+	std::string modname;
+	std::string key;
+	// "" removes the entry
+	std::string value;
+};
+
+/*
+	Owns the mod storages of a server and the database they are stored in.
+
+	save() collects the changes of all mods and queues them as one batch,
+	which the thread writes in a single database transaction, keeping the
+	database I/O off the server thread.
+*/
+class ModStorageManager : public Thread {
+public:
+	// Takes ownership of database
+	ModStorageManager(ModStorageDatabase *database);
+	// Writes all remaining changes
+	~ModStorageManager();
+
+	// Returns the storage of the mod, created on first use
+	ModStorage *getStorage(const std::string &modname);
+
+	// Queues the changes made since the last call for writing
+	void save();
+	// Writes all changes before returning
+	void flush();
+
+	// Creates the database for a world.mt mod_storage_backend
+	static ModStorageDatabase *createDatabase(const std::string &name,
+		const std::string &savedir, Settings &conf);
+
+protected:
+	void *run();
+
+private:
+	friend class ModStorage;
+
+	void loadEntries(const std::string &modname, StringMap *values);
+	/*
+		Writes the queued batches in order. A batch that fails is rolled
+		back and put back in front, to be tried again on the next call.
+		Returns false in that case.
+	*/
+	bool writeQueued();
+
+	ModStorageDatabase *m_database;
+	// Held while the database is used
+	Mutex m_database_mutex;
+	// Failed attempts to write the batch at the front of the queue
+	u32 m_write_failures;
+
+	std::map<std::string, ModStorage *> m_storages;
+
+	std::deque<std::vector<ModStorageChange> > m_queue;
+	Mutex m_queue_mutex;
+	Semaphore m_queue_sem;
+};
+
+#endif
@@ -26,63 +26,255 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "constants.h" // MAP_BLOCKSIZE
 #include <sstream>
 
+/*
+	NodeMetadataKeys
+*/
+
+u32 NodeMetadataKeys::intern(const std::string &name)
+{
+	u32 index;
+	if (find(name, &index))
+		return index;
+
+	// Keep m_sorted sorted, there are usually only a few names
+	std::vector<u32>::iterator it = m_sorted.begin();
+	while (it != m_sorted.end() && m_names[*it] < name)
+		++it;
+	index = m_names.size();
+	m_names.push_back(name);
+	m_sorted.insert(it, index);
+	return index;
+}
+
+bool NodeMetadataKeys::find(const std::string &name, u32 *index) const
+{
+	size_t lo = 0;
+	size_t hi = m_sorted.size();
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		int cmp = m_names[m_sorted[mid]].compare(name);
+		if (cmp == 0) {
+			*index = m_sorted[mid];
+			return true;
+		}
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+void NodeMetadataKeys::clear()
+{
+	m_names.clear();
+	m_sorted.clear();
+}
+
 /*
 	NodeMetadata
 */
 
 NodeMetadata::NodeMetadata(IItemDefManager *item_def_mgr):
-	m_stringvars(),
-	m_inventory(new Inventory(item_def_mgr))
+	m_item_def_mgr(item_def_mgr),
+	m_keys(new NodeMetadataKeys),
+	m_own_keys(true),
+	m_inventory(NULL)
+{
+}
+
+NodeMetadata::NodeMetadata(IItemDefManager *item_def_mgr,
+		NodeMetadataKeys *keys):
+	m_item_def_mgr(item_def_mgr),
+	m_keys(keys),
+	m_own_keys(false),
+	m_inventory(NULL)
 {
 }
 
 NodeMetadata::~NodeMetadata()
 {
 	delete m_inventory;
+	if (m_own_keys)
+		delete m_keys;
+}
+
+/*
+	Reads a serialized inventory the way Inventory::deSerialize() does,
+	without making the items. Returns false if it has no lists.
+*/
+static bool read_inventory_data(std::istream &is, std::string *data)
+{
+	bool has_lists = false;
+	bool in_list = false;
+	for (;;) {
+		std::string line;
+		if (!std::getline(is, line, '\n'))
+			throw SerializationError("unexpected end of inventory");
+		data->append(line);
+		data->push_back('\n');
+
+		std::string name = line.substr(0, line.find(' '));
+		if (in_list) {
+			if (name == "EndInventoryList" || name == "end")
+				in_list = false;
+		} else if (name == "EndInventory" || name == "end") {
+			break;
+		} else if (name == "List") {
+			has_lists = true;
+			in_list = true;
+		} else {
+			throw SerializationError("invalid inventory specifier: " + name);
+		}
+	}
+	return has_lists;
 }
 
 void NodeMetadata::serialize(std::ostream &os) const
 {
-	int num_vars = m_stringvars.size();
-	writeU32(os, num_vars);
-	for (StringMap::const_iterator
-			it = m_stringvars.begin();
-			it != m_stringvars.end(); ++it) {
-		os << serializeString(it->first);
-		os << serializeLongString(it->second);
+	writeU32(os, m_fields.size());
+	for (std::vector<Field>::const_iterator
+			it = m_fields.begin();
+			it != m_fields.end(); ++it) {
+		os << serializeString(m_keys->get(it->key));
+		// As serializeLongString(), without copying the value
+		if (it->length > LONG_STRING_MAX_LEN)
+			throw SerializationError("String too long for serializeLongString");
+		writeU32(os, it->length);
+		os.write(m_values.data() + it->offset, it->length);
 	}
 
-	m_inventory->serialize(os);
+	if (m_inventory)
+		m_inventory->serialize(os);
+	else if (!m_inventory_data.empty())
+		os << m_inventory_data;
+	else
+		os << "EndInventory\n";
 }
 
 void NodeMetadata::deSerialize(std::istream &is)
 {
-	m_stringvars.clear();
+	m_fields.clear();
+	m_values.clear();
 	int num_vars = readU32(is);
 	for(int i=0; i<num_vars; i++){
 		std::string name = deSerializeString(is);
 		std::string var = deSerializeLongString(is);
-		m_stringvars[name] = var;
+		setString(name, var);
 	}
 
-	m_inventory->deSerialize(is);
+	// An inventory in use is kept, there may be pointers to it
+	m_inventory_data.clear();
+	if (m_inventory) {
+		m_inventory->deSerialize(is);
+		return;
+	}
+	if (!read_inventory_data(is, &m_inventory_data))
+		m_inventory_data.clear();
 }
 
 void NodeMetadata::clear()
 {
-	m_stringvars.clear();
-	m_inventory->clear();
+	m_fields.clear();
+	m_values.clear();
+	if (m_inventory)
+		m_inventory->clear();
+	m_inventory_data.clear();
 }
 
 bool NodeMetadata::empty() const
 {
-	return m_stringvars.size() == 0 && m_inventory->getLists().size() == 0;
+	if (!m_fields.empty())
+		return false;
+	if (m_inventory)
+		return m_inventory->getLists().size() == 0;
+	return m_inventory_data.empty();
+}
+
+Inventory *NodeMetadata::getInventory()
+{
+	if (m_inventory)
+		return m_inventory;
+
+	m_inventory = new Inventory(m_item_def_mgr);
+	if (!m_inventory_data.empty()) {
+		std::istringstream is(m_inventory_data, std::ios::binary);
+		try {
+			m_inventory->deSerialize(is);
+		} catch (SerializationError &e) {
+			errorstream << "NodeMetadata::getInventory(): "
+				<< "invalid inventory: " << e.what() << std::endl;
+		}
+		std::string().swap(m_inventory_data);
+	}
+	return m_inventory;
+}
+
+void NodeMetadata::setKeys(NodeMetadataKeys *keys)
+{
+	if (keys == m_keys)
+		return;
+
+	for (std::vector<Field>::iterator
+			it = m_fields.begin();
+			it != m_fields.end(); ++it)
+		it->key = keys->intern(m_keys->get(it->key));
+
+	if (m_own_keys)
+		delete m_keys;
+	m_keys = keys;
+	m_own_keys = false;
+}
+
+const NodeMetadata::Field *NodeMetadata::findField(const std::string &name) const
+{
+	u32 key;
+	if (!m_keys->find(name, &key))
+		return NULL;
+
+	for (std::vector<Field>::const_iterator
+			it = m_fields.begin();
+			it != m_fields.end(); ++it) {
+		if (it->key == key)
+			return &(*it);
+	}
+	return NULL;
+}
+
+void NodeMetadata::eraseField(size_t i)
+{
+	Field field = m_fields[i];
+	m_values.erase(field.offset, field.length);
+	m_fields.erase(m_fields.begin() + i);
+
+	for (std::vector<Field>::iterator
+			it = m_fields.begin();
+			it != m_fields.end(); ++it) {
+		if (it->offset > field.offset)
+			it->offset -= field.length;
+	}
 }
 
 /*
 	NodeMetadataList
 */
 
+static inline u16 pack_node_index(v3s16 p)
+{
+	return p.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE + p.Y * MAP_BLOCKSIZE + p.X;
+}
+
+static inline v3s16 unpack_node_index(u16 p16)
+{
+	v3s16 p;
+	p.Z = p16 / MAP_BLOCKSIZE / MAP_BLOCKSIZE;
+	p16 &= MAP_BLOCKSIZE * MAP_BLOCKSIZE - 1;
+	p.Y = p16 / MAP_BLOCKSIZE;
+	p16 &= MAP_BLOCKSIZE - 1;
+	p.X = p16;
+	return p;
+}
+
 void NodeMetadataList::serialize(std::ostream &os) const
 {
 	/*
@@ -98,17 +290,15 @@ void NodeMetadataList::serialize(std::ostream &os) const
 	writeU8(os, 1); // version
 	writeU16(os, count);
 
-	for(std::map<v3s16, NodeMetadata*>::const_iterator
+	for (EntryVect::const_iterator
 			i = m_data.begin();
 			i != m_data.end(); ++i)
 	{
-		v3s16 p = i->first;
 		NodeMetadata *data = i->second;
 		if (data->empty())
 			continue;
 
-		u16 p16 = p.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE + p.Y * MAP_BLOCKSIZE + p.X;
-		writeU16(os, p16);
+		writeU16(os, i->first);
 
 		data->serialize(os);
 	}
@@ -137,14 +327,9 @@ void NodeMetadataList::deSerialize(std::istream &is, IItemDefManager *item_def_m
 	for (u16 i=0; i < count; i++) {
 		u16 p16 = readU16(is);
 
-		v3s16 p;
-		p.Z = p16 / MAP_BLOCKSIZE / MAP_BLOCKSIZE;
-		p16 &= MAP_BLOCKSIZE * MAP_BLOCKSIZE - 1;
-		p.Y = p16 / MAP_BLOCKSIZE;
-		p16 &= MAP_BLOCKSIZE - 1;
-		p.X = p16;
-
-		if (m_data.find(p) != m_data.end()) {
+		EntryVect::iterator it = find(p16);
+		if (it != m_data.end() && it->first == p16) {
+			v3s16 p = unpack_node_index(p16);
 			warningstream<<"NodeMetadataList::deSerialize(): "
 					<<"already set data at position"
 					<<"("<<p.X<<","<<p.Y<<","<<p.Z<<"): Ignoring."
@@ -152,9 +337,9 @@ void NodeMetadataList::deSerialize(std::istream &is, IItemDefManager *item_def_m
 			continue;
 		}
 
-		NodeMetadata *data = new NodeMetadata(item_def_mgr);
+		NodeMetadata *data = new NodeMetadata(item_def_mgr, &m_keys);
+		m_data.insert(it, Entry(p16, data));
 		data->deSerialize(is);
-		m_data[p] = data;
 	}
 }
 
@@ -166,50 +351,62 @@ NodeMetadataList::~NodeMetadataList()
 std::vector<v3s16> NodeMetadataList::getAllKeys()
 {
 	std::vector<v3s16> keys;
+	keys.reserve(m_data.size());
 
-	std::map<v3s16, NodeMetadata *>::const_iterator it;
+	EntryVect::const_iterator it;
 	for (it = m_data.begin(); it != m_data.end(); ++it)
-		keys.push_back(it->first);
+		keys.push_back(unpack_node_index(it->first));
 
 	return keys;
 }
 
 NodeMetadata *NodeMetadataList::get(v3s16 p)
 {
-	std::map<v3s16, NodeMetadata *>::const_iterator n = m_data.find(p);
-	if (n == m_data.end())
+	u16 p16 = pack_node_index(p);
+	EntryVect::iterator it = find(p16);
+	if (it == m_data.end() || it->first != p16)
 		return NULL;
-	return n->second;
+	return it->second;
 }
 
 void NodeMetadataList::remove(v3s16 p)
 {
-	NodeMetadata *olddata = get(p);
-	if (olddata) {
-		delete olddata;
-		m_data.erase(p);
+	u16 p16 = pack_node_index(p);
+	EntryVect::iterator it = find(p16);
+	if (it != m_data.end() && it->first == p16) {
+		delete it->second;
+		m_data.erase(it);
 	}
 }
 
 void NodeMetadataList::set(v3s16 p, NodeMetadata *d)
 {
-	remove(p);
-	m_data.insert(std::make_pair(p, d));
+	d->setKeys(&m_keys);
+
+	u16 p16 = pack_node_index(p);
+	EntryVect::iterator it = find(p16);
+	if (it != m_data.end() && it->first == p16) {
+		delete it->second;
+		it->second = d;
+	} else {
+		m_data.insert(it, Entry(p16, d));
+	}
 }
 
 void NodeMetadataList::clear()
 {
-	std::map<v3s16, NodeMetadata*>::iterator it;
+	EntryVect::iterator it;
 	for (it = m_data.begin(); it != m_data.end(); ++it) {
 		delete it->second;
 	}
 	m_data.clear();
+	m_keys.clear();
 }
 
 int NodeMetadataList::countNonEmpty() const
 {
 	int n = 0;
-	std::map<v3s16, NodeMetadata*>::const_iterator it;
+	EntryVect::const_iterator it;
 	for (it = m_data.begin(); it != m_data.end(); ++it) {
 		if (!it->second->empty())
 			n++;
@@ -217,23 +414,64 @@ int NodeMetadataList::countNonEmpty() const
 	return n;
 }
 
+NodeMetadataList::EntryVect::iterator NodeMetadataList::find(u16 p16)
+{
+	size_t lo = 0;
+	size_t hi = m_data.size();
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (m_data[mid].first < p16)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return m_data.begin() + lo;
+}
+
 std::string NodeMetadata::getString(const std::string &name,
 	unsigned short recursion) const
 {
-	StringMap::const_iterator it = m_stringvars.find(name);
-	if (it == m_stringvars.end())
+	const Field *field = findField(name);
+	if (field == NULL)
 		return "";
 
-	return resolveString(it->second, recursion);
+	return resolveString(m_values.substr(field->offset, field->length),
+		recursion);
 }
 
 void NodeMetadata::setString(const std::string &name, const std::string &var)
 {
-	if (var.empty()) {
-		m_stringvars.erase(name);
-	} else {
-		m_stringvars[name] = var;
+	u32 key;
+	bool known = m_keys->find(name, &key);
+	if (known) {
+		for (size_t i = 0; i < m_fields.size(); i++) {
+			if (m_fields[i].key == key) {
+				eraseField(i);
+				break;
+			}
+		}
+	}
+	if (var.empty())
+		return;
+
+	Field field;
+	field.key = known ? key : m_keys->intern(name);
+	field.offset = m_values.size();
+	field.length = var.size();
+	m_values.append(var);
+	m_fields.push_back(field);
+}
+
+StringMap NodeMetadata::getStrings() const
+{
+	StringMap vars;
+	for (std::vector<Field>::const_iterator
+			it = m_fields.begin();
+			it != m_fields.end(); ++it) {
+		vars[m_keys->get(it->key)] =
+			m_values.substr(it->offset, it->length);
 	}
+	return vars;
 }
 
 std::string NodeMetadata::resolveString(const std::string &str,
@@ -25,6 +25,34 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <vector>
 #include "util/string.h"
 
+/*
+	Names of the metadata fields of the nodes of a block. Every name is
+	stored once and the fields refer to it by its index.
+
+	Names are only dropped when all metadata of the block is cleared.
+*/
+
+class NodeMetadataKeys
+{
+public:
+	// Returns the index of name, adding it if needed
+	u32 intern(const std::string &name);
+	// Returns false if name was never added
+	bool find(const std::string &name, u32 *index) const;
+
+	const std::string &get(u32 index) const
+	{
+		return m_names[index];
+	}
+
+	void clear();
+
+private:
+	std::vector<std::string> m_names;
+	// Indices of m_names, sorted by name
+	std::vector<u32> m_sorted;
+};
+
 /*
 	NodeMetadata stores arbitary amounts of data for special blocks.
 	Used for furnaces, chests and signs.
@@ -32,6 +60,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 	There are two interaction methods: inventory menu and text input.
 	Only one can be used for a single metadata, thus only inventory OR
 	text input should exist in a metadata.
+
+	The values are kept one after another in a single string. A loaded
+	inventory is kept serialized until getInventory() is called.
 */
 
 class Inventory;
@@ -40,7 +71,9 @@ class IItemDefManager;
 class NodeMetadata
 {
 public:
+	// The metadata has its own names until it is put into a list
 	NodeMetadata(IItemDefManager *item_def_mgr);
+	NodeMetadata(IItemDefManager *item_def_mgr, NodeMetadataKeys *keys);
 	~NodeMetadata();
 
 	void serialize(std::ostream &os) const;
@@ -54,20 +87,39 @@ class NodeMetadata
 	void setString(const std::string &name, const std::string &var);
 	// Support variable names in values
 	std::string resolveString(const std::string &str, unsigned short recursion = 0) const;
-	StringMap getStrings() const
-	{
-		return m_stringvars;
-	}
+	StringMap getStrings() const;
 
 	// The inventory
-	Inventory *getInventory()
-	{
-		return m_inventory;
-	}
+	Inventory *getInventory();
+
+	// Makes the fields refer to the names in keys
+	void setKeys(NodeMetadataKeys *keys);
 
 private:
-	StringMap m_stringvars;
+	struct Field {
+		u32 key;
+		u32 offset;
+		u32 length;
+	};
+
+	// Returns NULL if there is no such field
+	const Field *findField(const std::string &name) const;
+	void eraseField(size_t i);
+
+	IItemDefManager *m_item_def_mgr;
+	NodeMetadataKeys *m_keys;
+	bool m_own_keys;
+
+	std::vector<Field> m_fields;
+	std::string m_values;
+
+	// NULL until the inventory is used
 	Inventory *m_inventory;
+	// The serialized inventory if it was not used since being loaded
+	std::string m_inventory_data;
+
+	NodeMetadata(const NodeMetadata &);
+	NodeMetadata &operator=(const NodeMetadata &);
 };
 
 
@@ -95,9 +147,16 @@ class NodeMetadataList
 	void clear();
 
 private:
+	typedef std::pair<u16, NodeMetadata *> Entry;
+	typedef std::vector<Entry> EntryVect;
+
 	int countNonEmpty() const;
+	// The entry of p16, or where it would be inserted
+	EntryVect::iterator find(u16 p16);
 
-	std::map<v3s16, NodeMetadata *> m_data;
+	// Sorted by the index of the node in the block
+	EntryVect m_data;
+	NodeMetadataKeys m_keys;
 };
 
 #endif
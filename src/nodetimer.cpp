@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "serialization.h"
 #include "util/serialize.h"
 #include "constants.h" // MAP_BLOCKSIZE
+#include <cmath>
 
 /*
 	NodeTimer
@@ -65,7 +66,7 @@ void NodeTimerList::serialize(std::ostream &os, u8 map_format_version) const
 			i != m_timers.end(); ++i) {
 		NodeTimer t = i->second;
 		NodeTimer nt = NodeTimer(t.timeout,
-			t.timeout - (f32)(i->first - m_time), t.position);
+			t.timeout - (f32)(i->first - getTime()), t.position);
 		v3s16 p = t.position;
 
 		u16 p16 = p.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE + p.Y * MAP_BLOCKSIZE + p.X;
@@ -127,18 +128,46 @@ void NodeTimerList::deSerialize(std::istream &is, u8 map_format_version)
 	}
 }
 
+std::string NodeTimerList::readSerialized(std::istream &is, u8 map_format_version)
+{
+	FATAL_ERROR_IF(map_format_version < 25, "Unsupported map format version");
+
+	// length of the data for a single timer, count
+	char header[1 + 2];
+	if (!is.read(header, sizeof(header)))
+		throw SerializationError("NodeTimerList::readSerialized(): "
+				"unexpected end of data");
+	u8 timer_data_len = readU8((u8 *)&header[0]);
+	if(timer_data_len != 2+4+4)
+		throw SerializationError("unsupported NodeTimer data length");
+	u16 count = readU16((u8 *)&header[1]);
+
+	std::string data(header, sizeof(header));
+	data.resize(sizeof(header) + count * timer_data_len);
+	if (count != 0 && !is.read(&data[sizeof(header)], count * timer_data_len))
+		throw SerializationError("NodeTimerList::readSerialized(): "
+				"unexpected end of data");
+	return data;
+}
+
 std::vector<NodeTimer> NodeTimerList::step(float dtime)
 {
-	std::vector<NodeTimer> elapsed_timers;
 	m_time += dtime;
-	if (m_next_trigger_time == -1. || m_time < m_next_trigger_time) {
+	return popElapsed();
+}
+
+std::vector<NodeTimer> NodeTimerList::popElapsed()
+{
+	std::vector<NodeTimer> elapsed_timers;
+	double time = getTime();
+	if (m_next_trigger_time == -1. || time < m_next_trigger_time) {
 		return elapsed_timers;
 	}
 	std::multimap<double, NodeTimer>::iterator i = m_timers.begin();
 	// Process timers
-	for (; i != m_timers.end() && i->first <= m_time; ++i) {
+	for (; i != m_timers.end() && i->first <= time; ++i) {
 		NodeTimer t = i->second;
-		t.elapsed = t.timeout + (f32)(m_time - i->first);
+		t.elapsed = t.timeout + (f32)(time - i->first);
 		elapsed_timers.push_back(t);
 		m_iterators.erase(t.position);
 	}
@@ -150,3 +179,115 @@ std::vector<NodeTimer> NodeTimerList::step(float dtime)
 		m_next_trigger_time = m_timers.begin()->first;
 	return elapsed_timers;
 }
+
+void NodeTimerList::attachClock(const double *clock)
+{
+	double offset = *clock - getTime();
+	m_clock = clock;
+	if (offset == 0.)
+		return;
+
+	// Move the trigger times to the new time base
+	std::multimap<double, NodeTimer> timers;
+	timers.swap(m_timers);
+	m_iterators.clear();
+	for (std::multimap<double, NodeTimer>::const_iterator
+			i = timers.begin(); i != timers.end(); ++i) {
+		std::multimap<double, NodeTimer>::iterator it = m_timers.insert(
+			m_timers.end(), std::make_pair(i->first + offset, i->second));
+		m_iterators[i->second.position] = it;
+	}
+	if (m_next_trigger_time != -1.)
+		m_next_trigger_time += offset;
+}
+
+void NodeTimerList::detachClock()
+{
+	m_time = getTime();
+	m_clock = NULL;
+}
+
+/*
+	NodeTimerWheel
+*/
+
+NodeTimerWheel::NodeTimerWheel(double tick_length):
+	m_tick_length(tick_length),
+	m_tick(0),
+	m_size(0)
+{
+}
+
+void NodeTimerWheel::insert(v3s16 blockpos, double time)
+{
+	insertEntry(Entry(blockpos, time));
+	m_size++;
+}
+
+void NodeTimerWheel::insertEntry(const Entry &entry)
+{
+	// The first tick at which the entry is due
+	double ticks = ceil(entry.time / m_tick_length);
+	if (ticks <= (double)m_tick) {
+		m_due.push_back(entry);
+		return;
+	}
+	u64 tick = ticks < 1e18 ? (u64)ticks : (u64)1e18;
+
+	// The lowest level whose slots reach the tick, the last one takes
+	// everything further away and is cascaded again when its slot comes up
+	u64 delta = tick - m_tick;
+	u32 level = 0;
+	while (level + 1 < NODETIMER_WHEEL_LEVELS &&
+			delta >= (u64)1 << (NODETIMER_WHEEL_BITS * (level + 1)))
+		level++;
+
+	u32 slot = (tick >> (NODETIMER_WHEEL_BITS * level)) &
+		(NODETIMER_WHEEL_SLOTS - 1);
+	m_slots[level][slot].push_back(entry);
+}
+
+void NodeTimerWheel::cascade(u32 level)
+{
+	u32 slot = (m_tick >> (NODETIMER_WHEEL_BITS * level)) &
+		(NODETIMER_WHEEL_SLOTS - 1);
+	std::vector<Entry> entries;
+	entries.swap(m_slots[level][slot]);
+	for (std::vector<Entry>::const_iterator i = entries.begin();
+			i != entries.end(); ++i)
+		insertEntry(*i);
+}
+
+void NodeTimerWheel::advance(double time, std::vector<Entry> *due)
+{
+	u64 target = time > 0 ? (u64)(time / m_tick_length) : 0;
+	while (m_tick < target) {
+		m_tick++;
+		// Bring down the entries of the higher level slots that begin now
+		for (u32 level = 1; level < NODETIMER_WHEEL_LEVELS; level++) {
+			if ((m_tick >> (NODETIMER_WHEEL_BITS * (level - 1))) &
+					(NODETIMER_WHEEL_SLOTS - 1))
+				break;
+			cascade(level);
+		}
+
+		std::vector<Entry> &slot =
+			m_slots[0][m_tick & (NODETIMER_WHEEL_SLOTS - 1)];
+		due->insert(due->end(), slot.begin(), slot.end());
+		m_size -= slot.size();
+		slot.clear();
+	}
+
+	due->insert(due->end(), m_due.begin(), m_due.end());
+	m_size -= m_due.size();
+	m_due.clear();
+}
+
+void NodeTimerWheel::clear()
+{
+	for (u32 level = 0; level < NODETIMER_WHEEL_LEVELS; level++)
+		for (u32 slot = 0; slot < NODETIMER_WHEEL_SLOTS; slot++)
+			m_slots[level][slot].clear();
+	m_due.clear();
+	m_size = 0;
+}
@@ -53,16 +53,24 @@ class NodeTimer
 
 /*
 	List of timers of all the nodes of a block
+
+	The list keeps its own time while its block is inactive. An active block
+	is attached to the clock of the environment, which then schedules the
+	list in its NodeTimerWheel instead of stepping it.
 */
 
 class NodeTimerList
 {
 public:
-	NodeTimerList(): m_next_trigger_time(-1.), m_time(0.) {}
+	NodeTimerList(): m_next_trigger_time(-1.), m_time(0.), m_clock(NULL),
+		m_scheduled_time(-1.) {}
 	~NodeTimerList() {}
 	
 	void serialize(std::ostream &os, u8 map_format_version) const;
 	void deSerialize(std::istream &is, u8 map_format_version);
+	// Reads a serialized list without parsing the timers, for deSerialize()
+	// Only for map format version 25 and later
+	static std::string readSerialized(std::istream &is, u8 map_format_version);
 	
 	// Get timer
 	NodeTimer get(const v3s16 &p) {
@@ -71,7 +79,7 @@ class NodeTimerList
 		if (n == m_iterators.end())
 			return NodeTimer();
 		NodeTimer t = n->second->second;
-		t.elapsed = t.timeout - (n->second->first - m_time);
+		t.elapsed = t.timeout - (n->second->first - getTime());
 		return t;
 	}
 	// Deletes timer
@@ -96,7 +104,7 @@ class NodeTimerList
 	// Undefined behaviour if there already is a timer
 	void insert(NodeTimer timer) {
 		v3s16 p = timer.position;
-		double trigger_time = m_time + (double)(timer.timeout - timer.elapsed);
+		double trigger_time = getTime() + (double)(timer.timeout - timer.elapsed);
 		std::multimap<double, NodeTimer>::iterator it =
 			m_timers.insert(std::pair<double, NodeTimer>(
 				trigger_time, timer
@@ -122,14 +130,88 @@ class NodeTimerList
 		return m_next_trigger_time;
 	}
 
+	inline double getTime() const {
+		return m_clock ? *m_clock : m_time;
+	}
+
 	// Move forward in time, returns elapsed timers
 	std::vector<NodeTimer> step(float dtime);
+	// Returns the timers elapsed at the current time
+	std::vector<NodeTimer> popElapsed();
+
+	// Follow the given clock instead of the own time, keeping the remaining
+	// time of the timers. The clock has to outlive the attachment.
+	void attachClock(const double *clock);
+	// Continue with the own time from the time of the clock
+	void detachClock();
+	inline bool isAttachedTo(const double *clock) const {
+		return m_clock == clock;
+	}
+
+	// Time of the NodeTimerWheel entry that is due for this list, -1 if none
+	inline double getScheduledTime() const {
+		return m_scheduled_time;
+	}
+	inline void setScheduledTime(double time) {
+		m_scheduled_time = time;
+	}
 
 private:
 	std::multimap<double, NodeTimer> m_timers;
 	std::map<v3s16, std::multimap<double, NodeTimer>::iterator> m_iterators;
 	double m_next_trigger_time;
 	double m_time;
+	const double *m_clock;
+	double m_scheduled_time;
+};
+
+/*
+	Schedules the timer lists of the active blocks by absolute time.
+
+	A hierarchical timing wheel: each level has NODETIMER_WHEEL_SLOTS slots,
+	and a slot of a level spans all the slots of the level below. Inserting
+	is O(1), and advancing only looks at the slots of the passed ticks,
+	moving the entries of a higher level slot down when its time comes.
+	Entries are never removed; the one handling a due entry has to check
+	whether it still is the scheduled one of its block.
+*/
+
+#define NODETIMER_WHEEL_BITS 6
+#define NODETIMER_WHEEL_SLOTS (1 << NODETIMER_WHEEL_BITS)
+#define NODETIMER_WHEEL_LEVELS 4
+
+class NodeTimerWheel
+{
+public:
+	struct Entry {
+		Entry(v3s16 blockpos_, double time_):
+			blockpos(blockpos_), time(time_) {}
+
+		v3s16 blockpos;
+		double time;
+	};
+
+	NodeTimerWheel(double tick_length);
+
+	// Entries in the past are due at the next advance()
+	void insert(v3s16 blockpos, double time);
+	// Move forward to time, appends the entries that are due
+	void advance(double time, std::vector<Entry> *due);
+	void clear();
+
+	u32 size() const { return m_size; }
+
+private:
+	void insertEntry(const Entry &entry);
+	void cascade(u32 level);
+
+	double m_tick_length;
+	// The last tick that has been advanced to
+	u64 m_tick;
+	std::vector<Entry> m_slots[NODETIMER_WHEEL_LEVELS][NODETIMER_WHEEL_SLOTS];
+	// Entries that are already due
+	std::vector<Entry> m_due;
+	u32 m_size;
 };
 
 #endif
@@ -27,6 +27,7 @@
 #include "noise.h"
 #include <iostream>
 #include <string.h> // memset
+#include <vector>
 #include "debug.h"
 #include "util/numeric.h"
 #include "util/string.h"
@@ -425,6 +426,35 @@ float NoisePerlin3D(NoiseParams *np, float x, float y, float z, s32 seed)
 }
 
 
+void NoiseBounds(const NoiseParams *np, float *min, float *max)
+{
+	NoiseBounds(np, np->persist, min, max);
+}
+
+
+void NoiseBounds(const NoiseParams *np, float max_persist, float *min, float *max)
+{
+	// Every octave is an interpolation of lattice values in [-1, 1] and thus
+	// stays within [-1, 1] itself, so the sum is bounded by the sum of the
+	// octave weights.
+	float amp = 0.0f;
+	float g = 1.0f;
+	for (size_t i = 0; i < np->octaves; i++) {
+		amp += g;
+		g *= fabs(max_persist);
+	}
+
+	// Leave some room for rounding errors in the accumulation
+	amp = amp * 1.001f + 0.001f;
+
+	float lo = (np->flags & NOISE_FLAG_ABSVALUE) ? 0.0f : -amp;
+	float a = np->offset + lo * np->scale;
+	float b = np->offset + amp * np->scale;
+
+	*min = MYMIN(a, b);
+	*max = MYMAX(a, b);
+}
+
 Noise::Noise(NoiseParams *np_, s32 seed, u32 sx, u32 sy, u32 sz)
 {
 	memcpy(&np, np_, sizeof(np));
@@ -503,7 +533,7 @@ void Noise::setOctaves(int octaves)
 }
 
 
-void Noise::resizeNoiseBuf(bool is3d)
+size_t Noise::getNoiseBufSize(bool is3d)
 {
 	//maximum possible spread value factor
 	float ofactor = (np.lacunarity > 1.0) ?
@@ -528,9 +558,17 @@ void Noise::resizeNoiseBuf(bool is3d)
 	size_t nly = (size_t)ceil(num_noise_points_y) + 3;
 	size_t nlz = is3d ? (size_t)ceil(num_noise_points_z) + 3 : 1;
 
+	return nlx * nly * nlz;
+}
+
+
+void Noise::resizeNoiseBuf(bool is3d)
+{
+	size_t bufsize = getNoiseBufSize(is3d);
+
 	delete[] noise_buf;
 	try {
-		noise_buf = new float[nlx * nly * nlz];
+		noise_buf = new float[bufsize];
 	} catch (std::bad_alloc &e) {
 		throw InvalidNoiseParamsException();
 	}
@@ -617,12 +655,29 @@ void Noise::gradientMap3D(
 		float x, float y, float z,
 		float step_x, float step_y, float step_z,
 		s32 seed)
+{
+	gradientRows3D(x, y, z, step_x, step_y, step_z, seed,
+		0, sy, noise_buf, gradient_buf);
+}
+
+
+/*
+ * Computes the rows y_begin to y_end - 1 of the 3D gradient map into out,
+ * which has room for sx * (y_end - y_begin) * sz values, using lattice as
+ * buffer for the noise lattice.  The values are exactly the same as in the
+ * corresponding rows of the whole map.
+ */
+void Noise::gradientRows3D(
+		float x, float y, float z,
+		float step_x, float step_y, float step_z,
+		s32 seed, u32 y_begin, u32 y_end,
+		float *lattice, float *out)
 {
 	float v000, v010, v100, v110;
 	float v001, v011, v101, v111;
 	float u, v, w, orig_u, orig_v;
 	u32 index, i, j, k, noisex, noisey, noisez;
-	u32 nlx, nly, nlz;
+	u32 nlx, nly, nlz, lattice_y;
 	s32 x0, y0, z0;
 
 	Interp3dFxn interpolate = (np.flags & NOISE_FLAG_EASED) ?
@@ -634,18 +689,30 @@ void Noise::gradientMap3D(
 	u = x - (float)x0;
 	v = y - (float)y0;
 	w = z - (float)z0;
+
+	// Step over the rows before y_begin the same way as the loop below,
+	// so that v and the lattice row match the whole map exactly
+	lattice_y = 0;
+	for (j = 0; j != y_begin; j++) {
+		v += step_y;
+		if (v >= 1.0) {
+			v -= 1.0;
+			lattice_y++;
+		}
+	}
+
 	orig_u = u;
 	orig_v = v;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
-	nly = (u32)(v + sy * step_y) + 2;
+	nly = (u32)(v + (y_end - y_begin) * step_y) + 2;
 	nlz = (u32)(w + sz * step_z) + 2;
 	index = 0;
 	for (k = 0; k != nlz; k++)
 		for (j = 0; j != nly; j++)
 			for (i = 0; i != nlx; i++)
-				noise_buf[index++] = noise3d(x0 + i, y0 + j, z0 + k, seed);
+				lattice[index++] = noise3d(x0 + i, y0 + lattice_y + j, z0 + k, seed);
 
 	//calculate interpolations
 	index  = 0;
@@ -654,20 +721,20 @@ void Noise::gradientMap3D(
 	for (k = 0; k != sz; k++) {
 		v = orig_v;
 		noisey = 0;
-		for (j = 0; j != sy; j++) {
-			v000 = noise_buf[idx(0, noisey,     noisez)];
-			v100 = noise_buf[idx(1, noisey,     noisez)];
-			v010 = noise_buf[idx(0, noisey + 1, noisez)];
-			v110 = noise_buf[idx(1, noisey + 1, noisez)];
-			v001 = noise_buf[idx(0, noisey,     noisez + 1)];
-			v101 = noise_buf[idx(1, noisey,     noisez + 1)];
-			v011 = noise_buf[idx(0, noisey + 1, noisez + 1)];
-			v111 = noise_buf[idx(1, noisey + 1, noisez + 1)];
+		for (j = y_begin; j != y_end; j++) {
+			v000 = lattice[idx(0, noisey,     noisez)];
+			v100 = lattice[idx(1, noisey,     noisez)];
+			v010 = lattice[idx(0, noisey + 1, noisez)];
+			v110 = lattice[idx(1, noisey + 1, noisez)];
+			v001 = lattice[idx(0, noisey,     noisez + 1)];
+			v101 = lattice[idx(1, noisey,     noisez + 1)];
+			v011 = lattice[idx(0, noisey + 1, noisez + 1)];
+			v111 = lattice[idx(1, noisey + 1, noisez + 1)];
 
 			u = orig_u;
 			noisex = 0;
 			for (i = 0; i != sx; i++) {
-				gradient_buf[index++] = interpolate(
+				out[index++] = interpolate(
 					v000, v100, v010, v110,
 					v001, v101, v011, v111,
 					u, v, w);
@@ -678,12 +745,12 @@ void Noise::gradientMap3D(
 					noisex++;
 					v000 = v100;
 					v010 = v110;
-					v100 = noise_buf[idx(noisex + 1, noisey,     noisez)];
-					v110 = noise_buf[idx(noisex + 1, noisey + 1, noisez)];
+					v100 = lattice[idx(noisex + 1, noisey,     noisez)];
+					v110 = lattice[idx(noisex + 1, noisey + 1, noisez)];
 					v001 = v101;
 					v011 = v111;
-					v101 = noise_buf[idx(noisex + 1, noisey,     noisez + 1)];
-					v111 = noise_buf[idx(noisex + 1, noisey + 1, noisez + 1)];
+					v101 = lattice[idx(noisex + 1, noisey,     noisez + 1)];
+					v111 = lattice[idx(noisex + 1, noisey + 1, noisez + 1)];
 				}
 			}
 
@@ -779,6 +846,59 @@ float *Noise::perlinMap3D(float x, float y, float z, float *persistence_map)
 }
 
 
+float *Noise::perlinMap3DSlab(float x, float y, float z,
+	u32 y_begin, u32 y_end)
+{
+	float f = 1.0, g = 1.0;
+	size_t layersize = sx * sy;
+	size_t slabsize = sx * (y_end - y_begin);
+
+	// Own buffers, as other threads may compute other rows concurrently
+	std::vector<float> lattice(getNoiseBufSize(true));
+	std::vector<float> gradient(slabsize * sz);
+
+	x /= np.spread.X;
+	y /= np.spread.Y;
+	z /= np.spread.Z;
+
+	for (size_t k = 0; k != sz; k++)
+		memset(&result[k * layersize + y_begin * sx], 0,
+			sizeof(float) * slabsize);
+
+	for (size_t oct = 0; oct < np.octaves; oct++) {
+		gradientRows3D(x * f, y * f, z * f,
+			f / np.spread.X, f / np.spread.Y, f / np.spread.Z,
+			seed + np.seed + oct, y_begin, y_end,
+			&lattice[0], &gradient[0]);
+
+		for (size_t k = 0; k != sz; k++) {
+			float *res = &result[k * layersize + y_begin * sx];
+			const float *grad = &gradient[k * slabsize];
+			if (np.flags & NOISE_FLAG_ABSVALUE) {
+				for (size_t i = 0; i != slabsize; i++)
+					res[i] += g * fabs(grad[i]);
+			} else {
+				for (size_t i = 0; i != slabsize; i++)
+					res[i] += g * grad[i];
+			}
+		}
+
+		f *= np.lacunarity;
+		g *= np.persist;
+	}
+
+	if (fabs(np.offset - 0.f) > 0.00001 || fabs(np.scale - 1.f) > 0.00001) {
+		for (size_t k = 0; k != sz; k++) {
+			float *res = &result[k * layersize + y_begin * sx];
+			for (size_t i = 0; i != slabsize; i++)
+				res[i] = res[i] * np.scale + np.offset;
+		}
+	}
+
+	return result;
+}
+
+
 void Noise::updateResults(float g, float *gmap,
 	float *persistence_map, size_t bufsize)
 {
@@ -176,6 +176,11 @@ class Noise {
 	float *perlinMap2D(float x, float y, float *persistence_map=NULL);
 	float *perlinMap3D(float x, float y, float z, float *persistence_map=NULL);
 
+	// Computes only the rows y_begin to y_end - 1 of the 3D map into result,
+	// with the same values as perlinMap3D() (without persistence map).
+	// Different rows of the same map may be computed concurrently.
+	float *perlinMap3DSlab(float x, float y, float z, u32 y_begin, u32 y_end);
+
 	inline float *perlinMap2D_PO(float x, float xoff, float y, float yoff,
 		float *persistence_map=NULL)
 	{
@@ -197,7 +202,13 @@ class Noise {
 
 private:
 	void allocBuffers();
+	size_t getNoiseBufSize(bool is3d);
 	void resizeNoiseBuf(bool is3d);
+	void gradientRows3D(
+		float x, float y, float z,
+		float step_x, float step_y, float step_z,
+		s32 seed, u32 y_begin, u32 y_end,
+		float *lattice, float *out);
 	void updateResults(float g, float *gmap, float *persistence_map, size_t bufsize);
 
 };
@@ -224,6 +235,12 @@ inline float NoisePerlin3D_PO(NoiseParams *np, float x, float xoff,
 		seed);
 }
 
+// Conservative bounds of the values NoisePerlin*() and Noise::perlinMap*()
+// can return for the given parameters.  If a persistence map is used, pass
+// the largest absolute persistence it may contain as max_persist.
+void NoiseBounds(const NoiseParams *np, float *min, float *max);
+void NoiseBounds(const NoiseParams *np, float max_persist, float *min, float *max);
+
 // Return value: -1 ... 1
 float noise2d(int x, int y, s32 seed);
 float noise3d(int x, int y, int z, s32 seed);
@@ -715,7 +715,7 @@ MapNode readnode(lua_State *L, int index, INodeDefManager *ndef)
 	lua_getfield(L, index, "name");
 	if (!lua_isstring(L, -1))
 		throw LuaError("Node name is not set or is not a string!");
-	const char *name = lua_tostring(L, -1);
+	content_t c = read_node_name(L, -1, ndef);
 	lua_pop(L, 1);
 
 	u8 param1 = 0;
@@ -730,14 +730,14 @@ MapNode readnode(lua_State *L, int index, INodeDefManager *ndef)
 		param2 = lua_tonumber(L, -1);
 	lua_pop(L, 1);
 
-	return MapNode(ndef, name, param1, param2);
+	return MapNode(c, param1, param2);
 }
 
 /******************************************************************************/
 void pushnode(lua_State *L, const MapNode &n, INodeDefManager *ndef)
 {
-	lua_newtable(L);
-	lua_pushstring(L, ndef->get(n).name.c_str());
+	lua_createtable(L, 0, 3);
+	push_node_name(L, n.getContent(), ndef);
 	lua_setfield(L, -2, "name");
 	lua_pushnumber(L, n.getParam1());
 	lua_setfield(L, -2, "param1");
@@ -745,6 +745,84 @@ void pushnode(lua_State *L, const MapNode &n, INodeDefManager *ndef)
 	lua_setfield(L, -2, "param2");
 }
 
+/******************************************************************************/
+/*
+	Node names are cached in a registry table, mapping content ids to
+	name strings and name strings to content ids. Lua strings are interned,
+	so looking up a name that already is a Lua string is cheap.
+	The mapping can change until all nodes are registered, the cache is
+	only used after that.
+*/
+static bool push_node_name_cache(lua_State *L, INodeDefManager *ndef)
+{
+	if (!ndef->getNodeRegistrationStatus())
+		return false;
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, CUSTOM_RIDX_NODE_NAME_CACHE);
+	if (lua_istable(L, -1))
+		return true;
+
+	lua_pop(L, 1);
+	lua_newtable(L);
+	lua_pushvalue(L, -1);
+	lua_rawseti(L, LUA_REGISTRYINDEX, CUSTOM_RIDX_NODE_NAME_CACHE);
+	return true;
+}
+
+content_t read_node_name(lua_State *L, int index, INodeDefManager *ndef)
+{
+	if (index < 0)
+		index = lua_gettop(L) + index + 1;
+
+	// Numbers are valid names too, but would clash with the content ids
+	if (lua_type(L, index) != LUA_TSTRING || !push_node_name_cache(L, ndef)) {
+		content_t c = CONTENT_IGNORE;
+		ndef->getId(lua_tostring(L, index), c);
+		return c;
+	}
+	int cache = lua_gettop(L);
+
+	lua_pushvalue(L, index);
+	lua_rawget(L, cache);
+	if (lua_isnumber(L, -1)) {
+		content_t c = lua_tointeger(L, -1);
+		lua_pop(L, 2);
+		return c;
+	}
+	lua_pop(L, 1);
+
+	// Unknown names are cached as CONTENT_IGNORE, like MapNode does
+	size_t len;
+	const char *name = lua_tolstring(L, index, &len);
+	content_t c = CONTENT_IGNORE;
+	ndef->getId(std::string(name, len), c);
+
+	lua_pushvalue(L, index);
+	lua_pushinteger(L, c);
+	lua_rawset(L, cache);
+	lua_pop(L, 1);
+	return c;
+}
+
+void push_node_name(lua_State *L, content_t c, INodeDefManager *ndef)
+{
+	if (!push_node_name_cache(L, ndef)) {
+		const std::string &name = ndef->get(c).name;
+		lua_pushlstring(L, name.c_str(), name.size());
+		return;
+	}
+
+	lua_rawgeti(L, -1, c);
+	if (lua_isnil(L, -1)) {
+		lua_pop(L, 1);
+		const std::string &name = ndef->get(c).name;
+		lua_pushlstring(L, name.c_str(), name.size());
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, -3, c);
+	}
+	lua_remove(L, -2);
+}
+
 /******************************************************************************/
 void warn_if_field_exists(lua_State *L, int table,
 		const char *name, const std::string &message)
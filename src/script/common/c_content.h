@@ -38,10 +38,10 @@ extern "C" {
 #include "irrlichttypes_bloated.h"
 #include "util/string.h"
 #include "itemgroup.h"
+#include "mapnode.h"
 
 namespace Json { class Value; }
 
-struct MapNode;
 class INodeDefManager;
 struct PointedThing;
 struct ItemStack;
@@ -103,6 +103,10 @@ MapNode            readnode                  (lua_State *L, int index,
                                               INodeDefManager *ndef);
 void               pushnode                  (lua_State *L, const MapNode &n,
                                               INodeDefManager *ndef);
+content_t          read_node_name            (lua_State *L, int index,
+                                              INodeDefManager *ndef);
+void               push_node_name            (lua_State *L, content_t c,
+                                              INodeDefManager *ndef);
 
 NodeBox            read_nodebox              (lua_State *L, int index);
 
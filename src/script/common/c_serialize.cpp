@@ -0,0 +1,751 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "common/c_serialize.h"
+#include "common/c_internal.h"
+#include "util/serialize.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+extern "C" {
+#include <lauxlib.h>
+}
+
+/******************************************************************************/
+/* Text format                                                                */
+/******************************************************************************/
+
+static void write_text_number(lua_Number n, std::string *out)
+{
+	char buf[64];
+
+	if (n != n) {
+		out->append("0/0");
+	} else if (n == HUGE_VAL) {
+		out->append("1/0");
+	} else if (n == -HUGE_VAL) {
+		out->append("-1/0");
+	} else if (std::floor(n) == n && std::fabs(n) < 9223372036854775808.0) {
+		// Like string.format("%d"), no scientific notation for integers
+		snprintf(buf, sizeof(buf), "%.0f", n);
+		out->append(buf);
+	} else {
+		// Like tostring()
+		snprintf(buf, sizeof(buf), "%.14g", n);
+		out->append(buf);
+	}
+}
+
+// Like string.format("%q")
+static void write_text_string(const char *s, size_t len, std::string *out)
+{
+	out->push_back('"');
+	const char *run = s;
+	for (const char *end = s + len; s != end; s++) {
+		const char *esc;
+		switch (*s) {
+		case '"':  esc = "\\\""; break;
+		case '\\': esc = "\\\\"; break;
+		case '\n': esc = "\\\n"; break;
+		case '\r': esc = "\\r";  break;
+		case '\0': esc = "\\000"; break;
+		default: continue;
+		}
+		out->append(run, s - run);
+		out->append(esc);
+		run = s + 1;
+	}
+	out->append(run, s - run);
+	out->push_back('"');
+}
+
+// seen is the stack index of a table of the tables already written
+static bool write_text_value(lua_State *L, int index, int seen, int depth,
+	std::string *out)
+{
+	switch (lua_type(L, index)) {
+	case LUA_TNIL:
+		out->append("nil");
+		return true;
+	case LUA_TBOOLEAN:
+		out->append(lua_toboolean(L, index) ? "true" : "false");
+		return true;
+	case LUA_TNUMBER:
+		write_text_number(lua_tonumber(L, index), out);
+		return true;
+	case LUA_TSTRING: {
+		size_t len;
+		const char *s = lua_tolstring(L, index, &len);
+		write_text_string(s, len, out);
+		return true;
+	}
+	case LUA_TTABLE:
+		break;
+	default:
+		// Functions are dumped as bytecode, errors are raised by the Lua
+		// implementation
+		return false;
+	}
+
+	if (depth >= SERIALIZE_MAX_DEPTH || !lua_checkstack(L, 4))
+		return false;
+
+	// Tables referenced more than once need local variables
+	lua_pushvalue(L, index);
+	lua_rawget(L, seen);
+	bool was_seen = !lua_isnil(L, -1);
+	lua_pop(L, 1);
+	if (was_seen)
+		return false;
+
+	lua_pushvalue(L, index);
+	lua_pushboolean(L, true);
+	lua_rawset(L, seen);
+
+	out->push_back('{');
+	bool first = true;
+
+	// Array part first, like ipairs()
+	int n = 0;
+	for (;;) {
+		lua_rawgeti(L, index, n + 1);
+		if (lua_isnil(L, -1)) {
+			lua_pop(L, 1);
+			break;
+		}
+		if (!first)
+			out->append(", ");
+		first = false;
+		if (!write_text_value(L, lua_gettop(L), seen, depth + 1, out))
+			return false;
+		lua_pop(L, 1);
+		n++;
+	}
+
+	lua_pushnil(L);
+	while (lua_next(L, index) != 0) {
+		// key at index -2 and value at index -1
+		if (lua_type(L, -2) == LUA_TNUMBER) {
+			lua_Number k = lua_tonumber(L, -2);
+			if (k >= 1 && k <= n && std::floor(k) == k) {
+				lua_pop(L, 1);
+				continue;
+			}
+		}
+
+		if (!first)
+			out->append(", ");
+		first = false;
+		out->push_back('[');
+		if (!write_text_value(L, lua_gettop(L) - 1, seen, depth + 1, out))
+			return false;
+		out->append("] = ");
+		if (!write_text_value(L, lua_gettop(L), seen, depth + 1, out))
+			return false;
+		lua_pop(L, 1);
+	}
+
+	out->push_back('}');
+	return true;
+}
+
+bool serialize_value_text(lua_State *L, int index, std::string *result)
+{
+	if (index < 0)
+		index = lua_gettop(L) + index + 1;
+	int top = lua_gettop(L);
+
+	lua_newtable(L);
+	int seen = lua_gettop(L);
+
+	result->assign("return ");
+	bool ok = write_text_value(L, index, seen, 0, result);
+
+	lua_settop(L, top);
+	return ok;
+}
+
+/*
+	Reader for the Lua code written by serialize_value_text() and the Lua
+	implementation of core.serialize(): "return" followed by a single
+	expression made of literals and table constructors.
+*/
+class TextReader {
+public:
+	TextReader(lua_State *L, const char *data, size_t size) :
+		L(L),
+		m_pos(data),
+		m_end(data + size)
+	{}
+
+	DeserializeResult read()
+	{
+		skipSpace();
+		if (!readKeyword("return"))
+			return DESERIALIZE_UNHANDLED;
+
+		if (!readValue(0))
+			return DESERIALIZE_UNHANDLED;
+
+		skipSpace();
+		if (m_pos != m_end && *m_pos == ';') {
+			m_pos++;
+			skipSpace();
+		}
+		if (m_pos != m_end) {
+			lua_pop(L, 1);
+			return DESERIALIZE_UNHANDLED;
+		}
+		return DESERIALIZE_OK;
+	}
+
+private:
+	lua_State *L;
+	const char *m_pos;
+	const char *m_end;
+
+	static inline bool isIdentStart(char c)
+	{
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+	}
+
+	static inline bool isIdentChar(char c)
+	{
+		return isIdentStart(c) || (c >= '0' && c <= '9');
+	}
+
+	void skipSpace()
+	{
+		while (m_pos != m_end && (*m_pos == ' ' || *m_pos == '\n' ||
+				*m_pos == '\t' || *m_pos == '\r'))
+			m_pos++;
+	}
+
+	// Identifier at the current position, which is not consumed
+	size_t peekIdent()
+	{
+		if (m_pos == m_end || !isIdentStart(*m_pos))
+			return 0;
+		const char *p = m_pos + 1;
+		while (p != m_end && isIdentChar(*p))
+			p++;
+		return p - m_pos;
+	}
+
+	bool readKeyword(const char *word)
+	{
+		size_t len = peekIdent();
+		if (len != strlen(word) || strncmp(m_pos, word, len) != 0)
+			return false;
+		m_pos += len;
+		return true;
+	}
+
+	// Pushes the value and returns true on success, pushes nothing otherwise
+	bool readValue(int depth)
+	{
+		skipSpace();
+		if (m_pos == m_end)
+			return false;
+
+		char c = *m_pos;
+		if (c == '{')
+			return readTable(depth);
+		if (c == '"' || c == '\'')
+			return readString();
+		if (c == '-' || c == '.' || (c >= '0' && c <= '9'))
+			return readNumber();
+
+		if (readKeyword("nil")) {
+			lua_pushnil(L);
+			return true;
+		} else if (readKeyword("true")) {
+			lua_pushboolean(L, true);
+			return true;
+		} else if (readKeyword("false")) {
+			lua_pushboolean(L, false);
+			return true;
+		}
+		return false;
+	}
+
+	bool readNumberLiteral(lua_Number *n)
+	{
+		bool negative = false;
+		if (*m_pos == '-') {
+			negative = true;
+			m_pos++;
+			skipSpace();
+		}
+		if (m_pos == m_end)
+			return false;
+
+		// Scan the literal first, strtod must not read past the data
+		const char *start = m_pos;
+		while (m_pos != m_end && (isIdentChar(*m_pos) || *m_pos == '.' ||
+				((*m_pos == '-' || *m_pos == '+') &&
+				(m_pos[-1] == 'e' || m_pos[-1] == 'E'))))
+			m_pos++;
+
+		std::string literal(start, m_pos - start);
+		if (literal.empty())
+			return false;
+		char *endptr;
+		*n = strtod(literal.c_str(), &endptr);
+		if (*endptr != '\0')
+			return false;
+		if (negative)
+			*n = -*n;
+		return true;
+	}
+
+	bool readNumber()
+	{
+		lua_Number n;
+		if (!readNumberLiteral(&n))
+			return false;
+
+		// inf and nan are written as divisions
+		skipSpace();
+		if (m_pos != m_end && *m_pos == '/') {
+			m_pos++;
+			skipSpace();
+			lua_Number d;
+			if (m_pos == m_end || !readNumberLiteral(&d))
+				return false;
+			n /= d;
+		}
+
+		lua_pushnumber(L, n);
+		return true;
+	}
+
+	bool readString()
+	{
+		char quote = *m_pos++;
+		std::string s;
+
+		for (;;) {
+			if (m_pos == m_end)
+				return false;
+			char c = *m_pos++;
+			if (c == quote)
+				break;
+			if (c == '\n' || c == '\r')
+				return false;
+			if (c != '\\') {
+				s.push_back(c);
+				continue;
+			}
+
+			if (m_pos == m_end)
+				return false;
+			c = *m_pos++;
+			switch (c) {
+			case 'a':  s.push_back('\a'); break;
+			case 'b':  s.push_back('\b'); break;
+			case 'f':  s.push_back('\f'); break;
+			case 'n':  s.push_back('\n'); break;
+			case 'r':  s.push_back('\r'); break;
+			case 't':  s.push_back('\t'); break;
+			case 'v':  s.push_back('\v'); break;
+			case '\n': s.push_back('\n'); break;
+			case '\\': s.push_back('\\'); break;
+			case '"':  s.push_back('"');  break;
+			case '\'': s.push_back('\''); break;
+			default: {
+				if (c < '0' || c > '9')
+					return false;
+				int value = c - '0';
+				for (int i = 0; i < 2 && m_pos != m_end &&
+						*m_pos >= '0' && *m_pos <= '9'; i++)
+					value = value * 10 + (*m_pos++ - '0');
+				if (value > 255)
+					return false;
+				s.push_back((char)value);
+			}
+			}
+		}
+
+		lua_pushlstring(L, s.data(), s.size());
+		return true;
+	}
+
+	bool readTable(int depth)
+	{
+		if (depth >= SERIALIZE_MAX_DEPTH || !lua_checkstack(L, 4))
+			return false;
+
+		m_pos++;  // '{'
+		lua_newtable(L);
+		int table = lua_gettop(L);
+		int n = 0;
+
+		for (;;) {
+			skipSpace();
+			if (m_pos == m_end)
+				break;
+			if (*m_pos == '}') {
+				m_pos++;
+				return true;
+			}
+
+			if (*m_pos == '[' && (m_pos + 1 == m_end || m_pos[1] != '[')) {
+				// [key] = value
+				m_pos++;
+				if (!readValue(depth + 1))
+					break;
+				skipSpace();
+				if (m_pos == m_end || *m_pos != ']')
+					break;
+				m_pos++;
+				if (!readAssign() || !readValue(depth + 1))
+					break;
+				// nil and nan keys raise errors in Lua
+				if (lua_isnil(L, -2) || (lua_type(L, -2) == LUA_TNUMBER &&
+						lua_tonumber(L, -2) != lua_tonumber(L, -2)))
+					break;
+				lua_rawset(L, table);
+			} else if (size_t len = peekIdent()) {
+				// name = value, or nil/true/false
+				const char *name = m_pos;
+				m_pos += len;
+				skipSpace();
+				if (m_pos != m_end && *m_pos == '=' &&
+						(m_pos + 1 == m_end || m_pos[1] != '=')) {
+					lua_pushlstring(L, name, len);
+					if (!readAssign() || !readValue(depth + 1))
+						break;
+					lua_rawset(L, table);
+				} else {
+					m_pos = name;
+					if (!readValue(depth + 1))
+						break;
+					lua_rawseti(L, table, ++n);
+				}
+			} else {
+				if (!readValue(depth + 1))
+					break;
+				lua_rawseti(L, table, ++n);
+			}
+
+			skipSpace();
+			if (m_pos != m_end && (*m_pos == ',' || *m_pos == ';'))
+				m_pos++;
+			else if (m_pos == m_end || *m_pos != '}')
+				break;
+		}
+
+		lua_settop(L, table - 1);
+		return false;
+	}
+
+	bool readAssign()
+	{
+		skipSpace();
+		if (m_pos == m_end || *m_pos != '=')
+			return false;
+		m_pos++;
+		return true;
+	}
+};
+
+/******************************************************************************/
+/* Binary format                                                              */
+/******************************************************************************/
+
+enum BinaryTag {
+	BINTAG_NIL,
+	BINTAG_FALSE,
+	BINTAG_TRUE,
+	BINTAG_INT,     // s32
+	BINTAG_NUMBER,  // double, as u64
+	BINTAG_STRING,  // u32 length, data
+	BINTAG_TABLE,   // key, value pairs until BINTAG_END
+	BINTAG_END,
+	BINTAG_REF,     // u32 number of an earlier table, counting from 1
+};
+
+static inline void write_binary_u32(u32 i, std::string *out)
+{
+	u8 buf[4];
+	writeU32(buf, i);
+	out->append((char *)buf, 4);
+}
+
+// tables maps the tables already written to their number
+static void write_binary_value(lua_State *L, int index, int tables,
+	int *num_tables, int depth, std::string *out)
+{
+	switch (lua_type(L, index)) {
+	case LUA_TNIL:
+		out->push_back(BINTAG_NIL);
+		return;
+	case LUA_TBOOLEAN:
+		out->push_back(lua_toboolean(L, index) ? BINTAG_TRUE : BINTAG_FALSE);
+		return;
+	case LUA_TNUMBER: {
+		lua_Number n = lua_tonumber(L, index);
+		if (std::floor(n) == n && n >= -2147483648.0 && n <= 2147483647.0) {
+			out->push_back(BINTAG_INT);
+			write_binary_u32((u32)(s32)n, out);
+		} else {
+			double d = n;
+			u64 bits;
+			memcpy(&bits, &d, sizeof(bits));
+			u8 buf[8];
+			writeU64(buf, bits);
+			out->push_back(BINTAG_NUMBER);
+			out->append((char *)buf, 8);
+		}
+		return;
+	}
+	case LUA_TSTRING: {
+		size_t len;
+		const char *s = lua_tolstring(L, index, &len);
+		out->push_back(BINTAG_STRING);
+		write_binary_u32(len, out);
+		out->append(s, len);
+		return;
+	}
+	case LUA_TTABLE:
+		break;
+	default:
+		throw LuaError(std::string("Can't serialize data of type ") +
+			luaL_typename(L, index));
+	}
+
+	if (depth >= SERIALIZE_MAX_DEPTH)
+		throw LuaError("Can't serialize tables nested this deep");
+	if (!lua_checkstack(L, 4))
+		throw LuaError("Lua stack overflow while serializing");
+
+	lua_pushvalue(L, index);
+	lua_rawget(L, tables);
+	if (!lua_isnil(L, -1)) {
+		out->push_back(BINTAG_REF);
+		write_binary_u32(lua_tointeger(L, -1), out);
+		lua_pop(L, 1);
+		return;
+	}
+	lua_pop(L, 1);
+
+	lua_pushvalue(L, index);
+	lua_pushinteger(L, ++*num_tables);
+	lua_rawset(L, tables);
+
+	out->push_back(BINTAG_TABLE);
+	lua_pushnil(L);
+	while (lua_next(L, index) != 0) {
+		// key at index -2 and value at index -1
+		int top = lua_gettop(L);
+		write_binary_value(L, top - 1, tables, num_tables, depth + 1, out);
+		write_binary_value(L, top, tables, num_tables, depth + 1, out);
+		lua_pop(L, 1);
+	}
+	out->push_back(BINTAG_END);
+}
+
+void serialize_value_binary(lua_State *L, int index, std::string *result)
+{
+	if (index < 0)
+		index = lua_gettop(L) + index + 1;
+	int top = lua_gettop(L);
+
+	lua_newtable(L);
+	int tables = lua_gettop(L);
+	int num_tables = 0;
+
+	result->assign(SERIALIZE_BINARY_MAGIC, SERIALIZE_BINARY_MAGIC_LEN);
+	try {
+		write_binary_value(L, index, tables, &num_tables, 0, result);
+	} catch (LuaError &e) {
+		lua_settop(L, top);
+		throw;
+	}
+
+	lua_settop(L, top);
+}
+
+class BinaryReader {
+public:
+	BinaryReader(lua_State *L, const char *data, size_t size) :
+		L(L),
+		m_pos((const u8 *)data),
+		m_end((const u8 *)data + size),
+		m_num_tables(0)
+	{}
+
+	DeserializeResult read(std::string *error)
+	{
+		int top = lua_gettop(L);
+
+		// Tables read so far by number, for references
+		lua_newtable(L);
+		m_tables = lua_gettop(L);
+
+		if (!readValue(0, error)) {
+			lua_settop(L, top);
+			return DESERIALIZE_ERROR;
+		}
+		if (m_pos != m_end) {
+			*error = "Trailing data after serialized value";
+			lua_settop(L, top);
+			return DESERIALIZE_ERROR;
+		}
+
+		lua_remove(L, m_tables);
+		return DESERIALIZE_OK;
+	}
+
+private:
+	lua_State *L;
+	const u8 *m_pos;
+	const u8 *m_end;
+	int m_tables;
+	int m_num_tables;
+
+	bool readU32(u32 *i)
+	{
+		if (m_end - m_pos < 4)
+			return false;
+		*i = ::readU32(m_pos);
+		m_pos += 4;
+		return true;
+	}
+
+	// Pushes the value and returns true on success
+	bool readValue(int depth, std::string *error)
+	{
+		if (m_pos == m_end) {
+			*error = "Unexpected end of serialized data";
+			return false;
+		}
+
+		u32 i;
+		switch (*m_pos++) {
+		case BINTAG_NIL:
+			lua_pushnil(L);
+			return true;
+		case BINTAG_FALSE:
+			lua_pushboolean(L, false);
+			return true;
+		case BINTAG_TRUE:
+			lua_pushboolean(L, true);
+			return true;
+		case BINTAG_INT:
+			if (!readU32(&i))
+				break;
+			lua_pushnumber(L, (s32)i);
+			return true;
+		case BINTAG_NUMBER: {
+			if (m_end - m_pos < 8)
+				break;
+			u64 bits = readU64(m_pos);
+			m_pos += 8;
+			double d;
+			memcpy(&d, &bits, sizeof(d));
+			lua_pushnumber(L, d);
+			return true;
+		}
+		case BINTAG_STRING:
+			if (!readU32(&i) || (size_t)(m_end - m_pos) < i)
+				break;
+			lua_pushlstring(L, (const char *)m_pos, i);
+			m_pos += i;
+			return true;
+		case BINTAG_REF:
+			if (!readU32(&i))
+				break;
+			if (i < 1 || i > (u32)m_num_tables) {
+				*error = "Invalid table reference in serialized data";
+				return false;
+			}
+			lua_rawgeti(L, m_tables, i);
+			return true;
+		case BINTAG_TABLE:
+			return readTable(depth, error);
+		default:
+			*error = "Invalid serialized data";
+			return false;
+		}
+
+		*error = "Unexpected end of serialized data";
+		return false;
+	}
+
+	bool readTable(int depth, std::string *error)
+	{
+		if (depth >= SERIALIZE_MAX_DEPTH || !lua_checkstack(L, 4)) {
+			*error = "Serialized tables nested too deep";
+			return false;
+		}
+
+		lua_newtable(L);
+		int table = lua_gettop(L);
+		lua_pushvalue(L, table);
+		lua_rawseti(L, m_tables, ++m_num_tables);
+
+		for (;;) {
+			if (m_pos == m_end) {
+				*error = "Unexpected end of serialized data";
+				break;
+			}
+			if (*m_pos == BINTAG_END) {
+				m_pos++;
+				return true;
+			}
+
+			if (!readValue(depth + 1, error))
+				break;
+			if (lua_isnil(L, -1) || (lua_type(L, -1) == LUA_TNUMBER &&
+					lua_tonumber(L, -1) != lua_tonumber(L, -1))) {
+				*error = "Invalid table key in serialized data";
+				break;
+			}
+			if (!readValue(depth + 1, error))
+				break;
+			lua_rawset(L, table);
+		}
+
+		lua_settop(L, table - 1);
+		return false;
+	}
+};
+
+/******************************************************************************/
+
+DeserializeResult deserialize_value(lua_State *L, const char *data, size_t size,
+	std::string *error)
+{
+	if (size >= SERIALIZE_BINARY_MAGIC_LEN &&
+			memcmp(data, SERIALIZE_BINARY_MAGIC, SERIALIZE_BINARY_MAGIC_LEN) == 0) {
+		BinaryReader reader(L, data + SERIALIZE_BINARY_MAGIC_LEN,
+			size - SERIALIZE_BINARY_MAGIC_LEN);
+		return reader.read(error);
+	}
+
+	if (!lua_checkstack(L, 8))
+		return DESERIALIZE_UNHANDLED;
+
+	TextReader reader(L, data, size);
+	return reader.read();
+}
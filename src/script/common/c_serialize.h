@@ -0,0 +1,77 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+	Native implementation of core.serialize() and core.deserialize().
+
+	The text format is the Lua code produced by builtin/common/serialize.lua.
+	Only values the native code handles completely are dealt with here,
+	everything else (functions, tables referenced more than once, code that
+	is not a plain table constructor) is left to the Lua implementation.
+
+	The binary format is more compact and much faster to read, and also
+	supports tables referenced more than once (including recursive ones).
+*/
+
+#ifndef C_SERIALIZE_H_
+#define C_SERIALIZE_H_
+
+#include <string>
+
+extern "C" {
+#include <lua.h>
+}
+
+// Tables nested deeper than this are not handled natively
+#define SERIALIZE_MAX_DEPTH 256
+
+// First bytes of data in the binary format
+#define SERIALIZE_BINARY_MAGIC "\x01MTB"
+#define SERIALIZE_BINARY_MAGIC_LEN 4
+
+/*
+	Serializes the value at index as Lua code.
+	Returns false if the value has to be serialized by the Lua
+	implementation instead.
+*/
+bool serialize_value_text(lua_State *L, int index, std::string *result);
+
+/*
+	Serializes the value at index in the binary format.
+	Throws LuaError if the value can't be serialized.
+*/
+void serialize_value_binary(lua_State *L, int index, std::string *result);
+
+enum DeserializeResult {
+	// The value was pushed onto the stack
+	DESERIALIZE_OK,
+	// Not in a format read natively, use the Lua implementation
+	DESERIALIZE_UNHANDLED,
+	// Invalid data, error is set
+	DESERIALIZE_ERROR,
+};
+
+/*
+	Reads data in either format, and pushes the value onto the stack
+	if successful.
+*/
+DeserializeResult deserialize_value(lua_State *L, const char *data, size_t size,
+	std::string *error);
+
+#endif /* C_SERIALIZE_H_ */
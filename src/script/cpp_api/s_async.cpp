@@ -36,6 +36,8 @@ extern "C" {
 /******************************************************************************/
 AsyncEngine::AsyncEngine() :
 	initDone(false),
+	server(NULL),
+	secure(false),
 	jobIdCounter(0)
 {
 }
@@ -87,9 +89,12 @@ bool AsyncEngine::registerFunction(const char* name, lua_CFunction func)
 }
 
 /******************************************************************************/
-void AsyncEngine::initialize(unsigned int numEngines)
+void AsyncEngine::initialize(unsigned int numEngines, Server *server,
+		bool secure)
 {
 	initDone = true;
+	this->server = server;
+	this->secure = secure;
 
 	for (unsigned int i = 0; i < numEngines; i++) {
 		AsyncWorkerThread *toAdd = new AsyncWorkerThread(this,
@@ -117,6 +122,25 @@ unsigned int AsyncEngine::queueAsyncJob(std::string func, std::string params)
 	return toAdd.id;
 }
 
+/******************************************************************************/
+static int dump_writer(lua_State *L, const void *p, size_t size, void *ud)
+{
+	((std::string *)ud)->append((const char *)p, size);
+	return 0;
+}
+
+bool AsyncEngine::serializeFunction(lua_State *L, int index, std::string *result)
+{
+	result->clear();
+
+	lua_pushvalue(L, index);
+	bool ok = lua_isfunction(L, -1) && !lua_iscfunction(L, -1) &&
+		lua_dump(L, dump_writer, result) == 0;
+	lua_pop(L, 1);
+
+	return ok;
+}
+
 /******************************************************************************/
 LuaJobInfo AsyncEngine::getJob()
 {
@@ -150,9 +174,17 @@ void AsyncEngine::step(lua_State *L)
 	int error_handler = PUSH_ERROR_HANDLER(L);
 	lua_getglobal(L, "core");
 	resultQueueMutex.lock();
-	while (!resultQueue.empty()) {
+	// Only the results that are there now, so that busy workers can't keep
+	// this going
+	size_t count = resultQueue.size();
+	resultQueueMutex.unlock();
+	for (size_t i = 0; i < count; i++) {
+		// Don't hold the lock while the handler runs, the workers would
+		// block on it when they finish their jobs
+		resultQueueMutex.lock();
 		LuaJobInfo jobDone = resultQueue.front();
 		resultQueue.pop_front();
+		resultQueueMutex.unlock();
 
 		lua_getfield(L, -1, "async_event_handler");
 
@@ -168,7 +200,6 @@ void AsyncEngine::step(lua_State *L)
 
 		PCALL_RESL(L, lua_pcall(L, 2, 0, error_handler));
 	}
-	resultQueueMutex.unlock();
 	lua_pop(L, 2); // Pop core and error handler
 }
 
@@ -215,12 +246,17 @@ void AsyncEngine::prepareEnvironment(lua_State* L, int top)
 /******************************************************************************/
 AsyncWorkerThread::AsyncWorkerThread(AsyncEngine* jobDispatcher,
 		const std::string &name) :
-	Thread(name),
 	ScriptApiBase(),
+	Thread(name),
 	jobDispatcher(jobDispatcher)
 {
 	lua_State *L = getStack();
 
+	setServer(jobDispatcher->server);
+
+	if (jobDispatcher->secure)
+		initializeSecurity();
+
 	// Prepare job lua environment
 	lua_getglobal(L, "core");
 	int top = lua_gettop(L);
@@ -245,7 +281,7 @@ void* AsyncWorkerThread::run()
 
 	std::string script = getServer()->getBuiltinLuaPath() + DIR_DELIM + "init.lua";
 	try {
-		loadScript(script);
+		loadMod(script, BUILTIN_MOD_NAME);
 	} catch (const ModError &e) {
 		errorstream << "Execution of async base environment failed: "
 			<< e.what() << std::endl;
@@ -276,9 +312,16 @@ void* AsyncWorkerThread::run()
 		luaL_checktype(L, -1, LUA_TFUNCTION);
 
 		// Call it
-		lua_pushlstring(L,
+		// The function is loaded here since the sandbox refuses bytecode
+		if (luaL_loadbuffer(L,
 				toProcess.serializedFunction.data(),
-				toProcess.serializedFunction.size());
+				toProcess.serializedFunction.size(),
+				"=(async job)")) {
+			errorstream << "ASYNC WORKER: Unable to load function: "
+				<< lua_tostring(L, -1) << std::endl;
+			lua_pop(L, 1);
+			lua_pushnil(L);
+		}
 		lua_pushlstring(L,
 				toProcess.serializedParams.data(),
 				toProcess.serializedParams.size());
@@ -30,9 +30,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "debug.h"
 #include "lua.h"
 #include "cpp_api/s_base.h"
+#include "cpp_api/s_security.h"
 
 // Forward declarations
 class AsyncEngine;
+class Server;
 
 
 // Declarations
@@ -52,7 +54,7 @@ struct LuaJobInfo {
 };
 
 // Asynchronous working environment
-class AsyncWorkerThread : public Thread, public ScriptApiBase {
+class AsyncWorkerThread : public Thread, public ScriptApiSecurity {
 public:
 	AsyncWorkerThread(AsyncEngine* jobDispatcher, const std::string &name);
 	virtual ~AsyncWorkerThread();
@@ -80,8 +82,11 @@ class AsyncEngine {
 	/**
 	 * Create async engine tasks and lock function registration
 	 * @param numEngines Number of async threads to be started
+	 * @param server Server the jobs are run for, NULL for the main menu
+	 * @param secure Run the jobs in a mod security sandbox
 	 */
-	void initialize(unsigned int numEngines);
+	void initialize(unsigned int numEngines, Server *server = NULL,
+			bool secure = false);
 
 	/**
 	 * Queue an async job
@@ -91,6 +96,17 @@ class AsyncEngine {
 	 */
 	unsigned int queueAsyncJob(std::string func, std::string params);
 
+	/**
+	 * Serialize a Lua function to be passed to queueAsyncJob
+	 *  the bytecode is created here rather than by string.dump, so that
+	 *  sandboxed code can't pass arbitrary bytecode to the async environment
+	 * @param L The Lua stack
+	 * @param index Stack index of the function
+	 * @param result Serialized function
+	 * @return false if the function can't be serialized (C functions)
+	 */
+	static bool serializeFunction(lua_State *L, int index, std::string *result);
+
 	/**
 	 * Engine step to process finished jobs
 	 *   the engine step is one way to pass events back, PushFinishedJobs another
@@ -131,6 +147,12 @@ class AsyncEngine {
 	// Variable locking the engine against further modification
 	bool initDone;
 
+	// Server the jobs are run for, if any
+	Server *server;
+
+	// Whether async environments are sandboxed by mod security
+	bool secure;
+
 	// Internal store for registred functions
 	UNORDERED_MAP<std::string, lua_CFunction> functionList;
 
@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "cpp_api/s_base.h"
 #include "cpp_api/s_internal.h"
 #include "cpp_api/s_security.h"
+#include "cpp_api/s_sampler.h"
 #include "lua_api/l_object.h"
 #include "common/c_converter.h"
 #include "serverobject.h"
@@ -28,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "log.h"
 #include "mods.h"
 #include "porting.h"
+#include "profiler.h"
 #include "util/string.h"
 
 
@@ -69,7 +71,11 @@ class ModNameStorer
 */
 
 ScriptApiBase::ScriptApiBase() :
-	m_luastackmutex()
+	m_luastackmutex(),
+	m_script_entry(NULL),
+	m_sampler(NULL),
+	m_timing_entry(NULL),
+	m_timing_start_us(0)
 {
 #ifdef SCRIPTAPI_LOCK_DEBUG
 	m_lock_recursion_count = 0;
@@ -120,6 +126,7 @@ ScriptApiBase::ScriptApiBase() :
 
 ScriptApiBase::~ScriptApiBase()
 {
+	delete m_sampler;
 	lua_close(m_luastack);
 }
 
@@ -200,7 +207,11 @@ void ScriptApiBase::runCallbacksRaw(int nargs,
 	// Stack now looks like this:
 	// ... <error handler> <run_callbacks> <table> <mode> <arg#1> <arg#2> ... <arg#n>
 
-	int result = lua_pcall(L, nargs + 2, 1, error_handler);
+	int result;
+	{
+		ScriptCallbackTimer timer(this, fxn);
+		result = lua_pcall(L, nargs + 2, 1, error_handler);
+	}
 	if (result != 0)
 		scriptError(result, fxn);
 
@@ -252,6 +263,8 @@ void ScriptApiBase::stackDump(std::ostream &o)
 
 void ScriptApiBase::setOriginDirect(const char *origin)
 {
+	if (m_timing_entry)
+		chargeCallbackTime();
 	m_last_run_mod = origin ? origin : "??";
 }
 
@@ -260,12 +273,131 @@ void ScriptApiBase::setOriginFromTableRaw(int index, const char *fxn)
 #ifdef SCRIPTAPI_DEBUG
 	lua_State *L = getStack();
 
+	if (m_timing_entry)
+		chargeCallbackTime();
 	m_last_run_mod = lua_istable(L, index) ?
 		getstringfield_default(L, index, "mod_origin", "") : "";
 	//printf(">>>> running %s for mod: %s\n", fxn, m_last_run_mod.c_str());
 #endif
 }
 
+void ScriptApiBase::samplerHook(lua_State *L, lua_Debug *ar)
+{
+	lua_rawgeti(L, LUA_REGISTRYINDEX, CUSTOM_RIDX_SCRIPTAPI);
+	ScriptApiBase *script = (ScriptApiBase *)lua_touserdata(L, -1);
+	lua_pop(L, 1);
+
+	if (script->m_sampler)
+		script->m_sampler->record(L, script->m_script_entry,
+			script->m_last_run_mod);
+	else
+		lua_sethook(L, NULL, 0, 0);
+}
+
+void ScriptApiBase::startSampling(u32 interval_ms)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	if (!m_sampler)
+		m_sampler = new ScriptSampler(L, samplerHook);
+	if (m_sampler->isRunning())
+		return;
+
+	m_sampler->setInterval(interval_ms);
+	// Callbacks can start sampling, the scope above is not the outermost then
+	m_sampler->setInScript(true);
+	m_sampler->start();
+}
+
+void ScriptApiBase::stopSampling()
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	if (!m_sampler)
+		return;
+	m_sampler->stop();
+	m_sampler->wait();
+}
+
+bool ScriptApiBase::isSampling()
+{
+	return m_sampler && m_sampler->isRunning();
+}
+
+std::string ScriptApiBase::getSamples(bool reset, u32 *sample_count)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	if (!m_sampler) {
+		if (sample_count)
+			*sample_count = 0;
+		return "";
+	}
+
+	std::string samples = m_sampler->getFoldedStacks();
+	if (sample_count)
+		*sample_count = m_sampler->getSampleCount();
+	if (reset)
+		m_sampler->reset();
+	return samples;
+}
+
+void ScriptApiBase::chargeCallbackTime()
+{
+	u64 now = porting::getTimeUs();
+	u32 time_us = now - m_timing_start_us;
+	m_timing_start_us = now;
+	// Origin switches before any code ran
+	if (time_us == 0)
+		return;
+
+	CallbackTiming &timing = m_callback_times[
+		std::make_pair(m_timing_entry, m_last_run_mod)];
+	ScriptCallbackTime &total = timing.total;
+	if (total.entry.empty()) {
+		total.entry = m_timing_entry;
+		total.mod = m_last_run_mod;
+	}
+	total.time_us += time_us;
+	total.calls++;
+	total.max_us = MYMAX(total.max_us, time_us);
+	timing.unreported_us += time_us;
+}
+
+void ScriptApiBase::getCallbackTimes(std::vector<ScriptCallbackTime> *times,
+	bool reset)
+{
+	RecursiveMutexAutoLock scriptlock(m_luastackmutex);
+
+	for (CallbackTimings::iterator it = m_callback_times.begin();
+			it != m_callback_times.end(); ++it) {
+		ScriptCallbackTime &total = it->second.total;
+		if (total.calls == 0)
+			continue;
+		times->push_back(total);
+		if (reset) {
+			total.time_us = 0;
+			total.calls = 0;
+			total.max_us = 0;
+		}
+	}
+}
+
+void ScriptApiBase::reportCallbackTimes(Profiler *profiler)
+{
+	RecursiveMutexAutoLock scriptlock(m_luastackmutex);
+
+	for (CallbackTimings::iterator it = m_callback_times.begin();
+			it != m_callback_times.end(); ++it) {
+		CallbackTiming &timing = it->second;
+		if (timing.unreported_us == 0)
+			continue;
+		profiler->add("Script: " + timing.total.mod + " " + timing.total.entry
+			+ " [ms]", timing.unreported_us / 1000.0f);
+		timing.unreported_us = 0;
+	}
+}
+
 void ScriptApiBase::addObjectReference(ServerActiveObject *cobj)
 {
 	SCRIPTAPI_PRECHECKHEADER
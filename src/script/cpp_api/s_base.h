@@ -21,7 +21,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define S_BASE_H_
 
 #include <iostream>
+#include <map>
 #include <string>
+#include <vector>
 
 extern "C" {
 #include <lua.h>
@@ -56,8 +58,22 @@ extern "C" {
 
 class Server;
 class Environment;
+class ScriptSampler;
 class GUIEngine;
 class ServerActiveObject;
+class Profiler;
+
+// Wall time spent by a mod in the callbacks of one engine entry point
+struct ScriptCallbackTime {
+	ScriptCallbackTime() : time_us(0), calls(0), max_us(0) {}
+
+	std::string entry;
+	std::string mod;
+	u64 time_us;
+	// Number of times the mod's code was entered
+	u32 calls;
+	u32 max_us;
+};
 
 class ScriptApiBase {
 public:
@@ -81,6 +97,18 @@ class ScriptApiBase {
 	void setOriginDirect(const char *origin);
 	void setOriginFromTableRaw(int index, const char *fxn);
 
+	/* sampling profiler */
+	void startSampling(u32 interval_ms);
+	void stopSampling();
+	bool isSampling();
+	// Returns the samples as folded stacks, see ScriptSampler
+	std::string getSamples(bool reset, u32 *sample_count=NULL);
+
+	/* callback time accounting */
+	void getCallbackTimes(std::vector<ScriptCallbackTime> *times, bool reset);
+	// Adds the time spent since the last call to the profiler
+	void reportCallbackTimes(Profiler *profiler);
+
 protected:
 	friend class LuaABM;
 	friend class LuaLBM;
@@ -90,6 +118,8 @@ class ScriptApiBase {
 	friend class ModApiBase;
 	friend class ModApiEnvMod;
 	friend class LuaVoxelManip;
+	friend class ScriptEntryScope;
+	friend class ScriptCallbackTimer;
 
 	lua_State* getStack()
 		{ return m_luastack; }
@@ -109,9 +139,18 @@ class ScriptApiBase {
 	void objectrefGetOrCreate(lua_State *L, ServerActiveObject *cobj);
 	void objectrefGet(lua_State *L, u16 id);
 
+	// Charges the time since the last charge to the current origin
+	void chargeCallbackTime();
+
 	RecursiveMutex  m_luastackmutex;
 	std::string     m_last_run_mod;
 	bool            m_secure;
+	// Engine callback being run, for the sampling profiler
+	const char     *m_script_entry;
+	ScriptSampler  *m_sampler;
+	// Outermost timed callback, see ScriptCallbackTimer
+	const char     *m_timing_entry;
+	u64             m_timing_start_us;
 #ifdef SCRIPTAPI_LOCK_DEBUG
 	int             m_lock_recursion_count;
 	threadid_t      m_owning_thread;
@@ -119,6 +158,18 @@ class ScriptApiBase {
 
 private:
 	static int luaPanic(lua_State *L);
+	static void samplerHook(lua_State *L, lua_Debug *ar);
+
+	struct CallbackTiming {
+		CallbackTiming() : unreported_us(0) {}
+
+		ScriptCallbackTime total;
+		u64 unreported_us;
+	};
+	// Keyed by entry point and mod
+	typedef std::map<std::pair<const char *, std::string>, CallbackTiming>
+		CallbackTimings;
+	CallbackTimings m_callback_times;
 
 	lua_State*      m_luastack;
 
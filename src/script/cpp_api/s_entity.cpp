@@ -218,7 +218,10 @@ void ScriptApiEntity::luaentity_Step(u16 id, float dtime)
 	lua_pushnumber(L, dtime); // dtime
 
 	setOriginFromTable(object);
-	PCALL_RES(lua_pcall(L, 2, 0, error_handler));
+	{
+		ScriptCallbackTimer timer(this, __FUNCTION__);
+		PCALL_RES(lua_pcall(L, 2, 0, error_handler));
+	}
 
 	lua_pop(L, 2); // Pop object and error handler
 }
@@ -29,6 +29,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "common/c_internal.h"
 #include "cpp_api/s_base.h"
+#include "cpp_api/s_sampler.h"
+#include "porting.h"
 
 #ifdef SCRIPTAPI_LOCK_DEBUG
 #include "debug.h" // assert()
@@ -74,9 +76,72 @@ class LockChecker {
 	#define SCRIPTAPI_LOCK_CHECK while(0)
 #endif
 
+// Records the callback that runs scripts, see ScriptApiBase::m_script_entry
+class ScriptEntryScope {
+public:
+	ScriptEntryScope(ScriptApiBase *script, const char *entry) :
+		m_script(script),
+		m_prev_entry(script->m_script_entry)
+	{
+		script->m_script_entry = entry;
+		if (script->m_sampler && !m_prev_entry)
+			script->m_sampler->setInScript(true);
+	}
+
+	~ScriptEntryScope()
+	{
+		m_script->m_script_entry = m_prev_entry;
+		if (m_script->m_sampler && !m_prev_entry)
+			m_script->m_sampler->setInScript(false);
+	}
+
+private:
+	ScriptApiBase *m_script;
+	const char *m_prev_entry;
+};
+
+/*
+	Accounts the wall time of a callback to the mods that run in it.
+
+	Origin changes while the timer lives split the time between the mods.
+	Nested timers charge the outer callback up to their start and restore
+	its origin when they end, so that the time stays with the outermost
+	entry point.
+*/
+class ScriptCallbackTimer {
+public:
+	ScriptCallbackTimer(ScriptApiBase *script, const char *entry) :
+		m_script(script),
+		m_nested(script->m_timing_entry != NULL)
+	{
+		if (m_nested) {
+			script->chargeCallbackTime();
+			m_outer_origin = script->m_last_run_mod;
+		} else {
+			script->m_timing_entry = entry;
+			script->m_timing_start_us = porting::getTimeUs();
+		}
+	}
+
+	~ScriptCallbackTimer()
+	{
+		m_script->chargeCallbackTime();
+		if (m_nested)
+			m_script->m_last_run_mod = m_outer_origin;
+		else
+			m_script->m_timing_entry = NULL;
+	}
+
+private:
+	ScriptApiBase *m_script;
+	bool m_nested;
+	std::string m_outer_origin;
+};
+
 #define SCRIPTAPI_PRECHECKHEADER                                               \
 		RecursiveMutexAutoLock scriptlock(this->m_luastackmutex);              \
 		SCRIPTAPI_LOCK_CHECK;                                                  \
+		ScriptEntryScope script_entry_scope(this, __FUNCTION__);               \
 		realityCheck();                                                        \
 		lua_State *L = getStack();                                             \
 		assert(lua_checkstack(L, 20));                                         \
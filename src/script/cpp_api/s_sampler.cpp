@@ -0,0 +1,125 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "cpp_api/s_sampler.h"
+#include "porting.h"
+#include "threading/mutex_auto_lock.h"
+#include <sstream>
+
+ScriptSampler::ScriptSampler(lua_State *L, lua_Hook hook) :
+	Thread("ScriptSampler"),
+	m_luastack(L),
+	m_hook(hook),
+	m_interval_ms(10),
+	m_in_script(false),
+	m_sample_count(0)
+{
+}
+
+ScriptSampler::~ScriptSampler()
+{
+	stop();
+	wait();
+}
+
+void ScriptSampler::setInScript(bool in_script)
+{
+	MutexAutoLock lock(m_hook_mutex);
+	m_in_script = in_script;
+	// Drop a pending sample, it would end up in the next callback
+	if (!in_script)
+		lua_sethook(m_luastack, NULL, 0, 0);
+}
+
+void *ScriptSampler::run()
+{
+	while (!stopRequested()) {
+		sleep_ms(m_interval_ms);
+		// lua_sethook() may be called from other threads, like signal
+		// handlers do. The hook then runs at the next Lua instruction.
+		MutexAutoLock lock(m_hook_mutex);
+		if (m_in_script)
+			lua_sethook(m_luastack, m_hook, LUA_MASKCOUNT, 1);
+	}
+	MutexAutoLock lock(m_hook_mutex);
+	lua_sethook(m_luastack, NULL, 0, 0);
+	return NULL;
+}
+
+static void append_frame(std::string *stack, lua_Debug *ar)
+{
+	std::ostringstream os;
+	if (ar->what[0] == 'C') {
+		os << "[C] " << (ar->name ? ar->name : "?");
+	} else if (ar->what[0] == 'm') {
+		os << "main chunk (" << ar->short_src << ")";
+	} else {
+		os << (ar->name ? ar->name : "?") << " ("
+			<< ar->short_src << ":" << ar->linedefined << ")";
+	}
+
+	// ';' separates frames in the folded format
+	std::string frame = os.str();
+	for (size_t i = 0; i < frame.size(); i++) {
+		if (frame[i] == ';' || frame[i] == '\n')
+			frame[i] = ':';
+	}
+
+	stack->push_back(';');
+	stack->append(frame);
+}
+
+void ScriptSampler::record(lua_State *L, const char *entry,
+	const std::string &mod)
+{
+	lua_sethook(L, NULL, 0, 0);
+
+	std::string stack = entry ? entry : "?";
+	stack.push_back(';');
+	stack.append(mod.empty() ? "??" : mod);
+
+	// Level 0 is the innermost function
+	lua_Debug ar;
+	int depth = 0;
+	while (depth < SCRIPT_SAMPLER_MAX_DEPTH && lua_getstack(L, depth, &ar))
+		depth++;
+	for (int level = depth - 1; level >= 0; level--) {
+		lua_getstack(L, level, &ar);
+		lua_getinfo(L, "Sn", &ar);
+		append_frame(&stack, &ar);
+	}
+
+	m_stacks[stack]++;
+	m_sample_count++;
+}
+
+std::string ScriptSampler::getFoldedStacks() const
+{
+	std::ostringstream os;
+	for (std::map<std::string, u32>::const_iterator it = m_stacks.begin();
+			it != m_stacks.end(); ++it)
+		os << it->first << " " << it->second << "\n";
+	return os.str();
+}
+
+void ScriptSampler::reset()
+{
+	m_stacks.clear();
+	m_sample_count = 0;
+}
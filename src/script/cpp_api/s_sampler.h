@@ -0,0 +1,90 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef S_SAMPLER_H_
+#define S_SAMPLER_H_
+
+#include <map>
+#include <string>
+
+extern "C" {
+#include <lua.h>
+}
+
+#include "irrlichttypes.h"
+#include "threading/mutex.h"
+#include "threading/thread.h"
+#include "util/basic_macros.h"
+
+// Only this many of the innermost frames of deeper stacks are recorded
+#define SCRIPT_SAMPLER_MAX_DEPTH 64
+
+/*
+	Sampling profiler for the Lua code of a ScriptApiBase.
+
+	A thread periodically installs a count hook, which then records the
+	Lua stack of the script thread at its next instruction. Samples are
+	only taken while the engine runs a script callback, and are attributed
+	to that callback and to the mod it belongs to.
+
+	Everything except the thread itself runs in the script thread.
+*/
+class ScriptSampler : public Thread {
+public:
+	// hook has to call record()
+	ScriptSampler(lua_State *L, lua_Hook hook);
+	~ScriptSampler();
+
+	void setInterval(u32 interval_ms) { m_interval_ms = MYMAX(interval_ms, 1); }
+	u32 getInterval() const { return m_interval_ms; }
+
+	// Whether a script callback is being run, samples are only taken then
+	void setInScript(bool in_script);
+
+	// Records the current Lua stack, called from the hook
+	void record(lua_State *L, const char *entry, const std::string &mod);
+
+	/*
+		Returns the samples as folded stacks, as read by flamegraph.pl:
+		"<callback>;<mod>;<outermost function>;...;<function> <count>"
+		per line.
+	*/
+	std::string getFoldedStacks() const;
+	u32 getSampleCount() const { return m_sample_count; }
+	void reset();
+
+protected:
+	void *run();
+
+private:
+	lua_State *m_luastack;
+	lua_Hook m_hook;
+	u32 m_interval_ms;
+	/*
+		Held while m_in_script is changed together with the hook, so that
+		the thread cannot install the hook after a callback has ended
+	*/
+	Mutex m_hook_mutex;
+	bool m_in_script;
+
+	std::map<std::string, u32> m_stacks;
+	u32 m_sample_count;
+};
+
+#endif /* S_SAMPLER_H_ */
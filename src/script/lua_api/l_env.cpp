@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "lua_api/l_env.h"
 #include "lua_api/l_internal.h"
+#include "cpp_api/s_internal.h"
 #include "lua_api/l_nodemeta.h"
 #include "lua_api/l_nodetimer.h"
 #include "lua_api/l_noise.h"
@@ -50,6 +51,7 @@ void LuaABM::trigger(ServerEnvironment *env, v3s16 p, MapNode n,
 		u32 active_object_count, u32 active_object_count_wider)
 {
 	GameScripting *scriptIface = env->getScriptIface();
+	ScriptEntryScope script_entry_scope(scriptIface, "LuaABM::trigger");
 	scriptIface->realityCheck();
 
 	lua_State *L = scriptIface->getStack();
@@ -83,7 +85,11 @@ void LuaABM::trigger(ServerEnvironment *env, v3s16 p, MapNode n,
 	lua_pushnumber(L, active_object_count);
 	lua_pushnumber(L, active_object_count_wider);
 
-	int result = lua_pcall(L, 4, 0, error_handler);
+	int result;
+	{
+		ScriptCallbackTimer timer(scriptIface, "abm_action");
+		result = lua_pcall(L, 4, 0, error_handler);
+	}
 	if (result)
 		scriptIface->scriptError(result, "LuaABM::trigger");
 
@@ -93,6 +99,7 @@ void LuaABM::trigger(ServerEnvironment *env, v3s16 p, MapNode n,
 void LuaLBM::trigger(ServerEnvironment *env, v3s16 p, MapNode n)
 {
 	GameScripting *scriptIface = env->getScriptIface();
+	ScriptEntryScope script_entry_scope(scriptIface, "LuaLBM::trigger");
 	scriptIface->realityCheck();
 
 	lua_State *L = scriptIface->getStack();
@@ -143,7 +150,11 @@ void LuaEmergeAreaCallback(v3s16 blockpos, EmergeAction action, void *param)
 
 	state->refcount--;
 
-	state->script->on_emerge_area_completion(blockpos, action, state);
+	{
+		ScriptEntryScope script_entry_scope(state->script,
+			"LuaEmergeAreaCallback");
+		state->script->on_emerge_area_completion(blockpos, action, state);
+	}
 
 	if (state->refcount == 0)
 		delete state;
@@ -202,6 +213,49 @@ int ModApiEnvMod::l_swap_node(lua_State *L)
 	return 1;
 }
 
+static void read_pos_list(lua_State *L, int index, std::vector<v3s16> *positions)
+{
+	luaL_checktype(L, index, LUA_TTABLE);
+
+	size_t len = lua_objlen(L, index);
+	positions->reserve(len);
+	for (size_t i = 1; i <= len; i++) {
+		lua_rawgeti(L, index, i);
+		positions->push_back(read_v3s16(L, -1));
+		lua_pop(L, 1);
+	}
+}
+
+// bulk_set_node({pos1, pos2, ...}, node)
+int ModApiEnvMod::l_bulk_set_node(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	INodeDefManager *ndef = env->getGameDef()->ndef();
+	// parameters
+	std::vector<v3s16> positions;
+	read_pos_list(L, 1, &positions);
+	MapNode n = readnode(L, 2, ndef);
+	// Do it
+	lua_pushinteger(L, env->setNodes(positions, n));
+	return 1;
+}
+
+// bulk_swap_node({pos1, pos2, ...}, node)
+int ModApiEnvMod::l_bulk_swap_node(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	INodeDefManager *ndef = env->getGameDef()->ndef();
+	// parameters
+	std::vector<v3s16> positions;
+	read_pos_list(L, 1, &positions);
+	MapNode n = readnode(L, 2, ndef);
+	// Do it
+	lua_pushinteger(L, env->swapNodes(positions, n));
+	return 1;
+}
+
 // get_node(pos)
 // pos = {x=num, y=num, z=num}
 int ModApiEnvMod::l_get_node(lua_State *L)
@@ -237,6 +291,56 @@ int ModApiEnvMod::l_get_node_or_nil(lua_State *L)
 	return 1;
 }
 
+// get_node_raw(x, y, z) -> content_id, param1, param2, pos_ok
+int ModApiEnvMod::l_get_node_raw(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	// pos, without a table
+	v3f pf(luaL_checknumber(L, 1), luaL_checknumber(L, 2),
+		luaL_checknumber(L, 3));
+	v3s16 pos = floatToInt(pf, 1.0);
+	// Do it
+	bool pos_ok;
+	MapNode n = env->getMap().getNodeNoEx(pos, &pos_ok);
+	lua_pushinteger(L, n.getContent());
+	lua_pushinteger(L, n.getParam1());
+	lua_pushinteger(L, n.getParam2());
+	lua_pushboolean(L, pos_ok);
+	return 4;
+}
+
+// set_node_raw(x, y, z, content_id, [param1], [param2])
+int ModApiEnvMod::l_set_node_raw(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	// parameters
+	v3f pf(luaL_checknumber(L, 1), luaL_checknumber(L, 2),
+		luaL_checknumber(L, 3));
+	v3s16 pos = floatToInt(pf, 1.0);
+	lua_Integer c = luaL_checkinteger(L, 4);
+	lua_Integer param1 = luaL_optinteger(L, 5, 0);
+	lua_Integer param2 = luaL_optinteger(L, 6, 0);
+
+	// Ids that no node was registered for map to "unknown"
+	INodeDefManager *ndef = env->getGameDef()->ndef();
+	content_t id;
+	if (c < 0 || c > 0xFFFF ||
+			!ndef->getId(ndef->get((content_t)c).name, id) || id != c)
+		return luaL_argerror(L, 4, "unknown content ID");
+	if (param1 < 0 || param1 > 0xFF)
+		return luaL_argerror(L, 5, "value out of range");
+	if (param2 < 0 || param2 > 0xFF)
+		return luaL_argerror(L, 6, "value out of range");
+
+	MapNode n(c, param1, param2);
+	// Do it
+	bool succeeded = env->setNode(pos, n);
+	lua_pushboolean(L, succeeded);
+	return 1;
+}
+
 // get_node_light(pos, timeofday)
 // pos = {x=num, y=num, z=num}
 // timeofday: nil = current time, 0 = night, 0.5 = day
@@ -587,6 +691,124 @@ int ModApiEnvMod::l_get_gametime(lua_State *L)
 }
 
 
+/*
+	Content IDs matched by the nodenames argument of the find_node*
+	functions, as a bitset for fast lookups
+*/
+struct NodeNameFilter {
+	std::set<content_t> ids;
+	std::vector<bool> bits;
+
+	NodeNameFilter(lua_State *L, int index, INodeDefManager *ndef)
+	{
+		if (lua_istable(L, index)) {
+			lua_pushnil(L);
+			while (lua_next(L, index) != 0) {
+				// key at index -2 and value at index -1
+				luaL_checktype(L, -1, LUA_TSTRING);
+				ndef->getIds(lua_tostring(L, -1), ids);
+				// removes value, keeps key for next iteration
+				lua_pop(L, 1);
+			}
+		} else if (lua_isstring(L, index)) {
+			ndef->getIds(lua_tostring(L, index), ids);
+		}
+
+		if (!ids.empty())
+			bits.resize(*ids.rbegin() + 1, false);
+		for (std::set<content_t>::iterator it = ids.begin();
+				it != ids.end(); ++it)
+			bits[*it] = true;
+	}
+
+	inline bool contains(content_t c) const
+	{
+		return c < bits.size() && bits[c];
+	}
+};
+
+/*
+	Calls visitor(p, c) for all nodes in the area minp..maxp, going block by
+	block through the node arrays of the MapBlocks.  Nodes of blocks that
+	aren't loaded are CONTENT_IGNORE; such blocks are skipped as a whole if
+	the filter does not match CONTENT_IGNORE, and so are packed blocks whose
+	palette has none of the filtered contents.
+*/
+template <typename Visitor>
+static void visit_nodes_in_area(Map *map, v3s16 minp, v3s16 maxp,
+	const NodeNameFilter &filter, Visitor &visitor)
+{
+	v3s16 bpmin = getNodeBlockPos(minp);
+	v3s16 bpmax = getNodeBlockPos(maxp);
+	bool visit_ignore = filter.contains(CONTENT_IGNORE);
+
+	for (s16 bz = bpmin.Z; bz <= bpmax.Z; bz++)
+	for (s16 by = bpmin.Y; by <= bpmax.Y; by++)
+	for (s16 bx = bpmin.X; bx <= bpmax.X; bx++) {
+		v3s16 bp(bx, by, bz);
+		MapBlock *block = map->getBlockNoCreateNoEx(bp);
+		bool loaded = block && !block->isDummy();
+		if (loaded ? !block->mayContainContent(filter.bits) : !visit_ignore)
+			continue;
+
+		// Part of the area within this block, relative to the block
+		v3s16 base = bp * MAP_BLOCKSIZE;
+		v3s16 rmin(MYMAX(minp.X, base.X), MYMAX(minp.Y, base.Y),
+			MYMAX(minp.Z, base.Z));
+		v3s16 rmax(MYMIN(maxp.X, base.X + MAP_BLOCKSIZE - 1),
+			MYMIN(maxp.Y, base.Y + MAP_BLOCKSIZE - 1),
+			MYMIN(maxp.Z, base.Z + MAP_BLOCKSIZE - 1));
+		rmin -= base;
+		rmax -= base;
+
+		for (s16 z = rmin.Z; z <= rmax.Z; z++)
+		for (s16 y = rmin.Y; y <= rmax.Y; y++)
+		for (s16 x = rmin.X; x <= rmax.X; x++) {
+			content_t c = loaded ?
+				block->getNodeUnsafe(x, y, z).getContent() : CONTENT_IGNORE;
+			if (filter.contains(c))
+				visitor(base + v3s16(x, y, z), c);
+		}
+	}
+}
+
+// Counts the found nodes per content ID, and optionally lists them in the
+// table on top of the Lua stack
+struct FoundNodesCounter {
+	lua_State *L;
+	bool push_positions;
+	u32 total;
+	std::vector<u32> counts;
+
+	FoundNodesCounter(lua_State *L, bool push_positions, const NodeNameFilter &filter) :
+		L(L),
+		push_positions(push_positions),
+		total(0),
+		counts(filter.bits.size(), 0)
+	{}
+
+	inline void operator()(v3s16 p, content_t c)
+	{
+		counts[c]++;
+		total++;
+		if (push_positions) {
+			push_v3s16(L, p);
+			lua_rawseti(L, -2, total);
+		}
+	}
+
+	// Pushes a table of the number of nodes found per node name
+	void pushCounts(const NodeNameFilter &filter, INodeDefManager *ndef)
+	{
+		lua_newtable(L);
+		for (std::set<content_t>::const_iterator it = filter.ids.begin();
+				it != filter.ids.end(); ++it) {
+			lua_pushnumber(L, counts[*it]);
+			lua_setfield(L, -2, ndef->get(*it).name.c_str());
+		}
+	}
+};
+
 // find_node_near(pos, radius, nodenames) -> pos or nil
 // nodenames: eg. {"ignore", "group:tree"} or "default:dirt"
 int ModApiEnvMod::l_find_node_near(lua_State *L)
@@ -594,30 +816,32 @@ int ModApiEnvMod::l_find_node_near(lua_State *L)
 	GET_ENV_PTR;
 
 	INodeDefManager *ndef = getServer(L)->ndef();
+	Map &map = env->getMap();
 	v3s16 pos = read_v3s16(L, 1);
 	int radius = luaL_checkinteger(L, 2);
-	std::set<content_t> filter;
-	if(lua_istable(L, 3)){
-		int table = 3;
-		lua_pushnil(L);
-		while(lua_next(L, table) != 0){
-			// key at index -2 and value at index -1
-			luaL_checktype(L, -1, LUA_TSTRING);
-			ndef->getIds(lua_tostring(L, -1), filter);
-			// removes value, keeps key for next iteration
-			lua_pop(L, 1);
-		}
-	} else if(lua_isstring(L, 3)){
-		ndef->getIds(lua_tostring(L, 3), filter);
-	}
+	NodeNameFilter filter(L, 3, ndef);
+
+	// Consecutive positions are mostly in the same block
+	MapBlock *block = NULL;
+	v3s16 blockpos;
 
 	for(int d=1; d<=radius; d++){
 		std::vector<v3s16> list = FacePositionCache::getFacePositions(d);
 		for(std::vector<v3s16>::iterator i = list.begin();
 				i != list.end(); ++i){
 			v3s16 p = pos + (*i);
-			content_t c = env->getMap().getNodeNoEx(p).getContent();
-			if(filter.count(c) != 0){
+			v3s16 bp = getNodeBlockPos(p);
+			if (!block || bp != blockpos) {
+				block = map.getBlockNoCreateNoEx(bp);
+				blockpos = bp;
+			}
+
+			content_t c = CONTENT_IGNORE;
+			if (block && !block->isDummy()) {
+				v3s16 relpos = p - bp * MAP_BLOCKSIZE;
+				c = block->getNodeUnsafe(relpos).getContent();
+			}
+			if (filter.contains(c)) {
 				push_v3s16(L, p);
 				return 1;
 			}
@@ -635,45 +859,75 @@ int ModApiEnvMod::l_find_nodes_in_area(lua_State *L)
 	INodeDefManager *ndef = getServer(L)->ndef();
 	v3s16 minp = read_v3s16(L, 1);
 	v3s16 maxp = read_v3s16(L, 2);
-	std::set<content_t> filter;
-	if(lua_istable(L, 3)) {
-		int table = 3;
-		lua_pushnil(L);
-		while(lua_next(L, table) != 0) {
-			// key at index -2 and value at index -1
-			luaL_checktype(L, -1, LUA_TSTRING);
-			ndef->getIds(lua_tostring(L, -1), filter);
-			// removes value, keeps key for next iteration
-			lua_pop(L, 1);
-		}
-	} else if(lua_isstring(L, 3)) {
-		ndef->getIds(lua_tostring(L, 3), filter);
-	}
-
-	std::map<content_t, u16> individual_count;
+	NodeNameFilter filter(L, 3, ndef);
 
 	lua_newtable(L);
-	u64 i = 0;
-	for (s16 x = minp.X; x <= maxp.X; x++)
-		for (s16 y = minp.Y; y <= maxp.Y; y++)
-			for (s16 z = minp.Z; z <= maxp.Z; z++) {
-				v3s16 p(x, y, z);
-				content_t c = env->getMap().getNodeNoEx(p).getContent();
-				if (filter.count(c) != 0) {
-					push_v3s16(L, p);
-					lua_rawseti(L, -2, ++i);
-					individual_count[c]++;
-				}
-	}
-	lua_newtable(L);
-	for (std::set<content_t>::iterator it = filter.begin();
-			it != filter.end(); ++it) {
-		lua_pushnumber(L, individual_count[*it]);
-		lua_setfield(L, -2, ndef->get(*it).name.c_str());
-	}
+	FoundNodesCounter counter(L, true, filter);
+	visit_nodes_in_area(&env->getMap(), minp, maxp, filter, counter);
+
+	counter.pushCounts(filter, ndef);
+	return 2;
+}
+
+// count_nodes_in_area(minp, maxp, nodenames) -> total, count per name
+// nodenames: eg. {"ignore", "group:tree"} or "default:dirt"
+int ModApiEnvMod::l_count_nodes_in_area(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	INodeDefManager *ndef = getServer(L)->ndef();
+	v3s16 minp = read_v3s16(L, 1);
+	v3s16 maxp = read_v3s16(L, 2);
+	NodeNameFilter filter(L, 3, ndef);
+
+	FoundNodesCounter counter(L, false, filter);
+	visit_nodes_in_area(&env->getMap(), minp, maxp, filter, counter);
+
+	lua_pushnumber(L, counter.total);
+	counter.pushCounts(filter, ndef);
 	return 2;
 }
 
+// Lists the found nodes that have air above them in the table on top of
+// the Lua stack
+struct UnderAirFinder {
+	lua_State *L;
+	Map *map;
+	u32 total;
+	// Consecutive nodes are mostly in the same block
+	MapBlock *block;
+	v3s16 blockpos;
+
+	UnderAirFinder(lua_State *L, Map *map) :
+		L(L),
+		map(map),
+		total(0),
+		block(NULL)
+	{}
+
+	inline void operator()(v3s16 p, content_t c)
+	{
+		if (c == CONTENT_AIR)
+			return;
+
+		// The node above may be in the next block up
+		v3s16 p_above = p + v3s16(0, 1, 0);
+		v3s16 bp = getNodeBlockPos(p_above);
+		if (!block || bp != blockpos) {
+			block = map->getBlockNoCreateNoEx(bp);
+			blockpos = bp;
+		}
+		if (!block || block->isDummy())
+			return;
+
+		v3s16 relpos = p_above - bp * MAP_BLOCKSIZE;
+		if (block->getNodeUnsafe(relpos).getContent() == CONTENT_AIR) {
+			push_v3s16(L, p);
+			lua_rawseti(L, -2, ++total);
+		}
+	}
+};
+
 // find_nodes_in_area_under_air(minp, maxp, nodenames) -> list of positions
 // nodenames: e.g. {"ignore", "group:tree"} or "default:dirt"
 int ModApiEnvMod::l_find_nodes_in_area_under_air(lua_State *L)
@@ -688,42 +942,14 @@ int ModApiEnvMod::l_find_nodes_in_area_under_air(lua_State *L)
 	GET_ENV_PTR;
 
 	INodeDefManager *ndef = getServer(L)->ndef();
+	Map *map = &env->getMap();
 	v3s16 minp = read_v3s16(L, 1);
 	v3s16 maxp = read_v3s16(L, 2);
-	std::set<content_t> filter;
-
-	if (lua_istable(L, 3)) {
-		int table = 3;
-		lua_pushnil(L);
-		while(lua_next(L, table) != 0) {
-			// key at index -2 and value at index -1
-			luaL_checktype(L, -1, LUA_TSTRING);
-			ndef->getIds(lua_tostring(L, -1), filter);
-			// removes value, keeps key for next iteration
-			lua_pop(L, 1);
-		}
-	} else if (lua_isstring(L, 3)) {
-		ndef->getIds(lua_tostring(L, 3), filter);
-	}
+	NodeNameFilter filter(L, 3, ndef);
 
 	lua_newtable(L);
-	u64 i = 0;
-	for (s16 x = minp.X; x <= maxp.X; x++)
-	for (s16 z = minp.Z; z <= maxp.Z; z++) {
-		s16 y = minp.Y;
-		v3s16 p(x, y, z);
-		content_t c = env->getMap().getNodeNoEx(p).getContent();
-		for (; y <= maxp.Y; y++) {
-			v3s16 psurf(x, y + 1, z);
-			content_t csurf = env->getMap().getNodeNoEx(psurf).getContent();
-			if(c != CONTENT_AIR && csurf == CONTENT_AIR &&
-					filter.count(c) != 0) {
-				push_v3s16(L, v3s16(x, y, z));
-				lua_rawseti(L, -2, ++i);
-			}
-			c = csurf;
-		}
-	}
+	UnderAirFinder finder(L, map);
+	visit_nodes_in_area(map, minp, maxp, filter, finder);
 	return 1;
 }
 
@@ -1049,10 +1275,14 @@ void ModApiEnvMod::Initialize(lua_State *L, int top)
 	API_FCT(set_node);
 	API_FCT(add_node);
 	API_FCT(swap_node);
+	API_FCT(bulk_set_node);
+	API_FCT(bulk_swap_node);
 	API_FCT(add_item);
 	API_FCT(remove_node);
 	API_FCT(get_node);
 	API_FCT(get_node_or_nil);
+	API_FCT(get_node_raw);
+	API_FCT(set_node_raw);
 	API_FCT(get_node_light);
 	API_FCT(place_node);
 	API_FCT(dig_node);
@@ -1074,6 +1304,7 @@ void ModApiEnvMod::Initialize(lua_State *L, int top)
 	API_FCT(find_node_near);
 	API_FCT(find_nodes_in_area);
 	API_FCT(find_nodes_in_area_under_air);
+	API_FCT(count_nodes_in_area);
 	API_FCT(emerge_area);
 	API_FCT(delete_area);
 	API_FCT(get_perlin);
@@ -39,6 +39,12 @@ class ModApiEnvMod : public ModApiBase {
 	// pos = {x=num, y=num, z=num}
 	static int l_swap_node(lua_State *L);
 
+	// bulk_set_node({pos1, pos2, ...}, node) -> count
+	static int l_bulk_set_node(lua_State *L);
+
+	// bulk_swap_node({pos1, pos2, ...}, node) -> count
+	static int l_bulk_swap_node(lua_State *L);
+
 	// get_node(pos)
 	// pos = {x=num, y=num, z=num}
 	static int l_get_node(lua_State *L);
@@ -47,6 +53,12 @@ class ModApiEnvMod : public ModApiBase {
 	// pos = {x=num, y=num, z=num}
 	static int l_get_node_or_nil(lua_State *L);
 
+	// get_node_raw(x, y, z) -> content_id, param1, param2, pos_ok
+	static int l_get_node_raw(lua_State *L);
+
+	// set_node_raw(x, y, z, content_id, [param1], [param2])
+	static int l_set_node_raw(lua_State *L);
+
 	// get_node_light(pos, timeofday)
 	// pos = {x=num, y=num, z=num}
 	// timeofday: nil = current time, 0 = night, 0.5 = day
@@ -128,6 +140,10 @@ class ModApiEnvMod : public ModApiBase {
 	// nodenames: eg. {"ignore", "group:tree"} or "default:dirt"
 	static int l_find_nodes_in_area_under_air(lua_State *L);
 
+	// count_nodes_in_area(minp, maxp, nodenames) -> total, count per name
+	// nodenames: eg. {"ignore", "group:tree"} or "default:dirt"
+	static int l_count_nodes_in_area(lua_State *L);
+
 	// emerge_area(p1, p2)
 	static int l_emerge_area(lua_State *L);
 
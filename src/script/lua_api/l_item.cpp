@@ -566,10 +566,10 @@ int ModApiItemMod::l_register_alias_raw(lua_State *L)
 int ModApiItemMod::l_get_content_id(lua_State *L)
 {
 	NO_MAP_LOCK_REQUIRED;
-	std::string name = luaL_checkstring(L, 1);
+	luaL_checkstring(L, 1);
 
 	INodeDefManager *ndef = getServer(L)->getNodeDefManager();
-	content_t c = ndef->getId(name);
+	content_t c = read_node_name(L, 1, ndef);
 
 	lua_pushinteger(L, c);
 	return 1; /* number of results */
@@ -582,9 +582,8 @@ int ModApiItemMod::l_get_name_from_content_id(lua_State *L)
 	content_t c = luaL_checkint(L, 1);
 
 	INodeDefManager *ndef = getServer(L)->getNodeDefManager();
-	const char *name = ndef->get(c).name.c_str();
+	push_node_name(L, c, ndef);
 
-	lua_pushstring(L, name);
 	return 1; /* number of results */
 }
 
@@ -1392,6 +1392,64 @@ int ModApiMapgen::l_place_schematic(lua_State *L)
 	return 1;
 }
 
+// place_schematics({{pos=, schematic=, rotation=, replacements=,
+//     force_placement=}, ...})
+int ModApiMapgen::l_place_schematics(lua_State *L)
+{
+	MAP_LOCK_REQUIRED;
+
+	Map *map = &(getEnv(L)->getMap());
+	SchematicManager *schemmgr = getServer(L)->getEmergeManager()->schemmgr;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+
+	std::vector<SchematicPlacement> placements;
+	size_t num_placements = lua_objlen(L, 1);
+	for (size_t i = 1; i <= num_placements; i++) {
+		lua_rawgeti(L, 1, i);
+		int index = lua_gettop(L);
+		luaL_checktype(L, index, LUA_TTABLE);
+
+		SchematicPlacement sp;
+		sp.flags = 0;
+
+		//// Read position
+		lua_getfield(L, index, "pos");
+		sp.p = check_v3s16(L, -1);
+		lua_pop(L, 1);
+
+		//// Read rotation and force placement
+		sp.rot = (Rotation)getenumfield(L, index, "rotation",
+			es_Rotation, ROTATE_0);
+		sp.force_place = getboolfield_default(L, index,
+			"force_placement", true);
+
+		//// Read node replacements
+		StringMap replace_names;
+		lua_getfield(L, index, "replacements");
+		if (lua_istable(L, -1))
+			read_schematic_replacements(L, -1, &replace_names);
+		lua_pop(L, 1);
+
+		//// Read schematic
+		lua_getfield(L, index, "schematic");
+		sp.schematic = get_or_load_schematic(L, -1, schemmgr, &replace_names);
+		lua_pop(L, 2);
+
+		if (!sp.schematic) {
+			errorstream << "place_schematics: failed to get schematic" << std::endl;
+			return 0;
+		}
+
+		placements.push_back(sp);
+	}
+
+	place_schematics_on_map(map, placements);
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
 int ModApiMapgen::l_place_schematic_on_vmanip(lua_State *L)
 {
 	NO_MAP_LOCK_REQUIRED;
@@ -1516,6 +1574,7 @@ void ModApiMapgen::Initialize(lua_State *L, int top)
 	API_FCT(generate_decorations);
 	API_FCT(create_schematic);
 	API_FCT(place_schematic);
+	API_FCT(place_schematics);
 	API_FCT(place_schematic_on_vmanip);
 	API_FCT(serialize_schematic);
 }
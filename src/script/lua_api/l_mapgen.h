@@ -100,6 +100,10 @@ class ModApiMapgen : public ModApiBase {
 	// place_schematic(p, schematic, rotation, replacements, force_placement)
 	static int l_place_schematic(lua_State *L);
 
+	// place_schematics({{pos=, schematic=, rotation=, replacements=,
+	//     force_placement=}, ...})
+	static int l_place_schematics(lua_State *L);
+
 	// place_schematic_on_vmanip(vm, p, schematic,
 	//     rotation, replacements, force_placement)
 	static int l_place_schematic_on_vmanip(lua_State *L);
@@ -45,7 +45,7 @@ int NodeTimerRef::l_set(lua_State *L)
 	if(env == NULL) return 0;
 	f32 t = luaL_checknumber(L,2);
 	f32 e = luaL_checknumber(L,3);
-	env->getMap().setNodeTimer(NodeTimer(t, e, o->m_p));
+	env->setNodeTimer(NodeTimer(t, e, o->m_p));
 	return 0;
 }
 
@@ -56,7 +56,7 @@ int NodeTimerRef::l_start(lua_State *L)
 	ServerEnvironment *env = o->m_env;
 	if(env == NULL) return 0;
 	f32 t = luaL_checknumber(L,2);
-	env->getMap().setNodeTimer(NodeTimer(t, 0, o->m_p));
+	env->setNodeTimer(NodeTimer(t, 0, o->m_p));
 	return 0;
 }
 
@@ -66,7 +66,7 @@ int NodeTimerRef::l_stop(lua_State *L)
 	NodeTimerRef *o = checkobject(L, 1);
 	ServerEnvironment *env = o->m_env;
 	if(env == NULL) return 0;
-	env->getMap().removeNodeTimer(o->m_p);
+	env->removeNodeTimer(o->m_p);
 	return 0;
 }
 
@@ -978,6 +978,68 @@ int ObjectRef::l_get_luaentity(lua_State *L)
 	return 1;
 }
 
+// set_step_interval(self, interval)
+int ObjectRef::l_set_step_interval(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	ObjectRef *ref = checkobject(L, 1);
+	LuaEntitySAO *co = getluaobject(ref);
+	if (co == NULL) return 0;
+	// Do it
+	co->setStepInterval(luaL_checknumber(L, 2));
+	return 0;
+}
+
+// get_step_interval(self)
+int ObjectRef::l_get_step_interval(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	ObjectRef *ref = checkobject(L, 1);
+	LuaEntitySAO *co = getluaobject(ref);
+	if (co == NULL) return 0;
+	// Do it
+	lua_pushnumber(L, co->getStepInterval());
+	return 1;
+}
+
+// sleep(self, [time], [wake_distance])
+int ObjectRef::l_sleep(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	ObjectRef *ref = checkobject(L, 1);
+	LuaEntitySAO *co = getluaobject(ref);
+	if (co == NULL) return 0;
+	float time = luaL_optnumber(L, 2, -1);
+	float wake_distance = luaL_optnumber(L, 3, 0);
+	// Do it
+	co->sleep(time, wake_distance);
+	return 0;
+}
+
+// wake(self)
+int ObjectRef::l_wake(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	ObjectRef *ref = checkobject(L, 1);
+	LuaEntitySAO *co = getluaobject(ref);
+	if (co == NULL) return 0;
+	// Do it
+	co->wake();
+	return 0;
+}
+
+// is_sleeping(self)
+int ObjectRef::l_is_sleeping(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	ObjectRef *ref = checkobject(L, 1);
+	LuaEntitySAO *co = getluaobject(ref);
+	if (co == NULL) return 0;
+	// Do it
+	lua_pushboolean(L, co->isSleeping());
+	return 1;
+}
+
 /* Player-only */
 
 // is_player_connected(self)
@@ -1862,6 +1924,11 @@ const luaL_reg ObjectRef::methods[] = {
 	luamethod_aliased(ObjectRef, set_sprite, setsprite),
 	luamethod(ObjectRef, get_entity_name),
 	luamethod(ObjectRef, get_luaentity),
+	luamethod(ObjectRef, set_step_interval),
+	luamethod(ObjectRef, get_step_interval),
+	luamethod(ObjectRef, sleep),
+	luamethod(ObjectRef, wake),
+	luamethod(ObjectRef, is_sleeping),
 	// Player-only
 	luamethod(ObjectRef, is_player),
 	luamethod(ObjectRef, is_player_connected),
@@ -178,6 +178,21 @@ class ObjectRef : public ModApiBase {
 	// get_luaentity(self)
 	static int l_get_luaentity(lua_State *L);
 
+	// set_step_interval(self, interval)
+	static int l_set_step_interval(lua_State *L);
+
+	// get_step_interval(self)
+	static int l_get_step_interval(lua_State *L);
+
+	// sleep(self, [time], [wake_distance])
+	static int l_sleep(lua_State *L);
+
+	// wake(self)
+	static int l_wake(lua_State *L);
+
+	// is_sleeping(self)
+	static int l_is_sleeping(lua_State *L);
+
 	/* Player-only */
 
 	// is_player_connected(self)
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/c_converter.h"
 #include "common/c_content.h"
 #include "cpp_api/s_base.h"
+#include "scripting_game.h"
 #include "server.h"
 #include "environment.h"
 #include "player.h"
@@ -482,6 +483,77 @@ int ModApiServer::l_set_last_run_mod(lua_State *L)
 	return 0;
 }
 
+// do_async_callback(func, serialized_param) -> jobid
+int ModApiServer::l_do_async_callback(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	std::string serialized_func;
+	if (!AsyncEngine::serializeFunction(L, 1, &serialized_func))
+		throw LuaError("do_async_callback: unable to serialize function");
+
+	size_t param_length;
+	const char *serialized_param = luaL_checklstring(L, 2, &param_length);
+
+	lua_pushinteger(L, getServer(L)->getScriptIface()->queueAsync(
+		serialized_func, std::string(serialized_param, param_length)));
+	return 1;
+}
+
+// sampling_profiler_start([interval_ms])
+int ModApiServer::l_sampling_profiler_start(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	int interval_ms = luaL_optinteger(L, 1, 10);
+	getScriptApiBase(L)->startSampling(MYMAX(interval_ms, 1));
+	return 0;
+}
+
+// sampling_profiler_stop()
+int ModApiServer::l_sampling_profiler_stop(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	getScriptApiBase(L)->stopSampling();
+	return 0;
+}
+
+// sampling_profiler_get([reset]) -> folded stacks, sample count
+int ModApiServer::l_sampling_profiler_get(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	u32 sample_count;
+	std::string samples = getScriptApiBase(L)->getSamples(
+		lua_toboolean(L, 1), &sample_count);
+	lua_pushlstring(L, samples.data(), samples.size());
+	lua_pushinteger(L, sample_count);
+	return 2;
+}
+
+// get_callback_times([reset]) -> list of callback times
+int ModApiServer::l_get_callback_times(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	std::vector<ScriptCallbackTime> times;
+	getScriptApiBase(L)->getCallbackTimes(&times, lua_toboolean(L, 1));
+
+	lua_createtable(L, times.size(), 0);
+	for (u32 i = 0; i < times.size(); i++) {
+		const ScriptCallbackTime &time = times[i];
+		lua_createtable(L, 0, 5);
+		lua_pushstring(L, time.entry.c_str());
+		lua_setfield(L, -2, "entry");
+		lua_pushstring(L, time.mod.c_str());
+		lua_setfield(L, -2, "mod");
+		lua_pushnumber(L, time.time_us);
+		lua_setfield(L, -2, "time_us");
+		lua_pushinteger(L, time.calls);
+		lua_setfield(L, -2, "calls");
+		lua_pushinteger(L, time.max_us);
+		lua_setfield(L, -2, "max_us");
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
 #ifndef NDEBUG
 // cause_error(type_of_error)
 int ModApiServer::l_cause_error(lua_State *L)
@@ -544,6 +616,13 @@ void ModApiServer::Initialize(lua_State *L, int top)
 
 	API_FCT(get_last_run_mod);
 	API_FCT(set_last_run_mod);
+
+	API_FCT(do_async_callback);
+
+	API_FCT(sampling_profiler_start);
+	API_FCT(sampling_profiler_stop);
+	API_FCT(sampling_profiler_get);
+	API_FCT(get_callback_times);
 #ifndef NDEBUG
 	API_FCT(cause_error);
 #endif
@@ -100,6 +100,21 @@ class ModApiServer : public ModApiBase {
 	// set_last_run_mod(modname)
 	static int l_set_last_run_mod(lua_State *L);
 
+	// do_async_callback(func, serialized_param) -> jobid
+	static int l_do_async_callback(lua_State *L);
+
+	// sampling_profiler_start([interval_ms])
+	static int l_sampling_profiler_start(lua_State *L);
+
+	// sampling_profiler_stop()
+	static int l_sampling_profiler_stop(lua_State *L);
+
+	// sampling_profiler_get([reset]) -> folded stacks, sample count
+	static int l_sampling_profiler_get(lua_State *L);
+
+	// get_callback_times([reset]) -> list of callback times
+	static int l_get_callback_times(lua_State *L);
+
 #ifndef NDEBUG
 	//  cause_error(type_of_error)
 	static int l_cause_error(lua_State *L);
@@ -0,0 +1,253 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "lua_api/l_storage.h"
+#include "lua_api/l_internal.h"
+#include "common/c_internal.h"
+#include "mod_storage.h"
+#include "server.h"
+
+static std::string check_string(lua_State *L, int index)
+{
+	size_t len;
+	const char *str = luaL_checklstring(L, index, &len);
+	return std::string(str, len);
+}
+
+// get_mod_storage()
+int ModApiStorage::l_get_mod_storage(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	// Only while the mod is loaded, so that the mod name is known
+	lua_rawgeti(L, LUA_REGISTRYINDEX, CUSTOM_RIDX_CURRENT_MOD_NAME);
+	if (!lua_isstring(L, -1)) {
+		return 0;
+	}
+
+	std::string modname = lua_tostring(L, -1);
+	StorageRef::create(L, getServer(L)->getModStorage(modname));
+	return 1;
+}
+
+void ModApiStorage::Initialize(lua_State *L, int top)
+{
+	API_FCT(get_mod_storage);
+}
+
+StorageRef::StorageRef(ModStorage *storage) :
+	m_storage(storage)
+{
+}
+
+int StorageRef::gc_object(lua_State *L)
+{
+	StorageRef *o = *(StorageRef **)(lua_touserdata(L, 1));
+	delete o;
+	return 0;
+}
+
+StorageRef *StorageRef::checkobject(lua_State *L, int narg)
+{
+	luaL_checktype(L, narg, LUA_TUSERDATA);
+	void *ud = luaL_checkudata(L, narg, className);
+	if (!ud) luaL_typerror(L, narg, className);
+	return *(StorageRef **)ud;  // unbox pointer
+}
+
+// contains(self, key)
+int StorageRef::l_contains(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	StorageRef *ref = checkobject(L, 1);
+	std::string key = check_string(L, 2);
+
+	lua_pushboolean(L, ref->m_storage->contains(key));
+	return 1;
+}
+
+// get_string(self, key)
+int StorageRef::l_get_string(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	StorageRef *ref = checkobject(L, 1);
+	std::string key = check_string(L, 2);
+
+	std::string str = ref->m_storage->getString(key);
+	lua_pushlstring(L, str.c_str(), str.size());
+	return 1;
+}
+
+// set_string(self, key, value)
+int StorageRef::l_set_string(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	StorageRef *ref = checkobject(L, 1);
+	std::string key = check_string(L, 2);
+	std::string value;
+	if (!lua_isnoneornil(L, 3))
+		value = check_string(L, 3);
+
+	ref->m_storage->setString(key, value);
+	return 0;
+}
+
+// get_int(self, key)
+int StorageRef::l_get_int(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	StorageRef *ref = checkobject(L, 1);
+	std::string key = check_string(L, 2);
+
+	lua_pushnumber(L, stoi(ref->m_storage->getString(key)));
+	return 1;
+}
+
+// set_int(self, key, value)
+int StorageRef::l_set_int(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	StorageRef *ref = checkobject(L, 1);
+	std::string key = check_string(L, 2);
+	int value = luaL_checkint(L, 3);
+
+	ref->m_storage->setString(key, itos(value));
+	return 0;
+}
+
+// get_float(self, key)
+int StorageRef::l_get_float(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	StorageRef *ref = checkobject(L, 1);
+	std::string key = check_string(L, 2);
+
+	std::string str = ref->m_storage->getString(key);
+	lua_pushnumber(L, strtod(str.c_str(), NULL));
+	return 1;
+}
+
+// set_float(self, key, value)
+int StorageRef::l_set_float(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	StorageRef *ref = checkobject(L, 1);
+	std::string key = check_string(L, 2);
+	luaL_checknumber(L, 3);
+
+	// Lua's own conversion, which keeps more digits than ftos()
+	lua_pushvalue(L, 3);
+	std::string value = lua_tostring(L, -1);
+	lua_pop(L, 1);
+
+	ref->m_storage->setString(key, value);
+	return 0;
+}
+
+// get_keys(self)
+int StorageRef::l_get_keys(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	StorageRef *ref = checkobject(L, 1);
+
+	const StringMap &values = ref->m_storage->getValues();
+	lua_createtable(L, values.size(), 0);
+	int i = 1;
+	for (StringMap::const_iterator it = values.begin();
+			it != values.end(); ++it) {
+		lua_pushlstring(L, it->first.c_str(), it->first.size());
+		lua_rawseti(L, -2, i++);
+	}
+	return 1;
+}
+
+// to_table(self)
+int StorageRef::l_to_table(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	StorageRef *ref = checkobject(L, 1);
+
+	const StringMap &values = ref->m_storage->getValues();
+	lua_createtable(L, 0, values.size());
+	for (StringMap::const_iterator it = values.begin();
+			it != values.end(); ++it) {
+		lua_pushlstring(L, it->first.c_str(), it->first.size());
+		lua_pushlstring(L, it->second.c_str(), it->second.size());
+		lua_rawset(L, -3);
+	}
+	return 1;
+}
+
+void StorageRef::create(lua_State *L, ModStorage *storage)
+{
+	StorageRef *o = new StorageRef(storage);
+	*(void **)(lua_newuserdata(L, sizeof(void *))) = o;
+	luaL_getmetatable(L, className);
+	lua_setmetatable(L, -2);
+}
+
+void StorageRef::Register(lua_State *L)
+{
+	lua_newtable(L);
+	int methodtable = lua_gettop(L);
+	luaL_newmetatable(L, className);
+	int metatable = lua_gettop(L);
+
+	lua_pushliteral(L, "__metatable");
+	lua_pushvalue(L, methodtable);
+	lua_settable(L, metatable);  // hide metatable from Lua getmetatable()
+
+	lua_pushliteral(L, "__index");
+	lua_pushvalue(L, methodtable);
+	lua_settable(L, metatable);
+
+	lua_pushliteral(L, "__gc");
+	lua_pushcfunction(L, gc_object);
+	lua_settable(L, metatable);
+
+	lua_pop(L, 1);  // drop metatable
+
+	luaL_openlib(L, 0, methods, 0);  // fill methodtable
+	lua_pop(L, 1);  // drop methodtable
+
+	// Cannot be created from Lua
+}
+
+const char StorageRef::className[] = "StorageRef";
+const luaL_reg StorageRef::methods[] = {
+	luamethod(StorageRef, contains),
+	luamethod(StorageRef, get_string),
+	luamethod(StorageRef, set_string),
+	luamethod(StorageRef, get_int),
+	luamethod(StorageRef, set_int),
+	luamethod(StorageRef, get_float),
+	luamethod(StorageRef, set_float),
+	luamethod(StorageRef, get_keys),
+	luamethod(StorageRef, to_table),
+	{0,0}
+};
@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "lua_api/l_internal.h"
 #include "common/c_converter.h"
 #include "common/c_content.h"
+#include "common/c_serialize.h"
 #include "cpp_api/s_async.h"
 #include "serialization.h"
 #include <json/json.h>
@@ -219,6 +220,52 @@ int ModApiUtil::l_write_json(lua_State *L)
 	return 1;
 }
 
+// native_serialize(value[, binary]) -> string
+// Returns nil if the value has to be serialized by the Lua implementation.
+int ModApiUtil::l_native_serialize(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	lua_settop(L, 2);
+	bool binary = lua_toboolean(L, 2);
+	lua_pop(L, 1);
+
+	std::string out;
+	if (binary) {
+		serialize_value_binary(L, 1, &out);
+	} else if (!serialize_value_text(L, 1, &out)) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_pushlstring(L, out.data(), out.size());
+	return 1;
+}
+
+// native_deserialize(str) -> true, value or false[, error]
+// Returns false without an error if the string has to be deserialized
+// by the Lua implementation.
+int ModApiUtil::l_native_deserialize(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	size_t size;
+	const char *data = luaL_checklstring(L, 1, &size);
+
+	std::string error;
+	switch (deserialize_value(L, data, size, &error)) {
+	case DESERIALIZE_OK:
+		lua_pushboolean(L, true);
+		lua_insert(L, -2);
+		return 2;
+	case DESERIALIZE_ERROR:
+		lua_pushboolean(L, false);
+		lua_pushstring(L, error.c_str());
+		return 2;
+	default:
+		lua_pushboolean(L, false);
+		return 1;
+	}
+}
+
 // get_dig_params(groups, tool_capabilities[, time_from_last_punch])
 int ModApiUtil::l_get_dig_params(lua_State *L)
 {
@@ -502,6 +549,9 @@ void ModApiUtil::Initialize(lua_State *L, int top)
 	API_FCT(parse_json);
 	API_FCT(write_json);
 
+	API_FCT(native_serialize);
+	API_FCT(native_deserialize);
+
 	API_FCT(get_dig_params);
 	API_FCT(get_hit_params);
 
@@ -541,6 +591,9 @@ void ModApiUtil::InitializeAsync(AsyncEngine& engine)
 	ASYNC_API_FCT(parse_json);
 	ASYNC_API_FCT(write_json);
 
+	ASYNC_API_FCT(native_serialize);
+	ASYNC_API_FCT(native_deserialize);
+
 	ASYNC_API_FCT(is_yes);
 
 	ASYNC_API_FCT(get_builtin_path);
@@ -65,6 +65,12 @@ class ModApiUtil : public ModApiBase {
 	// write_json(data[, styled])
 	static int l_write_json(lua_State *L);
 
+	// native_serialize(value[, binary])
+	static int l_native_serialize(lua_State *L);
+
+	// native_deserialize(str)
+	static int l_native_deserialize(lua_State *L);
+
 	// get_dig_params(groups, tool_capabilities[, time_from_last_punch])
 	static int l_get_dig_params(lua_State *L);
 
@@ -111,7 +111,9 @@ int LuaVoxelManip::l_write_to_map(lua_State *L)
 	LuaVoxelManip *o = checkobject(L, 1);
 	MMVManip *vm = o->vm;
 
-	vm->blitBackAll(&o->modified_blocks);
+	// Mapgen VMs compute their lighting with calc_lighting() instead
+	vm->blitBackChanged(&o->modified_blocks,
+		o->is_mapgen_vm ? NULL : &o->changed_nodes, &o->written_blocks);
 
 	return 0;
 }
@@ -329,14 +331,26 @@ int LuaVoxelManip::l_update_map(lua_State *L)
 		return 0;
 
 	Map *map = &(env->getMap());
+	std::string lighting = luaL_optstring(L, 2, "full");
 
-	// TODO: Optimize this by using Mapgen::calcLighting() instead
-	std::map<v3s16, MapBlock *> lighting_mblocks;
 	std::map<v3s16, MapBlock *> *mblocks = &o->modified_blocks;
-
-	lighting_mblocks.insert(mblocks->begin(), mblocks->end());
-
-	map->updateLighting(lighting_mblocks, *mblocks);
+	if (lighting == "full") {
+		// TODO: Optimize this by using Mapgen::calcLighting() instead
+		std::map<v3s16, MapBlock *> lighting_mblocks;
+		lighting_mblocks.insert(o->written_blocks.begin(),
+			o->written_blocks.end());
+		mblocks->insert(o->written_blocks.begin(), o->written_blocks.end());
+
+		map->updateLighting(lighting_mblocks, *mblocks);
+	} else if (lighting == "changed" || lighting == "lazy") {
+		// Only the light around the nodes changed by write_to_map() is updated
+		map->updateChangedLighting(o->changed_nodes, *mblocks,
+			lighting == "lazy");
+	} else {
+		return luaL_argerror(L, 2, "expected \"full\", \"changed\" or \"lazy\"");
+	}
+	o->changed_nodes.clear();
+	o->written_blocks.clear();
 
 	MapEditEvent event;
 	event.type = MEET_OTHER;
@@ -364,6 +378,27 @@ int LuaVoxelManip::l_was_modified(lua_State *L)
 	return 1;
 }
 
+int LuaVoxelManip::l_get_data_buffer(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	checkobject(L, 1);
+
+	static const EnumString es_VoxelManipBufferField[] = {
+		{VMBUF_CONTENT, "content"},
+		{VMBUF_PARAM1,  "param1"},
+		{VMBUF_PARAM2,  "param2"},
+		{0, NULL},
+	};
+
+	int field = VMBUF_CONTENT;
+	if (!lua_isnoneornil(L, 2) &&
+			!string_to_enum(es_VoxelManipBufferField, field, luaL_checkstring(L, 2)))
+		throw LuaError("Unknown VoxelManip buffer field");
+
+	return LuaVoxelManipBuffer::create_object(L, 1, (VoxelManipBufferField)field);
+}
+
 int LuaVoxelManip::l_get_emerged_area(lua_State *L)
 {
 	NO_MAP_LOCK_REQUIRED;
@@ -481,5 +516,331 @@ const luaL_reg LuaVoxelManip::methods[] = {
 	luamethod(LuaVoxelManip, set_param2_data),
 	luamethod(LuaVoxelManip, was_modified),
 	luamethod(LuaVoxelManip, get_emerged_area),
+	luamethod(LuaVoxelManip, get_data_buffer),
+	{0,0}
+};
+
+/*
+  VoxelManipBuffer
+ */
+
+// garbage collector
+int LuaVoxelManipBuffer::gc_object(lua_State *L)
+{
+	LuaVoxelManipBuffer *o = *(LuaVoxelManipBuffer **)(lua_touserdata(L, 1));
+	luaL_unref(L, LUA_REGISTRYINDEX, o->m_vmanip_ref);
+	delete o;
+
+	return 0;
+}
+
+u16 LuaVoxelManipBuffer::get(u32 i) const
+{
+	const MapNode &n = m_vmanip->vm->m_data[i];
+	switch (m_field) {
+	case VMBUF_PARAM1:
+		return n.param1;
+	case VMBUF_PARAM2:
+		return n.param2;
+	default:
+		return n.param0;
+	}
+}
+
+void LuaVoxelManipBuffer::set(u32 i, u16 value)
+{
+	MapNode &n = m_vmanip->vm->m_data[i];
+	switch (m_field) {
+	case VMBUF_PARAM1:
+		n.param1 = value;
+		break;
+	case VMBUF_PARAM2:
+		n.param2 = value;
+		break;
+	default:
+		n.param0 = value;
+	}
+}
+
+VoxelArea LuaVoxelManipBuffer::checkarea(lua_State *L, int narg) const
+{
+	const VoxelArea &vm_area = m_vmanip->vm->m_area;
+	if (lua_isnoneornil(L, narg) && lua_isnoneornil(L, narg + 1))
+		return vm_area;
+
+	v3s16 pmin = check_v3s16(L, narg);
+	v3s16 pmax = check_v3s16(L, narg + 1);
+	sortBoxVerticies(pmin, pmax);
+
+	VoxelArea area(pmin, pmax);
+	if (!vm_area.contains(area))
+		throw LuaError("Specified voxel area out of VoxelManipulator bounds");
+	return area;
+}
+
+u16 LuaVoxelManipBuffer::checkvalue(lua_State *L, int narg) const
+{
+	lua_Integer value = luaL_checkinteger(L, narg);
+	lua_Integer max = m_field == VMBUF_CONTENT ? 0xFFFF : 0xFF;
+	if (value < 0 || value > max)
+		luaL_argerror(L, narg, "value out of range");
+	return value;
+}
+
+// Pushes the value of node i (1-based), nothing if out of range
+int LuaVoxelManipBuffer::push_value(lua_State *L, lua_Integer i) const
+{
+	i--;
+	if (i < 0 || i >= m_vmanip->vm->m_area.getVolume())
+		return 0;
+
+	lua_pushinteger(L, get(i));
+	return 1;
+}
+
+// buffer[i] -> value, or the method of that name
+int LuaVoxelManipBuffer::mt_index(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	if (lua_type(L, 2) != LUA_TNUMBER) {
+		lua_pushvalue(L, 2);
+		lua_rawget(L, lua_upvalueindex(1));
+		return 1;
+	}
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	return o->push_value(L, lua_tointeger(L, 2));
+}
+
+// buffer[i] = value
+int LuaVoxelManipBuffer::mt_newindex(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	lua_Integer i = luaL_checkinteger(L, 2) - 1;
+	if (i < 0 || i >= o->m_vmanip->vm->m_area.getVolume())
+		throw LuaError("VoxelManip buffer index out of range");
+
+	o->set(i, o->checkvalue(L, 3));
+	return 0;
+}
+
+// #buffer
+int LuaVoxelManipBuffer::mt_len(lua_State *L)
+{
+	return l_size(L);
+}
+
+// get(i) -> value
+int LuaVoxelManipBuffer::l_get(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	return o->push_value(L, luaL_checkinteger(L, 2));
+}
+
+// set(i, value)
+int LuaVoxelManipBuffer::l_set(lua_State *L)
+{
+	return mt_newindex(L);
+}
+
+// size() -> number of nodes
+int LuaVoxelManipBuffer::l_size(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	lua_pushinteger(L, o->m_vmanip->vm->m_area.getVolume());
+	return 1;
+}
+
+// fill(value, [pmin, pmax])
+int LuaVoxelManipBuffer::l_fill(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	u16 value      = o->checkvalue(L, 2);
+	VoxelArea area = o->checkarea(L, 3);
+	VoxelArea &vm_area = o->m_vmanip->vm->m_area;
+
+	for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+	for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++) {
+		u32 i = vm_area.index(area.MinEdge.X, y, z);
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++, i++)
+			o->set(i, value);
+	}
+
+	return 0;
+}
+
+// replace(from, to, [pmin, pmax]) -> number of replaced nodes
+int LuaVoxelManipBuffer::l_replace(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	u16 from       = luaL_checkinteger(L, 2);
+	u16 to         = o->checkvalue(L, 3);
+	VoxelArea area = o->checkarea(L, 4);
+	VoxelArea &vm_area = o->m_vmanip->vm->m_area;
+
+	u32 count = 0;
+	for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+	for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++) {
+		u32 i = vm_area.index(area.MinEdge.X, y, z);
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++, i++) {
+			if (o->get(i) == from) {
+				o->set(i, to);
+				count++;
+			}
+		}
+	}
+
+	lua_pushinteger(L, count);
+	return 1;
+}
+
+// count(value, [pmin, pmax]) -> number of nodes
+int LuaVoxelManipBuffer::l_count(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	u16 value      = luaL_checkinteger(L, 2);
+	VoxelArea area = o->checkarea(L, 3);
+	VoxelArea &vm_area = o->m_vmanip->vm->m_area;
+
+	u32 count = 0;
+	for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+	for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++) {
+		u32 i = vm_area.index(area.MinEdge.X, y, z);
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++, i++) {
+			if (o->get(i) == value)
+				count++;
+		}
+	}
+
+	lua_pushinteger(L, count);
+	return 1;
+}
+
+#if USE_LUAJIT
+// get_pointer() -> pointer to the field of the first node, stride in bytes
+int LuaVoxelManipBuffer::l_get_pointer(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	MapNode *n = o->m_vmanip->vm->m_data;
+	if (!n)
+		return 0;
+
+	void *p;
+	switch (o->m_field) {
+	case VMBUF_PARAM1:
+		p = &n->param1;
+		break;
+	case VMBUF_PARAM2:
+		p = &n->param2;
+		break;
+	default:
+		p = &n->param0;
+	}
+
+	lua_pushlightuserdata(L, p);
+	lua_pushinteger(L, sizeof(MapNode));
+	return 2;
+}
+#endif
+
+LuaVoxelManipBuffer::LuaVoxelManipBuffer(LuaVoxelManip *vmanip, int vmanip_ref,
+	VoxelManipBufferField field) :
+	m_vmanip(vmanip),
+	m_vmanip_ref(vmanip_ref),
+	m_field(field)
+{
+}
+
+int LuaVoxelManipBuffer::create_object(lua_State *L, int narg,
+	VoxelManipBufferField field)
+{
+	LuaVoxelManip *vmanip = LuaVoxelManip::checkobject(L, narg);
+
+	lua_pushvalue(L, narg);
+	int vmanip_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	LuaVoxelManipBuffer *o = new LuaVoxelManipBuffer(vmanip, vmanip_ref, field);
+	*(void **)(lua_newuserdata(L, sizeof(void *))) = o;
+	luaL_getmetatable(L, className);
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+LuaVoxelManipBuffer *LuaVoxelManipBuffer::checkobject(lua_State *L, int narg)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	luaL_checktype(L, narg, LUA_TUSERDATA);
+
+	void *ud = luaL_checkudata(L, narg, className);
+	if (!ud)
+		luaL_typerror(L, narg, className);
+
+	return *(LuaVoxelManipBuffer **)ud;  // unbox pointer
+}
+
+void LuaVoxelManipBuffer::Register(lua_State *L)
+{
+	lua_newtable(L);
+	int methodtable = lua_gettop(L);
+	luaL_newmetatable(L, className);
+	int metatable = lua_gettop(L);
+
+	lua_pushliteral(L, "__metatable");
+	lua_pushvalue(L, methodtable);
+	lua_settable(L, metatable);  // hide metatable from Lua getmetatable()
+
+	// Numeric keys index the nodes, other keys the methods
+	lua_pushliteral(L, "__index");
+	lua_pushvalue(L, methodtable);
+	lua_pushcclosure(L, mt_index, 1);
+	lua_settable(L, metatable);
+
+	lua_pushliteral(L, "__newindex");
+	lua_pushcfunction(L, mt_newindex);
+	lua_settable(L, metatable);
+
+	lua_pushliteral(L, "__len");
+	lua_pushcfunction(L, mt_len);
+	lua_settable(L, metatable);
+
+	lua_pushliteral(L, "__gc");
+	lua_pushcfunction(L, gc_object);
+	lua_settable(L, metatable);
+
+	lua_pop(L, 1);  // drop metatable
+
+	luaL_openlib(L, 0, methods, 0);  // fill methodtable
+	lua_pop(L, 1);  // drop methodtable
+
+	// Only created by VoxelManip:get_data_buffer()
+}
+
+const char LuaVoxelManipBuffer::className[] = "VoxelManipBuffer";
+const luaL_reg LuaVoxelManipBuffer::methods[] = {
+	luamethod(LuaVoxelManipBuffer, get),
+	luamethod(LuaVoxelManipBuffer, set),
+	luamethod(LuaVoxelManipBuffer, size),
+	luamethod(LuaVoxelManipBuffer, fill),
+	luamethod(LuaVoxelManipBuffer, replace),
+	luamethod(LuaVoxelManipBuffer, count),
+#if USE_LUAJIT
+	luamethod(LuaVoxelManipBuffer, get_pointer),
+#endif
 	{0,0}
 };
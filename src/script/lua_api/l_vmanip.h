@@ -22,7 +22,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "lua_api/l_base.h"
 #include "irr_v3d.h"
+#include "mapnode.h"
+#include "voxel.h"
+#include "config.h"
 #include <map>
+#include <vector>
 
 class Map;
 class MapBlock;
@@ -33,7 +37,12 @@ class MMVManip;
  */
 class LuaVoxelManip : public ModApiBase {
 private:
+	// Blocks in which write_to_map() changed nodes
 	std::map<v3s16, MapBlock *> modified_blocks;
+	// All blocks write_to_map() wrote to, relit by update_map()
+	std::map<v3s16, MapBlock *> written_blocks;
+	// Nodes replaced by write_to_map() whose lighting has to be updated
+	std::vector<std::pair<v3s16, MapNode> > changed_nodes;
 	bool is_mapgen_vm;
 
 	static const char className[];
@@ -63,6 +72,8 @@ class LuaVoxelManip : public ModApiBase {
 	static int l_was_modified(lua_State *L);
 	static int l_get_emerged_area(lua_State *L);
 
+	static int l_get_data_buffer(lua_State *L);
+
 public:
 	MMVManip *vm;
 
@@ -80,4 +91,63 @@ class LuaVoxelManip : public ModApiBase {
 	static void Register(lua_State *L);
 };
 
+enum VoxelManipBufferField {
+	VMBUF_CONTENT,
+	VMBUF_PARAM1,
+	VMBUF_PARAM2,
+};
+
+/*
+  VoxelManipBuffer
+
+  Flat array aliasing one field of all nodes of a VoxelManip, so that Lua
+  code can access them without copying them to and from a Lua table.
+  Indices are the same as those of VoxelManip:get_data().
+ */
+class LuaVoxelManipBuffer : public ModApiBase {
+private:
+	LuaVoxelManip *m_vmanip;
+	// Registry reference keeping the VoxelManip from being collected
+	int m_vmanip_ref;
+	VoxelManipBufferField m_field;
+
+	static const char className[];
+	static const luaL_reg methods[];
+
+	static int gc_object(lua_State *L);
+	static int mt_index(lua_State *L);
+	static int mt_newindex(lua_State *L);
+	static int mt_len(lua_State *L);
+
+	static int l_get(lua_State *L);
+	static int l_set(lua_State *L);
+	static int l_size(lua_State *L);
+	static int l_fill(lua_State *L);
+	static int l_replace(lua_State *L);
+	static int l_count(lua_State *L);
+#if USE_LUAJIT
+	static int l_get_pointer(lua_State *L);
+#endif
+
+	u16 get(u32 i) const;
+	void set(u32 i, u16 value);
+	// Reads a value to be set at narg, raising an error if it does not fit
+	u16 checkvalue(lua_State *L, int narg) const;
+	int push_value(lua_State *L, lua_Integer i) const;
+	// Reads the optional area arguments starting at narg, whole VM if absent
+	VoxelArea checkarea(lua_State *L, int narg) const;
+
+public:
+	LuaVoxelManipBuffer(LuaVoxelManip *vmanip, int vmanip_ref,
+		VoxelManipBufferField field);
+
+	// Creates a buffer for the VoxelManip at index narg and leaves it on
+	// top of stack
+	static int create_object(lua_State *L, int narg, VoxelManipBufferField field);
+
+	static LuaVoxelManipBuffer *checkobject(lua_State *L, int narg);
+
+	static void Register(lua_State *L);
+};
+
 #endif /* L_VMANIP_H_ */
@@ -39,6 +39,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "lua_api/l_util.h"
 #include "lua_api/l_vmanip.h"
 #include "lua_api/l_settings.h"
+#include "lua_api/l_storage.h"
 #include "lua_api/l_http.h"
 
 extern "C" {
@@ -75,9 +76,32 @@ GameScripting::GameScripting(Server* server)
 	lua_pushstring(L, "game");
 	lua_setglobal(L, "INIT");
 
+	// Register functions to async environment and start it, sandboxed
+	// the same way as the mods
+	ModApiUtil::InitializeAsync(asyncEngine);
+
+	s16 num_async = 0;
+	if (!g_settings->getS16NoEx("async_lua_threads", num_async) || num_async < 1)
+		num_async = MYMAX(Thread::getNumberOfProcessors() - 2, 1);
+	asyncEngine.initialize(num_async, server,
+		g_settings->getBool("secure.enable_security"));
+
 	infostream << "SCRIPTAPI: Initialized game modules" << std::endl;
 }
 
+void GameScripting::stepAsync()
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	asyncEngine.step(L);
+}
+
+unsigned int GameScripting::queueAsync(const std::string &serialized_func,
+		const std::string &serialized_param)
+{
+	return asyncEngine.queueAsyncJob(serialized_func, serialized_param);
+}
+
 void GameScripting::InitializeModApi(lua_State *L, int top)
 {
 	// Initialize mod api modules
@@ -89,6 +113,7 @@ void GameScripting::InitializeModApi(lua_State *L, int top)
 	ModApiParticles::Initialize(L, top);
 	ModApiRollback::Initialize(L, top);
 	ModApiServer::Initialize(L, top);
+	ModApiStorage::Initialize(L, top);
 	ModApiUtil::Initialize(L, top);
 	ModApiHttp::Initialize(L, top);
 
@@ -102,10 +127,12 @@ void GameScripting::InitializeModApi(lua_State *L, int top)
 	LuaPcgRandom::Register(L);
 	LuaSecureRandom::Register(L);
 	LuaVoxelManip::Register(L);
+	LuaVoxelManipBuffer::Register(L);
 	NodeMetaRef::Register(L);
 	NodeTimerRef::Register(L);
 	ObjectRef::Register(L);
 	LuaSettings::Register(L);
+	StorageRef::Register(L);
 }
 
 void log_deprecated(const std::string &message)
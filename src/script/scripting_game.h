@@ -28,6 +28,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "cpp_api/s_player.h"
 #include "cpp_api/s_server.h"
 #include "cpp_api/s_security.h"
+#include "cpp_api/s_async.h"
 
 /*****************************************************************************/
 /* Scripting <-> Game Interface                                              */
@@ -48,8 +49,17 @@ class GameScripting :
 
 	// use ScriptApiBase::loadMod() to load mods
 
+	// Pass results of finished async jobs back to the mods
+	void stepAsync();
+
+	// Pass async jobs from the mods to the async threads
+	unsigned int queueAsync(const std::string &serialized_func,
+			const std::string &serialized_param);
+
 private:
 	void InitializeModApi(lua_State *L, int top);
+
+	AsyncEngine asyncEngine;
 };
 
 void log_deprecated(const std::string &message);
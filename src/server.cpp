@@ -50,6 +50,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "content_abm.h"
 #include "content_sao.h"
 #include "mods.h"
+#include "mod_storage.h"
 #include "event_manager.h"
 #include "serverlist.h"
 #include "util/string.h"
@@ -165,6 +166,7 @@ Server::Server(
 	m_enable_rollback_recording(false),
 	m_emerge(NULL),
 	m_script(NULL),
+	m_mod_storage(NULL),
 	m_itemdef(createItemDefManager()),
 	m_nodedef(createNodeDefManager()),
 	m_craftdef(createCraftDefManager()),
@@ -266,6 +268,14 @@ Server::Server(
 	// Create the Map (loads map_meta.txt, overriding configured mapgen params)
 	ServerMap *servermap = new ServerMap(path_world, this, m_emerge);
 
+	// Create the mod storage, in the map backend unless configured otherwise
+	std::string mod_storage_backend = "sqlite3";
+	worldmt_settings.getNoEx("backend", mod_storage_backend);
+	worldmt_settings.getNoEx("mod_storage_backend", mod_storage_backend);
+	m_mod_storage = new ModStorageManager(ModStorageManager::createDatabase(
+		mod_storage_backend, m_path_world, worldmt_settings));
+	m_mod_storage->start();
+
 	// Initialize scripting
 	infostream<<"Server: Initializing Lua"<<std::endl;
 
@@ -413,6 +423,9 @@ Server::~Server()
 	infostream<<"Server: Deinitializing scripting"<<std::endl;
 	delete m_script;
 
+	infostream << "Server: Saving mod storage" << std::endl;
+	delete m_mod_storage;
+
 	// Delete detached inventories
 	for (std::map<std::string, Inventory*>::iterator
 			i = m_detached_inventories.begin();
@@ -563,6 +576,9 @@ void Server::AsyncRunStep(bool initial_step)
 		ScopeProfiler sp(g_profiler, "SEnv step");
 		ScopeProfiler sp2(g_profiler, "SEnv step avg", SPT_AVG);
 		m_env->step(dtime);
+
+		// Pass results of finished async jobs back to the mods
+		m_script->stepAsync();
 	}
 
 	static const float map_timer_and_unload_dtime = 2.92;
@@ -633,6 +649,25 @@ void Server::AsyncRunStep(bool initial_step)
 			SetBlocksNotSent(modified_blocks);
 		}
 	}
+
+	/*
+		Finish lighting queued by lazy VoxelManip updates
+	*/
+	{
+		MutexAutoLock lock(m_env_mutex);
+
+		Map &map = m_env->getMap();
+		if (map.hasQueuedLighting()) {
+			ScopeProfiler sp(g_profiler, "Server: queued lighting");
+
+			std::map<v3s16, MapBlock*> modified_blocks;
+			map.updateQueuedLighting(modified_blocks,
+				g_settings->getS32("lighting_loop_max"));
+			if (!modified_blocks.empty())
+				SetBlocksNotSent(modified_blocks);
+		}
+	}
+
 	m_clients.step(dtime);
 
 	m_lag += (m_lag > dtime ? -1 : 1) * dtime/100;
@@ -1015,6 +1050,9 @@ void Server::AsyncRunStep(bool initial_step)
 				m_banmanager->save();
 			}
 
+			// Hand changed mod storage entries to its thread
+			m_mod_storage->save();
+
 			// Save changed parts of map
 			m_env->getMap().save(MOD_STATE_WRITE_NEEDED);
 
@@ -3399,6 +3437,11 @@ void Server::getModNames(std::vector<std::string> &modlist)
 		modlist.push_back(it->name);
 }
 
+ModStorage *Server::getModStorage(const std::string &modname)
+{
+	return m_mod_storage->getStorage(modname);
+}
+
 std::string Server::getBuiltinLuaPath()
 {
 	return porting::path_share + DIR_DELIM + "builtin";
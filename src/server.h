@@ -51,6 +51,8 @@ class EventManager;
 class Inventory;
 class PlayerSAO;
 class IRollbackManager;
+class ModStorage;
+class ModStorageManager;
 struct RollbackAction;
 class EmergeManager;
 class GameScripting;
@@ -298,6 +300,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	const std::vector<ModSpec> &getMods() const { return m_mods; }
 	const ModSpec* getModSpec(const std::string &modname) const;
 	void getModNames(std::vector<std::string> &modlist);
+	// Under envlock
+	ModStorage *getModStorage(const std::string &modname);
 	std::string getBuiltinLuaPath();
 	inline std::string getWorldPath() const { return m_path_world; }
 
@@ -538,6 +542,9 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// Envlock and conlock should be locked when using Lua
 	GameScripting *m_script;
 
+	// Key-value storage of the mods, outlives m_script
+	ModStorageManager *m_mod_storage;
+
 	// Item definition manager
 	IWritableItemDefManager *m_itemdef;
 
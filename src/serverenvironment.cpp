@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "nodemetadata.h"
 #include "gamedef.h"
 #include "map.h"
+#include "porting.h"
 #include "profiler.h"
 #include "raycast.h"
 #include "remoteplayer.h"
@@ -36,6 +37,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/pointedthing.h"
 #include "threading/mutex_auto_lock.h"
 #include "filesys.h"
+#include <algorithm>
 
 #define LBM_NAME_ALLOWED_CHARS "abcdefghijklmnopqrstuvwxyz0123456789_:"
 
@@ -279,72 +281,160 @@ void LBMManager::applyLBMs(ServerEnvironment *env, MapBlock *block, u32 stamp)
 	ActiveBlockList
 */
 
-void fillRadiusBlock(v3s16 p0, s16 r, std::set<v3s16> &list)
+static void fillRadiusBlock(s16 r, std::vector<v3s16> &list)
 {
+	v3s16 p0(0, 0, 0);
 	v3s16 p;
-	for(p.X=p0.X-r; p.X<=p0.X+r; p.X++)
-		for(p.Y=p0.Y-r; p.Y<=p0.Y+r; p.Y++)
-			for(p.Z=p0.Z-r; p.Z<=p0.Z+r; p.Z++)
+	for(p.X=-r; p.X<=r; p.X++)
+		for(p.Y=-r; p.Y<=r; p.Y++)
+			for(p.Z=-r; p.Z<=r; p.Z++)
 			{
 				// limit to a sphere
 				if (p.getDistanceFrom(p0) <= r) {
 					// Set in list
-					list.insert(p);
+					list.push_back(p);
 				}
 			}
 }
 
+ActiveBlockList::ActiveBlockList():
+	m_radius(0),
+	m_list_dirty(false)
+{
+}
+
 void ActiveBlockList::update(std::vector<v3s16> &active_positions,
 	s16 radius,
 	std::set<v3s16> &blocks_removed,
 	std::set<v3s16> &blocks_added)
 {
-	/*
-		Create the new list
-	*/
-	std::set<v3s16> newlist = m_forceloaded_list;
+	// Try again to activate the blocks that failed
+	blocks_added.insert(m_failed.begin(), m_failed.end());
+	m_failed.clear();
+
+	std::map<v3s16, u32> centers;
 	for(std::vector<v3s16>::iterator i = active_positions.begin();
 		i != active_positions.end(); ++i)
-	{
-		fillRadiusBlock(*i, radius, newlist);
+		centers[*i]++;
+
+	std::vector<v3s16> old_sphere;
+	bool radius_changed = radius != m_radius || m_sphere.empty();
+	if (radius_changed) {
+		old_sphere.swap(m_sphere);
+		fillRadiusBlock(radius, m_sphere);
+		m_radius = radius;
 	}
 
 	/*
-		Find out which blocks on the old list are not on the new list
+		Add the new references first, so that blocks that stay covered
+		never drop to zero
 	*/
-	// Go through old list
-	for(std::set<v3s16>::iterator i = m_list.begin();
-		i != m_list.end(); ++i)
+	for(std::map<v3s16, u32>::iterator i = centers.begin();
+		i != centers.end(); ++i)
 	{
-		v3s16 p = *i;
-		// If not on new list, it's been removed
-		if(newlist.find(p) == newlist.end())
-			blocks_removed.insert(p);
+		std::map<v3s16, u32>::iterator old = m_centers.find(i->first);
+		u32 old_count = radius_changed || old == m_centers.end() ?
+			0 : old->second;
+		for (u32 n = old_count; n < i->second; n++)
+			for (size_t j = 0; j < m_sphere.size(); j++)
+				addRef(i->first + m_sphere[j], blocks_added);
 	}
 
-	/*
-		Find out which blocks on the new list are not on the old list
-	*/
-	// Go through new list
-	for(std::set<v3s16>::iterator i = newlist.begin();
-		i != newlist.end(); ++i)
+	for(std::set<v3s16>::iterator i = m_forceloaded_list.begin();
+		i != m_forceloaded_list.end(); ++i)
 	{
-		v3s16 p = *i;
-		// If not on old list, it's been added
-		if(m_list.find(p) == m_list.end())
-			blocks_added.insert(p);
+		if (m_forceloaded.find(*i) == m_forceloaded.end())
+			addRef(*i, blocks_added);
 	}
 
 	/*
-		Update m_list
+		Remove the references of the players that moved away
 	*/
-	m_list.clear();
-	for(std::set<v3s16>::iterator i = newlist.begin();
-		i != newlist.end(); ++i)
+	for(std::map<v3s16, u32>::iterator i = m_centers.begin();
+		i != m_centers.end(); ++i)
 	{
-		v3s16 p = *i;
-		m_list.insert(p);
+		std::map<v3s16, u32>::iterator now = centers.find(i->first);
+		u32 new_count = radius_changed || now == centers.end() ?
+			0 : now->second;
+		const std::vector<v3s16> &sphere = radius_changed ?
+			old_sphere : m_sphere;
+		for (u32 n = new_count; n < i->second; n++)
+			for (size_t j = 0; j < sphere.size(); j++)
+				removeRef(i->first + sphere[j], blocks_added, blocks_removed);
+	}
+
+	for(std::set<v3s16>::iterator i = m_forceloaded.begin();
+		i != m_forceloaded.end(); ++i)
+	{
+		if (m_forceloaded_list.find(*i) == m_forceloaded_list.end())
+			removeRef(*i, blocks_added, blocks_removed);
 	}
+
+	m_centers.swap(centers);
+	m_forceloaded = m_forceloaded_list;
+}
+
+void ActiveBlockList::addRef(v3s16 p, std::set<v3s16> &blocks_added)
+{
+	u32 &refs = m_refs[packPos(p)];
+	if (refs++ == 0) {
+		blocks_added.insert(p);
+		m_list_dirty = true;
+	}
+}
+
+void ActiveBlockList::removeRef(v3s16 p, std::set<v3s16> &blocks_added,
+	std::set<v3s16> &blocks_removed)
+{
+	UNORDERED_MAP<u64, u32>::iterator i = m_refs.find(packPos(p));
+	if (i == m_refs.end() || --i->second > 0)
+		return;
+	m_refs.erase(i);
+	m_list_dirty = true;
+	// A failed block that was to be tried again was never active
+	if (blocks_added.erase(p) == 0)
+		blocks_removed.insert(p);
+}
+
+void ActiveBlockList::remove(v3s16 p)
+{
+	if (m_refs.find(packPos(p)) == m_refs.end())
+		return;
+	m_failed.insert(p);
+	m_list_dirty = true;
+}
+
+void ActiveBlockList::clear()
+{
+	m_refs.clear();
+	m_failed.clear();
+	m_centers.clear();
+	m_forceloaded.clear();
+	m_list.clear();
+	m_list_dirty = false;
+}
+
+const std::vector<v3s16> &ActiveBlockList::getList()
+{
+	if (!m_list_dirty)
+		return m_list;
+
+	std::vector<u64> keys;
+	keys.reserve(m_refs.size());
+	for (UNORDERED_MAP<u64, u32>::const_iterator i = m_refs.begin();
+			i != m_refs.end(); ++i)
+		keys.push_back(i->first);
+	std::sort(keys.begin(), keys.end());
+
+	m_list.clear();
+	m_list.reserve(keys.size());
+	for (size_t i = 0; i < keys.size(); i++) {
+		v3s16 p = unpackPos(keys[i]);
+		if (m_failed.find(p) == m_failed.end())
+			m_list.push_back(p);
+	}
+	m_list_dirty = false;
+	return m_list;
 }
 
 /*
@@ -360,16 +450,33 @@ ServerEnvironment::ServerEnvironment(ServerMap *map,
 	m_path_world(path_world),
 	m_send_recommended_timer(0),
 	m_active_block_interval_overload_skip(0),
+	m_abm_handler(NULL),
+	m_abm_next_block(0),
+	m_abm_interval_time_ms(0),
+	m_node_timer_time(0),
+	m_node_timer_wheel(0.1),
 	m_game_time(0),
 	m_game_time_fraction_counter(0),
 	m_last_clear_objects_time(0),
 	m_recommended_send_interval(0.1),
 	m_max_lag_estimate(0.1)
 {
+	m_cache_abm_time_budget = g_settings->getFloat("abm_time_budget");
+	m_cache_object_activation_budget =
+		g_settings->getU16("object_activation_budget");
 }
 
 ServerEnvironment::~ServerEnvironment()
 {
+	// The map may keep the blocks beyond the node timer clock
+	const std::vector<v3s16> &active_blocks = m_active_blocks.getList();
+	for (std::vector<v3s16>::const_iterator i = active_blocks.begin();
+			i != active_blocks.end(); ++i) {
+		MapBlock *block = m_map->getBlockNoCreateNoEx(*i);
+		if (block)
+			block->getNodeTimerList().detachClock();
+	}
+
 	// Clear active block list.
 	// This makes the next one delete all active objects.
 	m_active_blocks.clear();
@@ -377,6 +484,8 @@ ServerEnvironment::~ServerEnvironment()
 	// Convert all objects to static and delete the active objects
 	deactivateFarObjects(true);
 
+	endABMInterval();
+
 	// Drop/delete map
 	m_map->drop();
 
@@ -748,11 +857,11 @@ class ABMHandler
 						wider_unknown_count++;
 						continue;
 					}
-					wider += block2->m_static_objects.m_active.size()
-						+ block2->m_static_objects.m_stored.size();
+					wider += block2->getStaticObjectList().m_active.size()
+						+ block2->getStaticObjectList().m_stored.size();
 				}
 		// Extrapolate
-		u32 active_object_count = block->m_static_objects.m_active.size();
+		u32 active_object_count = block->getStaticObjectList().m_active.size();
 		u32 wider_known_count = 3*3*3 - wider_unknown_count;
 		wider += wider_unknown_count * wider / wider_known_count;
 		return active_object_count;
@@ -833,6 +942,13 @@ class ABMHandler
 	}
 };
 
+void ServerEnvironment::endABMInterval()
+{
+	delete m_abm_handler;
+	m_abm_handler = NULL;
+	m_abm_blocks.clear();
+}
+
 void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
 {
 	// Reset usage timer immediately, otherwise a block that becomes active
@@ -855,7 +971,7 @@ void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
 
 	// Remove stored static objects if clearObjects was called since block's timestamp
 	if (stamp == BLOCK_TIMESTAMP_UNDEFINED || stamp < m_last_clear_objects_time) {
-		block->m_static_objects.m_stored.clear();
+		block->getStaticObjectList().m_stored.clear();
 		// do not set changed flag to avoid unnecessary mapblock writes
 	}
 
@@ -865,26 +981,20 @@ void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
 	/*infostream<<"ServerEnvironment::activateBlock(): block is "
 			<<dtime_s<<" seconds old."<<std::endl;*/
 
-	// Activate stored objects
-	activateObjects(block, dtime_s);
+	// Activate stored objects, or queue them when there is a budget
+	if (m_cache_object_activation_budget == 0)
+		activateObjects(block, dtime_s);
+	else if (!block->getStaticObjectList().m_stored.empty())
+		m_pending_object_activations[block->getPos()] = dtime_s;
 
 	/* Handle LoadingBlockModifiers */
 	m_lbm_mgr.applyLBMs(this, block, stamp);
 
-	// Run node timers
-	std::vector<NodeTimer> elapsed_timers =
-		block->m_node_timers.step((float)dtime_s);
-	if (!elapsed_timers.empty()) {
-		MapNode n;
-		for (std::vector<NodeTimer>::iterator
-			i = elapsed_timers.begin();
-			i != elapsed_timers.end(); ++i){
-			n = block->getNodeNoEx(i->position);
-			v3s16 p = i->position + block->getPosRelative();
-			if (m_script->node_on_timer(p, n, i->elapsed))
-				block->setNodeTimer(NodeTimer(i->timeout, 0, i->position));
-		}
-	}
+	// Run node timers for the time the block was inactive, then let the
+	// node timer wheel schedule them
+	triggerNodeTimers(block, block->getNodeTimerList().step((float)dtime_s));
+	block->getNodeTimerList().attachClock(&m_node_timer_time);
+	scheduleNodeTimers(block);
 
 	/* Handle ActiveBlockModifiers */
 	ABMHandler abmhandler(m_abms, dtime_s, this, false);
@@ -964,6 +1074,104 @@ bool ServerEnvironment::swapNode(v3s16 p, const MapNode &n)
 	return true;
 }
 
+u32 ServerEnvironment::setNodes(const std::vector<v3s16> &positions,
+	const MapNode &n)
+{
+	INodeDefManager *ndef = m_server->ndef();
+
+	// Call destructors
+	std::vector<MapNode> oldnodes;
+	oldnodes.reserve(positions.size());
+	for (size_t i = 0; i < positions.size(); i++) {
+		MapNode n_old = m_map->getNodeNoEx(positions[i]);
+		oldnodes.push_back(n_old);
+		if (ndef->get(n_old).has_on_destruct)
+			m_script->node_on_destruct(positions[i], n_old);
+	}
+
+	// Replace nodes
+	u32 count = m_map->addNodesWithEvent(positions, n);
+	if (count == 0)
+		return 0;
+
+	bool has_on_construct = ndef->get(n).has_on_construct;
+	for (size_t i = 0; i < positions.size(); i++) {
+		// Not loaded, so not replaced
+		if (oldnodes[i].getContent() == CONTENT_IGNORE)
+			continue;
+
+		// Update active VoxelManipulator if a mapgen thread
+		m_map->updateVManip(positions[i]);
+
+		// Call post-destructor
+		if (ndef->get(oldnodes[i]).has_after_destruct)
+			m_script->node_after_destruct(positions[i], oldnodes[i]);
+
+		// Call constructor
+		if (has_on_construct)
+			m_script->node_on_construct(positions[i], n);
+	}
+
+	return count;
+}
+
+u32 ServerEnvironment::swapNodes(const std::vector<v3s16> &positions,
+	const MapNode &n)
+{
+	u32 count = m_map->addNodesWithEvent(positions, n, false);
+	if (count == 0)
+		return 0;
+
+	// Update active VoxelManipulator if a mapgen thread
+	for (size_t i = 0; i < positions.size(); i++)
+		m_map->updateVManip(positions[i]);
+
+	return count;
+}
+
+void ServerEnvironment::setNodeTimer(const NodeTimer &t)
+{
+	m_map->setNodeTimer(t);
+	MapBlock *block = m_map->getBlockNoCreateNoEx(getNodeBlockPos(t.position));
+	if (block)
+		scheduleNodeTimers(block);
+}
+
+void ServerEnvironment::removeNodeTimer(v3s16 p)
+{
+	// The entry in the wheel is skipped when it turns out to be early
+	m_map->removeNodeTimer(p);
+}
+
+void ServerEnvironment::scheduleNodeTimers(MapBlock *block)
+{
+	NodeTimerList &timers = block->getNodeTimerList();
+	if (!timers.isAttachedTo(&m_node_timer_time))
+		return;
+
+	double next = timers.getNextTriggerTime();
+	if (next == -1.)
+		return;
+	double scheduled = timers.getScheduledTime();
+	if (scheduled != -1. && scheduled <= next)
+		return;
+
+	timers.setScheduledTime(next);
+	m_node_timer_wheel.insert(block->getPos(), next);
+}
+
+void ServerEnvironment::triggerNodeTimers(MapBlock *block,
+	const std::vector<NodeTimer> &elapsed_timers)
+{
+	for (std::vector<NodeTimer>::const_iterator i = elapsed_timers.begin();
+			i != elapsed_timers.end(); ++i) {
+		MapNode n = block->getNodeNoEx(i->position);
+		v3s16 p = i->position + block->getPosRelative();
+		if (m_script->node_on_timer(p, n, i->elapsed))
+			block->setNodeTimer(NodeTimer(i->timeout, 0, i->position));
+	}
+}
+
 void ServerEnvironment::getObjectsInsideRadius(std::vector<u16> &objects, v3f pos, float radius)
 {
 	for (ActiveObjectMap::iterator i = m_active_objects.begin();
@@ -992,7 +1200,7 @@ void ServerEnvironment::clearObjects(ClearObjectsMode mode)
 		if (obj->m_static_exists) {
 			MapBlock *block = m_map->getBlockNoCreateNoEx(obj->m_static_block);
 			if (block) {
-				block->m_static_objects.remove(id);
+				block->getStaticObjectList().remove(id);
 				block->raiseModified(MOD_STATE_WRITE_NEEDED,
 					MOD_REASON_CLEAR_ALL_OBJECTS);
 				obj->m_static_exists = false;
@@ -1077,11 +1285,11 @@ void ServerEnvironment::clearObjects(ClearObjectsMode mode)
 				<< "Failed to emerge block " << PP(p) << std::endl;
 			continue;
 		}
-		u32 num_stored = block->m_static_objects.m_stored.size();
-		u32 num_active = block->m_static_objects.m_active.size();
+		u32 num_stored = block->getStaticObjectList().m_stored.size();
+		u32 num_active = block->getStaticObjectList().m_active.size();
 		if (num_stored != 0 || num_active != 0) {
-			block->m_static_objects.m_stored.clear();
-			block->m_static_objects.m_active.clear();
+			block->getStaticObjectList().m_stored.clear();
+			block->getStaticObjectList().m_active.clear();
 			block->raiseModified(MOD_STATE_WRITE_NEEDED,
 				MOD_REASON_CLEAR_ALL_OBJECTS);
 			num_objs_cleared += num_stored + num_active;
@@ -1220,6 +1428,10 @@ void ServerEnvironment::step(float dtime)
 
 			// Set current time as timestamp (and let it set ChangedFlag)
 			block->setTimestamp(m_game_time);
+
+			// Freeze the node timers; the entry in the wheel becomes stale
+			block->getNodeTimerList().detachClock();
+			block->getNodeTimerList().setScheduledTime(-1);
 		}
 
 		/*
@@ -1234,7 +1446,7 @@ void ServerEnvironment::step(float dtime)
 
 			MapBlock *block = m_map->getBlockOrEmerge(p);
 			if(block==NULL){
-				m_active_blocks.m_list.erase(p);
+				m_active_blocks.remove(p);
 				continue;
 			}
 
@@ -1244,6 +1456,8 @@ void ServerEnvironment::step(float dtime)
 		}
 	}
 
+	activatePendingObjects();
+
 	/*
 		Mess around in active blocks
 	*/
@@ -1252,9 +1466,9 @@ void ServerEnvironment::step(float dtime)
 
 		float dtime = m_cache_nodetimer_interval;
 
-		for(std::set<v3s16>::iterator
-			i = m_active_blocks.m_list.begin();
-			i != m_active_blocks.m_list.end(); ++i)
+		const std::vector<v3s16> &active_blocks = m_active_blocks.getList();
+		for(std::vector<v3s16>::const_iterator i = active_blocks.begin();
+			i != active_blocks.end(); ++i)
 		{
 			v3s16 p = *i;
 
@@ -1276,22 +1490,36 @@ void ServerEnvironment::step(float dtime)
 				block->raiseModified(MOD_STATE_WRITE_AT_UNLOAD,
 					MOD_REASON_BLOCK_EXPIRED);
 
-			// Run node timers
-			std::vector<NodeTimer> elapsed_timers =
-				block->m_node_timers.step((float)dtime);
-			if (!elapsed_timers.empty()) {
-				MapNode n;
-				for (std::vector<NodeTimer>::iterator i = elapsed_timers.begin();
-					i != elapsed_timers.end(); ++i) {
-					n = block->getNodeNoEx(i->position);
-					p = i->position + block->getPosRelative();
-					if (m_script->node_on_timer(p, n, i->elapsed)) {
-						block->setNodeTimer(NodeTimer(
-							i->timeout, 0, i->position));
-					}
-				}
+			// A block that was replaced in the map while being active
+			if (!block->getNodeTimerList().isAttachedTo(&m_node_timer_time)) {
+				block->getNodeTimerList().attachClock(&m_node_timer_time);
+				scheduleNodeTimers(block);
 			}
 		}
+
+		/*
+			Run the node timers that are due
+		*/
+		m_node_timer_time += dtime;
+		std::vector<NodeTimerWheel::Entry> due;
+		m_node_timer_wheel.advance(m_node_timer_time, &due);
+		u32 due_blocks = 0;
+		for (std::vector<NodeTimerWheel::Entry>::iterator i = due.begin();
+				i != due.end(); ++i) {
+			MapBlock *block = m_map->getBlockNoCreateNoEx(i->blockpos);
+			// Skip entries superseded by an earlier one, or of blocks that
+			// were deactivated in the meantime
+			if (block == NULL ||
+					block->getNodeTimerList().getScheduledTime() != i->time)
+				continue;
+			due_blocks++;
+			block->getNodeTimerList().setScheduledTime(-1);
+			triggerNodeTimers(block, block->getNodeTimerList().popElapsed());
+			scheduleNodeTimers(block);
+		}
+		g_profiler->avg("SEnv: node timer blocks due", due_blocks);
+		g_profiler->avg("SEnv: node timer wheel entries",
+			m_node_timer_wheel.size());
 	}
 
 	if (m_active_block_modifier_interval.step(dtime, m_cache_abm_interval))
@@ -1301,47 +1529,79 @@ void ServerEnvironment::step(float dtime)
 				m_active_block_interval_overload_skip--;
 				break;
 			}
-			ScopeProfiler sp(g_profiler, "SEnv: modify in blocks avg per interval", SPT_AVG);
-			TimeTaker timer("modify in active blocks per interval");
+			// The previous interval did not fit into its time budget yet
+			if(m_abm_handler){
+				g_profiler->add("SEnv: ABM budget skips", 1);
+				break;
+			}
 
 			// Initialize handling of ActiveBlockModifiers
-			ABMHandler abmhandler(m_abms, m_cache_abm_interval, this, true);
+			m_abm_handler = new ABMHandler(m_abms, m_cache_abm_interval, this, true);
+			m_abm_blocks = m_active_blocks.getList();
+			m_abm_next_block = 0;
+			m_abm_interval_time_ms = 0;
+		}while(0);
 
-			for(std::set<v3s16>::iterator
-				i = m_active_blocks.m_list.begin();
-				i != m_active_blocks.m_list.end(); ++i)
-			{
-				v3s16 p = *i;
+	if (m_abm_handler) {
+		ScopeProfiler sp(g_profiler, "SEnv: modify in blocks avg per interval", SPT_AVG);
+		TimeTaker timer("modify in active blocks per interval");
+
+		u32 budget_ms = m_cache_abm_time_budget * 1000;
+		u32 start_ms = porting::getTimeMs();
+		bool started = false;
+		while (m_abm_next_block < m_abm_blocks.size()) {
+			// Handle at least one block per step so that the interval ends
+			if (budget_ms > 0 && started &&
+					porting::getTimeMs() - start_ms >= budget_ms)
+				break;
 
-				/*infostream<<"Server: Block ("<<p.X<<","<<p.Y<<","<<p.Z
-						<<") being handled"<<std::endl;*/
+			v3s16 p = m_abm_blocks[m_abm_next_block++];
 
-				MapBlock *block = m_map->getBlockNoCreateNoEx(p);
-				if(block == NULL)
-					continue;
+			/*infostream<<"Server: Block ("<<p.X<<","<<p.Y<<","<<p.Z
+					<<") being handled"<<std::endl;*/
 
-				// Set current time as timestamp
-				block->setTimestampNoChangedFlag(m_game_time);
+			// Blocks of a deferred interval may have been deactivated since
+			if (!m_active_blocks.contains(p))
+				continue;
 
-				/* Handle ActiveBlockModifiers */
-				abmhandler.apply(block);
-			}
+			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
+			if(block == NULL)
+				continue;
+
+			// Set current time as timestamp
+			block->setTimestampNoChangedFlag(m_game_time);
+
+			/* Handle ActiveBlockModifiers */
+			m_abm_handler->apply(block);
+			started = true;
+		}
 
-			u32 time_ms = timer.stop(true);
+		m_abm_interval_time_ms += timer.stop(true);
+		if (m_abm_next_block < m_abm_blocks.size()) {
+			g_profiler->avg("SEnv: ABM blocks deferred",
+				m_abm_blocks.size() - m_abm_next_block);
+		} else {
+			endABMInterval();
+
+			// A budget already spreads the interval over several steps
+			u32 time_ms = m_abm_interval_time_ms;
 			u32 max_time_ms = 200;
-			if(time_ms > max_time_ms){
+			if(budget_ms == 0 && time_ms > max_time_ms){
 				warningstream<<"active block modifiers took "
 					<<time_ms<<"ms (longer than "
 					<<max_time_ms<<"ms)"<<std::endl;
 				m_active_block_interval_overload_skip = (time_ms / max_time_ms) + 1;
 			}
-		}while(0);
+		}
+	}
 
 	/*
 		Step script environment (run global on_step())
 	*/
 	m_script->environment_Step(dtime);
 
+	m_script->reportCallbackTimes(g_profiler);
+
 	/*
 		Step active objects
 	*/
@@ -1388,6 +1648,10 @@ void ServerEnvironment::step(float dtime)
 			Remove objects that satisfy (m_removed && m_known_by_count==0)
 		*/
 		removeRemovedObjects();
+		/*
+			Wake sleeping entities near players
+		*/
+		wakeObjectsNearPlayers();
 	}
 
 	/*
@@ -1604,8 +1868,8 @@ void ServerEnvironment::setStaticForActiveObjectsInBlock(
 		return;
 
 	for (std::map<u16, StaticObject>::iterator
-		so_it = block->m_static_objects.m_active.begin();
-		so_it != block->m_static_objects.m_active.end(); ++so_it) {
+		so_it = block->getStaticObjectList().m_active.begin();
+		so_it != block->getStaticObjectList().m_active.end(); ++so_it) {
 		// Get the ServerActiveObject counterpart to this StaticObject
 		ActiveObjectMap::iterator ao_it = m_active_objects.find(so_it->first);
 		if (ao_it == m_active_objects.end()) {
@@ -1702,7 +1966,7 @@ u16 ServerEnvironment::addActiveObjectRaw(ServerActiveObject *object,
 		v3s16 blockpos = getNodeBlockPos(floatToInt(objectpos, BS));
 		MapBlock *block = m_map->emergeBlock(blockpos);
 		if(block){
-			block->m_static_objects.m_active[object->getId()] = s_obj;
+			block->getStaticObjectList().m_active[object->getId()] = s_obj;
 			object->m_static_exists = true;
 			object->m_static_block = blockpos;
 
@@ -1720,6 +1984,62 @@ u16 ServerEnvironment::addActiveObjectRaw(ServerActiveObject *object,
 	return object->getId();
 }
 
+/*
+	Wake sleeping entities that have players within their wake distance
+*/
+void ServerEnvironment::wakeObjectsNearPlayers()
+{
+	// Bucket sleeping entities by block, so that those far from players
+	// are skipped a whole block at a time
+	std::map<v3s16, std::vector<LuaEntitySAO *> > sleeping;
+	f32 max_distance = 0;
+	for (ActiveObjectMap::iterator i = m_active_objects.begin();
+			i != m_active_objects.end(); ++i) {
+		ServerActiveObject *obj = i->second;
+		if (obj->m_removed || obj->getType() != ACTIVEOBJECT_TYPE_LUAENTITY)
+			continue;
+		LuaEntitySAO *entity = (LuaEntitySAO *)obj;
+		if (!entity->isSleeping() || entity->getWakeDistance() <= 0)
+			continue;
+
+		v3s16 blockpos = getNodeBlockPos(floatToInt(entity->getBasePosition(), BS));
+		sleeping[blockpos].push_back(entity);
+		max_distance = MYMAX(max_distance, entity->getWakeDistance());
+	}
+
+	if (sleeping.empty())
+		return;
+
+	s16 block_range = ceilf(max_distance / MAP_BLOCKSIZE) + 1;
+	for (std::vector<RemotePlayer *>::iterator i = m_players.begin();
+			i != m_players.end(); ++i) {
+		RemotePlayer *player = *i;
+		if (player->peer_id == 0)
+			continue;
+		PlayerSAO *playersao = player->getPlayerSAO();
+		if (playersao == NULL)
+			continue;
+
+		v3f pos = playersao->getBasePosition();
+		v3s16 center = getNodeBlockPos(floatToInt(pos, BS));
+		for (std::map<v3s16, std::vector<LuaEntitySAO *> >::iterator
+				it = sleeping.begin(); it != sleeping.end(); ++it) {
+			v3s16 d = it->first - center;
+			if (abs(d.X) > block_range || abs(d.Y) > block_range ||
+					abs(d.Z) > block_range)
+				continue;
+
+			std::vector<LuaEntitySAO *> &entities = it->second;
+			for (size_t j = 0; j < entities.size(); j++) {
+				LuaEntitySAO *entity = entities[j];
+				if (entity->getBasePosition().getDistanceFrom(pos) <=
+						entity->getWakeDistance() * BS)
+					entity->wake();
+			}
+		}
+	}
+}
+
 /*
 	Remove objects that satisfy (m_removed && m_known_by_count==0)
 */
@@ -1754,7 +2074,7 @@ void ServerEnvironment::removeRemovedObjects()
 		{
 			MapBlock *block = m_map->emergeBlock(obj->m_static_block, false);
 			if (block) {
-				block->m_static_objects.remove(id);
+				block->getStaticObjectList().remove(id);
 				block->raiseModified(MOD_STATE_WRITE_NEEDED,
 					MOD_REASON_REMOVE_OBJECTS_REMOVE);
 				obj->m_static_exists = false;
@@ -1776,10 +2096,10 @@ void ServerEnvironment::removeRemovedObjects()
 			MapBlock *block = m_map->emergeBlock(obj->m_static_block, false);
 			if (block) {
 				std::map<u16, StaticObject>::iterator i =
-					block->m_static_objects.m_active.find(id);
-				if(i != block->m_static_objects.m_active.end()){
-					block->m_static_objects.m_stored.push_back(i->second);
-					block->m_static_objects.m_active.erase(id);
+					block->getStaticObjectList().m_active.find(id);
+				if(i != block->getStaticObjectList().m_active.end()){
+					block->getStaticObjectList().m_stored.push_back(i->second);
+					block->getStaticObjectList().m_active.erase(id);
 					block->raiseModified(MOD_STATE_WRITE_NEEDED,
 						MOD_REASON_REMOVE_OBJECTS_DEACTIVATE);
 				}
@@ -1851,21 +2171,21 @@ void ServerEnvironment::activateObjects(MapBlock *block, u32 dtime_s)
 		return;
 
 	// Ignore if no stored objects (to not set changed flag)
-	if(block->m_static_objects.m_stored.empty())
+	if(block->getStaticObjectList().m_stored.empty())
 		return;
 
 	verbosestream<<"ServerEnvironment::activateObjects(): "
 		<<"activating objects of block "<<PP(block->getPos())
-		<<" ("<<block->m_static_objects.m_stored.size()
+		<<" ("<<block->getStaticObjectList().m_stored.size()
 		<<" objects)"<<std::endl;
-	bool large_amount = (block->m_static_objects.m_stored.size() > g_settings->getU16("max_objects_per_block"));
+	bool large_amount = (block->getStaticObjectList().m_stored.size() > g_settings->getU16("max_objects_per_block"));
 	if (large_amount) {
 		errorstream<<"suspiciously large amount of objects detected: "
-			<<block->m_static_objects.m_stored.size()<<" in "
+			<<block->getStaticObjectList().m_stored.size()<<" in "
 			<<PP(block->getPos())
 			<<"; removing all of them."<<std::endl;
 		// Clear stored list
-		block->m_static_objects.m_stored.clear();
+		block->getStaticObjectList().m_stored.clear();
 		block->raiseModified(MOD_STATE_WRITE_NEEDED,
 			MOD_REASON_TOO_MANY_OBJECTS);
 		return;
@@ -1874,8 +2194,8 @@ void ServerEnvironment::activateObjects(MapBlock *block, u32 dtime_s)
 	// Activate stored objects
 	std::vector<StaticObject> new_stored;
 	for (std::vector<StaticObject>::iterator
-		i = block->m_static_objects.m_stored.begin();
-		i != block->m_static_objects.m_stored.end(); ++i) {
+		i = block->getStaticObjectList().m_stored.begin();
+		i != block->getStaticObjectList().m_stored.end(); ++i) {
 		StaticObject &s_obj = *i;
 
 		// Create an active object from the data
@@ -1898,21 +2218,14 @@ void ServerEnvironment::activateObjects(MapBlock *block, u32 dtime_s)
 		// This will also add the object to the active static list
 		addActiveObjectRaw(obj, false, dtime_s);
 	}
-	// Clear stored list
-	block->m_static_objects.m_stored.clear();
-	// Add leftover failed stuff to stored list
-	for(std::vector<StaticObject>::iterator
-		i = new_stored.begin();
-		i != new_stored.end(); ++i) {
-		StaticObject &s_obj = *i;
-		block->m_static_objects.m_stored.push_back(s_obj);
-	}
+	// Replace the stored list by the leftover failed stuff
+	block->getStaticObjectList().m_stored.swap(new_stored);
 
 	// Turn the active counterparts of activated objects not pending for
 	// deactivation
 	for(std::map<u16, StaticObject>::iterator
-		i = block->m_static_objects.m_active.begin();
-		i != block->m_static_objects.m_active.end(); ++i)
+		i = block->getStaticObjectList().m_active.begin();
+		i != block->getStaticObjectList().m_active.end(); ++i)
 	{
 		u16 id = i->first;
 		ServerActiveObject *object = getActiveObject(id);
@@ -1930,6 +2243,83 @@ void ServerEnvironment::activateObjects(MapBlock *block, u32 dtime_s)
 	*/
 }
 
+// A pending activation, by its distance to the nearest player
+struct PendingActivation
+{
+	s32 distance;
+	std::map<v3s16, u32>::iterator it;
+
+	bool operator<(const PendingActivation &other) const
+	{
+		return distance < other.distance;
+	}
+};
+
+void ServerEnvironment::activatePendingObjects()
+{
+	if (m_pending_object_activations.empty())
+		return;
+
+	ScopeProfiler sp(g_profiler, "SEnv: activate pending objects avg", SPT_AVG);
+
+	std::vector<v3s16> players_blockpos;
+	for (std::vector<RemotePlayer*>::iterator i = m_players.begin();
+			i != m_players.end(); ++i) {
+		RemotePlayer *player = *i;
+
+		// Ignore disconnected players
+		if (player->peer_id == 0)
+			continue;
+
+		PlayerSAO *playersao = player->getPlayerSAO();
+		assert(playersao);
+
+		players_blockpos.push_back(getNodeBlockPos(
+			floatToInt(playersao->getBasePosition(), BS)));
+	}
+
+	std::vector<PendingActivation> order;
+	order.reserve(m_pending_object_activations.size());
+	for (std::map<v3s16, u32>::iterator
+			i = m_pending_object_activations.begin();
+			i != m_pending_object_activations.end(); ++i) {
+		s32 distance = players_blockpos.empty() ? 0 : S32_MAX;
+		for (size_t j = 0; j < players_blockpos.size(); j++) {
+			v3s16 d = i->first - players_blockpos[j];
+			distance = MYMIN(distance, d.X * d.X + d.Y * d.Y + d.Z * d.Z);
+		}
+		PendingActivation pending;
+		pending.distance = distance;
+		pending.it = i;
+		order.push_back(pending);
+	}
+	std::stable_sort(order.begin(), order.end());
+
+	// Handle at least one block per step so that the queue goes down
+	u32 activated = 0;
+	for (size_t i = 0; i < order.size() &&
+			(i == 0 || activated < m_cache_object_activation_budget); i++) {
+		v3s16 p = order[i].it->first;
+		u32 dtime_s = order[i].it->second;
+		m_pending_object_activations.erase(order[i].it);
+
+		// The block may have been deactivated in the meantime
+		if (!m_active_blocks.contains(p))
+			continue;
+
+		MapBlock *block = m_map->getBlockNoCreateNoEx(p);
+		if (block == NULL)
+			continue;
+
+		activated += block->getStaticObjectList().m_stored.size();
+		activateObjects(block, dtime_s);
+	}
+
+	g_profiler->avg("SEnv: objects activated", activated);
+	g_profiler->avg("SEnv: object activation backlog (blocks)",
+		m_pending_object_activations.size());
+}
+
 /*
 	Convert objects that are not standing inside active blocks to static.
 
@@ -1985,7 +2375,7 @@ void ServerEnvironment::deactivateFarObjects(bool force_delete)
 			std::string staticdata_new = "";
 			obj->getStaticData(&staticdata_new);
 			StaticObject s_obj(obj->getType(), objectpos, staticdata_new);
-			block->m_static_objects.insert(id, s_obj);
+			block->getStaticObjectList().insert(id, s_obj);
 			obj->m_static_block = blockpos_o;
 			block->raiseModified(MOD_STATE_WRITE_NEEDED,
 				MOD_REASON_STATIC_DATA_ADDED);
@@ -1999,7 +2389,7 @@ void ServerEnvironment::deactivateFarObjects(bool force_delete)
 					<<std::endl;
 				continue;
 			}
-			block->m_static_objects.remove(id);
+			block->getStaticObjectList().remove(id);
 			block->raiseModified(MOD_STATE_WRITE_NEEDED,
 				MOD_REASON_STATIC_DATA_REMOVED);
 			continue;
@@ -2038,8 +2428,8 @@ void ServerEnvironment::deactivateFarObjects(bool force_delete)
 
 				if (block) {
 					std::map<u16, StaticObject>::iterator n =
-						block->m_static_objects.m_active.find(id);
-					if (n != block->m_static_objects.m_active.end()) {
+						block->getStaticObjectList().m_active.find(id);
+					if (n != block->getStaticObjectList().m_active.end()) {
 						StaticObject static_old = n->second;
 
 						float save_movem = obj->getMinimumSavedMovement();
@@ -2064,7 +2454,7 @@ void ServerEnvironment::deactivateFarObjects(bool force_delete)
 				MapBlock *block = m_map->emergeBlock(obj->m_static_block, false);
 				if(block)
 				{
-					block->m_static_objects.remove(id);
+					block->getStaticObjectList().remove(id);
 					obj->m_static_exists = false;
 					// Only mark block as modified if data changed considerably
 					if(shall_be_written)
@@ -2087,11 +2477,11 @@ void ServerEnvironment::deactivateFarObjects(bool force_delete)
 
 			if(block)
 			{
-				if (block->m_static_objects.m_stored.size() >= g_settings->getU16("max_objects_per_block")) {
+				if (block->getStaticObjectList().m_stored.size() >= g_settings->getU16("max_objects_per_block")) {
 					warningstream << "ServerEnv: Trying to store id = " << obj->getId()
 						<< " statically but block " << PP(blockpos)
 						<< " already contains "
-						<< block->m_static_objects.m_stored.size()
+						<< block->getStaticObjectList().m_stored.size()
 						<< " objects."
 						<< " Forcing delete." << std::endl;
 					force_delete = true;
@@ -2103,14 +2493,14 @@ void ServerEnvironment::deactivateFarObjects(bool force_delete)
 					// obj->m_static_block, but happens rarely for some unknown
 					// reason. Unsuccessful attempts have been made to find
 					// said reason.
-					if(id && block->m_static_objects.m_active.find(id) != block->m_static_objects.m_active.end()){
+					if(id && block->getStaticObjectList().m_active.find(id) != block->getStaticObjectList().m_active.end()){
 						warningstream<<"ServerEnv: Performing hack #83274"
 							<<std::endl;
-						block->m_static_objects.remove(id);
+						block->getStaticObjectList().remove(id);
 					}
 					// Store static data
 					u16 store_id = pending_delete ? id : 0;
-					block->m_static_objects.insert(store_id, s_obj);
+					block->getStaticObjectList().insert(store_id, s_obj);
 
 					// Only mark block as modified if data changed considerably
 					if(shall_be_written)
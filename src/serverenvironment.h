@@ -31,6 +31,7 @@ class RemotePlayer;
 class PlayerSAO;
 class ServerEnvironment;
 class ActiveBlockModifier;
+class ABMHandler;
 class ServerActiveObject;
 class Server;
 class GameScripting;
@@ -147,28 +148,71 @@ class LBMManager
 
 /*
 	List of active blocks, used by ServerEnvironment
+
+	A block is active as long as it is inside the sphere around a player
+	or forceloaded. The list counts the spheres and forceloads covering each
+	block, so that an update only has to look at the spheres of the players
+	that moved to another block.
 */
 
 class ActiveBlockList
 {
 public:
+	ActiveBlockList();
+
 	void update(std::vector<v3s16> &active_positions,
 		s16 radius,
 		std::set<v3s16> &blocks_removed,
 		std::set<v3s16> &blocks_added);
 
-	bool contains(v3s16 p){
-		return (m_list.find(p) != m_list.end());
+	bool contains(v3s16 p) const {
+		return m_refs.find(packPos(p)) != m_refs.end() &&
+			(m_failed.empty() || m_failed.find(p) == m_failed.end());
 	}
 
-	void clear(){
-		m_list.clear();
-	}
+	// Drops a block that could not be activated, it is added again by the
+	// next update if it is still covered
+	void remove(v3s16 p);
+	void clear();
+
+	// The active blocks, sorted by Z, Y and X so that neighbouring blocks
+	// are handled one after another
+	const std::vector<v3s16> &getList();
 
-	std::set<v3s16> m_list;
 	std::set<v3s16> m_forceloaded_list;
 
 private:
+	// Packs p into a key that sorts like Z, Y, X
+	static inline u64 packPos(v3s16 p)
+	{
+		return (u64)(u16)(p.X ^ 0x8000) |
+			((u64)(u16)(p.Y ^ 0x8000) << 16) |
+			((u64)(u16)(p.Z ^ 0x8000) << 32);
+	}
+	static inline v3s16 unpackPos(u64 key)
+	{
+		return v3s16((s16)((key & 0xFFFF) ^ 0x8000),
+			(s16)(((key >> 16) & 0xFFFF) ^ 0x8000),
+			(s16)(((key >> 32) & 0xFFFF) ^ 0x8000));
+	}
+
+	void addRef(v3s16 p, std::set<v3s16> &blocks_added);
+	void removeRef(v3s16 p, std::set<v3s16> &blocks_added,
+		std::set<v3s16> &blocks_removed);
+
+	// Number of spheres and forceloads covering a block, by packPos()
+	UNORDERED_MAP<u64, u32> m_refs;
+	// Covered blocks that could not be activated
+	std::set<v3s16> m_failed;
+	// Number of players at each sphere center, and the sphere around 0,0,0
+	std::map<v3s16, u32> m_centers;
+	std::vector<v3s16> m_sphere;
+	s16 m_radius;
+	// The forceloaded blocks covered as of the last update
+	std::set<v3s16> m_forceloaded;
+
+	std::vector<v3s16> m_list;
+	bool m_list_dirty;
 };
 
 /*
@@ -307,6 +351,16 @@ class ServerEnvironment : public Environment
 	bool setNode(v3s16 p, const MapNode &n);
 	bool removeNode(v3s16 p);
 	bool swapNode(v3s16 p, const MapNode &n);
+	/*
+		Like setNode() and swapNode() for many positions, with a single
+		lighting update and client update. Return the number of nodes set.
+	*/
+	u32 setNodes(const std::vector<v3s16> &positions, const MapNode &n);
+	u32 swapNodes(const std::vector<v3s16> &positions, const MapNode &n);
+
+	// Node timer setters that schedule the timers of active blocks
+	void setNodeTimer(const NodeTimer &t);
+	void removeNodeTimer(v3s16 p);
 
 	// Find all active objects inside a radius around a point
 	void getObjectsInsideRadius(std::vector<u16> &objects, v3f pos, float radius);
@@ -358,11 +412,22 @@ class ServerEnvironment : public Environment
 	*/
 	void removeRemovedObjects();
 
+	/*
+		Wake sleeping entities that have players within their wake distance
+	*/
+	void wakeObjectsNearPlayers();
+
 	/*
 		Convert stored objects from block to active
 	*/
 	void activateObjects(MapBlock *block, u32 dtime_s);
 
+	/*
+		Activate the stored objects of the queued blocks, nearest to the
+		players first, up to object_activation_budget objects
+	*/
+	void activatePendingObjects();
+
 	/*
 		Convert objects that are not in active blocks to static.
 
@@ -374,6 +439,16 @@ class ServerEnvironment : public Environment
 	*/
 	void deactivateFarObjects(bool force_delete);
 
+	// Frees the state of the ABM interval being handled
+	void endABMInterval();
+
+	// Puts the next trigger time of the timers of an active block into
+	// m_node_timer_wheel, unless an earlier entry is due for it already
+	void scheduleNodeTimers(MapBlock *block);
+	// Calls on_timer for the elapsed timers of a block
+	void triggerNodeTimers(MapBlock *block,
+		const std::vector<NodeTimer> &elapsed_timers);
+
 	/*
 		Member variables
 	*/
@@ -399,6 +474,22 @@ class ServerEnvironment : public Environment
 	IntervalLimiter m_active_block_modifier_interval;
 	IntervalLimiter m_active_blocks_nodemetadata_interval;
 	int m_active_block_interval_overload_skip;
+	// ABM interval that is being handled, spread over several steps when it
+	// exceeds abm_time_budget
+	ABMHandler *m_abm_handler;
+	std::vector<v3s16> m_abm_blocks;
+	size_t m_abm_next_block;
+	u32 m_abm_interval_time_ms;
+	float m_cache_abm_time_budget;
+	// Active blocks whose stored objects wait for activation, with the
+	// time the blocks were inactive
+	std::map<v3s16, u32> m_pending_object_activations;
+	u32 m_cache_object_activation_budget;
+	// Clock of the node timers of the active blocks, advanced by the
+	// node timer interval
+	double m_node_timer_time;
+	// Next trigger times of the node timers of the active blocks
+	NodeTimerWheel m_node_timer_wheel;
 	// Time from the beginning of the game in seconds.
 	// Incremented in step().
 	u32 m_game_time;
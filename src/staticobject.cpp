@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "staticobject.h"
 #include "util/serialize.h"
 #include "log.h"
+#include "exceptions.h"
 
 void StaticObject::serialize(std::ostream &os)
 {
@@ -86,3 +87,28 @@ void StaticObjectList::deSerialize(std::istream &is)
 	}
 }
 
+
+// Appends count bytes of is to data
+static void read_bytes(std::istream &is, u32 count, std::string &data)
+{
+	size_t size = data.size();
+	data.resize(size + count);
+	if (count != 0 && !is.read(&data[size], count))
+		throw SerializationError("StaticObjectList::readSerialized(): "
+				"unexpected end of data");
+}
+
+std::string StaticObjectList::readSerialized(std::istream &is)
+{
+	// version, count
+	std::string data;
+	read_bytes(is, 1 + 2, data);
+	u16 count = readU16((u8 *)&data[1]);
+	for(u16 i = 0; i < count; i++) {
+		// type, pos, length of data
+		read_bytes(is, 1 + 12 + 2, data);
+		u16 length = readU16((u8 *)&data[data.size() - 2]);
+		read_bytes(is, length, data);
+	}
+	return data;
+}
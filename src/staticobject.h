@@ -88,6 +88,8 @@ class StaticObjectList
 
 	void serialize(std::ostream &os);
 	void deSerialize(std::istream &is);
+	// Reads a serialized list without parsing the objects, for deSerialize()
+	static std::string readSerialized(std::istream &is);
 	
 	/*
 		NOTE: When an object is transformed to active, it is removed
@@ -30,6 +30,7 @@ content_t t_CONTENT_TORCH;
 content_t t_CONTENT_WATER;
 content_t t_CONTENT_LAVA;
 content_t t_CONTENT_BRICK;
+content_t t_CONTENT_WATER_FLOWING;
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -162,6 +163,8 @@ void TestGameDef::defineSomeNodes()
 	f.alpha = 128;
 	f.liquid_type = LIQUID_SOURCE;
 	f.liquid_viscosity = 4;
+	f.liquid_alternative_flowing = "default:water_flowing";
+	f.liquid_alternative_source = "default:water";
 	f.is_ground_content = true;
 	f.groups["liquids"] = 3;
 	for(int i = 0; i < 6; i++)
@@ -209,13 +212,30 @@ void TestGameDef::defineSomeNodes()
 	f.is_ground_content = true;
 	idef->registerItem(itemdef);
 	t_CONTENT_BRICK = ndef->set(f.name, f);
+
+	//// Flowing water
+	itemdef = ItemDefinition();
+	itemdef.type = ITEM_NODE;
+	itemdef.name = "default:water_flowing";
+	itemdef.description = "Flowing Water";
+	f = ContentFeatures();
+	f.name = itemdef.name;
+	f.alpha = 128;
+	f.liquid_type = LIQUID_FLOWING;
+	f.liquid_viscosity = 4;
+	f.liquid_alternative_flowing = "default:water_flowing";
+	f.liquid_alternative_source = "default:water";
+	for(int i = 0; i < 6; i++)
+		f.tiledef[i].name = "default_water.png";
+	idef->registerItem(itemdef);
+	t_CONTENT_WATER_FLOWING = ndef->set(f.name, f);
 }
 
 ////
 //// run_tests
 ////
 
-bool run_tests()
+bool run_tests(bool benchmarks)
 {
 	DSTACK(FUNCTION_NAME);
 
@@ -227,7 +247,8 @@ bool run_tests()
 	u32 num_modules_failed     = 0;
 	u32 num_total_tests_failed = 0;
 	u32 num_total_tests_run    = 0;
-	std::vector<TestBase *> &testmods = TestManager::getTestModules();
+	std::vector<TestBase *> &testmods = benchmarks ?
+		TestManager::getBenchmarkModules() : TestManager::getTestModules();
 	for (size_t i = 0; i != testmods.size(); i++) {
 		if (!testmods[i]->testModule(&gamedef))
 			num_modules_failed++;
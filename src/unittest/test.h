@@ -132,6 +132,18 @@ class TestManager {
 	{
 		getTestModules().push_back(module);
 	}
+
+	// Benchmarks only run with --run-benchmarks, not with the unit tests
+	static std::vector<TestBase *> &getBenchmarkModules()
+	{
+		static std::vector<TestBase *> m_benchmark_modules;
+		return m_benchmark_modules;
+	}
+
+	static void registerBenchmarkModule(TestBase *module)
+	{
+		getBenchmarkModules().push_back(module);
+	}
 };
 
 // A few item and node definitions for those tests that need them
@@ -141,7 +153,8 @@ extern content_t t_CONTENT_TORCH;
 extern content_t t_CONTENT_WATER;
 extern content_t t_CONTENT_LAVA;
 extern content_t t_CONTENT_BRICK;
+extern content_t t_CONTENT_WATER_FLOWING;
 
-bool run_tests();
+bool run_tests(bool benchmarks = false);
 
 #endif
@@ -0,0 +1,145 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "noise.h"
+#include "serverenvironment.h"
+
+class TestActiveBlockList : public TestBase {
+public:
+	TestActiveBlockList() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestActiveBlockList"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testUpdate();
+	void testRemove();
+};
+
+static TestActiveBlockList g_test_instance;
+
+void TestActiveBlockList::runTests(IGameDef *gamedef)
+{
+	TEST(testUpdate);
+	TEST(testRemove);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The blocks that have to be active, built from scratch
+static std::set<v3s16> expected_blocks(const std::vector<v3s16> &players,
+	s16 r, const std::set<v3s16> &forceloaded)
+{
+	std::set<v3s16> blocks = forceloaded;
+	for (size_t i = 0; i < players.size(); i++) {
+		v3s16 p;
+		for (p.X = -r; p.X <= r; p.X++)
+		for (p.Y = -r; p.Y <= r; p.Y++)
+		for (p.Z = -r; p.Z <= r; p.Z++)
+			if (p.getDistanceFrom(v3s16(0, 0, 0)) <= r)
+				blocks.insert(players[i] + p);
+	}
+	return blocks;
+}
+
+void TestActiveBlockList::testUpdate()
+{
+	ActiveBlockList list;
+	std::set<v3s16> active;
+	std::vector<v3s16> players;
+	PcgRandom pr(77);
+	s16 radius = 2;
+
+	for (u32 step = 0; step < 200; step++) {
+		// Players move, join and leave, and sometimes share a block
+		for (size_t i = 0; i < players.size(); i++)
+			if (pr.range(0, 3) == 0)
+				players[i] += v3s16(pr.range(-1, 1), pr.range(-1, 1),
+					pr.range(-1, 1));
+		if (pr.range(0, 4) == 0 || players.empty())
+			players.push_back(v3s16(pr.range(-5, 5), 0, pr.range(-5, 5)));
+		if (pr.range(0, 6) == 0)
+			players.erase(players.begin() + pr.range(0, players.size() - 1));
+		if (pr.range(0, 5) == 0 && !players.empty())
+			players.push_back(players[0]);
+		if (pr.range(0, 8) == 0)
+			list.m_forceloaded_list.insert(v3s16(pr.range(-9, 9), 1, 0));
+		if (pr.range(0, 8) == 0)
+			list.m_forceloaded_list.clear();
+		if (step == 100)
+			radius = 3;
+
+		std::set<v3s16> removed, added;
+		list.update(players, radius, removed, added);
+
+		std::set<v3s16> expected = expected_blocks(players, radius,
+			list.m_forceloaded_list);
+		for (std::set<v3s16>::iterator i = removed.begin();
+				i != removed.end(); ++i) {
+			UASSERT(active.erase(*i) == 1);
+			UASSERT(!list.contains(*i));
+		}
+		for (std::set<v3s16>::iterator i = added.begin();
+				i != added.end(); ++i) {
+			UASSERT(active.insert(*i).second);
+			UASSERT(list.contains(*i));
+		}
+		UASSERT(active == expected);
+
+		const std::vector<v3s16> &blocks = list.getList();
+		UASSERTEQ(size_t, blocks.size(), expected.size());
+		for (size_t i = 1; i < blocks.size(); i++) {
+			const v3s16 &a = blocks[i - 1];
+			const v3s16 &b = blocks[i];
+			UASSERT(a.Z < b.Z || (a.Z == b.Z &&
+				(a.Y < b.Y || (a.Y == b.Y && a.X < b.X))));
+		}
+	}
+}
+
+void TestActiveBlockList::testRemove()
+{
+	ActiveBlockList list;
+	std::vector<v3s16> players;
+	players.push_back(v3s16(0, 0, 0));
+	size_t count = expected_blocks(players, 1, std::set<v3s16>()).size();
+	std::set<v3s16> removed, added;
+	list.update(players, 1, removed, added);
+	UASSERTEQ(size_t, added.size(), count);
+
+	// A block that could not be activated is added again by the next update
+	list.remove(v3s16(1, 0, 0));
+	UASSERT(!list.contains(v3s16(1, 0, 0)));
+	UASSERTEQ(size_t, list.getList().size(), count - 1);
+	added.clear();
+	list.update(players, 1, removed, added);
+	UASSERT(removed.empty());
+	UASSERTEQ(size_t, added.size(), 1);
+	UASSERT(list.contains(v3s16(1, 0, 0)));
+
+	// ...unless it is not covered anymore
+	list.remove(v3s16(1, 0, 0));
+	players[0] = v3s16(-5, 0, 0);
+	added.clear();
+	list.update(players, 1, removed, added);
+	UASSERTEQ(size_t, removed.size(), count - 1);
+	UASSERT(removed.find(v3s16(1, 0, 0)) == removed.end());
+	UASSERTEQ(size_t, added.size(), count);
+}
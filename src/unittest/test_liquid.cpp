@@ -0,0 +1,235 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapsector.h"
+#include "porting.h"
+#include "settings.h"
+
+class TestLiquid : public TestBase {
+public:
+	TestLiquid() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestLiquid"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testFlow(IGameDef *gamedef);
+	void testThreadsDeterministic(IGameDef *gamedef);
+};
+
+static TestLiquid g_test_instance;
+
+// A walled pool of blank blocks with a dam of water sources at one end
+class DamMap : public Map {
+public:
+	DamMap(IGameDef *gamedef, v3s16 blocks, s16 dam_x) :
+		Map(dstream, gamedef),
+		m_size(blocks * MAP_BLOCKSIZE),
+		m_dam_x(dam_x)
+	{
+		v3s16 p;
+		for (p.Z = 0; p.Z < blocks.Z; p.Z++)
+		for (p.X = 0; p.X < blocks.X; p.X++) {
+			v2s16 p2d(p.X, p.Z);
+			MapSector *sector = new ServerMapSector(this, p2d, m_gamedef);
+			m_sectors[p2d] = sector;
+			for (p.Y = 0; p.Y < blocks.Y; p.Y++)
+				sector->createBlankBlock(p.Y);
+		}
+
+		MapNode stone(t_CONTENT_STONE);
+		MapNode water(t_CONTENT_WATER);
+		MapNode air(CONTENT_AIR);
+		for (p.Z = 0; p.Z < m_size.Z; p.Z++)
+		for (p.Y = 0; p.Y < m_size.Y; p.Y++)
+		for (p.X = 0; p.X < m_size.X; p.X++) {
+			bool wall = p.X == 0 || p.Y == 0 || p.Z == 0 ||
+				p.X == m_size.X - 1 || p.Z == m_size.Z - 1 ||
+				p.X == m_dam_x;
+			if (wall)
+				setNode(p, stone);
+			else if (p.X < m_dam_x)
+				setNode(p, water);
+			else
+				setNode(p, air);
+		}
+	}
+
+	u32 countWater()
+	{
+		u32 count = 0;
+		v3s16 p;
+		for (p.Z = 0; p.Z < m_size.Z; p.Z++)
+		for (p.Y = 0; p.Y < m_size.Y; p.Y++)
+		for (p.X = 0; p.X < m_size.X; p.X++) {
+			content_t c = getNodeNoEx(p).getContent();
+			count += c == t_CONTENT_WATER || c == t_CONTENT_WATER_FLOWING;
+		}
+		return count;
+	}
+
+	void breakDam()
+	{
+		MapNode air(CONTENT_AIR);
+		v3s16 p(m_dam_x, 1, 1);
+		for (p.Z = 1; p.Z < m_size.Z - 1; p.Z++)
+		for (p.Y = 1; p.Y < m_size.Y; p.Y++) {
+			setNode(p, air);
+			transforming_liquid_add(p);
+		}
+	}
+
+	// Transforms until the queue is empty, returns the number of steps
+	u32 drain(u32 max_steps, u32 *nodes_transformed)
+	{
+		u32 loop_max = g_settings->getS32("liquid_loop_max");
+		u32 steps = 0;
+		while (transforming_liquid_size() > 0 && steps < max_steps) {
+			*nodes_transformed += MYMIN((u32)transforming_liquid_size(),
+				loop_max);
+			std::map<v3s16, MapBlock *> modified_blocks;
+			transformLiquids(modified_blocks);
+			steps++;
+		}
+		return steps;
+	}
+
+	v3s16 m_size;
+	s16 m_dam_x;
+};
+
+// Flow speed of a broken dam with liquid_threads at 1 and 4, run by
+// --run-benchmarks
+class BenchmarkLiquid : public TestBase {
+public:
+	BenchmarkLiquid() { TestManager::registerBenchmarkModule(this); }
+	const char *getName() { return "BenchmarkLiquid"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void benchmarkDamBreak(IGameDef *gamedef);
+};
+
+static BenchmarkLiquid g_benchmark_instance;
+
+void TestLiquid::runTests(IGameDef *gamedef)
+{
+	std::string liquid_threads = g_settings->get("liquid_threads");
+
+	TEST(testFlow, gamedef);
+	TEST(testThreadsDeterministic, gamedef);
+
+	g_settings->set("liquid_threads", liquid_threads);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestLiquid::testFlow(IGameDef *gamedef)
+{
+	g_settings->set("liquid_threads", "1");
+	DamMap map(gamedef, v3s16(2, 1, 1), 4);
+	u32 water = map.countWater();
+	map.breakDam();
+
+	u32 nodes = 0;
+	UASSERT(map.drain(1000, &nodes) < 1000);
+	UASSERT(nodes > 0);
+
+	// The sources stay and the water flowed through the dam
+	UASSERT(map.countWater() > water);
+	UASSERTEQ(content_t, map.getNodeNoEx(v3s16(2, 1, 5)).getContent(),
+		t_CONTENT_WATER);
+	MapNode n = map.getNodeNoEx(v3s16(5, 1, 5));
+	UASSERTEQ(content_t, n.getContent(), t_CONTENT_WATER_FLOWING);
+	UASSERTEQ(content_t, map.getNodeNoEx(v3s16(30, 1, 5)).getContent(),
+		CONTENT_AIR);
+}
+
+void TestLiquid::testThreadsDeterministic(IGameDef *gamedef)
+{
+	const u32 threads[] = { 1, 3 };
+	// In the middle of the flood and after it settled
+	std::vector<MapNode> results[ARRLEN(threads)][2];
+
+	for (u32 k = 0; k < ARRLEN(threads); k++) {
+		g_settings->setU16("liquid_threads", threads[k]);
+		DamMap map(gamedef, v3s16(4, 2, 2), 20);
+		map.breakDam();
+		u32 nodes = 0;
+
+		for (u32 r = 0; r < 2; r++) {
+			if (r == 0)
+				map.drain(15, &nodes);
+			else
+				UASSERT(map.drain(1000, &nodes) < 1000);
+
+			v3s16 p;
+			for (p.Z = 0; p.Z < map.m_size.Z; p.Z++)
+			for (p.Y = 0; p.Y < map.m_size.Y; p.Y++)
+			for (p.X = 0; p.X < map.m_size.X; p.X++)
+				results[k][r].push_back(map.getNodeNoEx(p));
+		}
+	}
+
+	for (u32 r = 0; r < 2; r++) {
+		UASSERTEQ(size_t, results[0][r].size(), results[1][r].size());
+		for (size_t i = 0; i < results[0][r].size(); i++) {
+			UASSERT(results[0][r][i].param0 == results[1][r][i].param0 &&
+				results[0][r][i].param2 == results[1][r][i].param2);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void BenchmarkLiquid::runTests(IGameDef *gamedef)
+{
+	std::string liquid_threads = g_settings->get("liquid_threads");
+
+	TEST(benchmarkDamBreak, gamedef);
+
+	g_settings->set("liquid_threads", liquid_threads);
+}
+
+void BenchmarkLiquid::benchmarkDamBreak(IGameDef *gamedef)
+{
+	const u32 threads[] = { 1, 4 };
+	for (u32 k = 0; k < ARRLEN(threads); k++) {
+		g_settings->setU16("liquid_threads", threads[k]);
+		// A dam holding about 100000 water sources
+		DamMap map(gamedef, v3s16(8, 2, 4), 55);
+		map.breakDam();
+
+		u32 nodes = 0;
+		u64 t0 = porting::getTimeUs();
+		u32 steps = map.drain(10000, &nodes);
+		u64 t1 = porting::getTimeUs();
+		UASSERT(steps < 10000);
+
+		rawstream << "Liquid benchmark, " << threads[k] << " threads: "
+			<< nodes << " nodes in " << steps << " steps, drained in "
+			<< (t1 - t0) / 1000 << "ms ("
+			<< (u64)nodes * 1000000 / MYMAX(t1 - t0, 1) << " nodes/s)"
+			<< std::endl;
+	}
+}
@@ -0,0 +1,382 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <cstring>
+#include "common/c_serialize.h"
+#include "common/c_internal.h"
+#include "filesys.h"
+#include "log.h"
+#include "porting.h"
+#include "util/basic_macros.h"
+
+extern "C" {
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+class TestLuaSerialize : public TestBase {
+public:
+	TestLuaSerialize() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestLuaSerialize"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testTextRoundtrip(lua_State *L);
+	void testTextLoadable(lua_State *L);
+	void testTextFallback(lua_State *L);
+	void testBinaryRoundtrip(lua_State *L);
+	void testBinaryInvalid(lua_State *L);
+	void testBuiltinCompat(lua_State *L);
+};
+
+static TestLuaSerialize g_test_instance;
+
+// Times the native serializer against builtin's, run by --run-benchmarks
+class BenchmarkLuaSerialize : public TestBase {
+public:
+	BenchmarkLuaSerialize() { TestManager::registerBenchmarkModule(this); }
+	const char *getName() { return "BenchmarkLuaSerialize"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void benchmarkSerialize(lua_State *L);
+};
+
+static BenchmarkLuaSerialize g_benchmark_instance;
+
+static const char *test_value_code =
+	"return {1, 2.5, -3, 'four', true, false, 1e20, 1/0, -1/0,"
+	"	nested = {a = {b = {c = 'deep'}}, [0.5] = 'half'},"
+	"	escapes = 'q\"b\\\\n\\nr\\r0\\0t\\tv\\v',"
+	"	[-1] = 'neg', [100] = 'sparse', ['with space'] = {}}";
+
+static const char *test_value_check =
+	"local t = ...\n"
+	"assert(t[1] == 1 and t[2] == 2.5 and t[3] == -3 and t[4] == 'four')\n"
+	"assert(t[5] == true and t[6] == false and t[7] == 1e20)\n"
+	"assert(t[8] == 1/0 and t[9] == -1/0)\n"
+	"assert(t.nested.a.b.c == 'deep' and t.nested[0.5] == 'half')\n"
+	"assert(t.escapes == 'q\"b\\\\n\\nr\\r0\\0t\\tv\\v')\n"
+	"assert(t[-1] == 'neg' and t[100] == 'sparse')\n"
+	"assert(next(t['with space']) == nil)\n"
+	"local n = 0\n"
+	"for _ in pairs(t) do n = n + 1 end\n"
+	"assert(n == 14)\n"
+	"return true\n";
+
+static void push_code_result(lua_State *L, const char *code)
+{
+	if (luaL_loadstring(L, code) != 0 || lua_pcall(L, 0, 1, 0) != 0) {
+		std::string err = lua_tostring(L, -1);
+		lua_pop(L, 1);
+		throw LuaError(err);
+	}
+}
+
+// Runs test_value_check on the value at the top of the stack, and pops it
+static bool check_test_value(lua_State *L)
+{
+	luaL_loadstring(L, test_value_check);
+	lua_insert(L, -2);
+	bool ok = lua_pcall(L, 1, 1, 0) == 0 && lua_toboolean(L, -1);
+	if (!ok && lua_isstring(L, -1))
+		rawstream << "check failed: " << lua_tostring(L, -1) << std::endl;
+	lua_pop(L, 1);
+	return ok;
+}
+
+static int l_native_serialize(lua_State *L)
+{
+	std::string out;
+	if (!serialize_value_text(L, 1, &out))
+		return 0;
+	lua_pushlstring(L, out.data(), out.size());
+	return 1;
+}
+
+static int l_native_deserialize(lua_State *L)
+{
+	size_t size;
+	const char *data = luaL_checklstring(L, 1, &size);
+	std::string error;
+	if (deserialize_value(L, data, size, &error) != DESERIALIZE_OK)
+		return 0;
+	return 1;
+}
+
+void TestLuaSerialize::runTests(IGameDef *gamedef)
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+
+	TEST(testTextRoundtrip, L);
+	TEST(testTextLoadable, L);
+	TEST(testTextFallback, L);
+	TEST(testBinaryRoundtrip, L);
+	TEST(testBinaryInvalid, L);
+	TEST(testBuiltinCompat, L);
+
+	lua_close(L);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestLuaSerialize::testTextRoundtrip(lua_State *L)
+{
+	int top = lua_gettop(L);
+	push_code_result(L, test_value_code);
+
+	std::string data;
+	UASSERT(serialize_value_text(L, -1, &data));
+	lua_pop(L, 1);
+
+	std::string error;
+	UASSERT(deserialize_value(L, data.data(), data.size(), &error) ==
+		DESERIALIZE_OK);
+	UASSERT(check_test_value(L));
+	UASSERT(lua_gettop(L) == top);
+}
+
+void TestLuaSerialize::testTextLoadable(lua_State *L)
+{
+	// The output must stay readable by older versions, which run it as code
+	push_code_result(L, test_value_code);
+	std::string data;
+	UASSERT(serialize_value_text(L, -1, &data));
+	lua_pop(L, 1);
+
+	push_code_result(L, data.c_str());
+	UASSERT(check_test_value(L));
+
+	// Output of the Lua implementation, including its ways of writing numbers
+	const char *lua_output =
+		"return {[\"cat\"] = {[\"sound\"] = \"nyan\", [\"speed\"] = 400}, "
+		"[\"list\"] = {1, 2; 3, -0.25, 1e-05, 0x10}, plain = 'x\\65\\\ny'}";
+	std::string error;
+	UASSERT(deserialize_value(L, lua_output, strlen(lua_output), &error) ==
+		DESERIALIZE_OK);
+	lua_getfield(L, -1, "cat");
+	lua_getfield(L, -1, "speed");
+	UASSERT(lua_tonumber(L, -1) == 400);
+	lua_pop(L, 2);
+	lua_getfield(L, -1, "list");
+	UASSERT(lua_objlen(L, -1) == 6);
+	lua_rawgeti(L, -1, 5);
+	UASSERT(lua_tonumber(L, -1) == 1e-05);
+	lua_pop(L, 2);
+	lua_getfield(L, -1, "plain");
+	UASSERT(std::string(lua_tostring(L, -1)) == "xA\ny");
+	lua_pop(L, 2);
+}
+
+void TestLuaSerialize::testTextFallback(lua_State *L)
+{
+	int top = lua_gettop(L);
+	std::string data;
+
+	// Tables referenced more than once
+	push_code_result(L, "local t = {} return {t, t}");
+	UASSERT(!serialize_value_text(L, -1, &data));
+	lua_pop(L, 1);
+
+	// Functions
+	push_code_result(L, "return {print}");
+	UASSERT(!serialize_value_text(L, -1, &data));
+	lua_pop(L, 1);
+	UASSERT(lua_gettop(L) == top);
+
+	// Code that is more than a table constructor
+	const char *unhandled[] = {
+		"local _ = {}\n_[1] = {}\nreturn {_[1], _[1]}",
+		"return {loadstring(\"\")}",
+		"return os.exit()",
+		"return {1} -- comment",
+		"return [[long string]]",
+		"return {",
+		"return {[nil] = 1}",
+	};
+	for (size_t i = 0; i < ARRLEN(unhandled); i++) {
+		std::string error;
+		UASSERT(deserialize_value(L, unhandled[i], strlen(unhandled[i]),
+			&error) == DESERIALIZE_UNHANDLED);
+		UASSERT(lua_gettop(L) == top);
+	}
+}
+
+void TestLuaSerialize::testBinaryRoundtrip(lua_State *L)
+{
+	int top = lua_gettop(L);
+	push_code_result(L, test_value_code);
+
+	std::string data;
+	serialize_value_binary(L, -1, &data);
+	lua_pop(L, 1);
+	UASSERT(data.compare(0, SERIALIZE_BINARY_MAGIC_LEN,
+		SERIALIZE_BINARY_MAGIC) == 0);
+
+	std::string error;
+	UASSERT(deserialize_value(L, data.data(), data.size(), &error) ==
+		DESERIALIZE_OK);
+	UASSERT(check_test_value(L));
+
+	// Shared and recursive tables keep their identity
+	push_code_result(L, "local t = {} t.self = t return {t, t, [t] = t}");
+	serialize_value_binary(L, -1, &data);
+	lua_pop(L, 1);
+	UASSERT(deserialize_value(L, data.data(), data.size(), &error) ==
+		DESERIALIZE_OK);
+	lua_rawgeti(L, -1, 1);
+	lua_rawgeti(L, -2, 2);
+	UASSERT(lua_rawequal(L, -1, -2));
+	lua_getfield(L, -1, "self");
+	UASSERT(lua_rawequal(L, -1, -2));
+	lua_pop(L, 4);
+
+	// Unsupported values raise errors
+	push_code_result(L, "return {print}");
+	EXCEPTION_CHECK(LuaError, serialize_value_binary(L, -1, &data));
+	lua_pop(L, 1);
+	UASSERT(lua_gettop(L) == top);
+}
+
+void TestLuaSerialize::testBinaryInvalid(lua_State *L)
+{
+	int top = lua_gettop(L);
+	push_code_result(L, test_value_code);
+	std::string data;
+	serialize_value_binary(L, -1, &data);
+	lua_pop(L, 1);
+
+	// Every truncation of valid data must be rejected cleanly
+	std::string error;
+	for (size_t len = SERIALIZE_BINARY_MAGIC_LEN; len < data.size(); len++) {
+		UASSERT(deserialize_value(L, data.data(), len, &error) ==
+			DESERIALIZE_ERROR);
+		UASSERT(lua_gettop(L) == top);
+	}
+
+	// Nesting deeper than the limit
+	std::string deep(SERIALIZE_BINARY_MAGIC, SERIALIZE_BINARY_MAGIC_LEN);
+	deep.append(SERIALIZE_MAX_DEPTH + 10, '\x06');
+	UASSERT(deserialize_value(L, deep.data(), deep.size(), &error) ==
+		DESERIALIZE_ERROR);
+
+	// Reference to a table that was not read yet
+	const char bad_ref[] = SERIALIZE_BINARY_MAGIC "\x08\x00\x00\x00\x05";
+	UASSERT(deserialize_value(L, bad_ref, sizeof(bad_ref) - 1, &error) ==
+		DESERIALIZE_ERROR);
+	UASSERT(lua_gettop(L) == top);
+}
+
+// Loads builtin's serializer into core, next to native_serialize and
+// native_deserialize
+static bool load_builtin_serialize(lua_State *L)
+{
+	std::string path = porting::path_share + DIR_DELIM "builtin" DIR_DELIM
+		"common" DIR_DELIM "serialize.lua";
+	if (!fs::PathExists(path)) {
+		rawstream << "builtin not found, skipping" << std::endl;
+		return false;
+	}
+
+	lua_newtable(L);
+	lua_setglobal(L, "core");
+	UASSERT(luaL_dofile(L, path.c_str()) == 0);
+	lua_pushcfunction(L, l_native_serialize);
+	lua_setglobal(L, "native_serialize");
+	lua_pushcfunction(L, l_native_deserialize);
+	lua_setglobal(L, "native_deserialize");
+	return true;
+}
+
+void TestLuaSerialize::testBuiltinCompat(lua_State *L)
+{
+	int top = lua_gettop(L);
+	if (!load_builtin_serialize(L))
+		return;
+
+	// Both serializers read each other's output
+	const char *check =
+		"local t = {}\n"
+		"for i = 1, 400 do\n"
+		"	t[i] = {pos = {x = i, y = -i * 0.5, z = i % 77},\n"
+		"		name = 'default:stone_with_coal_' .. i,\n"
+		"		owner = 'singleplayer', flags = {true, false, i}}\n"
+		"end\n"
+		"local r1 = core.deserialize(native_serialize(t))\n"
+		"local r2 = native_deserialize(core.serialize(t))\n"
+		"assert(#r1 == #t and #r2 == #t)\n"
+		"assert(r1[123].name == t[123].name and r2[123].name == t[123].name)\n"
+		"assert(r1[400].pos.y == -200 and r2[400].pos.y == -200)\n"
+		"assert(r2[77].flags[1] == true and r2[77].flags[2] == false)\n";
+	if (luaL_dostring(L, check) != 0) {
+		rawstream << "check failed: " << lua_tostring(L, -1) << std::endl;
+		UASSERT(false);
+	}
+	lua_settop(L, top);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void BenchmarkLuaSerialize::runTests(IGameDef *gamedef)
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+
+	TEST(benchmarkSerialize, L);
+
+	lua_close(L);
+}
+
+void BenchmarkLuaSerialize::benchmarkSerialize(lua_State *L)
+{
+	int top = lua_gettop(L);
+	if (!load_builtin_serialize(L))
+		return;
+
+	// Several MB of serialized data, like a big mod storage table
+	const char *bench =
+		"local t = {}\n"
+		"for i = 1, 40000 do\n"
+		"	t[i] = {pos = {x = i, y = -i * 0.5, z = i % 77},\n"
+		"		name = 'default:stone_with_coal_' .. i,\n"
+		"		owner = 'singleplayer', flags = {true, false, i}}\n"
+		"end\n"
+		"local clock = os.clock\n"
+		"local t0 = clock()\n"
+		"local s1 = core.serialize(t)\n"
+		"local t1 = clock()\n"
+		"local r1 = core.deserialize(s1)\n"
+		"local t2 = clock()\n"
+		"local s2 = native_serialize(t)\n"
+		"local t3 = clock()\n"
+		"local r2 = native_deserialize(s2)\n"
+		"local t4 = clock()\n"
+		"assert(#r1 == #t and #r2 == #t)\n"
+		"return string.format('%d bytes: Lua %.3fs/%.3fs, native %.3fs/%.3fs'"
+		"	.. ' (serialize/deserialize)', #s2, t1 - t0, t2 - t1, t3 - t2, t4 - t3)\n";
+	if (luaL_loadstring(L, bench) != 0 || lua_pcall(L, 0, 1, 0) != 0) {
+		rawstream << "benchmark failed: " << lua_tostring(L, -1) << std::endl;
+		UASSERT(false);
+	}
+	rawstream << "serialize benchmark: " << lua_tostring(L, -1) << std::endl;
+	lua_settop(L, top);
+}
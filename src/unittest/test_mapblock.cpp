@@ -0,0 +1,327 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <sstream>
+#include "gamedef.h"
+#include "mapblock.h"
+#include "nodemetadata.h"
+#include "serialization.h"
+#include "voxel.h"
+
+class TestMapBlock : public TestBase {
+public:
+	TestMapBlock() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapBlock"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testUniform(IGameDef *gamedef);
+	void testPalette(IGameDef *gamedef);
+	void testTooManyNodes(IGameDef *gamedef);
+	void testSerializePacked(IGameDef *gamedef);
+	void testSerializeLazy(IGameDef *gamedef);
+	void testNetworkNodes(IGameDef *gamedef);
+	void testSnapshot(IGameDef *gamedef);
+};
+
+static TestMapBlock g_test_instance;
+
+void TestMapBlock::runTests(IGameDef *gamedef)
+{
+	TEST(testUniform, gamedef);
+	TEST(testPalette, gamedef);
+	TEST(testTooManyNodes, gamedef);
+	TEST(testSerializePacked, gamedef);
+	TEST(testSerializeLazy, gamedef);
+	TEST(testNetworkNodes, gamedef);
+	TEST(testSnapshot, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static MapNode test_node(u32 i, u32 distinct)
+{
+	return MapNode(i % distinct < distinct / 2 ? t_CONTENT_STONE : CONTENT_AIR,
+		i % distinct, 0);
+}
+
+void TestMapBlock::testUniform(IGameDef *gamedef)
+{
+	MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+	UASSERT(!block.isDummy());
+	UASSERT(block.isNodeDataCompressed());
+	UASSERT(block.getNodeDataSize() < 16);
+	UASSERTEQ(content_t, block.getNodeNoEx(v3s16(3, 4, 5)).getContent(),
+		CONTENT_IGNORE);
+
+	MapNode stone(t_CONTENT_STONE);
+	block.setNode(v3s16(3, 4, 5), stone);
+	UASSERT(!block.isNodeDataCompressed());
+	UASSERTEQ(u32, block.getNodeDataSize(), MapBlock::nodecount * sizeof(MapNode));
+	UASSERT(block.checkNodeDataWritten());
+	UASSERT(!block.checkNodeDataWritten());
+
+	// A single stone node in ignore takes one bit per node
+	block.compressNodeData();
+	UASSERT(block.isNodeDataCompressed());
+	UASSERT(block.getNodeDataSize() < MapBlock::nodecount / 8 + 64);
+	UASSERTEQ(content_t, block.getNodeNoEx(v3s16(3, 4, 5)).getContent(),
+		t_CONTENT_STONE);
+	UASSERTEQ(content_t, block.getNodeNoEx(v3s16(3, 4, 6)).getContent(),
+		CONTENT_IGNORE);
+
+	MapBlock dummy(NULL, v3s16(0, 0, 0), gamedef, true);
+	UASSERT(dummy.isDummy());
+	UASSERT(!dummy.isNodeDataCompressed());
+}
+
+void TestMapBlock::testPalette(IGameDef *gamedef)
+{
+	const u32 palette_sizes[] = { 2, 3, 16, 17, 256 };
+	for (u32 k = 0; k < ARRLEN(palette_sizes); k++) {
+		u32 distinct = palette_sizes[k];
+		MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+
+		v3s16 p;
+		u32 i = 0;
+		for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+		for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+		for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++) {
+			MapNode n = test_node(i++, distinct);
+			block.setNode(p, n);
+		}
+
+		block.compressNodeData();
+		UASSERT(block.isNodeDataCompressed());
+		UASSERT(block.getNodeDataSize() <= distinct * sizeof(MapNode) +
+			MapBlock::nodecount);
+
+		i = 0;
+		for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+		for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+		for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++) {
+			MapNode expected = test_node(i++, distinct);
+			MapNode n = block.getNodeUnsafe(p);
+			UASSERT(n.param0 == expected.param0 &&
+				n.param1 == expected.param1 && n.param2 == expected.param2);
+		}
+
+		// Writing unpacks and keeps the other nodes
+		MapNode water(t_CONTENT_WATER);
+		block.setNode(v3s16(1, 1, 1), water);
+		UASSERT(!block.isNodeDataCompressed());
+		UASSERTEQ(content_t, block.getNodeNoEx(v3s16(1, 1, 1)).getContent(),
+			t_CONTENT_WATER);
+		UASSERTEQ(u8, block.getNodeNoEx(v3s16(2, 1, 1)).param1,
+			test_node(2 + 1 * MapBlock::ystride + 1 * MapBlock::zstride,
+				distinct).param1);
+	}
+}
+
+void TestMapBlock::testTooManyNodes(IGameDef *gamedef)
+{
+	MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+
+	v3s16 p;
+	u32 i = 0;
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+	for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++) {
+		MapNode n(t_CONTENT_STONE, i % 256, (i / 256) % 2);
+		block.setNode(p, n);
+		i++;
+	}
+
+	// 512 distinct nodes do not fit into byte indices
+	block.compressNodeData();
+	UASSERT(!block.isNodeDataCompressed());
+	UASSERTEQ(u8, block.getNodeNoEx(v3s16(0, 0, 1)).param2, 1);
+
+	// Once written to, it is packed again if it fits
+	block.drawbox(0, 0, 0, MAP_BLOCKSIZE, MAP_BLOCKSIZE - 1, MAP_BLOCKSIZE,
+		MapNode(t_CONTENT_STONE));
+	block.compressNodeData();
+	UASSERT(block.isNodeDataCompressed());
+	UASSERTEQ(u8, block.getNodeNoEx(v3s16(0, 0, 1)).param2, 0);
+	UASSERTEQ(u8, block.getNodeNoEx(v3s16(0, 15, 1)).param2, 1);
+}
+
+void TestMapBlock::testSerializePacked(IGameDef *gamedef)
+{
+	MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+	MapNode grass(t_CONTENT_GRASS, 0, 3);
+	block.drawbox(0, 0, 0, MAP_BLOCKSIZE, 8, MAP_BLOCKSIZE, grass);
+	block.compressNodeData();
+
+	std::ostringstream os(std::ios_base::binary);
+	block.serialize(os, SER_FMT_VER_HIGHEST_WRITE, false);
+
+	MapBlock block2(NULL, v3s16(0, 0, 0), gamedef);
+	std::istringstream is(os.str(), std::ios_base::binary);
+	block2.deSerialize(is, SER_FMT_VER_HIGHEST_WRITE, false);
+
+	// Loaded blocks are packed right away
+	UASSERT(block2.isNodeDataCompressed());
+	UASSERTEQ(content_t, block2.getNodeNoEx(v3s16(5, 7, 5)).getContent(),
+		t_CONTENT_GRASS);
+	UASSERTEQ(u8, block2.getNodeNoEx(v3s16(5, 7, 5)).param2, 3);
+	UASSERTEQ(content_t, block2.getNodeNoEx(v3s16(5, 8, 5)).getContent(),
+		CONTENT_IGNORE);
+}
+
+void TestMapBlock::testSerializeLazy(IGameDef *gamedef)
+{
+	MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+	MapNode stone(t_CONTENT_STONE);
+	block.setNode(v3s16(1, 1, 1), stone);
+	NodeMetadata *meta = new NodeMetadata(gamedef->idef());
+	meta->setString("infotext", "A stone");
+	block.getNodeMetadataList().set(v3s16(1, 1, 1), meta);
+	block.setNodeTimer(NodeTimer(5, 1, v3s16(1, 1, 1)));
+	block.getStaticObjectList().insert(0,
+		StaticObject(7, v3f(1, 2, 3), "object data"));
+
+	std::ostringstream os(std::ios_base::binary);
+	block.serialize(os, SER_FMT_VER_HIGHEST_WRITE, true);
+
+	MapBlock block2(NULL, v3s16(0, 0, 0), gamedef);
+	std::istringstream is(os.str(), std::ios_base::binary);
+	block2.deSerialize(is, SER_FMT_VER_HIGHEST_WRITE, true);
+
+	// Parts that were not used are written back as they were read
+	std::ostringstream os2(std::ios_base::binary);
+	block2.serialize(os2, SER_FMT_VER_HIGHEST_WRITE, true);
+	UASSERT(os2.str() == os.str());
+
+	UASSERTEQ(content_t, block2.getNodeNoEx(v3s16(1, 1, 1)).getContent(),
+		t_CONTENT_STONE);
+	meta = block2.getNodeMetadataList().get(v3s16(1, 1, 1));
+	UASSERT(meta != NULL);
+	UASSERTEQ(std::string, meta->getString("infotext"), "A stone");
+	UASSERT(block2.getNodeTimer(v3s16(1, 1, 1)).timeout == 5);
+	StaticObjectList &objects = block2.getStaticObjectList();
+	UASSERTEQ(size_t, objects.m_stored.size(), 1);
+	UASSERTEQ(u8, objects.m_stored[0].type, 7);
+	UASSERTEQ(std::string, objects.m_stored[0].data, "object data");
+
+	// ...and once used, as they are now
+	objects.m_stored.clear();
+	std::ostringstream os3(std::ios_base::binary);
+	block2.serialize(os3, SER_FMT_VER_HIGHEST_WRITE, true);
+	MapBlock block3(NULL, v3s16(0, 0, 0), gamedef);
+	std::istringstream is3(os3.str(), std::ios_base::binary);
+	block3.deSerialize(is3, SER_FMT_VER_HIGHEST_WRITE, true);
+	UASSERT(block3.getStaticObjectList().m_stored.empty());
+	UASSERT(block3.getNodeMetadataList().get(v3s16(1, 1, 1)) != NULL);
+}
+
+void TestMapBlock::testNetworkNodes(IGameDef *gamedef)
+{
+	MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+	MapNode grass(t_CONTENT_GRASS);
+	block.drawbox(0, 0, 0, MAP_BLOCKSIZE, 4, MAP_BLOCKSIZE, grass);
+
+	std::ostringstream os(std::ios_base::binary);
+	block.serialize(os, SER_FMT_VER_HIGHEST_WRITE, false);
+	std::ostringstream os2(std::ios_base::binary);
+	block.serialize(os2, SER_FMT_VER_HIGHEST_WRITE, false);
+	UASSERT(os2.str() == os.str());
+
+	// Writing nodes makes them compressed again
+	MapNode water(t_CONTENT_WATER);
+	block.setNode(v3s16(2, 8, 2), water);
+	std::ostringstream os3(std::ios_base::binary);
+	block.serialize(os3, SER_FMT_VER_HIGHEST_WRITE, false);
+	UASSERT(os3.str() != os.str());
+
+	MapBlock block2(NULL, v3s16(0, 0, 0), gamedef);
+	std::istringstream is(os3.str(), std::ios_base::binary);
+	block2.deSerialize(is, SER_FMT_VER_HIGHEST_WRITE, false);
+	UASSERTEQ(content_t, block2.getNodeNoEx(v3s16(2, 8, 2)).getContent(),
+		t_CONTENT_WATER);
+	UASSERTEQ(content_t, block2.getNodeNoEx(v3s16(2, 3, 2)).getContent(),
+		t_CONTENT_GRASS);
+}
+
+void TestMapBlock::testSnapshot(IGameDef *gamedef)
+{
+	MapBlock dummy(NULL, v3s16(0, 0, 0), gamedef, true);
+	UASSERT(dummy.getSnapshot() == NULL);
+
+	MapBlock block(NULL, v3s16(1, -1, 2), gamedef);
+	MapNode grass(t_CONTENT_GRASS);
+	block.drawbox(0, 0, 0, MAP_BLOCKSIZE, 4, MAP_BLOCKSIZE, grass);
+
+	// Snapshots are shared until the nodes change
+	MapBlockSnapshot *snapshot = block.getSnapshot();
+	MapBlockSnapshot *same = block.getSnapshot();
+	UASSERT(same == snapshot);
+	same->drop();
+	block.compressNodeData();
+	same = block.getSnapshot();
+	UASSERT(same == snapshot);
+	same->drop();
+	// Two distinct nodes take one bit each
+	UASSERT(snapshot->getDataSize() < MapBlockSnapshot::nodecount / 8 + 64);
+
+	MapNode water(t_CONTENT_WATER);
+	block.setNode(v3s16(2, 8, 2), water);
+	MapBlockSnapshot *changed = block.getSnapshot();
+	UASSERT(changed != snapshot);
+
+	// The old snapshot keeps the nodes it was made with
+	UASSERTEQ(content_t, snapshot->getNode(v3s16(2, 8, 2)).getContent(),
+		CONTENT_IGNORE);
+	UASSERTEQ(content_t, snapshot->getNode(v3s16(2, 3, 2)).getContent(),
+		t_CONTENT_GRASS);
+	UASSERTEQ(content_t, snapshot->getNode(v3s16(2, 16, 2)).getContent(),
+		CONTENT_IGNORE);
+	UASSERTEQ(content_t, changed->getNode(v3s16(2, 8, 2)).getContent(),
+		t_CONTENT_WATER);
+	snapshot->drop();
+
+	// Blocks with too many distinct nodes are kept unpacked
+	u32 i = 0;
+	v3s16 p;
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+	for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++) {
+		MapNode n(t_CONTENT_STONE, i % 256, (i / 256) % 2);
+		block.setNode(p, n);
+		i++;
+	}
+	snapshot = block.getSnapshot();
+	UASSERTEQ(u8, snapshot->getNode(v3s16(0, 0, 1)).param2, 1);
+	UASSERTEQ(u8, snapshot->getNode(v3s16(3, 0, 0)).param1, 3);
+
+	// Copied into a VoxelManipulator at the position of the block
+	VoxelManipulator vm;
+	vm.addArea(VoxelArea(v3s16(0, -32, 0), v3s16(47, 0, 47)));
+	changed->copyTo(vm);
+	UASSERTEQ(content_t, vm.getNodeNoExNoEmerge(v3s16(18, -8, 34)).getContent(),
+		t_CONTENT_WATER);
+	UASSERTEQ(content_t, vm.getNodeNoExNoEmerge(v3s16(18, -13, 34)).getContent(),
+		t_CONTENT_GRASS);
+	snapshot->copyTo(vm);
+	UASSERTEQ(u8, vm.getNodeNoExNoEmerge(v3s16(19, -16, 32)).param1, 3);
+	changed->drop();
+	snapshot->drop();
+}
@@ -0,0 +1,321 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapblock_index.h"
+#include "mapsector.h"
+#include "noise.h"
+#include "porting.h"
+
+class TestMapBlockIndex : public TestBase {
+public:
+	TestMapBlockIndex() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapBlockIndex"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testInsertGet();
+	void testRemove();
+	void testMapLookup(IGameDef *gamedef);
+	void testUnloadOrder(IGameDef *gamedef);
+	void testMatchesSectors(IGameDef *gamedef);
+};
+
+static TestMapBlockIndex g_test_instance;
+
+// A Map that can be filled with blank blocks
+class TestMap : public Map {
+public:
+	TestMap(IGameDef *gamedef) : Map(dstream, gamedef) {}
+
+	MapBlock *addBlock(v3s16 p)
+	{
+		v2s16 p2d(p.X, p.Z);
+		MapSector *sector = getSectorNoGenerateNoEx(p2d);
+		if (sector == NULL) {
+			sector = new ServerMapSector(this, p2d, m_gamedef);
+			m_sectors[p2d] = sector;
+		}
+		return sector->createBlankBlock(p.Y);
+	}
+
+	void removeBlock(v3s16 p)
+	{
+		MapSector *sector = getSectorNoGenerate(v2s16(p.X, p.Z));
+		sector->deleteBlock(sector->getBlockNoCreateNoEx(p.Y));
+	}
+
+	// The lookup through the sector, as done before the block index
+	MapBlock *getBlockFromSector(v3s16 p)
+	{
+		MapSector *sector = getSectorNoGenerateNoEx(v2s16(p.X, p.Z));
+		if (sector == NULL)
+			return NULL;
+		return sector->getBlockNoCreateNoEx(p.Y);
+	}
+};
+
+// Node lookups through the block index and through the sectors, run by
+// --run-benchmarks
+class BenchmarkMapBlockIndex : public TestBase {
+public:
+	BenchmarkMapBlockIndex() { TestManager::registerBenchmarkModule(this); }
+	const char *getName() { return "BenchmarkMapBlockIndex"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void benchmarkGetNode(IGameDef *gamedef);
+};
+
+static BenchmarkMapBlockIndex g_benchmark_instance;
+
+void TestMapBlockIndex::runTests(IGameDef *gamedef)
+{
+	TEST(testInsertGet);
+	TEST(testRemove);
+	TEST(testMapLookup, gamedef);
+	TEST(testUnloadOrder, gamedef);
+	TEST(testMatchesSectors, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The index never dereferences the blocks
+static MapBlock *fake_block(u32 i)
+{
+	static char blocks[4096];
+	return (MapBlock *)&blocks[i % sizeof(blocks)];
+}
+
+void TestMapBlockIndex::testInsertGet()
+{
+	MapBlockIndex index;
+	UASSERT(index.get(v3s16(0, 0, 0)) == NULL);
+
+	u32 n = 0;
+	for (s16 z = -8; z < 8; z++)
+	for (s16 y = -8; y < 8; y++)
+	for (s16 x = -8; x < 8; x++)
+		index.insert(v3s16(x, y, z), fake_block(n++));
+
+	UASSERTEQ(u32, index.size(), 16 * 16 * 16);
+	UASSERT(index.capacity() >= index.size() * 2);
+
+	n = 0;
+	for (s16 z = -8; z < 8; z++)
+	for (s16 y = -8; y < 8; y++)
+	for (s16 x = -8; x < 8; x++)
+		UASSERT(index.get(v3s16(x, y, z)) == fake_block(n++));
+
+	UASSERT(index.get(v3s16(8, 0, 0)) == NULL);
+	UASSERT(index.get(v3s16(0, -9, 0)) == NULL);
+
+	// Coordinates that only differ in their sign bits
+	index.insert(v3s16(-2048, 2047, -1), fake_block(1));
+	index.insert(v3s16(2047, -2048, 1), fake_block(2));
+	UASSERT(index.get(v3s16(-2048, 2047, -1)) == fake_block(1));
+	UASSERT(index.get(v3s16(2047, -2048, 1)) == fake_block(2));
+	UASSERT(index.get(v3s16(2047, 2047, 1)) == NULL);
+
+	// Inserting an existing position replaces the block
+	index.insert(v3s16(1, 2, 3), fake_block(3));
+	UASSERT(index.get(v3s16(1, 2, 3)) == fake_block(3));
+	UASSERTEQ(u32, index.size(), 16 * 16 * 16 + 2);
+
+	index.clear();
+	UASSERTEQ(u32, index.size(), 0);
+	UASSERT(index.get(v3s16(1, 2, 3)) == NULL);
+}
+
+void TestMapBlockIndex::testRemove()
+{
+	MapBlockIndex index;
+	std::vector<v3s16> positions;
+	PcgRandom pr(42);
+
+	for (u32 i = 0; i < 3000; i++) {
+		v3s16 p(pr.range(-20, 20), pr.range(-20, 20), pr.range(-20, 20));
+		if (index.get(p) != NULL)
+			continue;
+		index.insert(p, fake_block(positions.size() + 1));
+		positions.push_back(p);
+	}
+
+	// Removing every other block has to keep the rest of the probe chains
+	for (u32 i = 0; i < positions.size(); i += 2)
+		UASSERT(index.remove(positions[i]));
+	UASSERT(!index.remove(positions[0]));
+	UASSERTEQ(u32, index.size(), positions.size() / 2);
+
+	for (u32 i = 0; i < positions.size(); i++) {
+		MapBlock *expected = i % 2 ? fake_block(i + 1) : NULL;
+		UASSERT(index.get(positions[i]) == expected);
+	}
+
+	for (u32 i = 1; i < positions.size(); i += 2)
+		UASSERT(index.remove(positions[i]));
+	UASSERTEQ(u32, index.size(), 0);
+	for (u32 i = 0; i < positions.size(); i++)
+		UASSERT(index.get(positions[i]) == NULL);
+}
+
+void TestMapBlockIndex::testMapLookup(IGameDef *gamedef)
+{
+	TestMap map(gamedef);
+
+	MapBlock *block1 = map.addBlock(v3s16(0, 0, 0));
+	MapBlock *block2 = map.addBlock(v3s16(0, -1, 0));
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(0, 0, 0)) == block1);
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(0, -1, 0)) == block2);
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(1, 0, 0)) == NULL);
+
+	// The last block found must not be returned after its removal
+	map.removeBlock(v3s16(0, 0, 0));
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(0, 0, 0)) == NULL);
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(0, -1, 0)) == block2);
+
+	bool is_valid;
+	MapNode n = map.getNodeNoEx(v3s16(5, -3, 7), &is_valid);
+	UASSERT(is_valid);
+	UASSERTEQ(content_t, n.getContent(), CONTENT_IGNORE);
+	map.getNodeNoEx(v3s16(5, 3, 7), &is_valid);
+	UASSERT(!is_valid);
+}
+
+void TestMapBlockIndex::testUnloadOrder(IGameDef *gamedef)
+{
+	TestMap map(gamedef);
+	for (s16 i = 0; i < 10; i++)
+		map.addBlock(v3s16(i, 0, 0));
+
+	std::vector<v3s16> unloaded;
+	map.timerUpdate(1.0, 100, U32_MAX, &unloaded);
+	UASSERT(unloaded.empty());
+
+	// Over the limit, the blocks used longest ago go first
+	for (s16 i = 5; i < 10; i++)
+		map.getBlockNoCreateNoEx(v3s16(i, 0, 0))->resetUsageTimer();
+	map.timerUpdate(1.0, 100, 5, &unloaded);
+	UASSERTEQ(size_t, unloaded.size(), 5);
+	for (s16 i = 0; i < 10; i++)
+		UASSERT((map.getBlockNoCreateNoEx(v3s16(i, 0, 0)) != NULL) == (i >= 5));
+	UASSERT(map.getSectorNoGenerateNoEx(v2s16(0, 0)) == NULL);
+
+	// After the timeout all but the referenced blocks go
+	MapBlock *block = map.getBlockNoCreateNoEx(v3s16(7, 0, 0));
+	block->refGrab();
+	unloaded.clear();
+	map.timerUpdate(100.0, 10, U32_MAX, &unloaded);
+	UASSERTEQ(size_t, unloaded.size(), 4);
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(7, 0, 0)) == block);
+	UASSERT(map.getBlockNoCreateNoEx(v3s16(8, 0, 0)) == NULL);
+	block->refDrop();
+}
+
+void TestMapBlockIndex::testMatchesSectors(IGameDef *gamedef)
+{
+	TestMap map(gamedef);
+
+	const s16 size = 4;
+	for (s16 z = 0; z < size; z++)
+	for (s16 y = -size / 2; y < size / 2; y++)
+	for (s16 x = 0; x < size; x++)
+		map.addBlock(v3s16(x, y, z));
+
+	// Nodes around the blocks too, which have to be invalid
+	const s16 nodes = (size + 2) * MAP_BLOCKSIZE;
+	PcgRandom pr(1234);
+	for (u32 i = 0; i < 10000; i++) {
+		v3s16 p(pr.range(-MAP_BLOCKSIZE, nodes - MAP_BLOCKSIZE - 1),
+			pr.range(-nodes / 2, nodes / 2 - 1),
+			pr.range(-MAP_BLOCKSIZE, nodes - MAP_BLOCKSIZE - 1));
+		v3s16 blockpos = getNodeBlockPos(p);
+		MapBlock *block = map.getBlockFromSector(blockpos);
+		UASSERT(map.getBlockNoCreateNoEx(blockpos) == block);
+
+		bool is_valid;
+		map.getNodeNoEx(p, &is_valid);
+		UASSERT(is_valid == (block != NULL));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void BenchmarkMapBlockIndex::runTests(IGameDef *gamedef)
+{
+	TEST(benchmarkGetNode, gamedef);
+}
+
+void BenchmarkMapBlockIndex::benchmarkGetNode(IGameDef *gamedef)
+{
+	TestMap map(gamedef);
+
+	const s16 size = 8;
+	for (s16 z = 0; z < size; z++)
+	for (s16 y = -size / 2; y < size / 2; y++)
+	for (s16 x = 0; x < size; x++)
+		map.addBlock(v3s16(x, y, z));
+
+	const s16 nodes = size * MAP_BLOCKSIZE;
+	std::vector<v3s16> random_positions;
+	PcgRandom pr(1234);
+	for (u32 i = 0; i < 1000000; i++)
+		random_positions.push_back(v3s16(pr.range(0, nodes - 1),
+			pr.range(-nodes / 2, nodes / 2 - 1), pr.range(0, nodes - 1)));
+
+	u32 valid = 0;
+	bool is_valid;
+
+	u64 t0 = porting::getTimeUs();
+	for (s16 z = 0; z < nodes; z++)
+	for (s16 y = -nodes / 2; y < nodes / 2; y++)
+	for (s16 x = 0; x < nodes; x++) {
+		map.getNodeNoEx(v3s16(x, y, z), &is_valid);
+		valid += is_valid;
+	}
+
+	u64 t1 = porting::getTimeUs();
+	for (u32 i = 0; i < random_positions.size(); i++) {
+		map.getNodeNoEx(random_positions[i], &is_valid);
+		valid += is_valid;
+	}
+
+	u64 t2 = porting::getTimeUs();
+	for (u32 i = 0; i < random_positions.size(); i++) {
+		v3s16 p = random_positions[i];
+		v3s16 blockpos = getNodeBlockPos(p);
+		MapBlock *block = map.getBlockFromSector(blockpos);
+		if (block) {
+			block->getNodeNoCheck(p - blockpos * MAP_BLOCKSIZE, &is_valid);
+			valid += is_valid;
+		}
+	}
+	u64 t3 = porting::getTimeUs();
+
+	UASSERTEQ(u32, valid, nodes * nodes * nodes + 2 * random_positions.size());
+
+	rawstream << "getNodeNoEx benchmark: " << nodes * nodes * nodes
+		<< " sequential " << (t1 - t0) / 1000 << "ms, "
+		<< random_positions.size() << " random " << (t2 - t1) / 1000
+		<< "ms (through the sector " << (t3 - t2) / 1000 << "ms)" << std::endl;
+}
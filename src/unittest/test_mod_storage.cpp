@@ -0,0 +1,238 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "database-dummy.h"
+#include "database-sqlite3.h"
+#include "exceptions.h"
+#include "filesys.h"
+#include "mod_storage.h"
+
+class TestModStorage : public TestBase {
+public:
+	TestModStorage() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestModStorage"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testLazyLoad();
+	void testDirtyKeys();
+	void testThreadedSave();
+	void testFailedSave();
+	void testSQLite3Roundtrip();
+};
+
+static TestModStorage g_test_instance;
+
+void TestModStorage::runTests(IGameDef *gamedef)
+{
+	TEST(testLazyLoad);
+	TEST(testDirtyKeys);
+	TEST(testThreadedSave);
+	TEST(testFailedSave);
+	TEST(testSQLite3Roundtrip);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestModStorage::testLazyLoad()
+{
+	Database_Dummy *db = new Database_Dummy;
+	db->setModEntry("mod_a", "key", "stored");
+	db->setModEntry("mod_b", "key", "other");
+
+	ModStorageManager mgr(db);
+	ModStorage *storage = mgr.getStorage("mod_a");
+	UASSERT(mgr.getStorage("mod_a") == storage);
+
+	// Nothing is read before the first access
+	db->setModEntry("mod_a", "late", "also stored");
+
+	UASSERTEQ(std::string, storage->getString("key"), "stored");
+	UASSERTEQ(std::string, storage->getString("late"), "also stored");
+	UASSERT(!storage->contains("missing"));
+	UASSERTEQ(std::string, storage->getString("missing"), "");
+	UASSERT(storage->getValues().size() == 2);
+}
+
+void TestModStorage::testDirtyKeys()
+{
+	Database_Dummy *db = new Database_Dummy;
+	db->setModEntry("mod", "same", "value");
+	db->setModEntry("mod", "removed", "value");
+
+	ModStorageManager mgr(db);
+	ModStorage *storage = mgr.getStorage("mod");
+
+	// Setting the stored value or removing missing keys changes nothing
+	storage->setString("same", "value");
+	storage->setString("missing", "");
+	UASSERT(!storage->isModified());
+
+	storage->setString("new", "1");
+	storage->setString("removed", "");
+	UASSERT(storage->isModified());
+	UASSERT(!storage->contains("removed"));
+
+	mgr.flush();
+	UASSERT(!storage->isModified());
+
+	StringMap stored;
+	db->getModEntries("mod", &stored);
+	UASSERT(stored.size() == 2);
+	UASSERTEQ(std::string, stored["same"], "value");
+	UASSERTEQ(std::string, stored["new"], "1");
+}
+
+void TestModStorage::testThreadedSave()
+{
+	Database_Dummy *db = new Database_Dummy;
+	ModStorageManager mgr(db);
+	mgr.start();
+
+	ModStorage *storage = mgr.getStorage("mod");
+	for (int i = 0; i < 100; i++) {
+		storage->setString("counter", itos(i));
+		storage->setString("key" + itos(i % 10), itos(i));
+		mgr.save();
+	}
+
+	// Batches must be written in order
+	mgr.flush();
+
+	StringMap stored;
+	db->getModEntries("mod", &stored);
+	UASSERT(stored.size() == 11);
+	UASSERTEQ(std::string, stored["counter"], "99");
+	UASSERTEQ(std::string, stored["key0"], "90");
+}
+
+// A database that fails the first writes
+class FailingModStorageDatabase : public Database_Dummy {
+public:
+	FailingModStorageDatabase(u32 failures) :
+		failures(failures),
+		throws(true),
+		in_save(false),
+		rollbacks(0)
+	{}
+
+	void beginSave() { in_save = true; }
+	void endSave() { in_save = false; }
+	void rollbackSave() { in_save = false; rollbacks++; }
+
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value)
+	{
+		if (failures > 0) {
+			failures--;
+			if (throws)
+				throw DatabaseException("Database is locked");
+			return false;
+		}
+		return Database_Dummy::setModEntry(modname, key, value);
+	}
+
+	u32 failures;
+	// Whether failures are thrown or returned
+	bool throws;
+	bool in_save;
+	u32 rollbacks;
+};
+
+void TestModStorage::testFailedSave()
+{
+	FailingModStorageDatabase *db = new FailingModStorageDatabase(1);
+	ModStorageManager mgr(db);
+	ModStorage *storage = mgr.getStorage("mod");
+
+	// A failed batch is rolled back and written before the later ones
+	storage->setString("key", "first");
+	mgr.save();
+	storage->setString("key", "second");
+	mgr.flush();
+	UASSERTEQ(u32, db->rollbacks, 1);
+	UASSERT(!db->in_save);
+
+	StringMap stored;
+	db->getModEntries("mod", &stored);
+	UASSERTEQ(std::string, stored["key"], "second");
+
+	// ...until it is given up
+	db->failures = 100;
+	storage->setString("key", "lost");
+	mgr.flush();
+	UASSERTEQ(u32, db->rollbacks, 4);
+	db->failures = 0;
+	storage->setString("other", "kept");
+	mgr.flush();
+
+	stored.clear();
+	db->getModEntries("mod", &stored);
+	UASSERTEQ(std::string, stored["key"], "second");
+	UASSERTEQ(std::string, stored["other"], "kept");
+
+	// Failures reported by the result are retried the same way
+	db->failures = 1;
+	db->throws = false;
+	storage->setString("key", "third");
+	mgr.flush();
+	UASSERTEQ(u32, db->rollbacks, 5);
+	stored.clear();
+	db->getModEntries("mod", &stored);
+	UASSERTEQ(std::string, stored["key"], "third");
+
+	// Removing an entry that isn't stored is not a failure
+	storage->setString("other", "");
+	storage->setString("never stored", "");
+	mgr.flush();
+	UASSERTEQ(u32, db->rollbacks, 5);
+}
+
+void TestModStorage::testSQLite3Roundtrip()
+{
+	std::string dir = getTestTempDirectory();
+
+	{
+		ModStorageManager mgr(new ModStorageDatabase_SQLite3(dir));
+		mgr.start();
+
+		ModStorage *storage = mgr.getStorage("mod");
+		storage->setString("key", "value");
+		storage->setString(std::string("bin\0ary", 7), std::string("\0\xff", 2));
+		storage->setString("empty", "x");
+		mgr.save();
+
+		// Written by the destructor
+		storage->setString("empty", "");
+		mgr.getStorage("other_mod")->setString("key", "other");
+	}
+
+	ModStorageManager mgr(new ModStorageDatabase_SQLite3(dir));
+	ModStorage *storage = mgr.getStorage("mod");
+	UASSERT(storage->getValues().size() == 2);
+	UASSERTEQ(std::string, storage->getString("key"), "value");
+	UASSERT(storage->getString(std::string("bin\0ary", 7)) ==
+		std::string("\0\xff", 2));
+	UASSERT(!storage->contains("empty"));
+	UASSERTEQ(std::string, mgr.getStorage("other_mod")->getString("key"), "other");
+
+	fs::RecursiveDelete(dir);
+}
@@ -0,0 +1,206 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <sstream>
+#include "gamedef.h"
+#include "inventory.h"
+#include "nodemetadata.h"
+
+class TestNodeMetadata : public TestBase {
+public:
+	TestNodeMetadata() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestNodeMetadata"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testStrings(IGameDef *gamedef);
+	void testList(IGameDef *gamedef);
+	void testLazyInventory(IGameDef *gamedef);
+	void testListReserialize(IGameDef *gamedef);
+};
+
+static TestNodeMetadata g_test_instance;
+
+void TestNodeMetadata::runTests(IGameDef *gamedef)
+{
+	TEST(testStrings, gamedef);
+	TEST(testList, gamedef);
+	TEST(testLazyInventory, gamedef);
+	TEST(testListReserialize, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// A chest as mods make them, with a few items
+static NodeMetadata *make_chest(IItemDefManager *idef, u32 i)
+{
+	NodeMetadata *meta = new NodeMetadata(idef);
+	meta->setString("formspec", "size[8,9]list[current_name;main;0,0;8,4;]"
+		"list[current_player;main;0,5;8,4;]");
+	meta->setString("infotext", "Chest " + itos(i));
+	meta->setString("owner", "player" + itos(i % 7));
+	InventoryList *list = meta->getInventory()->addList("main", 32);
+	list->addItem(i % 32, ItemStack("default:stone", 1 + i % 99, 0, "", idef));
+	list->addItem((i + 5) % 32, ItemStack("default:dirt_with_grass", 10, 0, "",
+		idef));
+	return meta;
+}
+
+void TestNodeMetadata::testStrings(IGameDef *gamedef)
+{
+	NodeMetadata meta(gamedef->idef());
+	UASSERT(meta.empty());
+
+	meta.setString("a", "one");
+	meta.setString("b", "two");
+	meta.setString("c", "${a}");
+	UASSERTEQ(std::string, meta.getString("a"), "one");
+	UASSERTEQ(std::string, meta.getString("b"), "two");
+	UASSERTEQ(std::string, meta.getString("c"), "one");
+	UASSERTEQ(std::string, meta.getString("d"), "");
+	UASSERT(!meta.empty());
+
+	// Replacing and removing values keeps the others
+	meta.setString("a", "a longer one");
+	meta.setString("b", "");
+	UASSERTEQ(std::string, meta.getString("a"), "a longer one");
+	UASSERTEQ(std::string, meta.getString("b"), "");
+	UASSERTEQ(std::string, meta.getString("c"), "a longer one");
+
+	StringMap vars = meta.getStrings();
+	UASSERTEQ(size_t, vars.size(), 2);
+	UASSERTEQ(std::string, vars["a"], "a longer one");
+	UASSERTEQ(std::string, vars["c"], "${a}");
+
+	meta.clear();
+	UASSERT(meta.empty());
+	UASSERTEQ(std::string, meta.getString("a"), "");
+}
+
+void TestNodeMetadata::testList(IGameDef *gamedef)
+{
+	IItemDefManager *idef = gamedef->idef();
+	NodeMetadataList list;
+
+	// Metadata made on its own keeps its fields when put into a list
+	for (s16 i = 0; i < 3; i++)
+		list.set(v3s16(i, 15 - i, 2), make_chest(idef, i));
+	NodeMetadata *meta = list.get(v3s16(1, 14, 2));
+	UASSERT(meta != NULL);
+	UASSERTEQ(std::string, meta->getString("infotext"), "Chest 1");
+	UASSERT(list.get(v3s16(1, 15, 2)) == NULL);
+
+	list.set(v3s16(1, 14, 2), make_chest(idef, 4));
+	list.remove(v3s16(0, 15, 2));
+	std::vector<v3s16> keys = list.getAllKeys();
+	UASSERTEQ(size_t, keys.size(), 2);
+
+	std::ostringstream os(std::ios::binary);
+	list.serialize(os);
+
+	NodeMetadataList list2;
+	std::istringstream is(os.str(), std::ios::binary);
+	list2.deSerialize(is, idef);
+	UASSERT(list2.get(v3s16(0, 15, 2)) == NULL);
+	UASSERTEQ(std::string, list2.get(v3s16(1, 14, 2))->getString("infotext"),
+		"Chest 4");
+	UASSERTEQ(std::string, list2.get(v3s16(2, 13, 2))->getString("owner"),
+		"player2");
+
+	std::ostringstream os2(std::ios::binary);
+	list2.serialize(os2);
+	UASSERT(os2.str() == os.str());
+}
+
+void TestNodeMetadata::testLazyInventory(IGameDef *gamedef)
+{
+	IItemDefManager *idef = gamedef->idef();
+	NodeMetadata *chest = make_chest(idef, 3);
+	std::ostringstream os(std::ios::binary);
+	chest->serialize(os);
+	delete chest;
+
+	// The inventory is written back as it was read
+	NodeMetadata meta(idef);
+	std::istringstream is(os.str(), std::ios::binary);
+	meta.deSerialize(is);
+	UASSERT(!meta.empty());
+	std::ostringstream os2(std::ios::binary);
+	meta.serialize(os2);
+	UASSERT(os2.str() == os.str());
+
+	InventoryList *list = meta.getInventory()->getList("main");
+	UASSERT(list != NULL);
+	UASSERTEQ(u32, list->getSize(), 32);
+	UASSERTEQ(std::string, list->getItem(3).name, "default:stone");
+	UASSERTEQ(u16, list->getItem(3).count, 4);
+	UASSERTEQ(std::string, list->getItem(8).name, "default:dirt_with_grass");
+
+	// Only a list makes the inventory count
+	NodeMetadata sign(idef);
+	sign.setString("text", "hello");
+	std::ostringstream os3(std::ios::binary);
+	sign.serialize(os3);
+	NodeMetadata sign2(idef);
+	std::istringstream is3(os3.str(), std::ios::binary);
+	sign2.deSerialize(is3);
+	sign2.setString("text", "");
+	UASSERT(sign2.empty());
+
+	// Inventories cut short are not accepted
+	std::string cut = os.str().substr(0, os.str().size() - 20);
+	std::istringstream is4(cut, std::ios::binary);
+	NodeMetadata meta4(idef);
+	try {
+		meta4.deSerialize(is4);
+		UASSERT(false);
+	} catch (SerializationError &e) {
+	}
+}
+
+void TestNodeMetadata::testListReserialize(IGameDef *gamedef)
+{
+	IItemDefManager *idef = gamedef->idef();
+	NodeMetadataList list;
+	for (u32 i = 0; i < 50; i++) {
+		v3s16 p(i % MAP_BLOCKSIZE, (i / MAP_BLOCKSIZE) % MAP_BLOCKSIZE,
+			i / MAP_BLOCKSIZE / MAP_BLOCKSIZE);
+		list.set(p, make_chest(idef, i));
+	}
+	std::ostringstream os(std::ios::binary);
+	list.serialize(os);
+	std::string data = os.str();
+
+	std::istringstream is(data, std::ios::binary);
+	list.deSerialize(is, idef);
+	std::ostringstream os2(std::ios::binary);
+	list.serialize(os2);
+	UASSERT(os2.str() == data);
+
+	// Using the inventories, as when every chest is opened
+	std::vector<v3s16> keys = list.getAllKeys();
+	UASSERTEQ(size_t, keys.size(), 50);
+	for (size_t i = 0; i < keys.size(); i++)
+		UASSERT(list.get(keys[i])->getInventory()->getList("main") != NULL);
+	std::ostringstream os3(std::ios::binary);
+	list.serialize(os3);
+	UASSERT(os3.str() == data);
+}
@@ -0,0 +1,147 @@
+/*
+Minetest
+Copyright (C) 2026 Minetest developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <cmath>
+#include "nodetimer.h"
+#include "noise.h"
+
+class TestNodeTimer : public TestBase {
+public:
+	TestNodeTimer() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestNodeTimer"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testListClock();
+	void testWheelOrder();
+	void testWheelFarEntries();
+};
+
+static TestNodeTimer g_test_instance;
+
+void TestNodeTimer::runTests(IGameDef *gamedef)
+{
+	TEST(testListClock);
+	TEST(testWheelOrder);
+	TEST(testWheelFarEntries);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestNodeTimer::testListClock()
+{
+	NodeTimerList timers;
+	timers.set(NodeTimer(5, 0, v3s16(1, 2, 3)));
+	timers.set(NodeTimer(10, 2, v3s16(4, 5, 6)));
+	UASSERT(timers.step(1).empty());
+
+	// Attaching keeps the remaining time of the timers
+	double clock = 1000;
+	timers.attachClock(&clock);
+	UASSERT(timers.isAttachedTo(&clock));
+	UASSERT(fabs(timers.getNextTriggerTime() - 1004) < 0.001);
+	UASSERT(fabs(timers.get(v3s16(4, 5, 6)).elapsed - 3) < 0.001);
+
+	clock += 4.5;
+	std::vector<NodeTimer> elapsed = timers.popElapsed();
+	UASSERTEQ(size_t, elapsed.size(), 1);
+	UASSERT(elapsed[0].position == v3s16(1, 2, 3));
+	UASSERT(fabs(elapsed[0].elapsed - 5.5) < 0.001);
+
+	// New timers start at the time of the clock
+	timers.set(NodeTimer(1, 0, v3s16(7, 7, 7)));
+	UASSERT(fabs(timers.getNextTriggerTime() - 1005.5) < 0.001);
+
+	// Detached, the list does not follow the clock anymore
+	timers.detachClock();
+	clock += 100;
+	UASSERT(timers.popElapsed().empty());
+	UASSERT(fabs(timers.get(v3s16(4, 5, 6)).elapsed - 7.5) < 0.001);
+	UASSERTEQ(size_t, timers.step(5).size(), 2);
+}
+
+void TestNodeTimer::testWheelOrder()
+{
+	NodeTimerWheel wheel(0.1);
+	std::vector<NodeTimerWheel::Entry> due;
+
+	wheel.insert(v3s16(1, 0, 0), 0.95);
+	wheel.insert(v3s16(2, 0, 0), 1.0);
+	wheel.insert(v3s16(3, 0, 0), 30.0);
+	UASSERTEQ(u32, wheel.size(), 3);
+
+	wheel.advance(0.9, &due);
+	UASSERT(due.empty());
+
+	// Nothing is due before its time
+	wheel.advance(1.0, &due);
+	UASSERTEQ(size_t, due.size(), 2);
+	UASSERT(due[0].time <= 1.0 && due[1].time <= 1.0);
+	due.clear();
+
+	// Entries in the past are due right away
+	wheel.insert(v3s16(4, 0, 0), 0.5);
+	wheel.advance(1.0, &due);
+	UASSERTEQ(size_t, due.size(), 1);
+	UASSERT(due[0].blockpos == v3s16(4, 0, 0));
+	due.clear();
+
+	wheel.advance(29.9, &due);
+	UASSERT(due.empty());
+	wheel.advance(30.0, &due);
+	UASSERTEQ(size_t, due.size(), 1);
+	UASSERT(due[0].blockpos == v3s16(3, 0, 0));
+	UASSERTEQ(u32, wheel.size(), 0);
+}
+
+void TestNodeTimer::testWheelFarEntries()
+{
+	NodeTimerWheel wheel(1.0);
+	std::vector<NodeTimerWheel::Entry> due;
+	PcgRandom pr(5);
+
+	// Spread over all levels and beyond the range of the wheel
+	std::vector<double> times;
+	for (u32 i = 0; i < 2000; i++) {
+		double time = pr.range(1, 20000000) + 0.5;
+		if (i % 4 == 0)
+			time = pr.range(1, 5000) + 0.5;
+		times.push_back(time);
+		wheel.insert(v3s16(i, 0, 0), time);
+	}
+
+	// Every entry is due at the first advance past its time
+	double now = 0;
+	u32 count = 0;
+	while (count < times.size()) {
+		double last = now;
+		now += pr.range(1, 50000);
+		wheel.advance(now, &due);
+		for (u32 i = 0; i < due.size(); i++) {
+			UASSERT(due[i].time <= now);
+			UASSERT(due[i].time > last);
+			UASSERT(due[i].time == times[due[i].blockpos.X]);
+		}
+		count += due.size();
+		due.clear();
+	}
+	UASSERTEQ(u32, wheel.size(), 0);
+}
@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "exceptions.h"
 #include "noise.h"
+#include "util/basic_macros.h"
 
 class TestNoise : public TestBase {
 public:
@@ -33,6 +34,7 @@ class TestNoise : public TestBase {
 	void testNoise2dBulk();
 	void testNoise3dPoint();
 	void testNoise3dBulk();
+	void testNoise3dSlabs();
 	void testNoiseInvalidParams();
 
 	static const float expected_2d_results[10 * 10];
@@ -47,6 +49,7 @@ void TestNoise::runTests(IGameDef *gamedef)
 	TEST(testNoise2dBulk);
 	TEST(testNoise3dPoint);
 	TEST(testNoise3dBulk);
+	TEST(testNoise3dSlabs);
 	TEST(testNoiseInvalidParams);
 }
 
@@ -105,6 +108,27 @@ void TestNoise::testNoise3dBulk()
 	}
 }
 
+void TestNoise::testNoise3dSlabs()
+{
+	NoiseParams np_normal(20, 40, v3f(50, 30, 50), 9, 5, 0.6, 2.0);
+	NoiseParams np_abs(0, 1, v3f(12, 7, 12), 9, 3, 0.6, 2.0,
+		NOISE_FLAG_ABSVALUE | NOISE_FLAG_EASED);
+	NoiseParams *nps[] = { &np_normal, &np_abs };
+
+	for (u32 n = 0; n != 2; n++) {
+		Noise noise_full(nps[n], 1337, 20, 45, 20);
+		Noise noise_slabs(nps[n], 1337, 20, 45, 20);
+		noise_full.perlinMap3D(-13.f, 250.f, 7.f);
+
+		// Slabs must give exactly the same values, in any order
+		for (s32 y = 45; y > 0; y -= 16)
+			noise_slabs.perlinMap3DSlab(-13.f, 250.f, 7.f, MYMAX(y - 16, 0), y);
+
+		for (u32 i = 0; i != 20 * 45 * 20; i++)
+			UASSERT(noise_slabs.result[i] == noise_full.result[i]);
+	}
+}
+
 void TestNoise::testNoiseInvalidParams()
 {
 	bool exception_thrown = false;
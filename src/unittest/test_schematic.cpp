@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include "mg_schematic.h"
+#include "map.h"
 #include "gamedef.h"
 #include "nodedef.h"
 
@@ -33,6 +34,7 @@ class TestSchematic : public TestBase {
 	void testMtsSerializeDeserialize(INodeDefManager *ndef);
 	void testLuaTableSerialize(INodeDefManager *ndef);
 	void testFileSerializeDeserialize(INodeDefManager *ndef);
+	void testPlaceRotated(INodeDefManager *ndef);
 
 	static const content_t test_schem1_data[7 * 6 * 4];
 	static const content_t test_schem2_data[3 * 3 * 3];
@@ -52,6 +54,7 @@ void TestSchematic::runTests(IGameDef *gamedef)
 	TEST(testMtsSerializeDeserialize, ndef);
 	TEST(testLuaTableSerialize, ndef);
 	TEST(testFileSerializeDeserialize, ndef);
+	TEST(testPlaceRotated, ndef);
 
 	ndef->resetNodeResolveState();
 }
@@ -181,6 +184,84 @@ void TestSchematic::testFileSerializeDeserialize(INodeDefManager *ndef)
 }
 
 
+void TestSchematic::testPlaceRotated(INodeDefManager *ndef)
+{
+	static const v3s16 size(7, 6, 4);
+	static const u32 volume = size.X * size.Y * size.Z;
+	const content_t content_map[] = {
+		t_CONTENT_STONE,
+		t_CONTENT_GRASS,
+		t_CONTENT_WATER,
+		t_CONTENT_BRICK,
+	};
+
+	Schematic schem1, schem2;
+
+	schem1.flags       = 0;
+	schem1.size        = size;
+	schem1.schemdata   = new MapNode[volume];
+	schem1.slice_probs = new u8[size.Y];
+	for (size_t i = 0; i != volume; i++) {
+		schem1.schemdata[i] = MapNode(content_map[test_schem1_data[i]],
+			MTSCHEM_PROB_ALWAYS, 0);
+	}
+	for (s16 y = 0; y != size.Y; y++)
+		schem1.slice_probs[y] = MTSCHEM_PROB_ALWAYS;
+
+	// Loading sets up the node resolver, which prepares the schematic
+	std::string temp_file = getTestTempFile();
+	UASSERT(schem1.saveSchematicToFile(temp_file, ndef));
+	UASSERT(schem2.loadSchematicFromFile(temp_file, ndef));
+
+	VoxelArea area(v3s16(-3, 0, -3), v3s16(5, 7, 5));
+
+	for (int rot = ROTATE_0; rot <= ROTATE_270; rot++) {
+		MMVManip vm(NULL);
+		vm.addArea(area);
+		for (s32 i = 0; i != area.getVolume(); i++)
+			vm.m_data[i] = MapNode(CONTENT_AIR);
+
+		// Partially outside of the VoxelManip, which clips the placement
+		v3s16 p(-5, 1, -2);
+		UASSERT(!schem2.placeOnVManip(&vm, p, 0, (Rotation)rot, true));
+
+		v3s16 s = (rot == ROTATE_90 || rot == ROTATE_270) ?
+			v3s16(size.Z, size.Y, size.X) : size;
+
+		for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+		for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++)
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+			v3s16 d = v3s16(x, y, z) - p;
+			content_t c = vm.m_data[area.index(x, y, z)].getContent();
+
+			if (d.X < 0 || d.Y < 0 || d.Z < 0 ||
+					d.X >= s.X || d.Y >= s.Y || d.Z >= s.Z) {
+				UASSERTEQ(content_t, c, CONTENT_AIR);
+				continue;
+			}
+
+			v3s16 src;
+			switch (rot) {
+			case ROTATE_90:
+				src = v3s16(size.X - 1 - d.Z, d.Y, d.X);
+				break;
+			case ROTATE_180:
+				src = v3s16(size.X - 1 - d.X, d.Y, size.Z - 1 - d.Z);
+				break;
+			case ROTATE_270:
+				src = v3s16(d.Z, d.Y, size.Z - 1 - d.X);
+				break;
+			default:
+				src = d;
+			}
+
+			u32 i = src.Z * size.Y * size.X + src.Y * size.X + src.X;
+			UASSERTEQ(content_t, c, content_map[test_schem1_data[i]]);
+		}
+	}
+}
+
+
 // Should form a cross-shaped-thing...?
 const content_t TestSchematic::test_schem1_data[7 * 6 * 4] = {
 	3, 3, 1, 1, 1, 3, 3, // Y=0, Z=0
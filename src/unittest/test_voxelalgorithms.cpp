@@ -21,7 +21,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "gamedef.h"
 #include "voxelalgorithms.h"
+#include "mapgen.h"
+#include "map.h"
+#include "noise.h"
 #include "util/numeric.h"
+#include "util/timetaker.h"
 
 class TestVoxelAlgorithms : public TestBase {
 public:
@@ -33,6 +37,7 @@ class TestVoxelAlgorithms : public TestBase {
 	void testPropogateSunlight(INodeDefManager *ndef);
 	void testClearLightAndCollectSources(INodeDefManager *ndef);
 	void testVoxelLineIterator(INodeDefManager *ndef);
+	void testMapgenLighting(INodeDefManager *ndef);
 };
 
 static TestVoxelAlgorithms g_test_instance;
@@ -44,6 +49,7 @@ void TestVoxelAlgorithms::runTests(IGameDef *gamedef)
 	TEST(testPropogateSunlight, ndef);
 	TEST(testClearLightAndCollectSources, ndef);
 	TEST(testVoxelLineIterator, ndef);
+	TEST(testMapgenLighting, ndef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -261,3 +267,149 @@ void TestVoxelAlgorithms::testVoxelLineIterator(INodeDefManager *ndef)
 		UASSERTEQ(int, actual_nodecount, nodecount);
 	}
 }
+
+// The recursive light spreading Mapgen used before it switched to a queue,
+// kept as a reference for testMapgenLighting()
+static void referenceLightSpread(MMVManip *vm, INodeDefManager *ndef,
+	VoxelArea &a, v3s16 p, u8 light)
+{
+	if (light <= 1 || !a.contains(p))
+		return;
+
+	MapNode &n = vm->m_data[vm->m_area.index(p)];
+
+	u8 light_day = light & 0x0F;
+	if (light_day > 0)
+		light_day -= 0x01;
+
+	u8 light_night = light & 0xF0;
+	if (light_night > 0)
+		light_night -= 0x10;
+
+	if ((light_day  <= (n.param1 & 0x0F) &&
+		light_night <= (n.param1 & 0xF0)) ||
+		!ndef->get(n).light_propagates)
+		return;
+
+	light = MYMAX(light_day, n.param1 & 0x0F) |
+			MYMAX(light_night, n.param1 & 0xF0);
+
+	n.param1 = light;
+
+	referenceLightSpread(vm, ndef, a, p + v3s16(0, 0, 1), light);
+	referenceLightSpread(vm, ndef, a, p + v3s16(0, 1, 0), light);
+	referenceLightSpread(vm, ndef, a, p + v3s16(1, 0, 0), light);
+	referenceLightSpread(vm, ndef, a, p - v3s16(0, 0, 1), light);
+	referenceLightSpread(vm, ndef, a, p - v3s16(0, 1, 0), light);
+	referenceLightSpread(vm, ndef, a, p - v3s16(1, 0, 0), light);
+}
+
+static void referenceCalcLighting(MMVManip *vm, INodeDefManager *ndef,
+	v3s16 nmin, v3s16 nmax, v3s16 full_nmin, v3s16 full_nmax)
+{
+	VoxelArea a(nmin, nmax);
+	v3s16 em = vm->m_area.getExtent();
+
+	for (int z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+	for (int x = a.MinEdge.X; x <= a.MaxEdge.X; x++) {
+		u32 i = vm->m_area.index(x, a.MaxEdge.Y + 1, z);
+		if (vm->m_data[i].getContent() != CONTENT_IGNORE &&
+				(vm->m_data[i].param1 & 0x0F) != LIGHT_SUN)
+			continue;
+		vm->m_area.add_y(em, i, -1);
+
+		for (int y = a.MaxEdge.Y; y >= a.MinEdge.Y; y--) {
+			MapNode &n = vm->m_data[i];
+			if (!ndef->get(n).sunlight_propagates)
+				break;
+			n.param1 = LIGHT_SUN;
+			vm->m_area.add_y(em, i, -1);
+		}
+	}
+
+	VoxelArea fa(full_nmin, full_nmax);
+
+	for (int z = fa.MinEdge.Z; z <= fa.MaxEdge.Z; z++)
+	for (int y = fa.MinEdge.Y; y <= fa.MaxEdge.Y; y++)
+	for (int x = fa.MinEdge.X; x <= fa.MaxEdge.X; x++) {
+		MapNode &n = vm->m_data[vm->m_area.index(x, y, z)];
+		if (n.getContent() == CONTENT_IGNORE)
+			continue;
+
+		const ContentFeatures &cf = ndef->get(n);
+		if (!cf.light_propagates)
+			continue;
+
+		if (cf.light_source)
+			n.param1 = cf.light_source | (cf.light_source << 4);
+
+		u8 light = n.param1;
+		if (light) {
+			referenceLightSpread(vm, ndef, fa, v3s16(x,     y,     z + 1), light);
+			referenceLightSpread(vm, ndef, fa, v3s16(x,     y + 1, z    ), light);
+			referenceLightSpread(vm, ndef, fa, v3s16(x + 1, y,     z    ), light);
+			referenceLightSpread(vm, ndef, fa, v3s16(x,     y,     z - 1), light);
+			referenceLightSpread(vm, ndef, fa, v3s16(x,     y - 1, z    ), light);
+			referenceLightSpread(vm, ndef, fa, v3s16(x - 1, y,     z    ), light);
+		}
+	}
+}
+
+void TestVoxelAlgorithms::testMapgenLighting(INodeDefManager *ndef)
+{
+	// A mapchunk of the default size, surrounded by one block of neighbors
+	v3s16 full_nmin(-16, -16, -16);
+	v3s16 full_nmax(95, 95, 95);
+	v3s16 nmin(0, -1, 0);
+	v3s16 nmax(79, 80, 79);
+
+	// Terrain with caves, overhangs, glass-like and light emitting nodes
+	MMVManip ref_vm(NULL);
+	ref_vm.addArea(VoxelArea(full_nmin, full_nmax));
+
+	PcgRandom pr(42);
+	for (s16 z = full_nmin.Z; z <= full_nmax.Z; z++)
+	for (s16 y = full_nmin.Y; y <= full_nmax.Y; y++)
+	for (s16 x = full_nmin.X; x <= full_nmax.X; x++) {
+		float ground = 40 + 20 * noise3d_gradient(x / 30.f, y / 30.f, z / 30.f, 7);
+		content_t c = CONTENT_AIR;
+		if (y < ground)
+			c = (pr.range(0, 9) == 0) ? CONTENT_AIR : t_CONTENT_STONE;
+		if (pr.range(0, 999) == 0)
+			c = t_CONTENT_TORCH;
+
+		// Sunlight comes in from above the chunk
+		MapNode n(c);
+		if (y > nmax.Y)
+			n.param1 = LIGHT_SUN;
+		ref_vm.m_data[ref_vm.m_area.index(x, y, z)] = n;
+	}
+
+	MMVManip vm(NULL);
+	vm.addArea(ref_vm.m_area);
+	vm.copyFrom(ref_vm.m_data, ref_vm.m_area, ref_vm.m_area.MinEdge,
+		ref_vm.m_area.MinEdge, ref_vm.m_area.getExtent());
+
+	u32 ref_time = 0;
+	u32 time = 0;
+	{
+		TimeTaker t("reference lighting", &ref_time, PRECISION_MICRO);
+		referenceCalcLighting(&ref_vm, ndef, nmin, nmax, full_nmin, full_nmax);
+	}
+	{
+		Mapgen mg;
+		mg.vm = &vm;
+		mg.ndef = ndef;
+		mg.water_level = -MAX_MAP_GENERATION_LIMIT;
+
+		TimeTaker t("Mapgen::calcLighting", &time, PRECISION_MICRO);
+		mg.calcLighting(nmin, nmax, full_nmin, full_nmax);
+	}
+
+	infostream << "TestVoxelAlgorithms: mapchunk lighting took " << time
+		<< "us, reference implementation " << ref_time << "us" << std::endl;
+
+	u32 volume = vm.m_area.getVolume();
+	for (u32 i = 0; i != volume; i++)
+		UASSERTEQ(u32, vm.m_data[i].param1, ref_vm.m_data[i].param1);
+}